@@ -0,0 +1,163 @@
+﻿#include "AudioBackend.h"
+#include "Misc.h"
+
+using namespace std;
+
+constexpr double WaveFileAudioBackend::RenderDelay;
+
+unique_ptr<AudioBackend> AudioBackend::CreateDevice()
+{
+    return make_unique<DeviceAudioBackend>();
+}
+
+unique_ptr<AudioBackend> AudioBackend::CreateNull()
+{
+    return make_unique<NullAudioBackend>();
+}
+
+unique_ptr<AudioBackend> AudioBackend::CreateWaveFile(const wstring &fileName)
+{
+    return make_unique<WaveFileAudioBackend>(fileName);
+}
+
+HSAMPLE AudioBackend::LoadSample(const wstring &fileName, const int maxChannels)
+{
+    return BASS_SampleLoad(FALSE, fileName.c_str(), 0, 0, maxChannels, BASS_SAMPLE_OVER_POS | BASS_UNICODE);
+}
+
+HSTREAM AudioBackend::LoadStream(const wstring &fileName)
+{
+    return BASS_StreamCreateFile(FALSE, fileName.c_str(), 0, 0, BASS_UNICODE);
+}
+
+HSTREAM AudioBackend::CreateMixer(const int channels, const int frequency)
+{
+    return BASS_Mixer_StreamCreate(frequency, channels, 0);
+}
+
+// DeviceAudioBackend ------------------------
+bool DeviceAudioBackend::Initialize()
+{
+    //よろしくない
+    return !!BASS_Init(-1, GetFrequency(), 0, GetMainWindowHandle(), nullptr);
+}
+
+void DeviceAudioBackend::Terminate()
+{
+    BASS_Free();
+}
+
+// NullAudioBackend ------------------------
+bool NullAudioBackend::Initialize()
+{
+    clock = 0;
+    return true;
+}
+
+void NullAudioBackend::Terminate()
+{}
+
+// WaveFileAudioBackend ------------------------
+namespace
+{
+    template<typename T>
+    void WriteValue(ofstream &stream, const T value)
+    {
+        stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void WriteWaveHeader(ofstream &stream, const int frequency, const int channels, const uint32_t dataSize)
+    {
+        stream.write("RIFF", 4);
+        WriteValue<uint32_t>(stream, 36 + dataSize);
+        stream.write("WAVEfmt ", 8);
+        WriteValue<uint32_t>(stream, 16);
+        WriteValue<uint16_t>(stream, 3);    // WAVE_FORMAT_IEEE_FLOAT
+        WriteValue<uint16_t>(stream, channels);
+        WriteValue<uint32_t>(stream, frequency);
+        WriteValue<uint32_t>(stream, frequency * channels * sizeof(float));
+        WriteValue<uint16_t>(stream, channels * sizeof(float));
+        WriteValue<uint16_t>(stream, 32);
+        stream.write("data", 4);
+        WriteValue<uint32_t>(stream, dataSize);
+    }
+}
+
+WaveFileAudioBackend::WaveFileAudioBackend(const wstring &fileName) : fileName(fileName)
+{}
+
+bool WaveFileAudioBackend::Initialize()
+{
+    if (!NullAudioBackend::Initialize()) return false;
+    if (!BASS_Init(0, GetFrequency(), 0, nullptr, nullptr)) return false;
+    // 書き出せなくても再生自体は続ける
+    Open();
+    return true;
+}
+
+void WaveFileAudioBackend::Terminate()
+{
+    Close();
+    BASS_Free();
+    NullAudioBackend::Terminate();
+}
+
+bool WaveFileAudioBackend::Open()
+{
+    clock = 0;
+    file.open(fileName, ios::out | ios::binary | ios::trunc);
+    if (!file) {
+        spdlog::get("main")->error(u8"音声出力ファイル {0} を開けませんでした", ConvertUnicodeToUTF8(fileName));
+        return false;
+    }
+    renderedFrames = 0;
+    WriteWaveHeader(file, GetFrequency(), Channels, 0);
+    return true;
+}
+
+void WaveFileAudioBackend::Close()
+{
+    if (file.is_open()) {
+        Flush();
+        file.seekp(0);
+        WriteWaveHeader(file, GetFrequency(), Channels, uint32_t(renderedFrames * Channels * sizeof(float)));
+        file.close();
+    }
+    sources.clear();
+}
+
+void WaveFileAudioBackend::Advance(const double delta)
+{
+    NullAudioBackend::Advance(delta);
+    RenderTo(llround((clock - RenderDelay) * GetFrequency()));
+}
+
+void WaveFileAudioBackend::RenderTo(const int64_t frame)
+{
+    if (!file.is_open()) return;
+    const size_t blockFrames = 1024;
+    while (renderedFrames < frame) {
+        const auto frames = size_t(min<int64_t>(blockFrames, frame - renderedFrames));
+        mix.assign(frames * Channels, 0.0f);
+        for (auto &source : sources) {
+            scratch.assign(frames * Channels, 0.0f);
+            source.second(scratch.data(), frames);
+            for (size_t i = 0; i < scratch.size(); i++) mix[i] += scratch[i];
+        }
+        file.write(reinterpret_cast<const char*>(mix.data()), mix.size() * sizeof(float));
+        renderedFrames += frames;
+    }
+}
+
+int WaveFileAudioBackend::AddSource(const Source &source)
+{
+    sources.emplace_back(nextSourceId, source);
+    return nextSourceId++;
+}
+
+void WaveFileAudioBackend::RemoveSource(const int id)
+{
+    sources.erase(remove_if(sources.begin(), sources.end(), [id](const pair<int, Source> &source) {
+        return source.first == id;
+    }), sources.end());
+}
@@ -0,0 +1,91 @@
+﻿#pragma once
+
+// 音声の出力先
+// BASS の初期化と、SoundManager が作る音声のハンドル、実時間で鳴らさない場合の時計を受け持つ
+class AudioBackend {
+public:
+    virtual ~AudioBackend() = default;
+
+    virtual bool Initialize() = 0;
+    virtual void Terminate() = 0;
+    // 実時間で鳴る出力なら true そうでなければ Advance で時計を進める
+    virtual bool IsRealtime() const = 0;
+    virtual void Advance(double delta) {}
+    // 出力を遅らせている分があれば、今の時計の位置まで出し切る
+    virtual void Flush() {}
+    virtual int GetFrequency() const { return 44100; }
+
+    // SoundSample/SoundStream/SoundMixerStream に渡すハンドルを作る 既定は BASS で読み込む
+    // 0 を返すと、それを受け取った側は何もしない
+    virtual HSAMPLE LoadSample(const std::wstring &fileName, int maxChannels);
+    virtual HSTREAM LoadStream(const std::wstring &fileName);
+    virtual HSTREAM CreateMixer(int channels, int frequency);
+
+    static std::unique_ptr<AudioBackend> CreateDevice();
+    static std::unique_ptr<AudioBackend> CreateNull();
+    static std::unique_ptr<AudioBackend> CreateWaveFile(const std::wstring &fileName);
+};
+
+// 既定のサウンドデバイス
+class DeviceAudioBackend final : public AudioBackend {
+public:
+    bool Initialize() override;
+    void Terminate() override;
+    bool IsRealtime() const override { return true; }
+};
+
+// 何も鳴らさない 時計は Advance した分だけ進む
+// BASS を初期化せず、音声のハンドルもすべて 0 にするのでサウンドデバイスがなくても動く
+class NullAudioBackend : public AudioBackend {
+protected:
+    double clock = 0;
+
+public:
+    bool Initialize() override;
+    void Terminate() override;
+    bool IsRealtime() const override { return false; }
+    void Advance(double delta) override { clock += delta; }
+
+    HSAMPLE LoadSample(const std::wstring &fileName, int maxChannels) override { return 0; }
+    HSTREAM LoadStream(const std::wstring &fileName) override { return 0; }
+    HSTREAM CreateMixer(int channels, int frequency) override { return 0; }
+};
+
+// 登録されたソースを仮想時計に合わせて合成し、32bit float の WAV に書き出す
+// 後から過去の時刻に予約されても間に合うよう、時計より RenderDelay だけ遅れて書き出す
+// BGM と判定音のデコードに BASS を "no sound" デバイスで初期化する 鳴らすためのストリームは作らない
+class WaveFileAudioBackend final : public NullAudioBackend {
+public:
+    // buffer には frames フレーム分の 0 が入っている 書き込んだものが全体に足される
+    using Source = std::function<void(float *buffer, size_t frames)>;
+    static const int Channels = 2;
+    static constexpr double RenderDelay = 0.25;
+
+private:
+    const std::wstring fileName;
+    std::ofstream file;
+    std::vector<std::pair<int, Source>> sources;
+    int nextSourceId = 0;
+    int64_t renderedFrames = 0;
+    std::vector<float> mix, scratch;
+
+    void RenderTo(int64_t frame);
+
+public:
+    explicit WaveFileAudioBackend(const std::wstring &fileName);
+
+    bool Initialize() override;
+    void Terminate() override;
+    void Advance(double delta) override;
+    void Flush() override { RenderTo(GetClockFrame()); }
+    // 判定音は KeysoundScheduler::AddSample で波形に展開して使うので読み込む
+    HSAMPLE LoadSample(const std::wstring &fileName, int maxChannels) override { return AudioBackend::LoadSample(fileName, maxChannels); }
+    // ファイルの書き出しだけを行う BASS を初期化せずに合成結果を確かめるときに使う
+    bool Open();
+    void Close();
+
+    int AddSource(const Source &source);
+    void RemoveSource(int id);
+    int64_t GetClockFrame() const { return llround(clock * GetFrequency()); }
+    int64_t GetRenderedFrames() const { return renderedFrames; }
+};
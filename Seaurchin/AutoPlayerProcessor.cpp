@@ -51,12 +51,20 @@ bool AutoPlayerProcessor::ShouldJudge(const std::shared_ptr<SusDrawableNoteData>
     return false;
 }
 
+double AutoPlayerProcessor::GetJudgeMargin()
+{
+    const auto extra = 0.5;
+    return fabs(player->soundBufferingLatency) + extra;
+}
+
 void AutoPlayerProcessor::Update(vector<shared_ptr<SusDrawableNoteData>> &notes)
 {
     auto slideCheck = false;
     auto holdCheck = false;
     auto aaCheck = false;
+    const auto lookahead = player->GetKeysoundLookahead();
     for (auto& note : notes) {
+        ReserveSounds(note, lookahead);
         ProcessScore(note);
         slideCheck = isInSlide || slideCheck;
         holdCheck = isInHold || holdCheck;
@@ -141,7 +149,7 @@ void AutoPlayerProcessor::ProcessScore(const shared_ptr<SusDrawableNoteData>& no
     if (note->Type.test(size_t(SusNoteType::Hold))) {
         isInHold = true;
         if (!note->OnTheFlyData.test(size_t(NoteAttribute::Finished))) {
-            player->EnqueueJudgeSound(JudgeSoundType::Tap);
+            PlayJudgeSound(note, JudgeSoundType::Tap);
             player->SpawnJudgeEffect(note, JudgeType::ShortNormal);
             IncrementCombo({ AbilityNoteType::Hold, note->StartLane, note->StartLane + note->Length }, "");
             note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
@@ -159,7 +167,7 @@ void AutoPlayerProcessor::ProcessScore(const shared_ptr<SusDrawableNoteData>& no
                 extra->OnTheFlyData.set(size_t(NoteAttribute::Finished));
                 return;
             }
-            player->EnqueueJudgeSound(JudgeSoundType::HoldStep);
+            PlayJudgeSound(extra, JudgeSoundType::HoldStep);
             player->SpawnJudgeEffect(note, JudgeType::ShortNormal);
             IncrementCombo({ AbilityNoteType::Hold, note->StartLane, note->StartLane + note->Length }, "");
             extra->OnTheFlyData.set(size_t(NoteAttribute::Finished));
@@ -168,7 +176,7 @@ void AutoPlayerProcessor::ProcessScore(const shared_ptr<SusDrawableNoteData>& no
     } else if (note->Type.test(size_t(SusNoteType::Slide))) {
         isInSlide = true;
         if (!note->OnTheFlyData.test(size_t(NoteAttribute::Finished))) {
-            player->EnqueueJudgeSound(JudgeSoundType::Tap);
+            PlayJudgeSound(note, JudgeSoundType::Tap);
             player->SpawnSlideLoopEffect(note);
 
             IncrementCombo({ AbilityNoteType::Slide, note->StartLane, note->StartLane + note->Length }, "");
@@ -189,7 +197,7 @@ void AutoPlayerProcessor::ProcessScore(const shared_ptr<SusDrawableNoteData>& no
                 extra->OnTheFlyData.set(size_t(NoteAttribute::Finished));
                 return;
             }
-            player->EnqueueJudgeSound(JudgeSoundType::SlideStep);
+            PlayJudgeSound(extra, JudgeSoundType::SlideStep);
             player->SpawnJudgeEffect(extra, JudgeType::SlideTap);
             IncrementCombo({ AbilityNoteType::Slide, extra->StartLane, extra->StartLane + extra->Length }, "");
             extra->OnTheFlyData.set(size_t(NoteAttribute::Finished));
@@ -212,34 +220,34 @@ void AutoPlayerProcessor::ProcessScore(const shared_ptr<SusDrawableNoteData>& no
                 extra->OnTheFlyData.set(size_t(NoteAttribute::Finished));
                 return;
             }
-            player->EnqueueJudgeSound(JudgeSoundType::AirAction);
+            PlayJudgeSound(extra, JudgeSoundType::AirAction);
             player->SpawnJudgeEffect(extra, JudgeType::Action);
             IncrementCombo({ AbilityNoteType::AirAction, extra->StartLane, extra->StartLane + extra->Length }, "");
             extra->OnTheFlyData.set(size_t(NoteAttribute::Finished));
         }
     } else if (note->Type.test(size_t(SusNoteType::Air))) {
         if (note->Type[size_t(SusNoteType::Up)]) {
-            player->EnqueueJudgeSound(JudgeSoundType::Air);
+            PlayJudgeSound(note, JudgeSoundType::Air);
         } else {
-            player->EnqueueJudgeSound(JudgeSoundType::AirDown);
+            PlayJudgeSound(note, JudgeSoundType::AirDown);
         }
         player->SpawnJudgeEffect(note, JudgeType::ShortNormal);
         player->SpawnJudgeEffect(note, JudgeType::ShortEx);
         IncrementCombo({ AbilityNoteType::Air, note->StartLane, note->StartLane + note->Length }, "");
         note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
     } else if (note->Type.test(size_t(SusNoteType::Tap))) {
-        player->EnqueueJudgeSound(JudgeSoundType::Tap);
+        PlayJudgeSound(note, JudgeSoundType::Tap);
         player->SpawnJudgeEffect(note, JudgeType::ShortNormal);
         IncrementCombo({ AbilityNoteType::Tap, note->StartLane, note->StartLane + note->Length }, "");
         note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
     } else if (note->Type.test(size_t(SusNoteType::ExTap))) {
-        player->EnqueueJudgeSound(JudgeSoundType::ExTap);
+        PlayJudgeSound(note, JudgeSoundType::ExTap);
         player->SpawnJudgeEffect(note, JudgeType::ShortNormal);
         player->SpawnJudgeEffect(note, JudgeType::ShortEx);
         IncrementCombo({ AbilityNoteType::ExTap, note->StartLane, note->StartLane + note->Length }, "");
         note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
     } else if (note->Type.test(size_t(SusNoteType::AwesomeExTap))) {
-        player->EnqueueJudgeSound(JudgeSoundType::ExTap);
+        PlayJudgeSound(note, JudgeSoundType::ExTap);
         player->SpawnJudgeEffect(note, JudgeType::ShortNormal);
         player->SpawnJudgeEffect(note, JudgeType::ShortEx);
         IncrementCombo(
@@ -248,20 +256,64 @@ void AutoPlayerProcessor::ProcessScore(const shared_ptr<SusDrawableNoteData>& no
         );
         note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
     } else if (note->Type.test(size_t(SusNoteType::Flick))) {
-        player->EnqueueJudgeSound(JudgeSoundType::Flick);
+        PlayJudgeSound(note, JudgeSoundType::Flick);
         player->SpawnJudgeEffect(note, JudgeType::ShortNormal);
         IncrementCombo({ AbilityNoteType::Flick, note->StartLane, note->StartLane + note->Length }, "");
         note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
     } else if (note->Type.test(size_t(SusNoteType::HellTap))) {
-        player->EnqueueJudgeSound(JudgeSoundType::Tap);
+        PlayJudgeSound(note, JudgeSoundType::Tap);
         player->SpawnJudgeEffect(note, JudgeType::ShortNormal);
         IncrementCombo({ AbilityNoteType::HellTap, note->StartLane, note->StartLane + note->Length }, "");
         note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
     }
 }
 
+// ProcessScore で鳴らす音を、ミキサーが合成する前に予約しておく
+// 判定の時点で予約すると、発音位置が合成中のバッファの頭に寄ってしまう
+void AutoPlayerProcessor::ReserveSounds(const shared_ptr<SusDrawableNoteData>& note, const double lookahead) const
+{
+    const auto limit = player->currentTime + player->soundBufferingLatency + lookahead;
+    const auto reserve = [&](const shared_ptr<SusDrawableNoteData>& target, const JudgeSoundType type) {
+        if (target->StartTime > limit) return;
+        if (target->OnTheFlyData[size_t(NoteAttribute::Finished)] || target->OnTheFlyData[size_t(NoteAttribute::SoundReserved)]) return;
+        if (player->ReserveJudgeSound(type, target->StartTime)) target->OnTheFlyData.set(size_t(NoteAttribute::SoundReserved));
+    };
+    const auto reserveSteps = [&](const JudgeSoundType type, const bool skipHidden) {
+        for (auto &extra : note->ExtraData) {
+            if (extra->StartTime > limit) continue;
+            if (extra->Type[size_t(SusNoteType::Injection)]) continue;
+            if (skipHidden && (extra->Type[size_t(SusNoteType::Control)] || extra->Type[size_t(SusNoteType::Invisible)])) continue;
+            reserve(extra, type);
+        }
+    };
+
+    if (note->Type[size_t(SusNoteType::Hold)]) {
+        reserve(note, JudgeSoundType::Tap);
+        reserveSteps(JudgeSoundType::HoldStep, false);
+    } else if (note->Type[size_t(SusNoteType::Slide)]) {
+        reserve(note, JudgeSoundType::Tap);
+        reserveSteps(JudgeSoundType::SlideStep, true);
+    } else if (note->Type[size_t(SusNoteType::AirAction)]) {
+        reserveSteps(JudgeSoundType::AirAction, true);
+    } else if (note->Type[size_t(SusNoteType::Air)]) {
+        reserve(note, note->Type[size_t(SusNoteType::Up)] ? JudgeSoundType::Air : JudgeSoundType::AirDown);
+    } else if (note->Type[size_t(SusNoteType::Tap)] || note->Type[size_t(SusNoteType::HellTap)]) {
+        reserve(note, JudgeSoundType::Tap);
+    } else if (note->Type[size_t(SusNoteType::ExTap)] || note->Type[size_t(SusNoteType::AwesomeExTap)]) {
+        reserve(note, JudgeSoundType::ExTap);
+    } else if (note->Type[size_t(SusNoteType::Flick)]) {
+        reserve(note, JudgeSoundType::Flick);
+    }
+}
+
+void AutoPlayerProcessor::PlayJudgeSound(const shared_ptr<SusDrawableNoteData>& note, const JudgeSoundType type) const
+{
+    if (note->OnTheFlyData[size_t(NoteAttribute::SoundReserved)]) return;
+    player->ScheduleJudgeSound(type, note->StartTime);
+}
+
 void AutoPlayerProcessor::IncrementCombo(const JudgeInformation &info, const string& extra) const
 {
     player->currentResult->PerformJusticeCritical();
-    player->currentCharacterInstance->OnJusticeCritical(info, extra);
+    player->NotifyJudge(AbilityJudgeType::JusticeCritical, info, extra);
 }
@@ -0,0 +1,650 @@
+﻿#include "BenchmarkRunner.h"
+#include "ScenePlayer.h"
+#include "SusAnalyzer.h"
+#include "MoverFunctionExpression.h"
+#include "ScriptResource.h"
+#include "SpriteBatch.h"
+#include "Setting.h"
+#include "Config.h"
+#include "Misc.h"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace
+{
+    const uint32_t BenchmarkTicksPerBeat = 192;
+    const uint32_t MeasureTicks = BenchmarkTicksPerBeat * 4;
+    const double QueryInterval = 1.0 / 240.0;
+    const char HexatridecimalDigits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+
+    // 計測対象が最適化で消されないように結果を溜めておく
+    volatile double benchmarkSink = 0;
+
+    // 判定音は 300打/秒 (16分で BPM 4500 相当) を 2秒分積む
+    const int JudgeSoundTaps = 600;
+    const microseconds JudgeSoundTapInterval(3333);
+
+    // このスレッドが使った CPU 時間 (秒)
+    double GetCurrentThreadCpuTime()
+    {
+        FILETIME creation, exit, kernel, user;
+        if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) return 0;
+        const auto toSeconds = [](const FILETIME &time) {
+            return (uint64_t(time.dwHighDateTime) << 32 | time.dwLowDateTime) / 10000000.0;
+        };
+        return toSeconds(kernel) + toSeconds(user);
+    }
+
+    const vector<pair<string, string>> MoverExpressions = {
+        { "BenchmarkLinear", "begin + diff * progress" },
+        { "BenchmarkOutQuad", "begin + diff * (1 - pow(1 - progress, 2))" },
+        { "BenchmarkInOutSine", "begin - diff * (cos(pi * progress) - 1) / 2" },
+        { "BenchmarkOutElastic", "begin + diff * (pow(2, -10 * progress) * sin((progress * 10 - 0.75) * pi * 2 / 3) + 1)" },
+        { "BenchmarkClamp", "max(begin, min(end, current + abs(diff) * floor(progress * 8) / 8))" },
+    };
+
+    const string LayoutText =
+        u8"The quick brown fox jumps over the lazy dog. 0123456789\n"
+        u8"いろはにほへと ちりぬるを わかよたれそ つねならむ\n"
+        u8"Seaurchin ベンチマーク用の文字列です。";
+}
+
+BenchmarkRunner::BenchmarkRunner(ExecutionManager *exm) : manager(exm)
+{}
+
+vector<BenchmarkRunner::ChartProfile> BenchmarkRunner::GetDefaultCorpus()
+{
+    return {
+        { "sparse", 32, 1, 4, 0, 0, 0 },
+        { "normal", 64, 2, 8, 1, 4, 1 },
+        { "dense", 128, 4, 16, 4, 8, 4 },
+        { "extreme", 256, 16, 16, 16, 32, 16 },
+    };
+}
+
+string BenchmarkRunner::GenerateChart(const ChartProfile &profile)
+{
+    ostringstream sus;
+    sus << "#TITLE \"Benchmark " << profile.Name << "\"\n";
+    sus << "#BPM01: 120\n";
+    sus << "#00008: 01\n";
+    sus << "#00002: 4\n";
+
+    if (profile.HispeedKeysPerMeasure) {
+        sus << "#TIL00: \"";
+        for (auto m = 0u; m < profile.Measures; m++) {
+            for (auto k = 0u; k < profile.HispeedKeysPerMeasure; k++) {
+                if (m || k) sus << ", ";
+                const auto speed = 0.5 + ((m * profile.HispeedKeysPerMeasure + k) % 7) * 0.25;
+                sus << m << "'" << (MeasureTicks * k / profile.HispeedKeysPerMeasure) << ":" << speed;
+            }
+        }
+        sus << "\"\n";
+        sus << "#HISPEED 00\n";
+    }
+
+    for (auto m = 0u; m < profile.Measures; m++) {
+        // ショート 1レーン1行で Tap/ExTap/Flick を混ぜる
+        for (auto lane = 0u; lane < min(profile.TapLanes, 16u); lane++) {
+            if (!profile.TapsPerMeasure) break;
+            sus << fmt::format("#{0:03d}1{1:x}:", m, lane);
+            for (auto i = 0u; i < profile.TapsPerMeasure; i++) sus << "123"[(m + lane + i) % 3] << '1';
+            sus << "\n";
+        }
+
+        // スライド 小節内で始まって終わるので、チャンネルは小節ごとに使い回せる
+        const auto points = profile.SlideSteps + 2;
+        for (auto channel = 0u; channel < min(profile.Slides, 36u); channel++) {
+            for (auto k = 0u; k < points; k++) {
+                const auto lane = (channel * 3 + k) % 15;
+                const auto type = k == 0 ? '1' : k + 1 == points ? '2' : (k % 2 ? '4' : '3');
+                sus << fmt::format("#{0:03d}3{1:x}{2}:", m, lane, HexatridecimalDigits[channel]);
+                for (auto i = 0u; i < points; i++) {
+                    if (i == k) {
+                        sus << type << '2';
+                    } else {
+                        sus << "00";
+                    }
+                }
+                sus << "\n";
+            }
+        }
+    }
+    return sus.str();
+}
+
+// ロングノーツの連結だけを見るための譜面
+// 小節ごとに Hold・中継点つき Slide・AirAction と、Air の乗ったタップを置く チャンネルは小節ごとに使い回す
+string BenchmarkRunner::GenerateLongNoteChart(const uint32_t measures)
+{
+    ostringstream sus;
+    sus << "#TITLE \"Benchmark linking " << measures << "\"\n";
+    sus << "#BPM01: 120\n";
+    sus << "#00008: 01\n";
+    sus << "#00002: 4\n";
+    for (auto m = 0u; m < measures; m++) {
+        for (auto channel = 0u; channel < 8; channel++) {
+            const auto lane = channel * 2;
+            sus << fmt::format("#{0:03d}2{1:x}{2:x}:12002200\n", m, lane, channel);
+            sus << fmt::format("#{0:03d}3{1:x}{2:x}:12000022\n", m, lane, channel);
+            sus << fmt::format("#{0:03d}3{1:x}{2:x}:00310000\n", m, lane + 1, channel);
+            sus << fmt::format("#{0:03d}1{1:x}:00120012\n", m, lane);
+            sus << fmt::format("#{0:03d}5{1:x}:00120012\n", m, lane);
+            if (channel % 2) continue;
+            sus << fmt::format("#{0:03d}4{1:x}{2:x}:12002200\n", m, lane, channel);
+        }
+    }
+    return sus.str();
+}
+
+template<typename F>
+void BenchmarkRunner::Measure(const string &benchmark, const string &chart, const uint64_t items, const int iterations, F &&body)
+{
+    Sample sample;
+    sample.Benchmark = benchmark;
+    sample.Chart = chart;
+    sample.Items = items;
+    // 1回目はキャッシュやアロケータの暖機として捨てる
+    body();
+    for (auto i = 0; i < iterations; i++) {
+        const auto start = steady_clock::now();
+        body();
+        sample.Times.push_back(duration_cast<duration<double, micro>>(steady_clock::now() - start).count());
+    }
+    spdlog::get("main")->info(u8"{0} ({1}): 平均{2:.1f}us", benchmark, chart,
+        accumulate(sample.Times.begin(), sample.Times.end(), 0.0) / max(size_t(1), sample.Times.size()));
+    samples.push_back(move(sample));
+}
+
+void BenchmarkRunner::RunChart(const ChartProfile &profile, const boost::filesystem::path &file, const int iterations)
+{
+    auto log = spdlog::get("main");
+    SusAnalyzer analyzer(BenchmarkTicksPerBeat);
+    DrawableNotesList data;
+    NoteCurvesList curveData;
+
+    Measure("SusAnalyzer::LoadFromFile", profile.Name, 1, iterations, [&] {
+        analyzer.Reset();
+        analyzer.LoadFromFile(file.wstring());
+    });
+
+    analyzer.Reset();
+    analyzer.LoadFromFile(file.wstring());
+    analyzer.SetCurveTolerance(SU_SLIDE_CURVE_TOLERANCE);
+    analyzer.RenderScoreData(data, curveData);
+    Measure("SusAnalyzer::RenderScoreData", profile.Name, data.size(), iterations, [&] {
+        curveData.Clear();
+        analyzer.RenderScoreData(data, curveData);
+    });
+
+    vector<shared_ptr<SusDrawableNoteData>> slides;
+    for (const auto &note : data) {
+        if (note->Type[size_t(SusNoteType::Slide)]) slides.push_back(note);
+    }
+    if (!slides.empty()) {
+        // SegmentsPerSecond での等分割と、許容誤差で打ち切る分割を比べる
+        NoteCurvesList curves;
+        const auto tolerance = analyzer.GetCurveTolerance();
+        const string names[] = { "SusAnalyzer::CalculateCurves/uniform", "SusAnalyzer::CalculateCurves/adaptive" };
+        size_t pointCounts[2];
+        for (auto i = 0; i < 2; i++) {
+            analyzer.SetCurveTolerance(i ? tolerance : 0);
+            Measure(names[i], profile.Name, slides.size(), iterations, [&] {
+                curves.Clear();
+                for (const auto &slide : slides) analyzer.CalculateCurves(slide, curves);
+            });
+            pointCounts[i] = curves.GetPointCount();
+        }
+        analyzer.SetCurveTolerance(tolerance);
+        log->info(u8"スライド曲線 ({0}): {1}点 -> {2}点 ({3:.1f}%)",
+            profile.Name, pointCounts[0], pointCounts[1], 100.0 * pointCounts[1] / max(size_t(1), pointCounts[0]));
+    }
+
+    // ハイスピード 再生中と同じ単調な問い合わせと、シーク時のようなばらばらの問い合わせ
+    vector<shared_ptr<SusHispeedTimeline>> timelines;
+    for (const auto &note : data) {
+        if (note->Timeline && find(timelines.begin(), timelines.end(), note->Timeline) == timelines.end()) timelines.push_back(note->Timeline);
+    }
+    const auto duration = analyzer.SharedMetaData.ScoreDuration;
+    vector<double> sequentialTimes;
+    for (auto t = 0.0; t < duration; t += QueryInterval) sequentialTimes.push_back(t);
+    auto randomTimes = sequentialTimes;
+    shuffle(randomTimes.begin(), randomTimes.end(), mt19937(0x5eaf00d));
+    if (!timelines.empty()) {
+        Measure("SusHispeedTimeline::GetRawDrawStateAt/sequential", profile.Name, timelines.size() * sequentialTimes.size(), iterations, [&] {
+            double sum = 0;
+            for (const auto &timeline : timelines) {
+                size_t cursor = 0;
+                for (const auto time : sequentialTimes) sum += get<1>(timeline->GetRawDrawStateAt(time, cursor));
+            }
+            benchmarkSink = sum;
+        });
+        Measure("SusHispeedTimeline::GetRawDrawStateAt/random", profile.Name, timelines.size() * randomTimes.size(), iterations, [&] {
+            double sum = 0;
+            for (const auto &timeline : timelines) {
+                for (const auto time : randomTimes) sum += get<1>(timeline->GetRawDrawStateAt(time));
+            }
+            benchmarkSink = sum;
+        });
+    }
+
+    // 再生中と同じ経路でノーツを絞る 読み込みは HeadlessRunner と同じく同期で行う
+    const auto player = manager->CreatePlayer();
+    player->SetScoreFile(file);
+    player->Initialize();
+    player->LoadSynchronously();
+    const auto &playerData = player->GetNotes();
+    const auto seenDuration = player->GetSeenDuration(), preloadingTime = player->GetPreloadingTime();
+    if (playerData.empty()) {
+        log->warn(u8"{0} の読み込みに失敗したので CalculateNotes は計測しません", profile.Name);
+    } else {
+        vector<double> frameTimes;
+        for (auto t = -preloadingTime; t < player->GetScoreDuration(); t += QueryInterval) frameTimes.push_back(t);
+        Measure("ScenePlayer::CalculateNotes", profile.Name, frameTimes.size(), iterations, [&] {
+            for (const auto time : frameTimes) player->CalculateNotesAt(time);
+        });
+
+        // 比較用に、索引を作る前と同じく毎フレーム全ノーツを見て並べ直す
+        vector<shared_ptr<SusDrawableNoteData>> scanJudgeData, scanSeenData;
+        const auto scanNotes = [&](const double time, const double duration, const double preced) {
+            scanJudgeData.clear();
+            copy_if(playerData.begin(), playerData.end(), back_inserter(scanJudgeData), [&](const shared_ptr<SusDrawableNoteData> &n) {
+                return player->GetProcessor()->ShouldJudge(n);
+            });
+            scanSeenData.clear();
+            copy_if(playerData.begin(), playerData.end(), back_inserter(scanSeenData), [&](const shared_ptr<SusDrawableNoteData> &n) {
+                const auto types = n->Type.to_ulong();
+                if (types & SU_NOTE_LONG_MASK) {
+                    if (time > n->StartTime + n->Duration) return false;
+                    const auto st = n->GetStateAt(time);
+                    if (n->ModifiedPosition >= -preced && n->ModifiedPosition <= duration) return get<0>(st);
+                    if (all_of(n->ExtraData.begin(), n->ExtraData.end(), [preced](const shared_ptr<SusDrawableNoteData> &en) {
+                        return isnan(en->ModifiedPosition) || en->ModifiedPosition < -preced;
+                    }) && n->ModifiedPosition < -preced) return false;
+                    if (all_of(n->ExtraData.begin(), n->ExtraData.end(), [duration](const shared_ptr<SusDrawableNoteData> &en) {
+                        return isnan(en->ModifiedPosition) || en->ModifiedPosition > duration;
+                    }) && n->ModifiedPosition > duration) return false;
+                    return true;
+                }
+                if (types & SU_NOTE_SHORT_MASK) {
+                    if (time > n->StartTime) return false;
+                    const auto st = n->GetStateAt(time);
+                    if (n->ModifiedPosition < -preced || n->ModifiedPosition > duration) return false;
+                    return get<0>(st);
+                }
+                if (n->Type[size_t(SusNoteType::MeasureLine)]) {
+                    const auto st = n->GetStateAt(time);
+                    if (n->ModifiedPosition < -preced || n->ModifiedPosition > duration) return false;
+                    return get<0>(st);
+                }
+                return false;
+            });
+            sort(scanSeenData.begin(), scanSeenData.end(), [](const shared_ptr<SusDrawableNoteData> &a, const shared_ptr<SusDrawableNoteData> &b) {
+                return a->StartTime > b->StartTime;
+            });
+            if (player->IsPrioritySorted()) sort(scanSeenData.begin(), scanSeenData.end(), [](const shared_ptr<SusDrawableNoteData> &a, const shared_ptr<SusDrawableNoteData> &b) {
+                return a->ExtraAttribute->Priority < b->ExtraAttribute->Priority;
+            });
+        };
+        Measure("ScenePlayer::CalculateNotes/full-scan", profile.Name, frameTimes.size(), iterations, [&] {
+            for (const auto time : frameTimes) scanNotes(time, seenDuration, preloadingTime);
+        });
+
+        // 同じ時刻の並びは全走査の sort では決まらないので、集合として比べる
+        auto mismatches = 0;
+        const auto sameNotes = [](vector<shared_ptr<SusDrawableNoteData>> a, vector<shared_ptr<SusDrawableNoteData>> b) {
+            sort(a.begin(), a.end());
+            sort(b.begin(), b.end());
+            return a == b;
+        };
+        for (const auto time : frameTimes) {
+            player->CalculateNotesAt(time);
+            scanNotes(time, seenDuration, preloadingTime);
+            vector<shared_ptr<SusDrawableNoteData>> seenData;
+            for (const auto i : player->GetSeenIndices()) seenData.push_back(player->GetNoteStore().Sources[i]);
+            if (!sameNotes(player->GetJudgeNotes(), scanJudgeData) || !sameNotes(seenData, scanSeenData)) ++mismatches;
+        }
+        const auto &indexed = samples[samples.size() - 2].Times;
+        const auto &scanned = samples.back().Times;
+        log->info(u8"CalculateNotes ({0}): 全走査の{1:.1f}倍 食い違い{2}フレーム", profile.Name,
+            accumulate(scanned.begin(), scanned.end(), 0.0) / max(1e-9, accumulate(indexed.begin(), indexed.end(), 0.0)), mismatches);
+        if (mismatches) log->warn(u8"CalculateNotes ({0}): 全走査と結果が食い違うフレームがあります", profile.Name);
+
+        // 全ノーツの描画位置の更新を、SusNoteStore の連続配列と shared_ptr のノーツごとの GetStateAt とで比べる
+        // 位置の更新で書き換えるので、再生側とは別に写しを持つ
+        auto store = player->GetNoteStore();
+        const auto rootCount = store.GetRootCount();
+        Measure("SusNoteStore::UpdatePositions", profile.Name, frameTimes.size() * rootCount, iterations, [&] {
+            double sum = 0;
+            for (const auto time : frameTimes) {
+                store.UpdateTimelines(time);
+                for (uint32_t i = 0; i < rootCount; ++i) {
+                    store.UpdatePositions(i);
+                    sum += store.Positions[i];
+                }
+            }
+            benchmarkSink = sum;
+        });
+        Measure("SusDrawableNoteData::GetStateAt", profile.Name, frameTimes.size() * rootCount, iterations, [&] {
+            double sum = 0;
+            for (const auto time : frameTimes) {
+                for (const auto &note : playerData) {
+                    note->GetStateAt(time);
+                    sum += note->ModifiedPosition;
+                }
+            }
+            benchmarkSink = sum;
+        });
+
+        // Slide の描画は記録だけする RenderDevice に流して、頂点を作る側の時間を見る (CalculateNotes の分も含む)
+        SlideMeshStore slideMeshes;
+        Measure("SlideMeshStore::Build", profile.Name, slides.size(), iterations, [&] {
+            slideMeshes.Build(store, player->GetCurves());
+        });
+        const auto previous = RenderDevice::GetCurrent();
+        RecordingRenderDevice device(SU_RES_WIDTH, SU_RES_HEIGHT, false);
+        RenderDevice::SetCurrent(&device);
+        const auto image = new SImage(device.CreateRenderTarget(64, 64));
+        image->AddRef();
+        Measure("ScenePlayer::DrawSlideNotes", profile.Name, frameTimes.size(), iterations, [&] {
+            for (const auto time : frameTimes) {
+                player->CalculateNotesAt(time);
+                player->DrawSlideNotesWith(image);
+                device.ClearCommands();
+            }
+        });
+        image->Release();
+        RenderDevice::SetCurrent(previous);
+
+        // 判定・エフェクトと同じく、再生中の Slide ごとに曲中時刻で中心位置と幅を引く
+        vector<const SusDrawableNoteData*> playerSlides;
+        for (const auto &note : playerData) {
+            if (note->Type[size_t(SusNoteType::Slide)]) playerSlides.push_back(note.get());
+        }
+        const auto evaluateSlides = [&](const vector<double> &times, const bool curve) {
+            double sum = 0, x, width;
+            for (const auto slide : playerSlides) {
+                for (const auto time : times) {
+                    if (time < slide->StartTime || time > slide->StartTime + slide->Duration) continue;
+                    const auto found = curve ? slideMeshes.EvaluateCurve(slide, time, &x, &width) : slideMeshes.Evaluate(slide, time, &x, &width);
+                    if (found) sum += x + width;
+                }
+            }
+            benchmarkSink = sum;
+        };
+        if (!playerSlides.empty()) {
+            Measure("SlideMeshStore::Evaluate/sequential", profile.Name, playerSlides.size(), iterations, [&] { evaluateSlides(sequentialTimes, false); });
+            Measure("SlideMeshStore::Evaluate/random", profile.Name, playerSlides.size(), iterations, [&] { evaluateSlides(randomTimes, false); });
+            // 判定で使う、曲線そのものを引く方
+            Measure("SlideMeshStore::EvaluateCurve/sequential", profile.Name, playerSlides.size(), iterations, [&] { evaluateSlides(sequentialTimes, true); });
+        }
+    }
+    player->Release();
+}
+
+void BenchmarkRunner::RunLongNoteLinking(const boost::filesystem::path &directory, const int iterations)
+{
+    auto log = spdlog::get("main");
+    const uint32_t measureCounts[] = { 60, 120, 240, 480, 960 };    // 小節番号は3桁まで
+    SusAnalyzer analyzer(BenchmarkTicksPerBeat);
+    DrawableNotesList data;
+    NoteCurvesList curveData;
+    size_t lastNotes = 0;
+    auto lastTime = 0.0;
+
+    for (const auto measures : measureCounts) {
+        const auto name = fmt::format("linking{0}", measures);
+        const auto file = directory / (ConvertUTF8ToUnicode(name) + L".sus");
+        {
+            std::ofstream stream(file.wstring(), ios::out | ios::trunc);
+            stream << GenerateLongNoteChart(measures);
+            if (!stream) {
+                log->error(u8"譜面ファイル {0} を書き出せませんでした", ConvertUnicodeToUTF8(file.wstring()));
+                return;
+            }
+        }
+
+        analyzer.Reset();
+        analyzer.LoadFromFile(file.wstring());
+        data.clear();
+        curveData.Clear();
+        analyzer.RenderScoreData(data, curveData);
+        const auto notes = data.size();
+        Measure("SusAnalyzer::RenderScoreData/linking", name, notes, iterations, [&] {
+            data.clear();
+            curveData.Clear();
+            analyzer.RenderScoreData(data, curveData);
+        });
+
+        // 線形なら指数はほぼ1 以前の全走査では2に近づく
+        const auto &times = samples.back().Times;
+        const auto time = accumulate(times.begin(), times.end(), 0.0) / max(size_t(1), times.size());
+        if (lastNotes && lastTime > 0) {
+            log->info(u8"ロングノーツ連結 ({0}): {1}ノーツ {2:.1f}us 伸び方の指数{3:.2f}",
+                name, notes, time, log2(time / lastTime) / log2(double(notes) / lastNotes));
+        }
+        lastNotes = notes;
+        lastTime = time;
+    }
+}
+
+void BenchmarkRunner::RunMoverExpressions(const int iterations)
+{
+    const auto evaluations = 100000;
+    for (const auto &expression : MoverExpressions) {
+        if (!MoverFunctionExpressionManager::IsRegistered(expression.first)) MoverFunctionExpressionManager::Register(expression.first, expression.second);
+        MoverFunctionExpressionSharedPtr function;
+        if (!MoverFunctionExpressionManager::GetInstance().Find(expression.first, function)) continue;
+
+        MoverFunctionExpressionVariables variables;
+        variables.Begin = 0;
+        variables.End = 640;
+        variables.Diff = variables.End - variables.Begin;
+        Measure("MoverFunctionExpression::Execute", expression.first, evaluations, iterations, [&] {
+            double sum = 0;
+            for (auto i = 0; i < evaluations; i++) {
+                variables.Progress = double(i) / evaluations;
+                variables.Current = sum;
+                sum += function->Execute(variables);
+            }
+            benchmarkSink = sum;
+        });
+    }
+}
+
+void BenchmarkRunner::RunFontLayout(const int iterations)
+{
+    auto log = spdlog::get("main");
+    const auto fontDirectory = boost::filesystem::path(Setting::GetRootDirectory()) / SU_DATA_DIR / SU_FONT_DIR;
+    boost::system::error_code ec;
+    boost::filesystem::path fontFile;
+    for (const auto &entry : boost::filesystem::directory_iterator(fontDirectory, ec)) {
+        if (entry.path().extension() == ".sif") {
+            fontFile = entry.path();
+            break;
+        }
+    }
+    if (fontFile.empty()) {
+        log->warn(u8"{0} にフォントが無いので SFont は計測しません", ConvertUnicodeToUTF8(fontDirectory.wstring()));
+        return;
+    }
+
+    const auto font = SFont::CreateLoadedFontFromFile(ConvertUnicodeToUTF8(fontFile.wstring()));
+    const auto layouts = 1000;
+    // 描画先を渡さなければ寸法の計算だけ行う
+    Measure("SFont::RenderRaw", ConvertUnicodeToUTF8(fontFile.filename().wstring()), uint64_t(layouts) * LayoutText.size(), iterations, [&] {
+        double sum = 0;
+        for (auto i = 0; i < layouts; i++) sum += get<0>(font->RenderRaw(nullptr, LayoutText));
+        benchmarkSink = sum;
+    });
+    font->Release();
+}
+
+void BenchmarkRunner::RunRendering(const int iterations, const boost::filesystem::path &imageFile)
+{
+    auto log = spdlog::get("main");
+    const auto sprites = 1000;
+    const auto previous = RenderDevice::GetCurrent();
+
+    // 記録だけする場合と、ソフトウェアで塗る場合の両方で同じ描画列を流す
+    for (const auto rasterize : { false, true }) {
+        RecordingRenderDevice device(SU_RES_WIDTH, SU_RES_HEIGHT, rasterize);
+        RenderDevice::SetCurrent(&device);
+        const string mode = rasterize ? "raster" : "record";
+
+        // 透明度のあるグラデーション画像を2枚交互に使う
+        SImage *images[2];
+        for (auto i = 0; i < 2; i++) {
+            const auto softImage = MakeARGB8ColorSoftImage(64, 64);
+            for (auto y = 0; y < 64; y++) {
+                for (auto x = 0; x < 64; x++) DrawPixelSoftImage(softImage, x, y, x * 4, y * 4, i * 255, 128 + x + y);
+            }
+            images[i] = new SImage(device.CreateTextureFromSoftImage(softImage));
+            images[i]->AddRef();
+            DeleteSoftImage(softImage);
+        }
+        vector<Transform2D> transforms(sprites);
+        for (auto i = 0; i < sprites; i++) {
+            transforms[i].X = float(i * 37 % SU_RES_WIDTH);
+            transforms[i].Y = float(i * 53 % SU_RES_HEIGHT);
+            transforms[i].Angle = i * 0.1f;
+            transforms[i].OriginX = transforms[i].OriginY = 32;
+        }
+        const ColorTint tint = { 255, 255, 255, 255 };
+
+        Measure("RenderDevice::DrawImage/" + mode, "sprites", sprites, iterations, [&] {
+            device.ClearCommands();
+            device.Clear();
+            device.SetBlendMode(RenderBlendMode::Alpha, 255);
+            for (auto i = 0; i < sprites; i++) {
+                const auto &tf = transforms[i];
+                device.DrawImage(tf.X, tf.Y, 0, 0, 64, 64, tf.OriginX, tf.OriginY, tf.ScaleX, tf.ScaleY, tf.Angle, images[i % 2]->GetHandle(), true);
+            }
+        });
+
+        SpriteBatch batch(SpriteBatchBackend::CreateDevice());
+        Measure("SpriteBatch/" + mode, "sprites", sprites, iterations, [&] {
+            device.ClearCommands();
+            device.Clear();
+            batch.BeginFrame();
+            for (auto i = 0; i < sprites; i++) batch.AddImage(images[i % 2], transforms[i], tint, true);
+            batch.EndFrame();
+        });
+        log->info(u8"SpriteBatch/{0}: {1}命令", mode, device.GetCommands().size());
+
+        if (rasterize && !device.SavePng(RenderDevice::BackBuffer, imageFile.wstring())) {
+            log->warn(u8"描画結果を {0} に書き出せませんでした", ConvertUnicodeToUTF8(imageFile.wstring()));
+        }
+        // 画像の解放もこのデバイスで行う
+        for (auto &image : images) image->Release();
+        RenderDevice::SetCurrent(previous);
+    }
+}
+
+void BenchmarkRunner::RunJudgeSoundDispatch()
+{
+    auto log = spdlog::get("main");
+    // 単一の生産者から順に積むので、k 番目に取り出したものが k 番目に積んだもの
+    for (const auto blocking : { false, true }) {
+        const string mode = blocking ? "blocking" : "spin";
+        JudgeSoundQueue queue;
+        boost::lockfree::queue<JudgeSoundType> spinQueue(32);
+        vector<steady_clock::time_point> pushed(JudgeSoundTaps), dispatched(JudgeSoundTaps);
+        auto consumerCpuTime = 0.0;
+
+        const auto start = steady_clock::now();
+        thread consumer([&] {
+            const auto cpuStart = GetCurrentThreadCpuTime();
+            JudgeSoundType type;
+            for (auto i = 0; i < JudgeSoundTaps;) {
+                if (blocking) {
+                    if (!queue.Pop(type)) break;
+                } else if (!spinQueue.pop(type)) {
+                    // 以前の ScenePlayer::ProcessSoundQueue と同じ待ち方
+                    Sleep(0);
+                    continue;
+                }
+                dispatched[i++] = steady_clock::now();
+            }
+            consumerCpuTime = GetCurrentThreadCpuTime() - cpuStart;
+        });
+        for (auto i = 0; i < JudgeSoundTaps; i++) {
+            this_thread::sleep_until(start + JudgeSoundTapInterval * (i + 1));
+            pushed[i] = steady_clock::now();
+            if (blocking) {
+                queue.Push(JudgeSoundType::Tap);
+            } else {
+                spinQueue.push(JudgeSoundType::Tap);
+            }
+        }
+        consumer.join();
+        const auto wallTime = duration<double>(steady_clock::now() - start).count();
+
+        Sample sample;
+        sample.Benchmark = "JudgeSoundDispatch/" + mode;
+        sample.Chart = "taps";
+        sample.Items = JudgeSoundTaps;
+        for (auto i = 0; i < JudgeSoundTaps; i++) sample.Times.push_back(duration_cast<duration<double, micro>>(dispatched[i] - pushed[i]).count());
+        auto latencies = sample.Times;
+        sort(latencies.begin(), latencies.end());
+        const auto p99 = latencies[size_t(ceil(latencies.size() * 0.99)) - 1];
+        log->info(u8"判定音の受け渡し ({0}): CPU {1:.1f}% 遅延 p50:{2:.1f}us p99:{3:.1f}us",
+            mode, consumerCpuTime / wallTime * 100, latencies[latencies.size() / 2], p99);
+        if (blocking && p99 > JudgeSoundQueue::WakeLatencyBoundMicroseconds) {
+            log->warn(u8"判定音の遅延 p99 が上限 {0}us を超えています", JudgeSoundQueue::WakeLatencyBoundMicroseconds);
+        }
+        samples.push_back(move(sample));
+    }
+}
+
+int BenchmarkRunner::Run(const int iterations, const boost::filesystem::path &outputFile)
+{
+    auto log = spdlog::get("main");
+    if (iterations <= 0) {
+        log->error(u8"反復回数の指定が不正です");
+        return 1;
+    }
+
+    const auto corpusDirectory = boost::filesystem::path(Setting::GetRootDirectory()) / SU_DATA_DIR / SU_CACHE_DIR / L"Benchmark";
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(corpusDirectory, ec);
+    samples.clear();
+
+    for (const auto &profile : GetDefaultCorpus()) {
+        const auto file = corpusDirectory / (ConvertUTF8ToUnicode(profile.Name) + L".sus");
+        {
+            std::ofstream stream(file.wstring(), ios::out | ios::trunc);
+            stream << GenerateChart(profile);
+            if (!stream) {
+                log->error(u8"譜面ファイル {0} を書き出せませんでした", ConvertUnicodeToUTF8(file.wstring()));
+                return 1;
+            }
+        }
+        RunChart(profile, file, iterations);
+    }
+    RunLongNoteLinking(corpusDirectory, iterations);
+    RunMoverExpressions(iterations);
+    RunFontLayout(iterations);
+    RunRendering(iterations, boost::filesystem::path(outputFile).replace_extension(L".png"));
+    RunJudgeSoundDispatch();
+
+    std::ofstream stream(outputFile.wstring(), ios::out | ios::trunc);
+    if (!stream) {
+        log->error(u8"結果ファイル {0} を開けませんでした", ConvertUnicodeToUTF8(outputFile.wstring()));
+        return 1;
+    }
+    stream << "# version: " << SU_APP_VERSION << "\n";
+    stream << "# iterations: " << iterations << "\n";
+    stream << "benchmark,chart,items,iterations,mean_us,median_us,min_us,max_us\n";
+    for (auto &sample : samples) {
+        auto &times = sample.Times;
+        sort(times.begin(), times.end());
+        const auto mean = accumulate(times.begin(), times.end(), 0.0) / times.size();
+        const auto median = times.size() % 2 ? times[times.size() / 2] : (times[times.size() / 2 - 1] + times[times.size() / 2]) / 2;
+        stream << fmt::format("{0},{1},{2},{3},{4:.3f},{5:.3f},{6:.3f},{7:.3f}\n",
+            sample.Benchmark, sample.Chart, sample.Items, times.size(), mean, median, times.front(), times.back());
+    }
+    log->info(u8"ベンチマーク終了: {0}項目", samples.size());
+    return 0;
+}
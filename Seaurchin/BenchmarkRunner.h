@@ -0,0 +1,56 @@
+﻿#pragma once
+
+#include "ExecutionManager.h"
+
+// 譜面解析と毎フレーム処理の計測 (ヘッドレス実行用)
+// 疎な譜面から超高密度の譜面まで生成して Cache/Benchmark に置き、各処理の所要時間を CSV に書き出す
+// 行: benchmark,chart,items,iterations,mean_us,median_us,min_us,max_us (items は1反復で処理した要素数)
+// 描画はソフトウェアの RenderDevice で計測し、最後に描いた画面を結果ファイル名.png に書き出す
+// CalculateNotes は索引を作る前の全走査とも比べ、速度比と結果の食い違いをログに出す
+// 描画位置の更新は SusNoteStore の配列とノーツごとの GetStateAt の両方で測る
+// ロングノーツの連結は小節数を倍々にした譜面で測り、ノーツ数に対する伸び方をログに出す
+// 判定音の受け渡しは JudgeSoundQueue と以前の Sleep(0) 待ちの両方に一定間隔で積み、
+// 受け取り側の CPU 使用率と遅延の p99 をログに出す (この行の時間は反復ごとではなく1打ごとの遅延)
+class BenchmarkRunner final {
+public:
+    struct ChartProfile {
+        std::string Name;
+        uint32_t Measures;
+        uint32_t TapsPerMeasure;    // 1レーンあたり
+        uint32_t TapLanes;
+        uint32_t Slides;            // 小節ごとに同時に走るスライド数
+        uint32_t SlideSteps;        // スライド1本の中継点+制御点の数
+        uint32_t HispeedKeysPerMeasure;
+    };
+
+private:
+    struct Sample {
+        std::string Benchmark;
+        std::string Chart;
+        uint64_t Items;
+        std::vector<double> Times;
+    };
+
+    ExecutionManager *manager;
+    std::vector<Sample> samples;
+
+    static std::string GenerateLongNoteChart(uint32_t measures);
+    template<typename F>
+    void Measure(const std::string &benchmark, const std::string &chart, uint64_t items, int iterations, F &&body);
+
+    void RunChart(const ChartProfile &profile, const boost::filesystem::path &file, int iterations);
+    void RunLongNoteLinking(const boost::filesystem::path &directory, int iterations);
+    void RunMoverExpressions(int iterations);
+    void RunFontLayout(int iterations);
+    void RunRendering(int iterations, const boost::filesystem::path &imageFile);
+    void RunJudgeSoundDispatch();
+
+public:
+    explicit BenchmarkRunner(ExecutionManager *exm);
+
+    static std::vector<ChartProfile> GetDefaultCorpus();
+    static std::string GenerateChart(const ChartProfile &profile);
+
+    // 成功したら0を返す
+    int Run(int iterations, const boost::filesystem::path &outputFile);
+};
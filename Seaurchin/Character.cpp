@@ -181,22 +181,23 @@ CharacterImageSet *CharacterImageSet::CreateImageSet(const shared_ptr<CharacterP
 
 void CharacterImageSet::LoadAllImage()
 {
-    auto root = ConvertUTF8ToUnicode(parameter->ImagePath);
-    const auto hBase = LoadGraph(reinterpret_cast<const char*>(root.c_str()));
-    const auto hSmall = MakeScreen(SU_CHAR_SMALL_WIDTH, SU_CHAR_SMALL_WIDTH, 1);
-    const auto hFace = MakeScreen(SU_CHAR_FACE_SIZE, SU_CHAR_FACE_SIZE, 1);
+    const auto device = RenderDevice::GetCurrent();
+    const auto root = ConvertUTF8ToUnicode(parameter->ImagePath);
+    const auto hBase = device->LoadTexture(root, false);
+    const auto hSmall = device->CreateRenderTarget(SU_CHAR_SMALL_WIDTH, SU_CHAR_SMALL_WIDTH);
+    const auto hFace = device->CreateRenderTarget(SU_CHAR_FACE_SIZE, SU_CHAR_FACE_SIZE);
     BEGIN_DRAW_TRANSACTION(hSmall);
-    DrawRectExtendGraph(
+    device->DrawImageExtended(
         0, 0, SU_CHAR_SMALL_WIDTH, SU_CHAR_SMALL_HEIGHT,
         parameter->Metric.SmallRange[0], parameter->Metric.SmallRange[1],
         parameter->Metric.SmallRange[2], parameter->Metric.SmallRange[3],
-        hBase, TRUE);
+        hBase, true);
     BEGIN_DRAW_TRANSACTION(hFace);
-    DrawRectExtendGraph(
+    device->DrawImageExtended(
         0, 0, SU_CHAR_FACE_SIZE, SU_CHAR_FACE_SIZE,
         parameter->Metric.FaceRange[0], parameter->Metric.FaceRange[1],
         parameter->Metric.FaceRange[2], parameter->Metric.FaceRange[3],
-        hBase, TRUE);
+        hBase, true);
     FINISH_DRAW_TRANSACTION;
     imageFull = new SImage(hBase);
     imageFull->AddRef();
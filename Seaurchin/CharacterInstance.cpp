@@ -278,6 +278,7 @@ void RegisterCharacterSkillTypes(asIScriptEngine *engine)
 {
     RegisterResultTypes(engine);
     RegisterSkillTypes(engine);
+    RegisterJudgeTimingTypes(engine);
     RegisterCharacterTypes(engine);
 
     engine->RegisterFuncdef("void " SU_IF_JUDGE_CALLBACK "(" SU_IF_JUDGETYPE ", " SU_IF_JUDGE_DATA ", const string &in)");
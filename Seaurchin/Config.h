@@ -8,6 +8,8 @@
 
 #define SU_SETTING_FILE L"config.toml"
 #define SU_CACHE_MUSIC_FILE L"musics.mp"
+#define SU_CACHE_CHART_EXTENSION L".suc"
+#define SU_REPLAY_EXTENSION L".srp"
 #define SU_NAMED_PIPE_NAME "\\\\.\\pipe\\seaurchin"
 
 #define SU_DATA_DIR L"Data"
@@ -15,6 +17,8 @@
 #define SU_SKIN_DIR L"Skins"
 #define SU_FONT_DIR L"Fonts"
 #define SU_CACHE_DIR L"Cache"
+#define SU_CHART_CACHE_DIR L"Charts"
+#define SU_REPLAY_DIR L"Replays"
 #define SU_CHARACTER_DIR L"Characters"
 #define SU_MUSIC_DIR L"Music"
 #define SU_SOUND_DIR L"Sounds"
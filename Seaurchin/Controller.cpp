@@ -1,6 +1,12 @@
 ﻿#include "Controller.h"
 
 using namespace std;
+using namespace std::chrono;
+
+double ControlState::GetInputTimestamp()
+{
+    return duration_cast<duration<double>>(steady_clock::now().time_since_epoch()).count();
+}
 
 void ControlState::Initialize()
 {
@@ -11,6 +17,17 @@ void ControlState::Initialize()
     ZeroMemory(integratedSliderLast, sizeof(bool) * 16);
     ZeroMemory(integratedSliderTrigger, sizeof(bool) * 16);
     ZeroMemory(integratedAir, sizeof(bool) * 4);
+    ZeroMemory(externalSlider, sizeof(bool) * 16);
+    ZeroMemory(externalSliderTrigger, sizeof(bool) * 16);
+    ZeroMemory(externalAir, sizeof(bool) * 4);
+    ZeroMemory(sliderKeyboardPrevious, sizeof(uint32_t) * 16);
+    ZeroMemory(sliderKeyboardCurrent, sizeof(uint32_t) * 16);
+    airHoldKeyboardLast = false;
+    judgeEvents.clear();
+    updateTime = GetInputTimestamp();
+    fill_n(keyboardTriggerTime, 256, updateTime);
+    fill_n(integratedSliderTriggerTime, 16, updateTime);
+    fill_n(integratedAirTime, 4, updateTime);
 
     sliderKeyboardInputCombinations[0] = { KEY_INPUT_A };
     sliderKeyboardInputCombinations[1] = { KEY_INPUT_Z };
@@ -38,12 +55,44 @@ void ControlState::Terminate()
 {
 }
 
+void ControlState::PushEvent(const InputEvent &ev)
+{
+    lock_guard<mutex> lock(eventMutex);
+    pendingEvents.push_back(ev);
+}
+
 void ControlState::Update()
 {
+    Update(GetInputTimestamp());
+}
+
+void ControlState::Update(const double time)
+{
+    updateTime = time;
+    {
+        // キーボードの押下時刻は今ポーリングした状態に当てるので全部使う
+        lock_guard<mutex> lock(eventMutex);
+        const auto later = stable_partition(pendingEvents.begin(), pendingEvents.end(), [time](const InputEvent &ev) {
+            return ev.Source == ControllerSource::RawKeyboard || ev.Time <= time;
+        });
+        frameEvents.assign(pendingEvents.begin(), later);
+        pendingEvents.erase(pendingEvents.begin(), later);
+    }
+    stable_sort(frameEvents.begin(), frameEvents.end(), [](const InputEvent &a, const InputEvent &b) { return a.Time < b.Time; });
+    fill_n(keyboardTriggerTime, 256, updateTime);
+    fill_n(integratedSliderTriggerTime, 16, updateTime);
+    fill_n(integratedAirTime, 4, updateTime);
+
     // 生のキーボード入力
     memcpy_s(keyboardLast, sizeof(char) * 256, keyboardCurrent, sizeof(char) * 256);
     GetHitKeyStateAll(keyboardCurrent);
     for (auto i = 0; i < 256; i++) keyboardTrigger[i] = !keyboardLast[i] && keyboardCurrent[i];
+    // ポーリングで拾った押下に、このフレーム中に届いた押下メッセージの時刻を当てる
+    for (const auto &ev : frameEvents) {
+        if (ev.Source != ControllerSource::RawKeyboard || !ev.Pressed) continue;
+        if (ev.Number < 0 || ev.Number >= 256 || !keyboardTrigger[ev.Number]) continue;
+        keyboardTriggerTime[ev.Number] = min(keyboardTriggerTime[ev.Number], ev.Time);
+    }
 
     // キーボード入力スライダー
     for (auto i = 0; i < 16; i++) sliderKeyboardPrevious[i] = sliderKeyboardCurrent[i];
@@ -54,6 +103,7 @@ void ControlState::Update()
         uint32_t mask = 1;
         for (const auto &knum : targets) {
             if(keyboardCurrent[knum]) state |= mask;
+            if (keyboardTrigger[knum]) integratedSliderTriggerTime[snum] = min(integratedSliderTriggerTime[snum], keyboardTriggerTime[knum]);
             mask <<= 1;
             if (!mask) break;
         }
@@ -73,25 +123,32 @@ void ControlState::Update()
     airStringKeyboard[size_t(AirControlSource::AirAction)] = false;
     for (const auto &upkey : airStringKeyboardInputCombinations[size_t(AirControlSource::AirUp)]) {
         airStringKeyboard[size_t(AirControlSource::AirUp)] |= keyboardTrigger[upkey] ? 1 : 0;
+        if (keyboardTrigger[upkey]) integratedAirTime[size_t(AirControlSource::AirUp)] = min(integratedAirTime[size_t(AirControlSource::AirUp)], keyboardTriggerTime[upkey]);
     }
     for (const auto &downkey : airStringKeyboardInputCombinations[size_t(AirControlSource::AirDown)]) {
         airStringKeyboard[size_t(AirControlSource::AirDown)] |= keyboardTrigger[downkey];
+        if (keyboardTrigger[downkey]) integratedAirTime[size_t(AirControlSource::AirDown)] = min(integratedAirTime[size_t(AirControlSource::AirDown)], keyboardTriggerTime[downkey]);
     }
     for (const auto &upkey : airStringKeyboardInputCombinations[size_t(AirControlSource::AirHold)]) {
         airStringKeyboard[size_t(AirControlSource::AirHold)] |= !!keyboardCurrent[upkey];
     }
     for (const auto &actkey : airStringKeyboardInputCombinations[size_t(AirControlSource::AirAction)]) {
         airStringKeyboard[size_t(AirControlSource::AirAction)] |= keyboardTrigger[actkey];
+        if (keyboardTrigger[actkey]) integratedAirTime[size_t(AirControlSource::AirAction)] = min(integratedAirTime[size_t(AirControlSource::AirAction)], keyboardTriggerTime[actkey]);
     }
 
+    // 外部デバイス
+    CollectJudgeEvents();
+    ApplyExternalEvents();
+
     // 統合化
     for (auto i = 0; i < 16; i++) integratedSliderLast[i] = integratedSliderCurrent[i];
-    for (auto i = 0; i < 16; i++) integratedSliderCurrent[i] = !!sliderKeyboardCurrent[i];
-    for (auto i = 0; i < 16; i++) integratedSliderTrigger[i] = sliderKeyboardTrigger[i];
-    integratedAir[size_t(AirControlSource::AirUp)] = airStringKeyboard[size_t(AirControlSource::AirUp)];
-    integratedAir[size_t(AirControlSource::AirDown)] = airStringKeyboard[size_t(AirControlSource::AirDown)];
-    integratedAir[size_t(AirControlSource::AirHold)] = airStringKeyboard[size_t(AirControlSource::AirHold)];
-    integratedAir[size_t(AirControlSource::AirAction)] = airStringKeyboard[size_t(AirControlSource::AirAction)];
+    for (auto i = 0; i < 16; i++) integratedSliderCurrent[i] = !!sliderKeyboardCurrent[i] || externalSlider[i];
+    for (auto i = 0; i < 16; i++) integratedSliderTrigger[i] = sliderKeyboardTrigger[i] || externalSliderTrigger[i];
+    integratedAir[size_t(AirControlSource::AirUp)] = airStringKeyboard[size_t(AirControlSource::AirUp)] || externalAir[size_t(AirControlSource::AirUp)];
+    integratedAir[size_t(AirControlSource::AirDown)] = airStringKeyboard[size_t(AirControlSource::AirDown)] || externalAir[size_t(AirControlSource::AirDown)];
+    integratedAir[size_t(AirControlSource::AirHold)] = airStringKeyboard[size_t(AirControlSource::AirHold)] || externalAir[size_t(AirControlSource::AirHold)];
+    integratedAir[size_t(AirControlSource::AirAction)] = airStringKeyboard[size_t(AirControlSource::AirAction)] || externalAir[size_t(AirControlSource::AirAction)];
 
     /*{
         lock_guard<mutex> lock(fingerMutex);
@@ -99,6 +156,103 @@ void ControlState::Update()
     }*/
 }
 
+void ControlState::ApplyExternalEvents()
+{
+    // AirHold 以外のエアーはそのフレーム限りのトリガー
+    externalAir[size_t(AirControlSource::AirUp)] = false;
+    externalAir[size_t(AirControlSource::AirDown)] = false;
+    externalAir[size_t(AirControlSource::AirAction)] = false;
+    for (auto i = 0; i < 16; i++) externalSliderTrigger[i] = false;
+
+    // 1フレーム内で押して離した場合もトリガーとして残す
+    for (const auto &ev : frameEvents) {
+        switch (ev.Source) {
+            case ControllerSource::IntegratedSliders:
+                if (ev.Number < 0 || ev.Number >= 16) break;
+                if (ev.Pressed && !externalSlider[ev.Number]) {
+                    externalSliderTrigger[ev.Number] = true;
+                    integratedSliderTriggerTime[ev.Number] = min(integratedSliderTriggerTime[ev.Number], ev.Time);
+                }
+                externalSlider[ev.Number] = ev.Pressed;
+                break;
+            case ControllerSource::IntegratedAir:
+                if (ev.Number < 0 || ev.Number >= 4) break;
+                if (ev.Number == int(AirControlSource::AirHold)) {
+                    externalAir[ev.Number] = ev.Pressed;
+                } else if (ev.Pressed) {
+                    externalAir[ev.Number] = true;
+                    integratedAirTime[ev.Number] = min(integratedAirTime[ev.Number], ev.Time);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+void ControlState::CollectJudgeEvents()
+{
+    // 時刻, 外部デバイスからか, 変化
+    typedef tuple<double, bool, InputEvent> Change;
+    vector<Change> changes;
+
+    // キーボードは押下メッセージの時刻 (なければ今回の Update の時刻) で押し、離すのはポーリングで気づいた今回の時刻
+    // この時点の integratedSliderTriggerTime と integratedAirTime にはキーボードの分だけが入っている
+    for (auto i = 0; i < 16; i++) {
+        if (sliderKeyboardTrigger[i]) {
+            changes.emplace_back(integratedSliderTriggerTime[i], false, InputEvent { integratedSliderTriggerTime[i], ControllerSource::IntegratedSliders, i, true });
+        }
+        if (sliderKeyboardPrevious[i] && !sliderKeyboardCurrent[i]) {
+            changes.emplace_back(updateTime, false, InputEvent { updateTime, ControllerSource::IntegratedSliders, i, false });
+        }
+    }
+    for (const auto source : { AirControlSource::AirUp, AirControlSource::AirDown, AirControlSource::AirAction }) {
+        const auto number = int(source);
+        if (airStringKeyboard[number]) changes.emplace_back(integratedAirTime[number], false, InputEvent { integratedAirTime[number], ControllerSource::IntegratedAir, number, true });
+    }
+    const auto airHoldKeyboard = airStringKeyboard[size_t(AirControlSource::AirHold)];
+    if (airHoldKeyboard != airHoldKeyboardLast) {
+        changes.emplace_back(updateTime, false, InputEvent { updateTime, ControllerSource::IntegratedAir, int(AirControlSource::AirHold), airHoldKeyboard });
+    }
+    for (const auto &ev : frameEvents) {
+        if (ev.Source == ControllerSource::IntegratedSliders && ev.Number >= 0 && ev.Number < 16) changes.emplace_back(ev.Time, true, ev);
+        if (ev.Source == ControllerSource::IntegratedAir && ev.Number >= 0 && ev.Number < 4) changes.emplace_back(ev.Time, true, ev);
+    }
+    stable_sort(changes.begin(), changes.end(), [](const Change &a, const Change &b) { return get<0>(a) < get<0>(b); });
+
+    // 統合した状態が変わったところだけを残す 押下は ApplyExternalEvents やキーボードのトリガーと同じく、どれか1つが増えれば立つ
+    bool keyboardSlider[16], external[16];
+    for (auto i = 0; i < 16; i++) {
+        keyboardSlider[i] = !!sliderKeyboardPrevious[i];
+        external[i] = externalSlider[i];
+    }
+    auto keyboardHold = airHoldKeyboardLast;
+    auto externalHold = externalAir[size_t(AirControlSource::AirHold)];
+    judgeEvents.clear();
+    for (const auto &change : changes) {
+        const auto fromExternal = get<1>(change);
+        const auto &ev = get<2>(change);
+        const auto delay = max(0.0, updateTime - get<0>(change));
+        if (ev.Source == ControllerSource::IntegratedSliders) {
+            auto &pressed = fromExternal ? external[ev.Number] : keyboardSlider[ev.Number];
+            const auto wasHeld = keyboardSlider[ev.Number] || external[ev.Number];
+            if (ev.Pressed && fromExternal && pressed) continue;
+            pressed = ev.Pressed;
+            if (ev.Pressed || (wasHeld && !keyboardSlider[ev.Number] && !external[ev.Number])) {
+                judgeEvents.push_back({ ev.Source, ev.Number, ev.Pressed, delay });
+            }
+        } else if (ev.Number == int(AirControlSource::AirHold)) {
+            auto &pressed = fromExternal ? externalHold : keyboardHold;
+            const auto wasHeld = keyboardHold || externalHold;
+            pressed = ev.Pressed;
+            if ((keyboardHold || externalHold) != wasHeld) judgeEvents.push_back({ ev.Source, ev.Number, ev.Pressed, delay });
+        } else if (ev.Pressed) {
+            judgeEvents.push_back({ ev.Source, ev.Number, true, delay });
+        }
+    }
+    airHoldKeyboardLast = airHoldKeyboard;
+}
+
 bool ControlState::GetTriggerState(const ControllerSource source, const int number)
 {
     switch (source) {
@@ -166,3 +320,44 @@ void ControlState::SetAirStringKeyCombination(const int airNumber, const vector<
     if (keys.size() > 8) return;
     airStringKeyboardInputCombinations[airNumber] = keys;
 }
+
+bool ControlEvent::operator==(const ControlEvent &other) const
+{
+    return Source == other.Source && Number == other.Number && Pressed == other.Pressed && Delay == other.Delay;
+}
+
+bool ControlSnapshot::operator==(const ControlSnapshot &other) const
+{
+    return SliderCurrent == other.SliderCurrent
+        && SliderLast == other.SliderLast
+        && SliderTrigger == other.SliderTrigger
+        && Air == other.Air
+        && Events == other.Events;
+}
+
+void ControlState::GetSnapshot(ControlSnapshot *snapshot) const
+{
+    *snapshot = ControlSnapshot();
+    for (auto i = 0; i < 16; i++) {
+        const auto bit = uint16_t(1u << i);
+        if (integratedSliderCurrent[i]) snapshot->SliderCurrent |= bit;
+        if (integratedSliderLast[i]) snapshot->SliderLast |= bit;
+        if (integratedSliderTrigger[i]) snapshot->SliderTrigger |= bit;
+    }
+    for (auto i = 0; i < 4; i++) {
+        if (integratedAir[i]) snapshot->Air |= uint8_t(1u << i);
+    }
+    snapshot->Events = judgeEvents;
+}
+
+void ControlState::ApplySnapshot(const ControlSnapshot &snapshot)
+{
+    for (auto i = 0; i < 16; i++) {
+        const auto bit = uint16_t(1u << i);
+        integratedSliderCurrent[i] = !!(snapshot.SliderCurrent & bit);
+        integratedSliderLast[i] = !!(snapshot.SliderLast & bit);
+        integratedSliderTrigger[i] = !!(snapshot.SliderTrigger & bit);
+    }
+    for (auto i = 0; i < 4; i++) integratedAir[i] = !!(snapshot.Air & (1u << i));
+    judgeEvents = snapshot.Events;
+}
@@ -14,6 +14,42 @@ enum class AirControlSource {
     AirAction,
 };
 
+// 時刻付きの入力変化
+// Time は ControlState::GetInputTimestamp() と同じ時計の秒
+// RawKeyboard は押下時刻の記録にだけ使い、状態自体は毎フレームのポーリングで決める
+// IntegratedSliders/IntegratedAir は外部デバイス用で、イベントがそのまま状態になる
+// (AirUp/AirDown/AirAction は Pressed のみ意味を持つ)
+struct InputEvent {
+    double Time;
+    ControllerSource Source;
+    int Number;
+    bool Pressed;
+};
+
+// 判定に使う統合済みの入力の変化 1回の Update までに起きたものを起きた順に並べる
+// IntegratedSliders は押した/離した、IntegratedAir は AirHold だけが離すことがあり、他は押した瞬間のみ
+// Delay は起きてから Update の時刻までの秒 (0以上)
+struct ControlEvent {
+    ControllerSource Source;
+    int Number;
+    bool Pressed;
+    double Delay;
+
+    bool operator==(const ControlEvent &other) const;
+};
+
+// 判定処理から見える統合済みの入力状態 (リプレイの記録と再生に使う)
+struct ControlSnapshot {
+    uint16_t SliderCurrent = 0;
+    uint16_t SliderLast = 0;
+    uint16_t SliderTrigger = 0;
+    uint8_t Air = 0;    // AirControlSource の順のビット
+    std::vector<ControlEvent> Events;
+
+    bool operator==(const ControlSnapshot &other) const;
+    bool operator!=(const ControlSnapshot &other) const { return !(*this == other); }
+};
+
 class ControlState final {
 private:
     char keyboardCurrent[256];
@@ -31,14 +67,47 @@ private:
     std::vector<int> airStringKeyboardInputCombinations[4];
     bool airStringKeyboard[4];
 
+    std::mutex eventMutex;
+    std::vector<InputEvent> pendingEvents;
+    std::vector<InputEvent> frameEvents;
+    std::vector<ControlEvent> judgeEvents;
+    double updateTime;
+    double keyboardTriggerTime[256];
+    bool externalSlider[16];
+    bool externalSliderTrigger[16];
+    bool externalAir[4];
+    bool airHoldKeyboardLast;
+    double integratedSliderTriggerTime[16];
+    double integratedAirTime[4];
+
+    void ApplyExternalEvents();
+    // キーボードと外部デバイスの変化を時刻順に統合して judgeEvents を作る
+    // 外部デバイスの状態を frameEvents で進める前に呼ぶこと
+    void CollectJudgeEvents();
+
 public:
+    static double GetInputTimestamp();
+
     void Initialize();
     void Terminate();
     void Update();
+    // 入力の時計で time の時点まで進める time より後に起きた外部デバイスの入力は次の Update に回す
+    // Tick が実時間より遅れている (処理落ちから追いついている) 間はその分戻した時刻を渡す
+    void Update(double time);
+
+    // どのスレッドから呼んでもよい
+    void PushEvent(const InputEvent &ev);
+    const std::vector<InputEvent>& GetFrameEvents() const { return frameEvents; }
+    // 前回の Update からこの Update までの判定用の変化 次の Update (ApplySnapshot) まで同じものを返す
+    const std::vector<ControlEvent>& GetJudgeEvents() const { return judgeEvents; }
 
     bool GetTriggerState(ControllerSource source, int number);
     bool GetCurrentState(ControllerSource source, int number);
     bool GetLastState(ControllerSource source, int number);
     void SetSliderKeyCombination(int sliderNumber, const std::vector<int>& keys);
     void SetAirStringKeyCombination(int airNumber, const std::vector<int>& keys);
+
+    void GetSnapshot(ControlSnapshot *snapshot) const;
+    // 統合済みの状態を丸ごと置き換える 以降は Update せずにこれだけで進めること
+    void ApplySnapshot(const ControlSnapshot &snapshot);
 };
@@ -10,6 +10,7 @@
 #include "MoverFunctionExpression.h"
 #include "ScenePlayer.h"
 #include "CharacterInstance.h"
+#include "Profiler.h"
 
 using namespace boost::filesystem;
 using namespace std;
@@ -25,11 +26,13 @@ const static toml::Array defaultAirStringKeys = {
     toml::Array { KEY_INPUT_PGUP }, toml::Array { KEY_INPUT_PGDN }, toml::Array { KEY_INPUT_HOME }, toml::Array { KEY_INPUT_END }
 };
 
-ExecutionManager::ExecutionManager(const shared_ptr<Setting>& setting)
+ExecutionManager::ExecutionManager(const shared_ptr<Setting>& setting, const bool headless, unique_ptr<AudioBackend> audio)
     : sharedSetting(setting)
+    // ウィンドウがなければ描画命令は記録だけする
+    , renderDevice(headless ? RenderDevice::CreateRecording(SU_RES_WIDTH, SU_RES_HEIGHT, false) : RenderDevice::CreateDxLib())
     , settingManager(new setting2::SettingItemManager(sharedSetting))
     , scriptInterface(new AngelScript())
-    , sound(new SoundManager())
+    , sound(new SoundManager(audio ? move(audio) : headless ? AudioBackend::CreateNull() : AudioBackend::CreateDevice()))
     , musics(new MusicsManager(this)) // this渡すの怖いけどMusicsManagerのコンストラクタ内で逆参照してないから多分セーフ
     , characters(new CharacterManager())
     , skills(new SkillManager())
@@ -43,7 +46,11 @@ ExecutionManager::ExecutionManager(const shared_ptr<Setting>& setting)
     , immSentence(0)
     , mixerBgm(nullptr)
     , mixerSe(nullptr)
-{}
+    , headless(headless)
+{
+    RenderDevice::SetCurrent(renderDevice.get());
+    renderDevice->SetRenderTarget(RenderDevice::BackBuffer);
+}
 
 void ExecutionManager::Initialize()
 {
@@ -72,6 +79,29 @@ void ExecutionManager::Initialize()
         log->warn(u8"エアストリングキー設定の配列が4要素未満のため、フォールバックを利用します");
     }
 
+    const auto serialPort = sharedSetting->ReadValue<string>("Play", "OpeNITHMPort", "");
+    if (!serialPort.empty() && !headless) {
+        serialController = make_unique<OpeNITHMController>(sharedControlState);
+        const auto threshold = sharedSetting->ReadValue<int>("Play", "OpeNITHMThreshold", 20);
+        for (auto i = 0; i < 16; i++) serialController->SetThreshold(i, uint8_t(max(1, min(threshold, 255))));
+        // エアーの報告は OpeNITHM 本来のプロトコルに無い独自拡張なので、対応したファームウェアのときだけ有効にする
+        serialController->SetAirReportEnabled(sharedSetting->ReadValue<bool>("Play", "OpeNITHMAirReport", false));
+        if (!serialController->Open(ConvertUTF8ToUnicode(serialPort))) serialController.reset();
+    }
+
+    // ループ設定 TickRate が0なら可変刻み、FrameLimit が0なら上限なし (垂直同期は別)
+    const auto tickRate = sharedSetting->ReadValue<int>("Graphic", "TickRate", 0);
+    const auto frameLimit = sharedSetting->ReadValue<int>("Graphic", "FrameLimit", 0);
+    gameLoop = make_unique<GameLoop>(make_unique<RealtimeLoopClock>(), max(tickRate, 0), max(frameLimit, 0));
+
+    // スプライトのバッチ描画
+    if (sharedSetting->ReadValue<bool>("Graphic", "SpriteBatch", true)) {
+        spriteBatch = make_unique<SpriteBatch>(SpriteBatchBackend::CreateDevice());
+    }
+#ifdef SU_ENABLE_PROFILER
+    Profiler::GetInstance().Start();
+#endif
+
     // 拡張ライブラリ読み込み
     extensions->LoadExtensions();
     extensions->Initialize(scriptInterface->GetEngine());
@@ -122,6 +152,7 @@ void ExecutionManager::Shutdown()
 
     if (skin) skin->Terminate();
     settingManager->SaveAllValues();
+    serialController.reset();
     sharedControlState->Terminate();
 
     BOOST_ASSERT(mixerBgm->GetRefCount() == 1);
@@ -133,6 +164,15 @@ void ExecutionManager::Shutdown()
         DisconnectNamedPipe(hCommunicationPipe);
         CloseHandle(hCommunicationPipe);
     }
+
+#ifdef SU_ENABLE_PROFILER
+    auto &profiler = Profiler::GetInstance();
+    profiler.Stop();
+    const auto tracePath = Setting::GetRootDirectory() / path(L"Profile.json");
+    if (profiler.SaveChromeTrace(tracePath.wstring())) {
+        spdlog::get("main")->info(u8"計測結果を {0} に書き出しました ({1}区間)", ConvertUnicodeToUTF8(tracePath.wstring()), profiler.GetZoneCount());
+    }
+#endif
 }
 
 void ExecutionManager::RegisterGlobalManagementFunction()
@@ -162,6 +202,8 @@ void ExecutionManager::RegisterGlobalManagementFunction()
     engine->RegisterGlobalFunction("bool ExecuteScene(" SU_IF_SCENE "@)", asMETHODPR(ExecutionManager, ExecuteScene, (asIScriptObject*), bool), asCALL_THISCALL_ASGLOBAL, this);
     engine->RegisterGlobalFunction("bool ExecuteScene(" SU_IF_COSCENE "@)", asMETHODPR(ExecutionManager, ExecuteScene, (asIScriptObject*), bool), asCALL_THISCALL_ASGLOBAL, this);
     engine->RegisterGlobalFunction(SU_IF_SOUNDMIXER "@ GetDefaultMixer(const string &in)", asMETHOD(ExecutionManager, GetDefaultMixer), asCALL_THISCALL_ASGLOBAL, this);
+    engine->RegisterGlobalFunction("void GetStoredResult(" SU_IF_DRESULT " &out)", asMETHOD(ExecutionManager, GetStoredResult), asCALL_THISCALL_ASGLOBAL, this);
+    engine->RegisterGlobalFunction(SU_IF_JUDGE_TIMING "@ GetStoredJudgeTiming()", asMETHOD(ExecutionManager, GetStoredJudgeTiming), asCALL_THISCALL_ASGLOBAL, this);
     engine->RegisterObjectBehaviour(SU_IF_MSCURSOR, asBEHAVE_FACTORY, SU_IF_MSCURSOR "@ f()", asMETHOD(MusicsManager, CreateMusicSelectionCursor), asCALL_THISCALL_ASGLOBAL, musics.get());
     engine->RegisterObjectBehaviour(SU_IF_SCENE_PLAYER, asBEHAVE_FACTORY, SU_IF_SCENE_PLAYER "@ f()", asMETHOD(ExecutionManager, CreatePlayer), asCALL_THISCALL_ASGLOBAL, this);
 }
@@ -214,7 +256,8 @@ void ExecutionManager::ExecuteSkin()
         settingManager->RetrieveAllValues();
     }
 
-    skin = make_unique<SkinHolder>(ConvertUTF8ToUnicode(sn), scriptInterface, sound);
+    const auto useAtlas = sharedSetting->ReadValue<bool>("Graphic", "TextureAtlas", true);
+    skin = make_unique<SkinHolder>(ConvertUTF8ToUnicode(sn), scriptInterface, sound, useAtlas);
     skin->Initialize();
     log->info(u8"スキン読み込み完了");
     ExecuteSkin(ConvertUnicodeToUTF8(SU_SKIN_TITLE_FILE));
@@ -296,7 +339,16 @@ void ExecutionManager::ExecuteSystemMenu()
 //Tick
 void ExecutionManager::Tick(const double delta)
 {
-    sharedControlState->Update();
+    SU_PROFILE_ZONE("ExecutionManager::Tick");
+    // 処理落ちから追いつく Tick では、その Tick が受け持つ時刻までに起きた入力だけを取り込む
+    sharedControlState->Update(ControlState::GetInputTimestamp() - gameLoop->GetTickLag());
+    if (serialController) {
+        // 押されているセルを光らせる
+        for (auto i = 0; i < 16; i++) {
+            const uint8_t level = sharedControlState->GetCurrentState(ControllerSource::IntegratedSliders, i) ? 0xFF : 0x20;
+            serialController->SetLedColor(i, level, level, level);
+        }
+    }
 
     //シーン操作
     for (auto& scene : scenesPending) scenes.push_back(scene);
@@ -321,15 +373,30 @@ void ExecutionManager::Tick(const double delta)
         mixerBgm->Update();
         mixerSe->Update();
     }
+    SU_PROFILE_ZONE("GarbageCollect");
     scriptInterface->GetEngine()->GarbageCollect(asGC_ONE_STEP);
 }
 
 //Draw
-void ExecutionManager::Draw()
+void ExecutionManager::Draw(const double interpolation)
 {
-    ClearDrawScreen();
+    SU_PROFILE_ZONE("ExecutionManager::Draw");
+    drawInterpolation = interpolation;
+    renderDevice->Clear();
+    if (spriteBatch) spriteBatch->BeginFrame();
     for (const auto& s : scenes) s->Draw();
-    ScreenFlip();
+    if (spriteBatch) spriteBatch->EndFrame();
+    SU_PROFILE_ZONE("ScreenFlip");
+    renderDevice->Present();
+}
+
+void ExecutionManager::RunFrame()
+{
+    {
+        SU_PROFILE_ZONE("Frame");
+        gameLoop->RunFrame([this](const double delta) { Tick(delta); }, [this](const double interpolation) { Draw(interpolation); });
+    }
+    SU_PROFILE_FRAME();
 }
 
 void ExecutionManager::AddScene(const shared_ptr<Scene>& scene)
@@ -380,6 +447,19 @@ std::tuple<bool, LRESULT> ExecutionManager::CustomWindowProc(const HWND hWnd, co
         case WM_SEAURCHIN_ABORT:
             InterfacesExitApplication();
             return make_tuple(true, 0);
+        case WM_KEYDOWN:
+        case WM_SYSKEYDOWN:
+        case WM_KEYUP:
+        case WM_SYSKEYUP: {
+            const auto pressed = msg == WM_KEYDOWN || msg == WM_SYSKEYDOWN;
+            // オートリピートは無視
+            if (pressed && (lParam & (1 << 30))) return make_tuple(false, LRESULT(0));
+            // KEY_INPUT_* は DirectInput のキーコードなので、スキャンコード(拡張キーは +0x80)で対応が取れる
+            const auto key = int((lParam >> 16) & 0xFF) | ((lParam & (1 << 24)) ? 0x80 : 0);
+            // 受け取った時点で刻む GetMessageTime は GetTickCount の時計 (分解能10ms以上) なので QPC の時刻とは混ぜない
+            sharedControlState->PushEvent({ ControlState::GetInputTimestamp(), ControllerSource::RawKeyboard, key, pressed });
+            return make_tuple(false, LRESULT(0));
+        }
             /*
                 //IME
             case WM_INPUTLANGCHANGE:
@@ -10,6 +10,10 @@
 #include "SoundManager.h"
 #include "ScenePlayer.h"
 #include "Controller.h"
+#include "OpeNITHMController.h"
+#include "GameLoop.h"
+#include "RenderDevice.h"
+#include "SpriteBatch.h"
 #include "Character.h"
 #include "Skill.h"
 
@@ -18,6 +22,7 @@ class ExecutionManager final {
 
 private:
     const std::shared_ptr<Setting> sharedSetting;
+    const std::unique_ptr<RenderDevice> renderDevice;   // 画像などより後に破棄されるよう先頭に置く
     const std::unique_ptr<setting2::SettingItemManager> settingManager;
     const std::shared_ptr<AngelScript> scriptInterface;
     const std::shared_ptr<SoundManager> sound;
@@ -27,6 +32,10 @@ private:
     const std::unique_ptr<ExtensionManager> extensions;
     const std::shared_ptr<std::mt19937> random;
     const std::shared_ptr<ControlState> sharedControlState;
+    std::unique_ptr<OpeNITHMController> serialController;
+    std::unique_ptr<GameLoop> gameLoop;     // Initializeで作る
+    double drawInterpolation = 0;
+    std::unique_ptr<SpriteBatch> spriteBatch;   // Initializeで作る 無効にしていれば空
 
     std::vector<std::shared_ptr<Scene>> scenes;
     std::vector<std::shared_ptr<Scene>> scenesPending;
@@ -34,23 +43,35 @@ private:
     std::unique_ptr<SkinHolder> skin;
     std::unordered_map<std::string, boost::any> optionalData;
     DrawableResult lastResult;
+    JudgeTiming lastTiming;
     HIMC hImc;
     HANDLE hCommunicationPipe;
     DWORD immConversion, immSentence;
     SSoundMixer *mixerBgm, *mixerSe;
+    const bool headless;    // ウィンドウも音声出力もない実行 (シミュレーション用)
 
 public:
-    explicit ExecutionManager(const std::shared_ptr<Setting>& setting);
+    // audio を省略すると、通常はサウンドデバイス、ヘッドレスなら無音の出力を使う
+    explicit ExecutionManager(const std::shared_ptr<Setting>& setting, bool headless = false, std::unique_ptr<AudioBackend> audio = nullptr);
 
     void EnumerateSkins();
     void Tick(double delta);
-    void Draw();
+    // interpolation は最後の Tick から次の Tick までの進み具合 (0~1)
+    void Draw(double interpolation);
+    // 必要な回数の Tick と1回の Draw を行い、フレームレート制限の分だけ待つ
+    void RunFrame();
     void Initialize();
     void Shutdown();
     void AddScene(const std::shared_ptr<Scene>& scene);
     std::shared_ptr<ScriptScene> CreateSceneFromScriptType(asITypeInfo *type) const;
     std::shared_ptr<ScriptScene> CreateSceneFromScriptObject(asIScriptObject *obj) const;
     int GetSceneCount() const { return scenes.size(); }
+    bool IsHeadless() const { return headless; }
+    const GameLoop* GetGameLoop() const { return gameLoop.get(); }
+    // 描画中のみ意味を持つ 刻みを固定した Tick の合間を補間して描くときに使う
+    double GetDrawInterpolation() const { return drawInterpolation; }
+    RenderDevice* GetRenderDevice() const { return renderDevice.get(); }
+    SpriteBatch* GetSpriteBatch() const { return spriteBatch.get(); }
 
     std::shared_ptr<MusicsManager> GetMusicsManager() const { return musics; }
     std::shared_ptr<ControlState> GetControlStateSafe() const { return sharedControlState; }
@@ -75,6 +96,7 @@ public:
     SSoundMixer *GetDefaultMixer(const std::string &name) const;
     SSettingItem *GetSettingItem(const std::string &group, const std::string &key) const;
     void GetStoredResult(DrawableResult *result) const;
+    JudgeTiming* GetStoredJudgeTiming() { return &lastTiming; }
 
     template<typename T>
     void SetData(const std::string &name, const T& data);
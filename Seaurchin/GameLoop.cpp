@@ -0,0 +1,156 @@
+﻿#include "GameLoop.h"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace
+{
+    // 刻みの和が浮動小数点の誤差で僅かに足りず、Tick を1回取りこぼすのを防ぐ
+    const double TickEpsilon = 1e-9;
+
+    double ToInterval(const double rate)
+    {
+        return rate > 0 ? 1.0 / rate : 0.0;
+    }
+}
+
+// FrameTimeRing ------------------------
+void FrameTimeRing::Push(const double seconds)
+{
+    samples[head] = seconds;
+    head = (head + 1) % Capacity;
+    count = min(count + 1, Capacity);
+}
+
+void FrameTimeRing::Clear()
+{
+    head = count = 0;
+}
+
+double FrameTimeRing::GetLatest() const
+{
+    return count ? samples[(head + Capacity - 1) % Capacity] : 0.0;
+}
+
+double FrameTimeRing::GetAverage() const
+{
+    if (!count) return 0;
+    double sum = 0;
+    for (size_t i = 0; i < count; i++) sum += samples[i];
+    return sum / count;
+}
+
+double FrameTimeRing::GetMax() const
+{
+    double result = 0;
+    for (size_t i = 0; i < count; i++) result = max(result, samples[i]);
+    return result;
+}
+
+double FrameTimeRing::GetPercentile(const double percentile) const
+{
+    if (!count) return 0;
+    vector<double> sorted(samples.begin(), samples.begin() + count);
+    const auto rank = size_t(ceil(count * max(0.0, min(percentile, 1.0))));
+    const auto index = rank ? min(rank, count) - 1 : 0;
+    nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+    return sorted[index];
+}
+
+// RealtimeLoopClock ------------------------
+RealtimeLoopClock::RealtimeLoopClock(const double spinThreshold)
+    : origin(steady_clock::now())
+    , spinThreshold(spinThreshold)
+{
+    // Sleep(1) が 15.6ms にならないようにタイマー分解能を上げる
+    timeBeginPeriod(1);
+}
+
+RealtimeLoopClock::~RealtimeLoopClock()
+{
+    timeEndPeriod(1);
+}
+
+double RealtimeLoopClock::Now() const
+{
+    return duration_cast<duration<double>>(steady_clock::now() - origin).count();
+}
+
+void RealtimeLoopClock::WaitUntil(const double time)
+{
+    for (;;) {
+        const auto remaining = time - Now();
+        if (remaining <= 0) return;
+        if (remaining > spinThreshold) {
+            Sleep(1);
+        } else {
+            this_thread::yield();
+        }
+    }
+}
+
+// GameLoop ------------------------
+GameLoop::GameLoop(unique_ptr<LoopClock> clock, const double tickRate, const double frameRate)
+    : clock(move(clock))
+    , tickInterval(ToInterval(tickRate))
+    , frameInterval(ToInterval(frameRate))
+{}
+
+void GameLoop::SetTickRate(const double rate)
+{
+    tickInterval = ToInterval(rate);
+    accumulator = 0;
+}
+
+void GameLoop::SetFrameRate(const double rate)
+{
+    frameInterval = ToInterval(rate);
+    nextFrameTime = clock->Now();
+}
+
+void GameLoop::RunFrame(const TickFunction &tick, const DrawFunction &draw)
+{
+    const auto now = clock->Now();
+    if (!started) {
+        started = true;
+        lastTime = nextFrameTime = now;
+    }
+    const auto elapsed = now - lastTime;
+    lastTime = now;
+    if (frameCount) frameTimes.Push(elapsed);
+
+    const auto workStart = steady_clock::now();
+    if (tickInterval > 0) {
+        accumulator += elapsed;
+        auto ticks = 0;
+        while (accumulator + TickEpsilon >= tickInterval && ticks < maxTicksPerFrame) {
+            tickLag = max(0.0, accumulator - tickInterval);
+            tick(tickInterval);
+            accumulator -= tickInterval;
+            ++ticks;
+        }
+        // 追いつけない分は次のフレームで続けて回す 捨てると Tick の時刻が BGM から遅れたままになる
+        const auto backlog = uint64_t(floor((accumulator + TickEpsilon) / tickInterval));
+        deferredTicks += backlog;
+        tickLag = 0;
+        accumulator = max(accumulator, 0.0);
+        tickCount += ticks;
+        // 持ち越しがある間は次の Tick の途中を描いているわけではないので補間しない
+        interpolation = backlog ? 0.0 : min(accumulator / tickInterval, 1.0);
+    } else {
+        tick(elapsed);
+        ++tickCount;
+        interpolation = 0;
+    }
+    draw(interpolation);
+    workTimes.Push(duration_cast<duration<double>>(steady_clock::now() - workStart).count());
+    ++frameCount;
+
+    if (frameInterval > 0) {
+        nextFrameTime += frameInterval;
+        // 大きく遅れたら取り戻そうとせずに今から数え直す
+        const auto current = clock->Now();
+        if (nextFrameTime < current - frameInterval) nextFrameTime = current;
+        clock->WaitUntil(nextFrameTime);
+    }
+}
@@ -0,0 +1,111 @@
+﻿#pragma once
+
+// 直近 Capacity フレーム分の時間 (秒) を覚えておくリングバッファ
+class FrameTimeRing final {
+public:
+    static const size_t Capacity = 1024;
+
+private:
+    std::array<double, Capacity> samples {};
+    size_t head = 0;
+    size_t count = 0;
+
+public:
+    void Push(double seconds);
+    void Clear();
+
+    size_t GetCount() const { return count; }
+    double GetLatest() const;
+    double GetAverage() const;
+    double GetMax() const;
+    // percentile は 0~1
+    double GetPercentile(double percentile) const;
+};
+
+// ループの時計 ヘッドレスでは仮想時計に差し替えて、待たずに同じ結果を得る
+class LoopClock {
+public:
+    virtual ~LoopClock() = default;
+
+    virtual double Now() const = 0;
+    virtual void WaitUntil(double time) = 0;
+};
+
+// 実時間 待ちは粗く Sleep してから、最後の spinThreshold 秒だけ回して合わせる
+class RealtimeLoopClock final : public LoopClock {
+private:
+    const std::chrono::steady_clock::time_point origin;
+    const double spinThreshold;
+
+public:
+    explicit RealtimeLoopClock(double spinThreshold = 0.002);
+    ~RealtimeLoopClock();
+
+    double Now() const override;
+    void WaitUntil(double time) override;
+};
+
+// 待った分だけ進む時計
+class VirtualLoopClock final : public LoopClock {
+private:
+    double time = 0;
+
+public:
+    double Now() const override { return time; }
+    void WaitUntil(const double target) override { time = std::max(time, target); }
+};
+
+// 1フレーム分の進行を受け持つ
+// tickRate が正なら Tick は常にその刻みで呼ばれ、フレームの経過時間に応じて0回以上呼ばれる
+// 余りは補間の割合として Draw に渡す 1フレームで回しきれなかった Tick は捨てずに次のフレームに持ち越すので、
+// Tick の刻みの合計は常にループの時計の経過時間に追いつく (BGM と譜面の時刻がずれたままにならない) 0 なら従来通りフレームの経過時間をそのまま1回渡し、割合は常に0
+// frameRate が正ならその間隔になるまでフレームの最後で待つ 仮想時計では必ず指定すること
+class GameLoop final {
+public:
+    using TickFunction = std::function<void(double)>;
+    // 引数は GetInterpolation と同じ
+    using DrawFunction = std::function<void(double)>;
+
+private:
+    const std::unique_ptr<LoopClock> clock;
+    double tickInterval;
+    double frameInterval;
+    int maxTicksPerFrame = 8;
+
+    bool started = false;
+    double lastTime = 0;
+    double nextFrameTime = 0;
+    double accumulator = 0;
+    double interpolation = 0;
+    double tickLag = 0;
+    uint64_t frameCount = 0;
+    uint64_t tickCount = 0;
+    uint64_t deferredTicks = 0;
+    FrameTimeRing frameTimes;
+    FrameTimeRing workTimes;
+
+public:
+    GameLoop(std::unique_ptr<LoopClock> clock, double tickRate, double frameRate);
+
+    void RunFrame(const TickFunction &tick, const DrawFunction &draw);
+
+    void SetTickRate(double rate);
+    void SetFrameRate(double rate);
+    // 1フレームで回す Tick の上限 これ以上溜まった分は次のフレームに持ち越す
+    void SetMaxTicksPerFrame(const int ticks) { maxTicksPerFrame = std::max(1, ticks); }
+
+    double GetTickInterval() const { return tickInterval; }
+    double GetFrameInterval() const { return frameInterval; }
+    // 最後の Tick から次の Tick までのどこを描画しているか (0~1)
+    double GetInterpolation() const { return interpolation; }
+    // Tick の中で呼ぶと、その Tick の終わりがフレームの開始時刻よりどれだけ前か (追いつくために続けて Tick している間だけ正)
+    double GetTickLag() const { return tickLag; }
+    uint64_t GetFrameCount() const { return frameCount; }
+    uint64_t GetTickCount() const { return tickCount; }
+    // フレームの終わりで回しきれずに次のフレームへ持ち越した Tick の延べ数
+    uint64_t GetDeferredTickCount() const { return deferredTicks; }
+    // フレームの開始から次の開始までの時間 (ループの時計で測る)
+    const FrameTimeRing& GetFrameTimes() const { return frameTimes; }
+    // Tick と描画にかかった実時間 (待ちは含まない)
+    const FrameTimeRing& GetWorkTimes() const { return workTimes; }
+};
@@ -0,0 +1,257 @@
+﻿#include "HeadlessRunner.h"
+#include "ScenePlayer.h"
+#include "Replay.h"
+#include "Misc.h"
+
+using namespace std;
+
+namespace
+{
+    void WriteResult(ostream &stream, const DrawableResult &result)
+    {
+        stream << "# result: JusticeCritical " << result.JusticeCritical
+            << ", Justice " << result.Justice
+            << ", Attack " << result.Attack
+            << ", Miss " << result.Miss
+            << ", MaxCombo " << result.MaxCombo
+            << ", Score " << result.Score << "\n";
+    }
+
+    void WriteJudges(ostream &stream, const vector<ReplayJudge> &records)
+    {
+        stream << "time,note,left,right,judge\n";
+        for (const auto &record : records) {
+            stream << fmt::format("{0:.6f},{1},{2},{3},{4}\n",
+                record.Time,
+                GetAbilityNoteTypeName(record.Information.Note),
+                record.Information.Left,
+                record.Information.Right,
+                GetAbilityJudgeTypeName(record.Judge));
+        }
+    }
+
+    // 判定のずれは出力ファイルの隣に Simulation.timing.json のような名前で書く
+    void WriteTiming(const boost::filesystem::path &outputFile, const JudgeTiming &timing)
+    {
+        auto log = spdlog::get("main");
+        auto timingFile = outputFile;
+        timingFile.replace_extension(".timing.json");
+        std::ofstream stream(timingFile.wstring(), ios::out | ios::trunc);
+        if (!stream) {
+            log->error(u8"判定タイミングのファイル {0} を開けませんでした", ConvertUnicodeToUTF8(timingFile.wstring()));
+            return;
+        }
+        timing.WriteJson(stream);
+        log->info(u8"判定タイミング: {0}回 推奨JudgeAdjust Slider:{1}ms AirString:{2}ms", timing.GetRecordCount(), timing.GetSuggestedAdjustSlider(), timing.GetSuggestedAdjustAirString());
+    }
+
+    bool IsSameJudge(const ReplayJudge &a, const ReplayJudge &b)
+    {
+        return a.Time == b.Time
+            && a.Judge == b.Judge
+            && a.Information.Note == b.Information.Note
+            && a.Information.Left == b.Information.Left
+            && a.Information.Right == b.Information.Right;
+    }
+}
+
+HeadlessRunner::HeadlessRunner(ExecutionManager *exm) : manager(exm)
+{}
+
+int HeadlessRunner::Run(const boost::filesystem::path &scoreFile, const double framesPerSecond, const boost::filesystem::path &outputFile)
+{
+    auto log = spdlog::get("main");
+    if (!exists(scoreFile)) {
+        log->error(u8"譜面ファイル {0} が見つかりません", ConvertUnicodeToUTF8(scoreFile.wstring()));
+        return 1;
+    }
+    if (framesPerSecond <= 0) {
+        log->error(u8"フレームレートの指定が不正です");
+        return 1;
+    }
+
+    const auto player = manager->CreatePlayer();
+    vector<ReplayJudge> records;
+    player->SetScoreFile(scoreFile);
+    player->SetJudgeRecorder([&records](const double time, const AbilityJudgeType judge, const JudgeInformation &info) {
+        records.push_back(ReplayJudge { time, judge, info });
+    });
+
+    // Load は別スレッドで読み込むので、ここでは直接同期で読む
+    player->Initialize();
+    player->LoadSynchronously();
+    player->GetReady();
+    player->Play();
+
+    // 終わらない譜面で止まらないように、譜面長+余裕で打ち切る
+    // 仮想時計なので待たずに回り、毎フレームちょうど1回 Tick する
+    const auto audio = manager->GetSoundManagerUnsafe()->GetBackend();
+    GameLoop loop(make_unique<VirtualLoopClock>(), framesPerSecond, framesPerSecond);
+    const auto delta = loop.GetTickInterval();
+    const auto timeLimit = player->GetScoreDuration() + 10.0;
+    uint64_t frames = 0;
+    double totalFrameTime = 0, maxFrameTime = 0;
+    while (player->GetState() != PlayingState::Completed && player->GetPlayingTime() < timeLimit) {
+        const auto ticks = loop.GetTickCount();
+        loop.RunFrame([player](const double tickDelta) { player->Tick(tickDelta); }, [](double) {});
+        if (loop.GetTickCount() == ticks) continue;
+        const auto frameTime = loop.GetWorkTimes().GetLatest();
+        totalFrameTime += frameTime;
+        maxFrameTime = max(maxFrameTime, frameTime);
+        ++frames;
+        // 音声の書き出しはフレーム時間に含めない
+        audio->Advance((loop.GetTickCount() - ticks) * delta);
+    }
+    const auto completed = player->GetState() == PlayingState::Completed;
+
+    DrawableResult result;
+    player->GetCurrentResult(&result);
+    const auto timing = *player->GetJudgeTiming();
+    player->SetJudgeRecorder(nullptr);
+    audio->Flush();
+    player->Release();
+
+    const auto averageFrameTime = frames ? totalFrameTime / frames : 0.0;
+    log->info(u8"シミュレーション終了: {0}フレーム 平均{1:.2f}us 最大{2:.2f}us", frames, averageFrameTime * 1e6, maxFrameTime * 1e6);
+    log->info(u8"JC:{0} J:{1} A:{2} M:{3} MaxCombo:{4} Score:{5}", result.JusticeCritical, result.Justice, result.Attack, result.Miss, result.MaxCombo, result.Score);
+
+    std::ofstream stream(outputFile.wstring(), ios::out | ios::trunc);
+    if (!stream) {
+        log->error(u8"結果ファイル {0} を開けませんでした", ConvertUnicodeToUTF8(outputFile.wstring()));
+        return 1;
+    }
+    stream << "# score: " << ConvertUnicodeToUTF8(scoreFile.wstring()) << "\n";
+    stream << "# completed: " << (completed ? "true" : "false") << "\n";
+    stream << "# frames: " << frames << " (" << framesPerSecond << " fps)\n";
+    stream << "# frame time: average " << averageFrameTime * 1e6 << " us, max " << maxFrameTime * 1e6 << " us\n";
+    WriteResult(stream, result);
+    WriteJudges(stream, records);
+    WriteTiming(outputFile, timing);
+    return completed ? 0 : 2;
+}
+
+int HeadlessRunner::RunReplay(const boost::filesystem::path &replayFile, const boost::filesystem::path &scoreFile, const boost::filesystem::path &outputFile)
+{
+    auto log = spdlog::get("main");
+    const auto replay = make_shared<Replay>();
+    if (!replay->Load(replayFile.wstring())) {
+        log->error(u8"リプレイ {0} を読み込めませんでした", ConvertUnicodeToUTF8(replayFile.wstring()));
+        return 1;
+    }
+    const auto &settings = replay->Settings;
+    auto chartFile = scoreFile;
+    if (chartFile.empty()) {
+        chartFile = ConvertUTF8ToUnicode(settings.ChartFile);
+        if (chartFile.is_relative()) chartFile = replayFile.parent_path() / chartFile;
+    }
+    if (!exists(chartFile)) {
+        log->error(u8"譜面ファイル {0} が見つかりません", ConvertUnicodeToUTF8(chartFile.wstring()));
+        return 1;
+    }
+    if (CalculateFileCrc32(chartFile.wstring()) != settings.ChartHash) {
+        log->error(u8"譜面 {0} が記録時と異なります", ConvertUnicodeToUTF8(chartFile.wstring()));
+        return 1;
+    }
+    log->info(u8"リプレイ: {0}Tick 入力変化{1}回 判定{2}回 (ハイスピード{3})", replay->Ticks.size(), replay->Inputs.size(), replay->Judges.size(), settings.Hispeed);
+
+    // 3 で ReplayProcessor を作らせる
+    manager->SetData<int>("AutoPlay", 3);
+    const auto player = manager->CreatePlayer();
+    vector<ReplayJudge> records;
+    player->SetScoreFile(chartFile);
+    // 設定は記録時のものに合わせる
+    player->SetReplaySource(replay);
+    player->SetJudgeRecorder([&records](const double time, const AbilityJudgeType judge, const JudgeInformation &info) {
+        records.push_back(ReplayJudge { time, judge, info });
+    });
+
+    player->Initialize();
+    player->LoadSynchronously();
+    player->GetReady();
+    player->Play();
+
+    // 記録した Tick をそのまま与えれば曲中時刻も同じ値を辿る
+    // 音声の時計は先に進めておく 後だと Tick の長さが変わるたびに発音位置が揺れる
+    const auto audio = manager->GetSoundManagerUnsafe()->GetBackend();
+    for (const auto &tick : replay->Ticks) {
+        if (tick.Paused && player->GetState() != PlayingState::Paused) player->Pause();
+        if (!tick.Paused && player->GetState() == PlayingState::Paused) player->Resume();
+        audio->Advance(tick.Delta);
+        player->Tick(tick.Delta);
+    }
+
+    DrawableResult result;
+    player->GetCurrentResult(&result);
+    const auto timing = *player->GetJudgeTiming();
+    player->SetJudgeRecorder(nullptr);
+    audio->Flush();
+    player->Release();
+
+    auto mismatch = min(records.size(), replay->Judges.size());
+    for (size_t i = 0; i < mismatch; i++) {
+        if (IsSameJudge(records[i], replay->Judges[i])) continue;
+        mismatch = i;
+        break;
+    }
+    const auto identical = records.size() == replay->Judges.size() && mismatch == records.size();
+    if (identical) {
+        log->info(u8"リプレイの判定はすべて一致しました ({0}回)", records.size());
+    } else {
+        log->warn(u8"リプレイの判定が {0} 番目から食い違いました (記録{1}回 再生{2}回)", mismatch, replay->Judges.size(), records.size());
+    }
+    log->info(u8"JC:{0} J:{1} A:{2} M:{3} MaxCombo:{4} Score:{5}", result.JusticeCritical, result.Justice, result.Attack, result.Miss, result.MaxCombo, result.Score);
+
+    std::ofstream stream(outputFile.wstring(), ios::out | ios::trunc);
+    if (!stream) {
+        log->error(u8"結果ファイル {0} を開けませんでした", ConvertUnicodeToUTF8(outputFile.wstring()));
+        return 1;
+    }
+    stream << "# replay: " << ConvertUnicodeToUTF8(replayFile.wstring()) << "\n";
+    stream << "# score: " << ConvertUnicodeToUTF8(chartFile.wstring()) << "\n";
+    stream << "# identical: " << (identical ? "true" : "false") << "\n";
+    if (!identical) stream << "# first mismatch: " << mismatch << "\n";
+    WriteResult(stream, result);
+    WriteJudges(stream, records);
+    WriteTiming(outputFile, timing);
+    return identical ? 0 : 3;
+}
+
+int HeadlessRunner::RunReplays(const boost::filesystem::path &replayDirectory, const boost::filesystem::path &outputFile)
+{
+    auto log = spdlog::get("main");
+    vector<boost::filesystem::path> replayFiles;
+    boost::system::error_code ec;
+    for (const auto &entry : boost::filesystem::directory_iterator(replayDirectory, ec)) {
+        if (is_regular_file(entry.path()) && entry.path().extension() == SU_REPLAY_EXTENSION) replayFiles.push_back(entry.path());
+    }
+    if (replayFiles.empty()) {
+        log->error(u8"{0} にリプレイがありません", ConvertUnicodeToUTF8(replayDirectory.wstring()));
+        return 1;
+    }
+    sort(replayFiles.begin(), replayFiles.end());
+
+    // それぞれの判定は Replay.csv なら Replay/<リプレイ名>.csv に書く
+    auto detailDirectory = outputFile;
+    detailDirectory.replace_extension();
+    boost::filesystem::create_directories(detailDirectory, ec);
+
+    std::ofstream stream(outputFile.wstring(), ios::out | ios::trunc);
+    if (!stream) {
+        log->error(u8"結果ファイル {0} を開けませんでした", ConvertUnicodeToUTF8(outputFile.wstring()));
+        return 1;
+    }
+    stream << "replay,result\n";
+    auto identical = 0, mismatched = 0, failed = 0;
+    for (const auto &replayFile : replayFiles) {
+        const auto code = RunReplay(replayFile, {}, detailDirectory / (replayFile.stem().wstring() + L".csv"));
+        const auto result = code == 0 ? "identical" : code == 3 ? "mismatch" : "error";
+        stream << ConvertUnicodeToUTF8(replayFile.filename().wstring()) << "," << result << "\n";
+        if (code == 0) ++identical;
+        else if (code == 3) ++mismatched;
+        else ++failed;
+    }
+
+    log->info(u8"リプレイ一括照合: {0}件中 一致{1}件 食い違い{2}件 照合できず{3}件", replayFiles.size(), identical, mismatched, failed);
+    if (failed) return 1;
+    return mismatched ? 3 : 0;
+}
@@ -0,0 +1,23 @@
+﻿#pragma once
+
+#include "ExecutionManager.h"
+
+// ウィンドウも音声出力も使わずに ScenePlayer を固定刻みの仮想時刻 (GameLoop + VirtualLoopClock) で最後まで回す
+// 判定結果と1フレームあたりの処理時間をファイルに書き出す 判定のずれの集計は別に JSON で書き出す
+// リプレイを渡すと記録した Tick と入力で同じように回し、判定が記録と一致するかを調べる
+// 判定処理を変えたら Data/Verification/Replays (回帰確認用の譜面とリプレイ) を一括で照合すること
+class HeadlessRunner final {
+private:
+    ExecutionManager *manager;
+
+public:
+    explicit HeadlessRunner(ExecutionManager *exm);
+
+    // 成功したら0を返す
+    int Run(const boost::filesystem::path &scoreFile, double framesPerSecond, const boost::filesystem::path &outputFile);
+    // scoreFile が空ならリプレイに記録されたパスを使う (相対パスならリプレイと同じディレクトリから) 判定が一致すれば0、食い違えば3を返す
+    int RunReplay(const boost::filesystem::path &replayFile, const boost::filesystem::path &scoreFile, const boost::filesystem::path &outputFile);
+    // ディレクトリ内のリプレイをすべて照合し、一覧を outputFile に、それぞれの判定を outputFile と同名のディレクトリに書く
+    // すべて一致すれば0、食い違いがあれば3、照合できないものがあれば1を返す
+    int RunReplays(const boost::filesystem::path &replayDirectory, const boost::filesystem::path &outputFile);
+};
@@ -0,0 +1,72 @@
+﻿#include "JudgeSoundQueue.h"
+
+using namespace std;
+using namespace std::chrono;
+
+void JudgeSoundQueue::Push(const JudgeSoundType type)
+{
+    {
+        lock_guard<mutex> lock(queueMutex);
+        if (closed) return;
+        entries.push_back({ type, steady_clock::now() });
+        maxDepth = max(maxDepth, entries.size());
+    }
+    signal.notify_one();
+}
+
+bool JudgeSoundQueue::Pop(JudgeSoundType &type)
+{
+    unique_lock<mutex> lock(queueMutex);
+    signal.wait(lock, [this] { return closed || !entries.empty(); });
+    if (entries.empty()) return false;
+
+    const auto entry = entries.front();
+    entries.pop_front();
+    const auto latency = duration_cast<microseconds>(steady_clock::now() - entry.Time).count();
+    ++latencyHistogram[min(size_t(latency / HistogramResolutionMicroseconds), HistogramBins - 1)];
+    ++dispatched;
+    type = entry.Type;
+    return true;
+}
+
+void JudgeSoundQueue::Close()
+{
+    {
+        lock_guard<mutex> lock(queueMutex);
+        closed = true;
+        entries.clear();
+    }
+    signal.notify_all();
+}
+
+size_t JudgeSoundQueue::GetDepth() const
+{
+    lock_guard<mutex> lock(queueMutex);
+    return entries.size();
+}
+
+size_t JudgeSoundQueue::GetMaxDepth() const
+{
+    lock_guard<mutex> lock(queueMutex);
+    return maxDepth;
+}
+
+uint64_t JudgeSoundQueue::GetDispatchedCount() const
+{
+    lock_guard<mutex> lock(queueMutex);
+    return dispatched;
+}
+
+double JudgeSoundQueue::GetLatencyPercentile(const double percentile) const
+{
+    lock_guard<mutex> lock(queueMutex);
+    if (!dispatched) return 0;
+
+    const auto target = uint64_t(ceil(dispatched * max(0.0, min(percentile, 1.0))));
+    uint64_t count = 0;
+    for (size_t i = 0; i < HistogramBins; i++) {
+        count += latencyHistogram[i];
+        if (count >= target && count) return (i + 1) * HistogramResolutionMicroseconds / 1000000.0;
+    }
+    return HistogramBins * HistogramResolutionMicroseconds / 1000000.0;
+}
@@ -0,0 +1,58 @@
+﻿#pragma once
+
+enum class JudgeSoundType {
+    Tap,
+    ExTap,
+    Flick,
+    Air,
+    AirDown,
+    AirAction,
+    Holding,
+    HoldStep,
+    HoldingStop,
+    Sliding,
+    SlideStep,
+    SlidingStop,
+    AirHolding,
+    AirHoldingStop,
+    Metronome,
+};
+
+// 判定音の発音要求を音声スレッドへ渡すキュー (複数書き込み・単一読み出し)
+// 空の間は条件変数で眠るので、待ち受けでコアを占有しない
+// 積まれてから取り出されるまでの遅延をヒストグラムに記録する
+class JudgeSoundQueue final {
+public:
+    static const size_t HistogramBins = 1000;
+    static const int HistogramResolutionMicroseconds = 10;    // 最後のビンは10ms以上全部
+    // 積んでから取り出すまでの遅延の上限 (p99)
+    // 起こすのは notify 1回とスケジューラの切り替え1回だけで、Sleep のようにタイマーの刻みを待たない
+    // 240fps の1フレームの1/4 で、BASS の更新周期 (既定10ms) より十分短い
+    static const int WakeLatencyBoundMicroseconds = 1000;
+
+private:
+    struct Entry {
+        JudgeSoundType Type;
+        std::chrono::steady_clock::time_point Time;
+    };
+
+    mutable std::mutex queueMutex;
+    std::condition_variable signal;
+    std::deque<Entry> entries;
+    bool closed = false;
+    size_t maxDepth = 0;
+    uint64_t dispatched = 0;
+    std::array<uint32_t, HistogramBins> latencyHistogram {};
+
+public:
+    void Push(JudgeSoundType type);
+    // 何か積まれるまで待つ Close されて空になったら false
+    bool Pop(JudgeSoundType &type);
+    void Close();
+
+    size_t GetDepth() const;
+    size_t GetMaxDepth() const;
+    uint64_t GetDispatchedCount() const;
+    // 遅延の percentile (0~1) を秒で返す ビンの上端なので最大で1ビン分だけ大きめに出る
+    double GetLatencyPercentile(double percentile) const;
+};
@@ -0,0 +1,184 @@
+﻿#include "KeysoundScheduler.h"
+
+using namespace std;
+
+constexpr double KeysoundScheduler::FrameMargin;
+
+namespace
+{
+    // これ以上ずれていたら対応を取り直す
+    const double SynchronizeTolerance = 0.005;
+}
+
+KeysoundScheduler::KeysoundScheduler(const int frequency, const int channels, const double leadTime)
+    : frequency(frequency)
+    , channels(channels)
+    , leadTime(leadTime)
+{}
+
+KeysoundScheduler::~KeysoundScheduler()
+{
+    Stop();
+}
+
+int KeysoundScheduler::AddWaveform(const vector<float> &frames)
+{
+    waveforms.push_back(frames);
+    waveforms.back().resize(frames.size() / channels * channels);
+    return int(waveforms.size() - 1);
+}
+
+int KeysoundScheduler::AddSample(const SoundSample *sample)
+{
+    if (!sample) return -1;
+    const auto handle = sample->GetSampleHandle();
+    BASS_SAMPLE info = { 0 };
+    if (!handle || !BASS_SampleGetInfo(handle, &info) || !info.chans || !info.freq) return -1;
+
+    vector<uint8_t> raw(info.length);
+    if (!BASS_SampleGetData(handle, raw.data())) return -1;
+
+    // 元の形式から float に
+    vector<float> source;
+    if (info.flags & BASS_SAMPLE_FLOAT) {
+        source.resize(raw.size() / sizeof(float));
+        memcpy(source.data(), raw.data(), source.size() * sizeof(float));
+    } else if (info.flags & BASS_SAMPLE_8BITS) {
+        source.resize(raw.size());
+        for (size_t i = 0; i < raw.size(); i++) source[i] = (raw[i] - 128) / 128.0f;
+    } else {
+        source.resize(raw.size() / sizeof(int16_t));
+        const auto pcm = reinterpret_cast<const int16_t*>(raw.data());
+        for (size_t i = 0; i < source.size(); i++) source[i] = pcm[i] / 32768.0f;
+    }
+
+    // 線形補間で周波数とチャンネル数を合わせる
+    const auto sourceFrames = source.size() / info.chans;
+    if (!sourceFrames) return -1;
+    const auto ratio = double(info.freq) / frequency;
+    const auto frames = size_t(ceil(sourceFrames / ratio));
+    vector<float> result(frames * channels);
+    for (size_t i = 0; i < frames; i++) {
+        const auto position = i * ratio;
+        const auto index = min(size_t(position), sourceFrames - 1);
+        const auto next = min(index + 1, sourceFrames - 1);
+        const auto t = float(position - index);
+        for (auto c = 0; c < channels; c++) {
+            const auto sc = min(c, int(info.chans) - 1);
+            const auto value = source[index * info.chans + sc] * (1 - t) + source[next * info.chans + sc] * t;
+            result[i * channels + c] = value * info.volume;
+        }
+    }
+    return AddWaveform(result);
+}
+
+bool KeysoundScheduler::Start()
+{
+    if (hStream) return true;
+    hStream = BASS_StreamCreate(frequency, channels, BASS_SAMPLE_FLOAT, &KeysoundScheduler::StreamProc, this);
+    if (!hStream) return false;
+    // 先読みバッファを持たせず、デバイスの更新ごとに合成させる
+    BASS_ChannelSetAttribute(hStream, BASS_ATTRIB_BUFFER, 0);
+    // 合成はデバイスのバッファの分だけ先行して、更新周期ごとにまとめて行われる
+    const auto updatePeriod = BASS_GetConfig(BASS_CONFIG_UPDATEPERIOD);
+    const auto deviceBuffer = BASS_GetConfig(BASS_CONFIG_DEV_BUFFER);
+    scheduleAhead = 0;
+    if (updatePeriod != DWORD(-1)) scheduleAhead += updatePeriod / 1000.0;
+    if (deviceBuffer != DWORD(-1)) scheduleAhead += deviceBuffer / 1000.0;
+    return !!BASS_ChannelPlay(hStream, FALSE);
+}
+
+void KeysoundScheduler::Stop()
+{
+    if (!hStream) return;
+    BASS_StreamFree(hStream);
+    hStream = 0;
+    scheduleAhead = 0;
+}
+
+DWORD CALLBACK KeysoundScheduler::StreamProc(HSTREAM handle, void *buffer, const DWORD length, void *user)
+{
+    const auto scheduler = static_cast<KeysoundScheduler*>(user);
+    scheduler->Render(static_cast<float*>(buffer), length / (sizeof(float) * scheduler->channels));
+    return length;
+}
+
+int64_t KeysoundScheduler::GetPlayingFrame() const
+{
+    if (!hStream) return renderedFrames;
+    const auto position = BASS_ChannelGetPosition(hStream, BASS_POS_BYTE);
+    if (position == QWORD(-1)) return renderedFrames;
+    return int64_t(position / (sizeof(float) * channels));
+}
+
+void KeysoundScheduler::Synchronize(const double chartTime)
+{
+    const auto frame = GetPlayingFrame();
+    if (anchored) {
+        const auto expected = anchorTime + double(frame - anchorFrame) / frequency;
+        if (fabs(expected - chartTime) <= SynchronizeTolerance) return;
+    }
+    Synchronize(chartTime, frame);
+}
+
+void KeysoundScheduler::Synchronize(const double chartTime, const int64_t frame)
+{
+    anchorTime = chartTime;
+    anchorFrame = frame;
+    anchored = true;
+}
+
+int64_t KeysoundScheduler::GetFrameAt(const double chartTime) const
+{
+    return anchorFrame + llround((chartTime - leadTime - anchorTime) * frequency);
+}
+
+bool KeysoundScheduler::Schedule(const int sound, const double chartTime)
+{
+    if (!anchored || sound < 0 || sound >= int(waveforms.size())) return false;
+    lock_guard<mutex> lock(voiceMutex);
+    pendingVoices.push_back({ uint32_t(sound), GetFrameAt(chartTime), 0 });
+    return true;
+}
+
+void KeysoundScheduler::Clear()
+{
+    {
+        lock_guard<mutex> lock(voiceMutex);
+        pendingVoices.clear();
+        clearRequested = true;
+    }
+    anchored = false;
+}
+
+void KeysoundScheduler::Render(float *buffer, const size_t frames)
+{
+    const int64_t start = renderedFrames;
+    const auto end = start + int64_t(frames);
+    {
+        lock_guard<mutex> lock(voiceMutex);
+        if (clearRequested) voices.clear();
+        clearRequested = false;
+        voices.insert(voices.end(), pendingVoices.begin(), pendingVoices.end());
+        pendingVoices.clear();
+    }
+
+    fill_n(buffer, frames * channels, 0.0f);
+    for (auto &voice : voices) {
+        if (voice.StartFrame >= end) continue;
+        const auto &waveform = waveforms[voice.Sound];
+        const auto total = waveform.size() / channels;
+        // 間に合わなかったものはバッファの頭から鳴らす
+        const auto begin = size_t(max(voice.StartFrame, start) - start);
+        const auto count = min(frames - begin, total - voice.Offset);
+        const auto source = waveform.data() + voice.Offset * channels;
+        const auto destination = buffer + begin * channels;
+        for (size_t i = 0; i < count * channels; i++) destination[i] += source[i];
+        voice.Offset += count;
+        voice.StartFrame = end;
+    }
+    voices.erase(remove_if(voices.begin(), voices.end(), [this](const Voice &voice) {
+        return voice.Offset >= waveforms[voice.Sound].size() / channels;
+    }), voices.end());
+    renderedFrames = end;
+}
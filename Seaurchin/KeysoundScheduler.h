@@ -0,0 +1,74 @@
+﻿#pragma once
+
+#include "SoundManager.h"
+
+// 曲中時刻を指定して効果音を鳴らすためのミキサー
+// 自前の BASS ストリームの中で合成するので、発音位置はサンプル単位で決まる
+// 曲中時刻と再生位置(フレーム)の対応は Synchronize で取り、leadTime だけ前倒しで鳴らす
+class KeysoundScheduler final {
+private:
+    struct Voice {
+        uint32_t Sound;
+        int64_t StartFrame;
+        size_t Offset;
+    };
+
+    const int frequency;
+    const int channels;
+    const double leadTime;
+    HSTREAM hStream = 0;
+    double scheduleAhead = 0;
+    std::vector<std::vector<float>> waveforms;      // インターリーブ済み、Start 前に登録しておく
+
+    std::mutex voiceMutex;
+    std::vector<Voice> pendingVoices;
+    bool clearRequested = false;
+    std::vector<Voice> voices;                      // 合成スレッドだけが触る
+    std::atomic<int64_t> renderedFrames { 0 };
+
+    bool anchored = false;
+    double anchorTime = 0;
+    int64_t anchorFrame = 0;
+
+    static DWORD CALLBACK StreamProc(HSTREAM handle, void *buffer, DWORD length, void *user);
+
+public:
+    // 予約は描画フレームごとにしか回らないので、先読みにはその間隔の分も足しておく
+    static constexpr double FrameMargin = 0.035;
+
+    KeysoundScheduler(int frequency, int channels, double leadTime);
+    ~KeysoundScheduler();
+
+    // 登録した番号を返す
+    int AddWaveform(const std::vector<float> &frames);
+    int AddSample(const SoundSample *sample);
+
+    bool Start();
+    void Stop();
+
+    // 今聞こえているはずのフレーム (Start 前なら合成済みのフレーム数)
+    int64_t GetPlayingFrame() const;
+    int64_t GetRenderedFrames() const { return renderedFrames; }
+    // 今のフレームが曲中時刻 chartTime にあたるとする 小さなずれは無視して対応を保つ
+    void Synchronize(double chartTime);
+    void Synchronize(double chartTime, int64_t frame);
+    bool IsSynchronized() const { return anchored; }
+    int64_t GetFrameAt(double chartTime) const;
+
+    bool Schedule(int sound, double chartTime);
+    // 発音位置どおりに鳴らすには、この秒数より前に Schedule しておく必要がある
+    // これより遅れた予約は、次に合成するバッファの頭に寄せられる
+    double GetScheduleAhead() const { return scheduleAhead; }
+    // 時刻順に並べた音 (メトロノームの拍など) を、*next 番目から曲中時刻 limit までに来る分だけ schedule に渡す
+    // 渡した分だけ *next を進める
+    template<typename F>
+    static void ScheduleUntil(const std::vector<double> &times, size_t *next, const double limit, F &&schedule)
+    {
+        for (; *next < times.size() && times[*next] <= limit; ++*next) schedule(times[*next]);
+    }
+    // 予約を全て破棄し、次の Synchronize で対応を取り直す
+    void Clear();
+
+    // frames フレーム分を合成する 普段は StreamProc から呼ばれる
+    void Render(float *buffer, size_t frames);
+};
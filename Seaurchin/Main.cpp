@@ -8,14 +8,30 @@
 #include "MoverFunctionExpression.h"
 #include "Easing.h"
 #include "ScriptSpriteMover.h"
+#include "HeadlessRunner.h"
+#include "BenchmarkRunner.h"
+#include "VerificationRunner.h"
 
 using namespace std;
-using namespace std::chrono;
 
-void PreInitialize(HINSTANCE hInstance);
-bool Initialize();
+struct SimulationOptions {
+    bool Enabled = false;
+    wstring ScoreFile;
+    wstring ReplayFile;     // 空でなければリプレイを再生して判定を照合する
+    wstring OutputFile;     // 空なら Simulation.csv / Benchmark.csv
+    wstring AudioFile;      // 空なら音声は書き出さない
+    double FramesPerSecond = 1000.0;
+    int AutoPlay = 1;
+    int BenchmarkIterations = 0;    // 正なら譜面の代わりにベンチマークを回す
+    string VerificationTarget;      // 空でなければ譜面の代わりに検証を行う
+};
+
+SimulationOptions ParseSimulationOptions();
+void PreInitialize(HINSTANCE hInstance, bool headless);
+bool Initialize(const SimulationOptions &simulation);
 void Run();
-void Terminate();
+int RunSimulation(const SimulationOptions &options);
+void Terminate(bool headless);
 LRESULT CALLBACK CustomWindowProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam);
 
 shared_ptr<Setting> setting;
@@ -26,20 +42,66 @@ HWND hDxlibWnd;
 
 int WINAPI WinMain(const HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow)
 {
-    PreInitialize(hInstance);
-    if (!Initialize()) {
+    const auto simulation = ParseSimulationOptions();
+    PreInitialize(hInstance, simulation.Enabled);
+    if (!Initialize(simulation)) {
         logger->LogError(u8"初期化処理に失敗しました。強制終了します。");
-        Terminate();
+        Terminate(simulation.Enabled);
         return -1;
     }
 
-    Run();
+    auto exitCode = 0;
+    if (simulation.Enabled) {
+        exitCode = RunSimulation(simulation);
+    } else {
+        Run();
+    }
 
-    Terminate();
-    return 0;
+    Terminate(simulation.Enabled);
+    return exitCode;
 }
 
-void PreInitialize(HINSTANCE hInstance)
+// -simulate <譜面> [-fps <仮想フレームレート>] [-autoplay <0|1|2>] [-out <結果ファイル>] [-wav <音声ファイル>]
+// -replay <リプレイ|リプレイのあるディレクトリ> [-simulate <譜面>] [-out <結果ファイル>] [-wav <音声ファイル>]
+// -benchmark <反復回数> [-out <結果ファイル>]
+// -verify <検証項目|all>
+SimulationOptions ParseSimulationOptions()
+{
+    SimulationOptions options;
+    auto argc = 0;
+    const auto argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    if (!argv) return options;
+
+    for (auto i = 1; i + 1 < argc; i += 2) {
+        const wstring key = argv[i];
+        const wstring value = argv[i + 1];
+        if (key == L"-simulate") {
+            options.Enabled = true;
+            options.ScoreFile = value;
+        } else if (key == L"-fps") {
+            options.FramesPerSecond = _wtof(value.c_str());
+        } else if (key == L"-autoplay") {
+            options.AutoPlay = _wtoi(value.c_str());
+        } else if (key == L"-out") {
+            options.OutputFile = value;
+        } else if (key == L"-wav") {
+            options.AudioFile = value;
+        } else if (key == L"-replay") {
+            options.Enabled = true;
+            options.ReplayFile = value;
+        } else if (key == L"-benchmark") {
+            options.Enabled = true;
+            options.BenchmarkIterations = _wtoi(value.c_str());
+        } else if (key == L"-verify") {
+            options.Enabled = true;
+            options.VerificationTarget = ConvertUnicodeToUTF8(value);
+        }
+    }
+    LocalFree(argv);
+    return options;
+}
+
+void PreInitialize(HINSTANCE hInstance, const bool headless)
 {
     logger = make_shared<Logger>();
     logger->Initialize();
@@ -59,24 +121,28 @@ void PreInitialize(HINSTANCE hInstance)
     SetUseFPUPreserveFlag(TRUE);
     SetGraphMode(SU_RES_WIDTH, SU_RES_HEIGHT, 32);
     SetFullSceneAntiAliasingMode(2, 2);
+    // ヘッドレス実行ではウィンドウ(と描画機能)を作らない
+    if (headless) SetNotWinFlag(TRUE);
 
     logger->LogDebug(u8"PreInitialize完了");
 }
 
-bool Initialize()
+bool Initialize(const SimulationOptions &simulation)
 {
+    const auto headless = simulation.Enabled;
     logger->LogDebug(u8"DxLib初期化開始");
     if (DxLib_Init() == -1) abort();
     logger->LogInfo(u8"DxLib初期化OK");
 
-    //WndProc差し替え
-    hDxlibWnd = GetMainWindowHandle();
-    dxlibWndProc = WNDPROC(GetWindowLong(hDxlibWnd, GWL_WNDPROC));
-    SetWindowLong(hDxlibWnd, GWL_WNDPROC, LONG(CustomWindowProc));
-    //D3D設定
-    SetUseZBuffer3D(TRUE);
-    SetWriteZBuffer3D(TRUE);
-    SetDrawScreen(DX_SCREEN_BACK);
+    if (!headless) {
+        //WndProc差し替え
+        hDxlibWnd = GetMainWindowHandle();
+        dxlibWndProc = WNDPROC(GetWindowLong(hDxlibWnd, GWL_WNDPROC));
+        SetWindowLong(hDxlibWnd, GWL_WNDPROC, LONG(CustomWindowProc));
+        //D3D設定
+        SetUseZBuffer3D(TRUE);
+        SetWriteZBuffer3D(TRUE);
+    }
 
     MoverFunctionExpressionManager::Initialize();
     if (!easing::RegisterDefaultMoverFunctionExpressions()) {
@@ -84,7 +150,10 @@ bool Initialize()
         return false;
     }
 
-    manager = make_unique<ExecutionManager>(setting);
+    auto audio = headless && !simulation.AudioFile.empty()
+        ? AudioBackend::CreateWaveFile((boost::filesystem::path(Setting::GetRootDirectory()) / simulation.AudioFile).wstring())
+        : nullptr;
+    manager = make_unique<ExecutionManager>(setting, headless, move(audio));
     manager->Initialize();
 
     SSpriteMover::StrTypeId = manager->GetScriptInterfaceUnsafe()->GetEngine()->GetTypeIdByDecl("string");
@@ -108,23 +177,45 @@ void Run()
     manager->AddScene(static_pointer_cast<Scene>(make_shared<SceneDebug>()));
 
 
-    auto start = high_resolution_clock::now();
-    auto pstart = start;
-    while (ProcessMessage() != -1) {
-        pstart = start;
-        start = high_resolution_clock::now();
-        const auto delta = duration_cast<nanoseconds>(start - pstart).count() / 1000000000.0;
-        manager->Tick(delta);
-        manager->Draw();
+    while (ProcessMessage() != -1) manager->RunFrame();
+
+    const auto loop = manager->GetGameLoop();
+    const auto &frameTimes = loop->GetFrameTimes();
+    spdlog::get("main")->info(u8"{0}フレーム {1}Tick (持ち越し{2}) 直近のフレーム時間 平均{3:.2f}ms 99%:{4:.2f}ms 最大{5:.2f}ms",
+        loop->GetFrameCount(), loop->GetTickCount(), loop->GetDeferredTickCount(),
+        frameTimes.GetAverage() * 1000, frameTimes.GetPercentile(0.99) * 1000, frameTimes.GetMax() * 1000);
+}
+
+int RunSimulation(const SimulationOptions &options)
+{
+    logger->LogInfo(u8"シミュレーション開始");
+    manager->SetData<int>("AutoPlay", options.AutoPlay);
+    const auto root = boost::filesystem::path(Setting::GetRootDirectory());
+    if (!options.VerificationTarget.empty()) {
+        VerificationRunner runner(manager.get());
+        return runner.Run(options.VerificationTarget);
+    }
+    if (options.BenchmarkIterations) {
+        BenchmarkRunner runner(manager.get());
+        return runner.Run(options.BenchmarkIterations, root / (options.OutputFile.empty() ? L"Benchmark.csv" : options.OutputFile));
+    }
+    HeadlessRunner runner(manager.get());
+    if (!options.ReplayFile.empty()) {
+        if (is_directory(boost::filesystem::path(options.ReplayFile))) {
+            return runner.RunReplays(options.ReplayFile, root / (options.OutputFile.empty() ? L"Replay.csv" : options.OutputFile));
+        }
+        return runner.RunReplay(options.ReplayFile, options.ScoreFile, root / (options.OutputFile.empty() ? L"Replay.csv" : options.OutputFile));
     }
+    return runner.Run(options.ScoreFile, options.FramesPerSecond, root / (options.OutputFile.empty() ? L"Simulation.csv" : options.OutputFile));
 }
 
-void Terminate()
+void Terminate(const bool headless)
 {
     if(manager) manager->Shutdown();
     manager.reset(nullptr);
     MoverFunctionExpressionManager::Finalize();
-    if(setting) setting->Save();
+    // ヘッドレス実行で読み替えた設定や補った既定値は保存しない
+    if(setting && !headless) setting->Save();
     if(setting) setting.reset();
     DxLib_End();
     if(logger) logger->Terminate();
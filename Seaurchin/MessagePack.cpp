@@ -0,0 +1,231 @@
+﻿#include "MessagePack.h"
+
+using namespace std;
+
+// MessagePackWriter ------------------------
+void MessagePackWriter::WriteBigEndian(const uint64_t value, const int bytes)
+{
+    for (auto i = bytes - 1; i >= 0; --i) buffer.push_back(char((value >> (i * 8)) & 0xff));
+}
+
+void MessagePackWriter::WriteInteger(const int64_t value)
+{
+    if (value >= 0) {
+        WriteUnsigned(uint64_t(value));
+    } else if (value >= -32) {
+        buffer.push_back(char(value));
+    } else if (value >= numeric_limits<int8_t>::min()) {
+        buffer.push_back(char(0xd0));
+        WriteBigEndian(uint64_t(value), 1);
+    } else if (value >= numeric_limits<int16_t>::min()) {
+        buffer.push_back(char(0xd1));
+        WriteBigEndian(uint64_t(value), 2);
+    } else if (value >= numeric_limits<int32_t>::min()) {
+        buffer.push_back(char(0xd2));
+        WriteBigEndian(uint64_t(value), 4);
+    } else {
+        buffer.push_back(char(0xd3));
+        WriteBigEndian(uint64_t(value), 8);
+    }
+}
+
+void MessagePackWriter::WriteUnsigned(const uint64_t value)
+{
+    if (value < 0x80) {
+        buffer.push_back(char(value));
+    } else if (value <= numeric_limits<uint8_t>::max()) {
+        buffer.push_back(char(0xcc));
+        WriteBigEndian(value, 1);
+    } else if (value <= numeric_limits<uint16_t>::max()) {
+        buffer.push_back(char(0xcd));
+        WriteBigEndian(value, 2);
+    } else if (value <= numeric_limits<uint32_t>::max()) {
+        buffer.push_back(char(0xce));
+        WriteBigEndian(value, 4);
+    } else {
+        buffer.push_back(char(0xcf));
+        WriteBigEndian(value, 8);
+    }
+}
+
+void MessagePackWriter::WriteDouble(const double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    buffer.push_back(char(0xcb));
+    WriteBigEndian(bits, 8);
+}
+
+void MessagePackWriter::WriteString(const string &value)
+{
+    const auto size = value.size();
+    if (size < 32) {
+        buffer.push_back(char(0xa0 | size));
+    } else if (size <= numeric_limits<uint8_t>::max()) {
+        buffer.push_back(char(0xd9));
+        WriteBigEndian(size, 1);
+    } else if (size <= numeric_limits<uint16_t>::max()) {
+        buffer.push_back(char(0xda));
+        WriteBigEndian(size, 2);
+    } else {
+        buffer.push_back(char(0xdb));
+        WriteBigEndian(size, 4);
+    }
+    buffer.append(value);
+}
+
+void MessagePackWriter::WriteArrayHeader(const uint32_t count)
+{
+    if (count < 16) {
+        buffer.push_back(char(0x90 | count));
+    } else if (count <= numeric_limits<uint16_t>::max()) {
+        buffer.push_back(char(0xdc));
+        WriteBigEndian(count, 2);
+    } else {
+        buffer.push_back(char(0xdd));
+        WriteBigEndian(count, 4);
+    }
+}
+
+void MessagePackWriter::WriteMapHeader(const uint32_t count)
+{
+    if (count < 16) {
+        buffer.push_back(char(0x80 | count));
+    } else if (count <= numeric_limits<uint16_t>::max()) {
+        buffer.push_back(char(0xde));
+        WriteBigEndian(count, 2);
+    } else {
+        buffer.push_back(char(0xdf));
+        WriteBigEndian(count, 4);
+    }
+}
+
+// MessagePackReader ------------------------
+MessagePackReader::MessagePackReader(const string &buffer)
+    : cursor(reinterpret_cast<const uint8_t*>(buffer.data()))
+    , end(reinterpret_cast<const uint8_t*>(buffer.data()) + buffer.size())
+{}
+
+bool MessagePackReader::Fail()
+{
+    failed = true;
+    cursor = end;
+    return false;
+}
+
+bool MessagePackReader::ReadBigEndian(const int bytes, uint64_t &value)
+{
+    if (end - cursor < bytes) return Fail();
+    value = 0;
+    for (auto i = 0; i < bytes; ++i) value = (value << 8) | *cursor++;
+    return true;
+}
+
+bool MessagePackReader::ReadInteger(int64_t &value)
+{
+    if (failed || cursor == end) return Fail();
+    const auto code = *cursor;
+    uint64_t raw;
+    switch (code) {
+        case 0xd0: ++cursor; if (!ReadBigEndian(1, raw)) return false; value = int8_t(raw); return true;
+        case 0xd1: ++cursor; if (!ReadBigEndian(2, raw)) return false; value = int16_t(raw); return true;
+        case 0xd2: ++cursor; if (!ReadBigEndian(4, raw)) return false; value = int32_t(raw); return true;
+        case 0xd3: ++cursor; if (!ReadBigEndian(8, raw)) return false; value = int64_t(raw); return true;
+        default: break;
+    }
+    if (code >= 0xe0) {
+        ++cursor;
+        value = int8_t(code);
+        return true;
+    }
+    if (!ReadUnsigned(raw)) return false;
+    if (raw > uint64_t(numeric_limits<int64_t>::max())) return Fail();
+    value = int64_t(raw);
+    return true;
+}
+
+bool MessagePackReader::ReadUnsigned(uint64_t &value)
+{
+    if (failed || cursor == end) return Fail();
+    const auto code = *cursor++;
+    if (code < 0x80) {
+        value = code;
+        return true;
+    }
+    switch (code) {
+        case 0xcc: return ReadBigEndian(1, value);
+        case 0xcd: return ReadBigEndian(2, value);
+        case 0xce: return ReadBigEndian(4, value);
+        case 0xcf: return ReadBigEndian(8, value);
+        default: return Fail();
+    }
+}
+
+bool MessagePackReader::ReadDouble(double &value)
+{
+    if (failed || cursor == end) return Fail();
+    const auto code = *cursor++;
+    uint64_t raw;
+    if (code == 0xcb) {
+        if (!ReadBigEndian(8, raw)) return false;
+        memcpy(&value, &raw, sizeof(value));
+        return true;
+    }
+    if (code == 0xca) {
+        if (!ReadBigEndian(4, raw)) return false;
+        const auto bits = uint32_t(raw);
+        float single;
+        memcpy(&single, &bits, sizeof(single));
+        value = single;
+        return true;
+    }
+    return Fail();
+}
+
+bool MessagePackReader::ReadString(string &value)
+{
+    if (failed || cursor == end) return Fail();
+    const auto code = *cursor++;
+    uint64_t size;
+    if ((code & 0xe0) == 0xa0) {
+        size = code & 0x1f;
+    } else if (code == 0xd9 || code == 0xda || code == 0xdb) {
+        if (!ReadBigEndian(1 << (code - 0xd9), size)) return false;
+    } else {
+        return Fail();
+    }
+    if (size > uint64_t(end - cursor)) return Fail();
+    value.assign(reinterpret_cast<const char*>(cursor), size_t(size));
+    cursor += size;
+    return true;
+}
+
+bool MessagePackReader::ReadContainerHeader(const uint8_t fixBase, const uint8_t fixMask, const uint8_t code16, const uint8_t code32, const uint32_t elementBytes, uint32_t &count)
+{
+    if (failed || cursor == end) return Fail();
+    const auto code = *cursor++;
+    uint64_t raw;
+    if ((code & ~fixMask) == fixBase) {
+        raw = code & fixMask;
+    } else if (code == code16) {
+        if (!ReadBigEndian(2, raw)) return false;
+    } else if (code == code32) {
+        if (!ReadBigEndian(4, raw)) return false;
+    } else {
+        return Fail();
+    }
+    // 要素は最低でも1バイトあるので、残りより多い要素数は壊れている
+    if (raw * elementBytes > uint64_t(end - cursor)) return Fail();
+    count = uint32_t(raw);
+    return true;
+}
+
+bool MessagePackReader::ReadArrayHeader(uint32_t &count)
+{
+    return ReadContainerHeader(0x90, 0x0f, 0xdc, 0xdd, 1, count);
+}
+
+bool MessagePackReader::ReadMapHeader(uint32_t &count)
+{
+    return ReadContainerHeader(0x80, 0x0f, 0xde, 0xdf, 2, count);
+}
@@ -0,0 +1,43 @@
+﻿#pragma once
+
+// MessagePack の読み書き (musics.mp 用の最小限)
+// 扱うのは 整数/浮動小数点数/str/array/map だけで、bin と ext は使わない
+class MessagePackWriter final {
+private:
+    std::string buffer;
+
+    void WriteBigEndian(uint64_t value, int bytes);
+
+public:
+    void WriteInteger(int64_t value);
+    void WriteUnsigned(uint64_t value);
+    void WriteDouble(double value);
+    void WriteString(const std::string &value);
+    void WriteArrayHeader(uint32_t count);
+    void WriteMapHeader(uint32_t count);
+
+    const std::string& GetBuffer() const { return buffer; }
+};
+
+// 読めなかったり型が違ったりすれば false を返し、以降の読み込みもすべて失敗させる
+// str の長さと array/map の要素数は、残りのバイト数に収まるかを確かめてから返す
+class MessagePackReader final {
+private:
+    const uint8_t *cursor;
+    const uint8_t *end;
+    bool failed = false;
+
+    bool Fail();
+    bool ReadBigEndian(int bytes, uint64_t &value);
+    bool ReadContainerHeader(uint8_t fixBase, uint8_t fixMask, uint8_t code16, uint8_t code32, uint32_t elementBytes, uint32_t &count);
+
+public:
+    explicit MessagePackReader(const std::string &buffer);
+
+    bool ReadInteger(int64_t &value);
+    bool ReadUnsigned(uint64_t &value);
+    bool ReadDouble(double &value);
+    bool ReadString(std::string &value);
+    bool ReadArrayHeader(uint32_t &count);
+    bool ReadMapHeader(uint32_t &count);
+};
@@ -103,3 +103,60 @@ void SplitProps(const string &source, PropList &vec)
     if (pos == string::npos) return;
     vec.push_back(make_tuple(pset.substr(0, pos), pset.substr(pos + 1)));
 }
+
+uint32_t CalculateFileCrc32(const wstring &fileName)
+{
+    ifstream stream(fileName, ios::in | ios::binary);
+    char buffer[4096];
+    boost::crc_32_type crc;
+    while (stream.read(buffer, sizeof(buffer)) || stream.gcount()) crc.process_bytes(buffer, SU_TO_UINT32(stream.gcount()));
+    return crc.checksum();
+}
+
+void WriteBinaryString(ostream &stream, const string &value)
+{
+    WriteBinaryValue(stream, SU_TO_UINT32(value.size()));
+    stream.write(value.data(), value.size());
+}
+
+bool ReadBinaryString(istream &stream, string &value)
+{
+    uint32_t size;
+    if (!ReadBinaryCount(stream, size, 1)) return false;
+    value.resize(size);
+    if (size) stream.read(&value[0], size);
+    return bool(stream);
+}
+
+streamoff GetRemainingBytes(istream &stream)
+{
+    const auto position = stream.tellg();
+    if (position < 0) return 0;
+    stream.seekg(0, ios::end);
+    const auto end = stream.tellg();
+    stream.seekg(position);
+    return end < position ? 0 : end - position;
+}
+
+bool WriteFileAtomically(const wstring &fileName, const function<bool(ostream&)> &write)
+{
+    const boost::filesystem::path file(fileName);
+    auto temporary = file;
+    temporary += L".tmp";
+    boost::system::error_code ec;
+    {
+        ofstream stream(temporary.wstring(), ios::out | ios::binary | ios::trunc);
+        if (!stream) return false;
+        if (!write(stream) || !stream.flush()) {
+            stream.close();
+            boost::filesystem::remove(temporary, ec);
+            return false;
+        }
+    }
+    boost::filesystem::rename(temporary, file, ec);
+    if (ec) {
+        boost::filesystem::remove(temporary, ec);
+        return false;
+    }
+    return true;
+}
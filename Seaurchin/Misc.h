@@ -1,7 +1,9 @@
 ﻿#pragma once
 
-#define BEGIN_DRAW_TRANSACTION(h) SetDrawScreen(h)
-#define FINISH_DRAW_TRANSACTION SetDrawScreen(DX_SCREEN_BACK);
+#include "RenderDevice.h"
+
+#define BEGIN_DRAW_TRANSACTION(h) RenderDevice::GetCurrent()->SetRenderTarget(h)
+#define FINISH_DRAW_TRANSACTION RenderDevice::GetCurrent()->SetRenderTarget(RenderDevice::BackBuffer);
 
 // AngelScriptに登録した値型用の汎用処理アレ
 
@@ -39,6 +41,40 @@ uint32_t ConvertHexatridecimal(const std::string &input);
 float ConvertFloat(const std::string &input);
 bool ConvertBoolean(const std::string &input);
 void SplitProps(const std::string &source, PropList &vec);
+uint32_t CalculateFileCrc32(const std::wstring &fileName);
+
+// キャッシュファイル用の単純なバイナリ読み書き
+template<typename T>
+void WriteBinaryValue(std::ostream &stream, const T &value)
+{
+    stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+bool ReadBinaryValue(std::istream &stream, T &value)
+{
+    stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+    return bool(stream);
+}
+
+void WriteBinaryString(std::ostream &stream, const std::string &value);
+// 長さが残りのバイト数を超えていれば確保せずに失敗する
+bool ReadBinaryString(std::istream &stream, std::string &value);
+// 読み込み位置からファイル末尾までのバイト数 シークできなければ0
+std::streamoff GetRemainingBytes(std::istream &stream);
+
+// 要素数を読み、1要素が minElementBytes バイト以上として残りに収まるかを確かめる
+// 壊れたファイルの要素数をそのまま resize/reserve に渡さないよう、確保の前に使う
+template<typename T>
+bool ReadBinaryCount(std::istream &stream, T &count, const size_t minElementBytes)
+{
+    if (!ReadBinaryValue(stream, count)) return false;
+    return uint64_t(count) * minElementBytes <= uint64_t(GetRemainingBytes(stream));
+}
+
+// fileName の隣の一時ファイルに write で書き出し、書き切れたときだけ fileName に置き換える
+// 途中で落ちても書きかけのファイルを fileName に残さない
+bool WriteFileAtomically(const std::wstring &fileName, const std::function<bool(std::ostream&)> &write);
 
 #define SU_TO_INT8(value)   static_cast<int8_t>((value))
 #define SU_TO_UINT8(value)  static_cast<uint8_t>((value))
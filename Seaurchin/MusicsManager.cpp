@@ -2,6 +2,7 @@
 #include "ExecutionManager.h"
 #include "Config.h"
 #include "Misc.h"
+#include "MessagePack.h"
 
 using namespace std;
 using namespace boost;
@@ -10,12 +11,21 @@ using namespace xpressive;
 
 typedef std::lock_guard<std::mutex> LockGuard;
 
+namespace
+{
+    // musics.mp は MessagePack で [版, { キー: エントリの配列 }]
+    const uint32_t musicCacheVersion = 2;               // 形式を変えたら上げる、違えば読み捨てる
+    const uint32_t musicCacheFields = 15;               // エントリの配列の要素数 MusicCacheEntry の並び
+}
+
 //path sepath = Setting::GetRootDirectory() / SU_DATA_DIR / SU_SKIN_DIR;
 
 MusicsManager::MusicsManager(ExecutionManager *exm)
 {
     manager = exm;
-    analyzer = make_unique<SusAnalyzer>(192);
+    categories = make_shared<const MusicLibrary>();
+    musicDirectory = Setting::GetRootDirectory() / SU_MUSIC_DIR;
+    musicCacheFile = Setting::GetRootDirectory() / SU_DATA_DIR / SU_CACHE_DIR / SU_CACHE_MUSIC_FILE;
 }
 
 MusicsManager::~MusicsManager()
@@ -26,7 +36,11 @@ void MusicsManager::Initialize()
 
 void MusicsManager::Reload(const bool async)
 {
-    if (IsReloading()) return;
+    {
+        LockGuard lock(flagMutex);
+        if (loading) return;
+        loading = true;
+    }
 
     if (async) {
         thread loadthread([this] { CreateMusicCache(); });
@@ -36,33 +50,53 @@ void MusicsManager::Reload(const bool async)
     }
 }
 
+void MusicsManager::SetLibraryLocation(const path &music, const path &cacheFile)
+{
+    musicDirectory = music;
+    musicCacheFile = cacheFile;
+    musicCacheLoaded = false;
+}
+
 bool MusicsManager::IsReloading()
 {
     LockGuard lock(flagMutex);
     return loading;
 }
 
+vector<string> MusicsManager::GetAnalyzedKeys()
+{
+    LockGuard lock(flagMutex);
+    return analyzedKeys;
+}
+
 path MusicsManager::GetSelectedScorePath()
 {
     const auto ci = manager->GetData<int>("Selected:Category");
     const auto mi = manager->GetData<int>("Selected:Music");
     const auto vi = manager->GetData<int>("Selected:Variant");
-    auto result = Setting::GetRootDirectory() / SU_MUSIC_DIR / ConvertUTF8ToUnicode(categories[ci]->GetName());
-    result /= categories[ci]->Musics[mi]->Scores[vi]->Path;
+    const auto library = GetCategories();
+    auto result = musicDirectory / ConvertUTF8ToUnicode((*library)[ci]->GetName());
+    result /= (*library)[ci]->Musics[mi]->Scores[vi]->Path;
     return result;
 }
 
 void MusicsManager::CreateMusicCache()
 {
-    {
-        LockGuard lock(flagMutex);
-        loading = true;
-    }
-
-    categories.clear();
-
-    const auto mlpath = Setting::GetRootDirectory() / SU_MUSIC_DIR;
-    for (const auto& fdata : make_iterator_range(directory_iterator(mlpath), {})) {
+    // loading は Reload で立てておく
+    struct ScanTarget {
+        std::shared_ptr<CategoryInfo> Category;
+        path MusicDirectory;
+        path File;
+        string Key;
+    };
+
+    auto log = spdlog::get("main");
+    if (!musicCacheLoaded) LoadMusicCacheFile();
+
+    // ディレクトリ走査は軽いので先に全部済ませる
+    auto library = make_shared<MusicLibrary>();
+    vector<ScanTarget> targets;
+    for (const auto& fdata : make_iterator_range(directory_iterator(musicDirectory), {})) {
         if (!is_directory(fdata)) continue;
 
         auto category = make_shared<CategoryInfo>(fdata);
@@ -71,39 +105,229 @@ void MusicsManager::CreateMusicCache()
             for (const auto& file : make_iterator_range(directory_iterator(mdir), {})) {
                 if (is_directory(file)) continue;
                 if (file.path().extension() != ".sus") continue;     //これ大文字どうすんの
-                analyzer->Reset();
-                analyzer->LoadFromFile(file.path().wstring(), true);
-                auto music = find_if(category->Musics.begin(), category->Musics.end(), [&](const std::shared_ptr<MusicMetaInfo> info) {
-                    return info->SongId == analyzer->SharedMetaData.USongId;
-                });
-                if (music == category->Musics.end()) {
-                    music = category->Musics.insert(category->Musics.begin(), make_shared<MusicMetaInfo>());
-                    (*music)->SongId = analyzer->SharedMetaData.USongId;
-                    (*music)->Name = analyzer->SharedMetaData.UTitle;
-                    (*music)->Artist = analyzer->SharedMetaData.UArtist;
-                    (*music)->JacketPath = mdir.path().filename() / ConvertUTF8ToUnicode(analyzer->SharedMetaData.UJacketFileName);
-                }
-                auto score = make_shared<MusicScoreInfo>();
-                score->Path = mdir.path().filename() / file.path().filename();
-                score->BackgroundPath = ConvertUTF8ToUnicode(analyzer->SharedMetaData.UBackgroundFileName);
-                score->WavePath = ConvertUTF8ToUnicode(analyzer->SharedMetaData.UWaveFileName);
-                score->Designer = analyzer->SharedMetaData.UDesigner;
-                score->BpmToShow = analyzer->SharedMetaData.ShowBpm;
-                score->Difficulty = analyzer->SharedMetaData.DifficultyType;
-                score->DifficultyName = analyzer->SharedMetaData.UExtraDifficulty;
-                score->Level = analyzer->SharedMetaData.Level;
-                (*music)->Scores.push_back(score);
+                const auto key = ConvertUnicodeToUTF8((fdata.path().filename() / mdir.path().filename() / file.path().filename()).wstring());
+                targets.push_back({ category, mdir.path(), file.path(), key });
+            }
+        }
+        library->push_back(category);
+    }
+    scannedFileCount = 0;
+    totalFileCount = SU_TO_UINT32(targets.size());
+
+    // 譜面の解析はスレッドごとに SusAnalyzer を持たせて、空いたスレッドから次の譜面を取っていく
+    vector<MusicCacheEntry> entries(targets.size());
+    vector<uint8_t> analyzed(targets.size(), 0);
+    vector<uint8_t> missing(targets.size(), 0);
+    std::atomic<size_t> nextTarget { 0 };
+    std::atomic<bool> modified { false };
+    const auto scan = [&] {
+        SusAnalyzer analyzer(192);
+        for (auto i = nextTarget++; i < targets.size(); i = nextTarget++) {
+            const auto &target = targets[i];
+            auto &entry = entries[i];
+            boost::system::error_code ec;
+            entry.LastWriteTime = last_write_time(target.File, ec);
+            if (!ec) entry.FileSize = file_size(target.File, ec);
+            if (ec) {
+                // 走査してから消された譜面は無かったことにする
+                missing[i] = 1;
+                ++scannedFileCount;
+                continue;
+            }
+            if (RestoreMusicCache(target.Key, target.File, entry)) {
+                if (musicCache.find(target.Key)->second.LastWriteTime != entry.LastWriteTime) modified = true;
+            } else {
+                analyzer.LoadFromFile(target.File.wstring(), true);
+                const auto &meta = analyzer.SharedMetaData;
+                entry.SongId = meta.USongId;
+                entry.Title = meta.UTitle;
+                entry.Artist = meta.UArtist;
+                entry.JacketFileName = meta.UJacketFileName;
+                entry.BackgroundFileName = meta.UBackgroundFileName;
+                entry.WaveFileName = meta.UWaveFileName;
+                entry.Designer = meta.UDesigner;
+                entry.ExtraDifficulty = meta.UExtraDifficulty;
+                entry.ShowBpm = meta.ShowBpm;
+                entry.DifficultyType = meta.DifficultyType;
+                entry.Level = meta.Level;
+                analyzed[i] = 1;
+                modified = true;
             }
+            ++scannedFileCount;
+        }
+    };
+    const auto workerCount = min(max(thread::hardware_concurrency(), 1u), max(totalFileCount.load(), 1u));
+    vector<thread> workers;
+    for (auto i = 1u; i < workerCount; i++) workers.emplace_back(scan);
+    scan();
+    for (auto &worker : workers) worker.join();
+
+    // 組み立ては走査順に行う 同じ SongId の譜面は1曲にまとめ、曲は後に見つかったものほど前に並べる
+    unordered_map<string, std::shared_ptr<MusicMetaInfo>> songIndex;
+    unordered_map<string, MusicCacheEntry> currentCache;
+    vector<string> keys;
+    for (auto i = 0u; i < targets.size(); i++) {
+        const auto &target = targets[i];
+        const auto &entry = entries[i];
+        if (i == 0 || targets[i - 1].Category != target.Category) songIndex.clear();
+        if (missing[i]) continue;
+
+        auto &music = songIndex[entry.SongId];
+        if (!music) {
+            music = make_shared<MusicMetaInfo>();
+            music->SongId = entry.SongId;
+            music->Name = entry.Title;
+            music->Artist = entry.Artist;
+            music->JacketPath = target.MusicDirectory.filename() / ConvertUTF8ToUnicode(entry.JacketFileName);
+            target.Category->Musics.push_back(music);
         }
-        categories.push_back(category);
+        auto score = make_shared<MusicScoreInfo>();
+        score->Path = target.MusicDirectory.filename() / target.File.filename();
+        score->BackgroundPath = ConvertUTF8ToUnicode(entry.BackgroundFileName);
+        score->WavePath = ConvertUTF8ToUnicode(entry.WaveFileName);
+        score->Designer = entry.Designer;
+        score->BpmToShow = entry.ShowBpm;
+        score->Difficulty = entry.DifficultyType;
+        score->DifficultyName = entry.ExtraDifficulty;
+        score->Level = entry.Level;
+        music->Scores.push_back(score);
+
+        currentCache[target.Key] = entry;
+        if (analyzed[i]) keys.push_back(target.Key);
     }
+    sort(keys.begin(), keys.end());
+    for (auto &category : *library) reverse(category->Musics.begin(), category->Musics.end());
+    atomic_store(&categories, std::shared_ptr<const MusicLibrary>(library));
+
+    // 消えた譜面があってもキャッシュは書き直す
+    if (currentCache.size() != musicCache.size()) modified = true;
+    musicCache = std::move(currentCache);
+    if (modified) SaveMusicCacheFile();
+    log->info(u8"譜面{0}件中{1}件を解析しました", musicCache.size(), keys.size());
 
     {
         LockGuard lock(flagMutex);
+        analyzedKeys = std::move(keys);
         loading = false;
     }
 }
 
+bool MusicsManager::RestoreMusicCache(const string &key, const path &file, MusicCacheEntry &entry) const
+{
+    // entry の更新日時とサイズは呼び出し側で読んである
+    const auto cached = musicCache.find(key);
+    if (cached != musicCache.end() && cached->second.LastWriteTime == entry.LastWriteTime && cached->second.FileSize == entry.FileSize) {
+        entry = cached->second;
+        return true;
+    }
+
+    // 更新日時だけ変わった場合は中身を比べる
+    entry.Hash = CalculateFileCrc32(file.wstring());
+    if (cached == musicCache.end() || cached->second.FileSize != entry.FileSize || cached->second.Hash != entry.Hash) return false;
+
+    const auto lastWriteTime = entry.LastWriteTime;
+    entry = cached->second;
+    entry.LastWriteTime = lastWriteTime;
+    return true;
+}
+
+void MusicsManager::LoadMusicCacheFile()
+{
+    auto log = spdlog::get("main");
+    musicCacheLoaded = true;
+    musicCache.clear();
+
+    std::ifstream stream(musicCacheFile.wstring(), ios::in | ios::binary);
+    if (!stream) return;
+    const string buffer((istreambuf_iterator<char>(stream)), istreambuf_iterator<char>());
+
+    // [版, { キー: [更新日時, サイズ, ハッシュ, SongId, ..., Level] }]
+    MessagePackReader reader(buffer);
+    uint32_t rootSize, count;
+    uint64_t version;
+    if (!reader.ReadArrayHeader(rootSize) || rootSize != 2 || !reader.ReadUnsigned(version)) {
+        log->warn(u8"譜面キャッシュが壊れているため作り直します");
+        return;
+    }
+    if (version != musicCacheVersion) {
+        log->info(u8"譜面キャッシュの形式が異なるため作り直します");
+        return;
+    }
+    if (!reader.ReadMapHeader(count)) {
+        log->warn(u8"譜面キャッシュが壊れているため作り直します");
+        return;
+    }
+
+    musicCache.reserve(count);
+    for (auto i = 0u; i < count; i++) {
+        string key;
+        MusicCacheEntry entry;
+        uint32_t fields;
+        uint64_t fileSize, hash, difficultyType, level;
+        const auto succeeded = reader.ReadString(key)
+            && reader.ReadArrayHeader(fields) && fields == musicCacheFields
+            && reader.ReadInteger(entry.LastWriteTime)
+            && reader.ReadUnsigned(fileSize)
+            && reader.ReadUnsigned(hash) && hash <= numeric_limits<uint32_t>::max()
+            && reader.ReadString(entry.SongId)
+            && reader.ReadString(entry.Title)
+            && reader.ReadString(entry.Artist)
+            && reader.ReadString(entry.JacketFileName)
+            && reader.ReadString(entry.BackgroundFileName)
+            && reader.ReadString(entry.WaveFileName)
+            && reader.ReadString(entry.Designer)
+            && reader.ReadString(entry.ExtraDifficulty)
+            && reader.ReadDouble(entry.ShowBpm)
+            && reader.ReadUnsigned(difficultyType) && difficultyType <= numeric_limits<uint32_t>::max()
+            && reader.ReadUnsigned(level) && level <= numeric_limits<uint32_t>::max();
+        if (!succeeded) {
+            log->warn(u8"譜面キャッシュが壊れているため作り直します");
+            musicCache.clear();
+            return;
+        }
+        entry.FileSize = fileSize;
+        entry.Hash = uint32_t(hash);
+        entry.DifficultyType = uint32_t(difficultyType);
+        entry.Level = uint32_t(level);
+        musicCache[key] = std::move(entry);
+    }
+}
+
+void MusicsManager::SaveMusicCacheFile() const
+{
+    boost::system::error_code ec;
+    create_directories(musicCacheFile.parent_path(), ec);
+
+    MessagePackWriter writer;
+    writer.WriteArrayHeader(2);
+    writer.WriteUnsigned(musicCacheVersion);
+    writer.WriteMapHeader(SU_TO_UINT32(musicCache.size()));
+    for (const auto &cache : musicCache) {
+        const auto &entry = cache.second;
+        writer.WriteString(cache.first);
+        writer.WriteArrayHeader(musicCacheFields);
+        writer.WriteInteger(entry.LastWriteTime);
+        writer.WriteUnsigned(entry.FileSize);
+        writer.WriteUnsigned(entry.Hash);
+        writer.WriteString(entry.SongId);
+        writer.WriteString(entry.Title);
+        writer.WriteString(entry.Artist);
+        writer.WriteString(entry.JacketFileName);
+        writer.WriteString(entry.BackgroundFileName);
+        writer.WriteString(entry.WaveFileName);
+        writer.WriteString(entry.Designer);
+        writer.WriteString(entry.ExtraDifficulty);
+        writer.WriteDouble(entry.ShowBpm);
+        writer.WriteUnsigned(entry.DifficultyType);
+        writer.WriteUnsigned(entry.Level);
+    }
+
+    std::ofstream stream(musicCacheFile.wstring(), ios::out | ios::binary | ios::trunc);
+    if (!stream) return;
+    const auto &buffer = writer.GetBuffer();
+    stream.write(buffer.data(), buffer.size());
+}
+
 MusicSelectionCursor *MusicsManager::CreateMusicSelectionCursor()
 {
     auto result = new MusicSelectionCursor(this);
@@ -132,29 +356,34 @@ void CategoryInfo::Reload(bool recreateCache) const
 
 //MusicSelectionCursor ------------------------------------------
 
+// 再読み込みで一覧が差し替わっても同じ呼び出しの中では1つの一覧だけを見るようにする
 std::shared_ptr<CategoryInfo> MusicSelectionCursor::GetCategoryAt(const int32_t relative) const
 {
-    const auto categorySize = GetCategorySize();
+    if (manager->IsReloading()) return nullptr;
+    const auto library = manager->GetCategories();
+    const auto categorySize = SU_TO_INT32(library->size());
     if (categorySize <= 0) return nullptr;
     auto actual = relative + categoryIndex;
     while (actual < 0) actual += categorySize;
-    return manager->categories[actual % categorySize];
+    return (*library)[actual % categorySize];
 }
 
 std::shared_ptr<MusicMetaInfo> MusicSelectionCursor::GetMusicAt(const int32_t relative) const
 {
-    const auto musicSize = GetMusicSize(0);
+    const auto category = GetCategoryAt(0);
+    if (!category) return nullptr;
+    const auto musicSize = SU_TO_INT32(category->Musics.size());
     if (musicSize <= 0) return nullptr;
     auto actual = relative + musicIndex;
     while (actual < 0) actual += musicSize;
-    return GetCategoryAt(0)->Musics[actual % musicSize];
+    return category->Musics[actual % musicSize];
 }
 
 std::shared_ptr<MusicScoreInfo> MusicSelectionCursor::GetScoreVariantAt(const int32_t relative) const
 {
     const auto music = GetMusicAt(relative);
     if (!music) return nullptr;
-    const auto variant = min(int32_t(variantIndex), GetVariantSize(relative) - 1);
+    const auto variant = min(int32_t(variantIndex), SU_TO_INT32(music->Scores.size()) - 1);
     if (variant < 0) return nullptr;
     return music->Scores[variant];
 }
@@ -176,6 +405,13 @@ MusicSelectionState MusicSelectionCursor::ReloadMusic(const bool async)
     return MusicSelectionState::Success;
 }
 
+double MusicSelectionCursor::GetReloadProgress() const
+{
+    if (!manager->IsReloading()) return 1.0;
+    const auto total = manager->GetTotalFileCount();
+    return total ? double(manager->GetScannedFileCount()) / total : 0.0;
+}
+
 MusicSelectionState MusicSelectionCursor::ResetState()
 {
     if (manager->IsReloading()) return MusicSelectionState::Reloading;
@@ -408,7 +644,7 @@ MusicSelectionState MusicSelectionCursor::GetState() const
 
 int32_t MusicSelectionCursor::GetCategorySize() const
 {
-    return manager->IsReloading() ? -1 : SU_TO_INT32(manager->categories.size());
+    return manager->IsReloading() ? -1 : SU_TO_INT32(manager->GetCategories()->size());
 }
 
 int32_t MusicSelectionCursor::GetMusicSize(int32_t relativeIndex) const
@@ -439,6 +675,7 @@ void MusicSelectionCursor::RegisterScriptInterface(asIScriptEngine *engine)
     engine->RegisterObjectBehaviour(SU_IF_MSCURSOR, asBEHAVE_RELEASE, "void f()", asMETHOD(MusicSelectionCursor, Release), asCALL_THISCALL);
     engine->RegisterObjectMethod(SU_IF_MSCURSOR, SU_IF_MSCSTATE " ReloadMusic(bool = false)", asMETHOD(MusicSelectionCursor, ReloadMusic), asCALL_THISCALL);
     engine->RegisterObjectMethod(SU_IF_MSCURSOR, SU_IF_MSCSTATE " ResetState()", asMETHOD(MusicSelectionCursor, ResetState), asCALL_THISCALL);
+    engine->RegisterObjectMethod(SU_IF_MSCURSOR, "double GetReloadProgress()", asMETHOD(MusicSelectionCursor, GetReloadProgress), asCALL_THISCALL);
     engine->RegisterObjectMethod(SU_IF_MSCURSOR, "string GetPrimaryString(int = 0)", asMETHOD(MusicSelectionCursor, GetPrimaryString), asCALL_THISCALL);
     engine->RegisterObjectMethod(SU_IF_MSCURSOR, "string GetCategoryName(int = 0)", asMETHOD(MusicSelectionCursor, GetCategoryName), asCALL_THISCALL);
     engine->RegisterObjectMethod(SU_IF_MSCURSOR, "string GetMusicName(int = 0)", asMETHOD(MusicSelectionCursor, GetMusicName), asCALL_THISCALL);
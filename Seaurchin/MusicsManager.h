@@ -22,6 +22,24 @@ struct MusicMetaInfo final {
     std::vector<std::shared_ptr<MusicScoreInfo>> Scores;
 };
 
+// musics.mp に保存する譜面1つ分の情報
+// 更新日時・サイズが一致すれば再解析しない、食い違っても内容のハッシュが一致すれば再解析しない
+struct MusicCacheEntry final {
+    int64_t LastWriteTime = 0;
+    uint64_t FileSize = 0;
+    uint32_t Hash = 0;
+    std::string SongId;
+    std::string Title;
+    std::string Artist;
+    std::string JacketFileName;
+    std::string BackgroundFileName;
+    std::string WaveFileName;
+    std::string Designer;
+    std::string ExtraDifficulty;
+    double ShowBpm = 0.0;
+    uint32_t DifficultyType = 0;
+    uint32_t Level = 0;
+};
 
 class CategoryInfo final {
 private:
@@ -39,6 +57,9 @@ public:
     void Reload(bool recreateCache) const;
 };
 
+// 公開後は書き換えない曲一覧 再読み込み時は丸ごと差し替える
+using MusicLibrary = std::vector<std::shared_ptr<CategoryInfo>>;
+
 enum class MusicSelectionState {
     OutOfFunction = 0,
     Category,
@@ -52,7 +73,6 @@ enum class MusicSelectionState {
 
 class MusicSelectionCursor;
 class ExecutionManager;
-class SusAnalyzer;
 class MusicsManager final {
     friend class MusicSelectionCursor;
 private:
@@ -60,9 +80,19 @@ private:
 
     bool loading = false;
     std::mutex flagMutex;
-    std::unique_ptr<SusAnalyzer> analyzer;
-    std::vector<std::shared_ptr<CategoryInfo>> categories;
+    std::atomic<uint32_t> scannedFileCount { 0 };
+    std::atomic<uint32_t> totalFileCount { 0 };
+    std::shared_ptr<const MusicLibrary> categories;     // std::atomic_load/atomic_store でのみ触る
+    std::unordered_map<std::string, MusicCacheEntry> musicCache;   // キーは Music ディレクトリからの相対パス
+    bool musicCacheLoaded = false;
+    boost::filesystem::path musicDirectory;
+    boost::filesystem::path musicCacheFile;
+    std::vector<std::string> analyzedKeys;     // 直前の走査で解析し直した譜面のキー (昇順) flagMutex で守る
+
     void CreateMusicCache();
+    bool RestoreMusicCache(const std::string &key, const boost::filesystem::path &file, MusicCacheEntry &entry) const;
+    void LoadMusicCacheFile();
+    void SaveMusicCacheFile() const;
 
 public:
     explicit MusicsManager(ExecutionManager *exm);
@@ -71,10 +101,15 @@ public:
     static void Initialize();
     void Reload(bool async);
     bool IsReloading();
+    uint32_t GetScannedFileCount() const { return scannedFileCount; }
+    uint32_t GetTotalFileCount() const { return totalFileCount; }
     boost::filesystem::path GetSelectedScorePath();
+    // 走査する Music ディレクトリと musics.mp の場所を差し替える (検証用)
+    void SetLibraryLocation(const boost::filesystem::path &music, const boost::filesystem::path &cacheFile);
+    std::vector<std::string> GetAnalyzedKeys();
 
     MusicSelectionCursor *CreateMusicSelectionCursor();
-    const std::vector<std::shared_ptr<CategoryInfo>> &GetCategories() const { return categories; }
+    std::shared_ptr<const MusicLibrary> GetCategories() const { return std::atomic_load(&categories); }
 };
 
 class MusicSelectionCursor final {
@@ -100,6 +135,7 @@ public:
 
     MusicSelectionState ReloadMusic(bool async);
     MusicSelectionState ResetState();
+    double GetReloadProgress() const;
 
     std::string GetPrimaryString(int32_t relativeIndex) const;
     std::string GetCategoryName(int32_t relativeIndex) const;
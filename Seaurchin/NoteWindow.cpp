@@ -0,0 +1,73 @@
+﻿#include "NoteWindow.h"
+
+using namespace std;
+
+void NoteWindow::Reset(const vector<uint32_t> &orderedNotes, const vector<tuple<double, double>> &noteLifetimes)
+{
+    notes = orderedNotes;
+    lifetimes.clear();
+    lifetimes.reserve(notes.size());
+    leaveTimes.resize(notes.size());
+    for (uint32_t i = 0; i < notes.size(); ++i) {
+        const auto enter = get<0>(noteLifetimes[i]);
+        const auto leave = get<1>(noteLifetimes[i]);
+        leaveTimes[i] = leave;
+        if (enter > leave) continue;
+        lifetimes.push_back(Lifetime { enter, leave, i });
+    }
+    stable_sort(lifetimes.begin(), lifetimes.end(), [](const Lifetime &a, const Lifetime &b) {
+        return a.Enter < b.Enter;
+    });
+    active.clear();
+    cursor = 0;
+    lastTime = -numeric_limits<double>::infinity();
+    lastMargin = 0;
+}
+
+void NoteWindow::Clear()
+{
+    notes.clear();
+    lifetimes.clear();
+    leaveTimes.clear();
+    active.clear();
+    cursor = 0;
+    lastTime = -numeric_limits<double>::infinity();
+    lastMargin = 0;
+}
+
+void NoteWindow::Update(const double time, const double margin)
+{
+    const auto enterTime = time + margin;
+    const auto leaveTime = time - margin;
+
+    // 巻き戻った時と幅が変わった時だけは全体から作り直す
+    if (time < lastTime || margin != lastMargin) {
+        Rebuild(enterTime, leaveTime);
+        lastTime = time;
+        lastMargin = margin;
+        return;
+    }
+    lastTime = time;
+
+    // 抜けたもの
+    active.erase(remove_if(active.begin(), active.end(), [&](const uint32_t index) {
+        return leaveTimes[index] < leaveTime;
+    }), active.end());
+
+    // 入ってきたもの
+    for (; cursor < lifetimes.size() && lifetimes[cursor].Enter <= enterTime; ++cursor) {
+        const auto &lifetime = lifetimes[cursor];
+        if (lifetime.Leave < leaveTime) continue;
+        active.insert(lower_bound(active.begin(), active.end(), lifetime.Index), lifetime.Index);
+    }
+}
+
+void NoteWindow::Rebuild(const double enterTime, const double leaveTime)
+{
+    active.clear();
+    for (cursor = 0; cursor < lifetimes.size() && lifetimes[cursor].Enter <= enterTime; ++cursor) {
+        if (lifetimes[cursor].Leave < leaveTime) continue;
+        active.push_back(lifetimes[cursor].Index);
+    }
+    sort(active.begin(), active.end());
+}
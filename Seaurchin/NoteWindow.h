@@ -0,0 +1,41 @@
+﻿#pragma once
+
+// 時刻区間付きのノーツ番号の集合から、ある時刻に区間がかかっているものだけを取り出す
+// 区間の開始順に並べた表とカーソルで差分だけ出し入れするので、毎フレーム全ノーツを走査しない
+class NoteWindow final {
+private:
+    struct Lifetime {
+        double Enter;
+        double Leave;
+        uint32_t Index;
+    };
+
+    std::vector<uint32_t> notes;        // 取り出し順に並べたノーツ番号
+    std::vector<Lifetime> lifetimes;    // Enter昇順
+    std::vector<double> leaveTimes;     // notes上の位置で引くLeave
+    std::vector<uint32_t> active;       // notes上の位置、昇順
+    size_t cursor = 0;                  // lifetimesのうち次に入ってくるもの
+    double lastTime = -std::numeric_limits<double>::infinity();
+    double lastMargin = 0;
+
+    void Rebuild(double enterTime, double leaveTime);
+
+public:
+    // orderedNotesの並びがそのまま取り出し順になる
+    // lifetimeがEnter > Leaveのノーツは常に対象外
+    void Reset(const std::vector<uint32_t> &orderedNotes, const std::vector<std::tuple<double, double>> &noteLifetimes);
+    void Clear();
+    // [time - margin, time + margin]と区間が重なるノーツを対象にする
+    void Update(double time, double margin = 0);
+
+    template<typename Predicate>
+    void Collect(std::vector<uint32_t> &result, Predicate pred) const
+    {
+        result.clear();
+        for (const auto position : active) {
+            const auto note = notes[position];
+            if (pred(note)) result.push_back(note);
+        }
+    }
+    size_t GetActiveCount() const { return active.size(); }
+};
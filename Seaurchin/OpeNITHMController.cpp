@@ -0,0 +1,276 @@
+﻿#include "OpeNITHMController.h"
+#include "Misc.h"
+
+using namespace std;
+
+namespace
+{
+    const uint8_t PacketSync = 0xFF;
+    const uint8_t PacketEscape = 0xFD;
+    const uint8_t DefaultThreshold = 20;
+
+    void PushEscaped(vector<uint8_t> &out, const uint8_t value)
+    {
+        if (value == PacketSync || value == PacketEscape) {
+            out.push_back(PacketEscape);
+            out.push_back(value - 1);
+        } else {
+            out.push_back(value);
+        }
+    }
+}
+
+OpeNITHMController::OpeNITHMController(const shared_ptr<ControlState> &controlState)
+    : state(controlState)
+    , port(INVALID_HANDLE_VALUE)
+    , running(false)
+    , readerActive(false)
+    , airReportEnabled(false)
+    , ledColors()
+    , ledDirty(false)
+    , escaping(false)
+    , droppedPackets(0)
+    , cellPressed()
+    , airHeight(-1)
+{
+    for (auto &threshold : thresholds) threshold = DefaultThreshold;
+}
+
+OpeNITHMController::~OpeNITHMController()
+{
+    Close();
+}
+
+bool OpeNITHMController::Open(const wstring &path)
+{
+    auto log = spdlog::get("main");
+    Close();
+
+    port = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+    if (port == INVALID_HANDLE_VALUE) {
+        log->error(u8"OpeNITHM: {0} を開けませんでした", ConvertUnicodeToUTF8(path));
+        return false;
+    }
+
+    // 名前付きパイプ等はシリアルの設定ができないのでそのまま読む
+    DCB dcb = { sizeof(DCB) };
+    if (GetCommState(port, &dcb)) {
+        dcb.BaudRate = 115200;
+        dcb.ByteSize = 8;
+        dcb.Parity = NOPARITY;
+        dcb.StopBits = ONESTOPBIT;
+        dcb.fDtrControl = DTR_CONTROL_ENABLE;
+        SetCommState(port, &dcb);
+
+        // 1バイトでも届いたらすぐ返し、何もなければ1msで返る
+        COMMTIMEOUTS timeouts = { MAXDWORD, MAXDWORD, 1, 0, 0 };
+        SetCommTimeouts(port, &timeouts);
+        PurgeComm(port, PURGE_RXCLEAR | PURGE_TXCLEAR);
+    }
+
+    packet.clear();
+    escaping = false;
+    Write(CommandEnableReport, nullptr, 0);
+
+    running = true;
+    readerActive = true;
+    reader = thread([this] { ReaderMain(); });
+    log->info(u8"OpeNITHM: {0} に接続しました", ConvertUnicodeToUTF8(path));
+    return true;
+}
+
+void OpeNITHMController::Close()
+{
+    if (port == INVALID_HANDLE_VALUE) return;
+
+    // 同期の ReadFile は CancelIoEx では止まらないことがあるので、読み込みスレッドの I/O を直接取り消す
+    // ReadFile に入る前に取り消すと空振りするので、スレッドが抜けるまで繰り返す
+    running = false;
+    if (reader.joinable()) {
+        while (readerActive) {
+            CancelSynchronousIo(reader.native_handle());
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        reader.join();
+    }
+    Write(CommandDisableReport, nullptr, 0);
+    CloseHandle(port);
+    port = INVALID_HANDLE_VALUE;
+    ReleaseAll(ControlState::GetInputTimestamp());
+}
+
+void OpeNITHMController::ReleaseAll(const double time)
+{
+    for (auto i = 0; i < 16; i++) {
+        if (!cellPressed[i]) continue;
+        cellPressed[i] = false;
+        state->PushEvent({ time, ControllerSource::IntegratedSliders, i, false });
+    }
+    if (airHeight >= 0) state->PushEvent({ time, ControllerSource::IntegratedAir, int(AirControlSource::AirHold), false });
+    airHeight = -1;
+}
+
+void OpeNITHMController::SetThreshold(const int cell, const uint8_t value)
+{
+    if (cell < 0 || cell >= 16) return;
+    thresholds[cell] = value;
+}
+
+void OpeNITHMController::SetLedColor(const int cell, const uint8_t red, const uint8_t green, const uint8_t blue)
+{
+    if (cell < 0 || cell >= 16) return;
+    lock_guard<mutex> lock(ledMutex);
+    auto color = ledColors.begin() + cell * 3;
+    if (color[0] == red && color[1] == green && color[2] == blue) return;
+    color[0] = red;
+    color[1] = green;
+    color[2] = blue;
+    ledDirty = true;
+}
+
+void OpeNITHMController::ReaderMain()
+{
+    uint8_t buffer[256];
+    while (running) {
+        DWORD read = 0;
+        if (!ReadFile(port, buffer, sizeof(buffer), &read, nullptr)) {
+            if (!running) break;
+            // 抜かれたなど Close を経ずに止まるときも、押されたまま残さず切断扱いにする
+            spdlog::get("main")->error(u8"OpeNITHM: 読み込みに失敗しました ({0})", GetLastError());
+            ReleaseAll(ControlState::GetInputTimestamp());
+            running = false;
+            break;
+        }
+        // 時刻は読めた瞬間に取る
+        if (read) Feed(buffer, read, ControlState::GetInputTimestamp());
+        SendLeds();
+    }
+    readerActive = false;
+}
+
+void OpeNITHMController::Feed(const uint8_t *data, const size_t size, const double time)
+{
+    for (size_t i = 0; i < size; i++) {
+        auto value = data[i];
+        if (value == PacketSync) {
+            // 前のパケットが途中でも捨てて同期し直す
+            if (!packet.empty()) ++droppedPackets;
+            packet.assign(1, PacketSync);
+            escaping = false;
+            continue;
+        }
+        if (packet.empty()) continue;
+        if (value == PacketEscape) {
+            escaping = true;
+            continue;
+        }
+        if (escaping) {
+            value += 1;
+            escaping = false;
+        }
+        packet.push_back(value);
+
+        // sync cmd len data[len] sum
+        if (packet.size() >= 3 && packet.size() == size_t(packet[2]) + 4) {
+            ProcessPacket(time);
+            packet.clear();
+        }
+    }
+}
+
+void OpeNITHMController::ProcessPacket(const double time)
+{
+    uint8_t sum = 0;
+    for (const auto value : packet) sum += value;
+    if (sum) {
+        ++droppedPackets;
+        return;
+    }
+
+    const auto data = packet.data() + 3;
+    const size_t size = packet[2];
+    switch (packet[1]) {
+        case CommandSliderReport:
+            ProcessSliderReport(data, size, time);
+            break;
+        case CommandAirReport:
+            if (airReportEnabled && size >= 1) ProcessAirReport(data[0], time);
+            break;
+        default:
+            // LED 等への応答は読み捨てる
+            break;
+    }
+}
+
+void OpeNITHMController::ProcessSliderReport(const uint8_t *pressures, const size_t size, const double time)
+{
+    // 32センサーが右端から上下2個ずつ並んでいる
+    if (size < 32) return;
+    for (auto i = 0; i < 16; i++) {
+        const auto sensor = (15 - i) * 2;
+        const auto pressure = max(pressures[sensor], pressures[sensor + 1]);
+        const auto pressed = pressure >= thresholds[i];
+        if (pressed == cellPressed[i]) continue;
+        cellPressed[i] = pressed;
+        state->PushEvent({ time, ControllerSource::IntegratedSliders, i, pressed });
+    }
+}
+
+void OpeNITHMController::ProcessAirReport(const uint8_t beams, const double time)
+{
+    // 遮られている一番上のビームを手の高さとみなす
+    auto height = -1;
+    for (auto i = 0; i < 6; i++) if (beams & (1 << i)) height = i;
+    if (height == airHeight) return;
+
+    if (airHeight < 0) state->PushEvent({ time, ControllerSource::IntegratedAir, int(AirControlSource::AirHold), true });
+    if (height < 0) state->PushEvent({ time, ControllerSource::IntegratedAir, int(AirControlSource::AirHold), false });
+    if (height > airHeight) {
+        state->PushEvent({ time, ControllerSource::IntegratedAir, int(AirControlSource::AirUp), true });
+    } else if (height >= 0) {
+        state->PushEvent({ time, ControllerSource::IntegratedAir, int(AirControlSource::AirDown), true });
+    }
+    airHeight = height;
+}
+
+void OpeNITHMController::SendLeds()
+{
+    // brightness + 32個分の BRG (右端から、奇数番目はセルの仕切り)
+    uint8_t data[1 + 32 * 3] = { 0xFF };
+    {
+        lock_guard<mutex> lock(ledMutex);
+        if (!ledDirty) return;
+        ledDirty = false;
+        for (auto i = 0; i < 16; i++) {
+            const auto led = data + 1 + (15 - i) * 2 * 3;
+            led[0] = ledColors[i * 3 + 2];
+            led[1] = ledColors[i * 3 + 0];
+            led[2] = ledColors[i * 3 + 1];
+        }
+    }
+    Write(CommandLed, data, sizeof(data));
+}
+
+bool OpeNITHMController::Write(const uint8_t command, const uint8_t *data, const size_t size) const
+{
+    if (port == INVALID_HANDLE_VALUE) return false;
+    const auto bytes = EncodePacket(command, data, size);
+    DWORD written = 0;
+    return WriteFile(port, bytes.data(), DWORD(bytes.size()), &written, nullptr) && written == bytes.size();
+}
+
+vector<uint8_t> OpeNITHMController::EncodePacket(const uint8_t command, const uint8_t *data, const size_t size)
+{
+    vector<uint8_t> result;
+    result.reserve(size * 2 + 8);
+    result.push_back(PacketSync);
+    uint8_t sum = PacketSync + command + uint8_t(size);
+    PushEscaped(result, command);
+    PushEscaped(result, uint8_t(size));
+    for (size_t i = 0; i < size; i++) {
+        sum += data[i];
+        PushEscaped(result, data[i]);
+    }
+    PushEscaped(result, uint8_t(0x100 - sum));
+    return result;
+}
@@ -0,0 +1,67 @@
+﻿#pragma once
+
+#include "Controller.h"
+
+// OpeNITHM (SEGA スライダー互換のシリアルプロトコル) の入力バックエンド
+// 専用スレッドでポートを読み、スライダーとエアーの変化を時刻付きで ControlState に流す
+// パケット: 0xFF cmd len data[len] sum (0xFF/0xFD は 0xFD + (値-1) にエスケープ、sum は全バイトの和が0になる値)
+class OpeNITHMController final {
+public:
+    static const uint8_t CommandSliderReport = 0x01;
+    static const uint8_t CommandLed = 0x02;
+    static const uint8_t CommandEnableReport = 0x03;
+    static const uint8_t CommandDisableReport = 0x04;
+    // 標準のプロトコルには無い独自の拡張: data[0] の下位6bitがエアーの各ビーム (bit0 が一番下)
+    // SetAirReportEnabled(true) のときだけ解釈し、それ以外は他の応答と同じく読み捨てる
+    static const uint8_t CommandAirReport = 0x20;
+
+private:
+    const std::shared_ptr<ControlState> state;
+    HANDLE port;
+    std::thread reader;
+    std::atomic<bool> running;
+    std::atomic<bool> readerActive;
+    std::atomic<bool> airReportEnabled;
+
+    // ゲームスレッドから書き、読み込みスレッドが読むもの
+    std::array<std::atomic<uint8_t>, 16> thresholds;
+    std::mutex ledMutex;
+    std::array<uint8_t, 16 * 3> ledColors;
+    bool ledDirty;
+
+    // 読み込みスレッドだけが触るもの (droppedPackets はゲームスレッドからも読む)
+    std::vector<uint8_t> packet;
+    bool escaping;
+    std::atomic<uint32_t> droppedPackets;
+    bool cellPressed[16];
+    int airHeight;
+
+    void ReaderMain();
+    void ProcessPacket(double time);
+    void ProcessSliderReport(const uint8_t *pressures, size_t size, double time);
+    void ProcessAirReport(uint8_t beams, double time);
+    // 押しっぱなしで残らないように、押されているセルとエアーを離す
+    void ReleaseAll(double time);
+    void SendLeds();
+    bool Write(uint8_t command, const uint8_t *data, size_t size) const;
+
+public:
+    explicit OpeNITHMController(const std::shared_ptr<ControlState> &controlState);
+    ~OpeNITHMController();
+
+    // COM ポートの他、リプレイ用の名前付きパイプも開ける
+    bool Open(const std::wstring &path);
+    void Close();
+    bool IsOpen() const { return running; }
+
+    void SetThreshold(int cell, uint8_t value);
+    void SetLedColor(int cell, uint8_t red, uint8_t green, uint8_t blue);
+    // CommandAirReport を受け付けるか (既定は受け付けない)
+    void SetAirReportEnabled(bool enabled) { airReportEnabled = enabled; }
+
+    // 受信したバイト列を解釈する (Open していなくても直接流し込める)
+    void Feed(const uint8_t *data, size_t size, double time);
+    uint32_t GetDroppedPacketCount() const { return droppedPackets; }
+
+    static std::vector<uint8_t> EncodePacket(uint8_t command, const uint8_t *data, size_t size);
+};
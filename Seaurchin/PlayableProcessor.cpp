@@ -9,7 +9,8 @@ PlayableProcessor::PlayableProcessor(ScenePlayer *splayer)
     player = splayer;
     currentState = player->manager->GetControlStateSafe();
     SetJudgeWidths(0.033, 0.066, 0.084);
-    PlayableProcessor::SetJudgeAdjusts(0, 1, 0, 1);
+    // player->currentResult はまだ作られていないので SetJudgeAdjusts は呼ばない
+    // 補正の初期値はヘッダー側で、実際の値は ScenePlayer::SetProcessorOptions が入れる
 }
 
 PlayableProcessor::PlayableProcessor(ScenePlayer *splayer, const bool autoAir) : PlayableProcessor(splayer)
@@ -35,11 +36,13 @@ void PlayableProcessor::SetJudgeAdjusts(const double jas, const double jms, cons
     judgeMultiplierSlider = jms;
     judgeAdjustAirString = jaa;
     judgeMultiplierAir = jma;
+    player->currentResult->SetJudgeAdjusts(jas, jaa);
 }
 
 void PlayableProcessor::Reset()
 {
     player->currentResult->Reset();
+    ResetInput();
     data = player->data;
     auto an = 0;
     for (auto &note : data) {
@@ -84,7 +87,45 @@ bool PlayableProcessor::ShouldJudge(std::shared_ptr<SusDrawableNoteData> note)
     return current >= -leastWidthSlider && current <= leastWidthSlider;
 }
 
+double PlayableProcessor::GetJudgeMargin()
+{
+    const auto extra = 0.033;
+    const auto marginAir = fabs(judgeAdjustAirString) + judgeWidthAttack * judgeMultiplierAir + extra;
+    const auto marginSlider = fabs(judgeAdjustSlider) + judgeWidthAttack * judgeMultiplierSlider + extra;
+    return max(marginAir, marginSlider);
+}
+
 void PlayableProcessor::Update(vector<shared_ptr<SusDrawableNoteData>>& notes)
+{
+    // 入力はフレームの頭にまとめて届くので、起きた順にその時刻まで戻って1つずつ判定する
+    // 最後にフレームの時刻で、押しっぱなしと見逃しを判定する
+    for (const auto &ev : currentState->GetJudgeEvents()) {
+        processTime = min(player->currentTime, max(lastProcessTime, player->currentTime - ev.Delay));
+        ApplyEvent(ev);
+        currentEvent = &ev;
+        ProcessNotes(notes);
+        lastProcessTime = processTime;
+    }
+    currentEvent = nullptr;
+    processTime = lastProcessTime = player->currentTime;
+    // 取りこぼした変化があってもフレームの終わりには共有の状態に揃える
+    for (auto i = 0; i < 16; i++) sliderHeld[i] = currentState->GetCurrentState(ControllerSource::IntegratedSliders, i);
+    airHeld = currentState->GetCurrentState(ControllerSource::IntegratedAir, int(AirControlSource::AirHold));
+    ProcessNotes(notes);
+}
+
+void PlayableProcessor::ApplyEvent(const ControlEvent &ev)
+{
+    if (ev.Source == ControllerSource::IntegratedSliders && ev.Number >= 0 && ev.Number < 16) sliderHeld[ev.Number] = ev.Pressed;
+    if (ev.Source == ControllerSource::IntegratedAir && ev.Number == int(AirControlSource::AirHold)) airHeld = ev.Pressed;
+}
+
+bool PlayableProcessor::IsPressedNow(const ControllerSource source, const int number) const
+{
+    return currentEvent && currentEvent->Pressed && currentEvent->Source == source && currentEvent->Number == number;
+}
+
+void PlayableProcessor::ProcessNotes(vector<shared_ptr<SusDrawableNoteData>>& notes)
 {
     auto slideCheck = false;
     auto holdCheck = false;
@@ -114,6 +155,7 @@ void PlayableProcessor::MovePosition(const double relative)
 {
     const auto newTime = player->currentTime + relative;
     player->currentResult->Reset();
+    ResetInput();
 
     wasInHold = isInHold = false;
     wasInSlide = isInSlide = false;
@@ -164,19 +206,28 @@ void PlayableProcessor::MovePosition(const double relative)
     }
 }
 
+void PlayableProcessor::ResetInput()
+{
+    processTime = lastProcessTime = numeric_limits<double>::lowest();
+    currentEvent = nullptr;
+    sliderHeld.fill(false);
+    airHeld = false;
+}
+
 void PlayableProcessor::Draw()
 {
     if (!imageHoldLight) return;
-    SetDrawBlendMode(DX_BLENDMODE_ALPHA, 255);
+    const auto device = RenderDevice::GetCurrent();
+    device->SetBlendMode(RenderBlendMode::Alpha, 255);
     for (auto i = 0; i < 16; i++)
         if (currentState->GetCurrentState(ControllerSource::IntegratedSliders, i))
-            DrawRectRotaGraph3F(
+            device->DrawImage(
                 SU_TO_FLOAT(player->widthPerLane * i), SU_TO_FLOAT(player->laneBufferY),
                 0, 0,
                 imageHoldLight->GetWidth(), imageHoldLight->GetHeight(),
                 0, SU_TO_FLOAT(imageHoldLight->GetHeight()),
                 1, 2, 0,
-                imageHoldLight->GetHandle(), TRUE, FALSE);
+                imageHoldLight->GetHandle(), true);
 }
 
 void PlayableProcessor::ProcessScore(const shared_ptr<SusDrawableNoteData>& note)
@@ -226,26 +277,22 @@ void PlayableProcessor::ProcessScore(const shared_ptr<SusDrawableNoteData>& note
 
 bool PlayableProcessor::CheckJudgement(const shared_ptr<SusDrawableNoteData>& note) const
 {
-    auto reltime = player->currentTime - note->StartTime - judgeAdjustSlider;
+    auto reltime = processTime - note->StartTime - judgeAdjustSlider;
     reltime /= judgeMultiplierSlider;
     if (note->OnTheFlyData.test(size_t(NoteAttribute::Finished))) return false;
     if (reltime < -judgeWidthAttack) return false;
-    if (reltime > judgeWidthAttack) {
-        if (note->Type[size_t(SusNoteType::ExTap)]) {
-            ResetCombo(note, { AbilityNoteType::ExTap, note->StartLane, note->StartLane + note->Length });
-        } else if (note->Type[size_t(SusNoteType::Flick)]) {
-            ResetCombo(note, { AbilityNoteType::Flick, note->StartLane, note->StartLane + note->Length });
-        } else {
-            ResetCombo(note, { AbilityNoteType::Tap, note->StartLane, note->StartLane + note->Length });
-        }
-        return false;
-    }
     const int left = SU_TO_INT32(note->StartLane), right = SU_TO_INT32(note->StartLane + note->Length);
     for (int i = left; i < right; i++) {
-        if (!currentState->GetTriggerState(ControllerSource::IntegratedSliders, i)) continue;
+        if (!IsPressedNow(ControllerSource::IntegratedSliders, i)) continue;
+        // processTime は押された時刻になっている
+        const auto offset = processTime - note->StartTime - judgeAdjustSlider;
+        const auto triggerTime = offset / judgeMultiplierSlider;
+        if (triggerTime < -judgeWidthAttack || triggerTime > judgeWidthAttack) continue;
         if (note->Type[size_t(SusNoteType::ExTap)]) {
+            RecordTiming(note, AbilityNoteType::ExTap, i, offset);
             IncrementComboEx(note, "");
         } else if (note->Type[size_t(SusNoteType::AwesomeExTap)]) {
+            RecordTiming(note, AbilityNoteType::AwesomeExTap, i, offset);
             IncrementComboEx(
                 note,
                 note->Type[size_t(SusNoteType::Down)]
@@ -253,18 +300,29 @@ bool PlayableProcessor::CheckJudgement(const shared_ptr<SusDrawableNoteData>& no
                 : "AwesomeExTapUp"
             );
         } else if (note->Type[size_t(SusNoteType::Flick)]) {
-            IncrementCombo(note, reltime, { AbilityNoteType::Flick, note->StartLane, note->StartLane + note->Length }, "");
+            RecordTiming(note, AbilityNoteType::Flick, i, offset);
+            IncrementCombo(note, triggerTime, { AbilityNoteType::Flick, note->StartLane, note->StartLane + note->Length }, "");
         } else {
-            IncrementCombo(note, reltime, { AbilityNoteType::Tap, note->StartLane, note->StartLane + note->Length }, "");
+            RecordTiming(note, AbilityNoteType::Tap, i, offset);
+            IncrementCombo(note, triggerTime, { AbilityNoteType::Tap, note->StartLane, note->StartLane + note->Length }, "");
         }
         return true;
     }
+    if (reltime > judgeWidthAttack) {
+        if (note->Type[size_t(SusNoteType::ExTap)]) {
+            ResetCombo(note, { AbilityNoteType::ExTap, note->StartLane, note->StartLane + note->Length });
+        } else if (note->Type[size_t(SusNoteType::Flick)]) {
+            ResetCombo(note, { AbilityNoteType::Flick, note->StartLane, note->StartLane + note->Length });
+        } else {
+            ResetCombo(note, { AbilityNoteType::Tap, note->StartLane, note->StartLane + note->Length });
+        }
+    }
     return false;
 }
 
 bool PlayableProcessor::CheckHellJudgement(const shared_ptr<SusDrawableNoteData>& note) const
 {
-    auto reltime = player->currentTime - note->StartTime - judgeAdjustSlider;
+    auto reltime = processTime - note->StartTime - judgeAdjustSlider;
     reltime *= judgeMultiplierSlider;  // Hellだからね
     if (note->OnTheFlyData.test(size_t(NoteAttribute::Finished))) return false;
     if (reltime < -judgeWidthAttack) return false;
@@ -280,7 +338,7 @@ bool PlayableProcessor::CheckHellJudgement(const shared_ptr<SusDrawableNoteData>
     const int left = SU_TO_INT32(note->StartLane), right = SU_TO_INT32(note->StartLane + note->Length);
     for (int i = left; i < right; i++) {
         /* 押しっぱなしにしていた時にJC出るのは違う気がした */
-        if (!currentState->GetCurrentState(ControllerSource::IntegratedSliders, i)) continue;
+        if (!sliderHeld[i]) continue;
         IncrementComboHell(note, 1, "");
         return false;
     }
@@ -289,35 +347,40 @@ bool PlayableProcessor::CheckHellJudgement(const shared_ptr<SusDrawableNoteData>
 
 bool PlayableProcessor::CheckAirJudgement(const shared_ptr<SusDrawableNoteData>& note) const
 {
-    auto reltime = player->currentTime - note->StartTime - judgeAdjustAirString;
+    auto reltime = processTime - note->StartTime - judgeAdjustAirString;
     reltime /= judgeMultiplierAir;
     if (note->OnTheFlyData.test(size_t(NoteAttribute::Finished))) return false;
     if (reltime < -judgeWidthAttack) return false;
-    if (reltime > judgeWidthAttack) {
-        ResetCombo(note, { AbilityNoteType::Air, note->StartLane, note->StartLane + note->Length });
-        return false;
-    }
 
     if (isAutoAir) {
+        if (reltime > judgeWidthAttack) {
+            ResetCombo(note, { AbilityNoteType::Air, note->StartLane, note->StartLane + note->Length });
+            return false;
+        }
         if (reltime >= 0) {
             IncrementComboAir(note, reltime, { AbilityNoteType::Air, note->StartLane, note->StartLane + note->Length }, "");
             return true;
         }
-    } else {
-        const auto judged = currentState->GetTriggerState(
-            ControllerSource::IntegratedAir,
-            note->Type[size_t(SusNoteType::Up)] ? int(AirControlSource::AirUp) : int(AirControlSource::AirDown));
-        if (judged) {
-            IncrementComboAir(note, (reltime < 0.0) ? 0.0 : reltime, { AbilityNoteType::Air, note->StartLane, note->StartLane + note->Length }, "");
+        return false;
+    }
+
+    const auto source = note->Type[size_t(SusNoteType::Up)] ? int(AirControlSource::AirUp) : int(AirControlSource::AirDown);
+    if (IsPressedNow(ControllerSource::IntegratedAir, source)) {
+        const auto offset = processTime - note->StartTime - judgeAdjustAirString;
+        const auto triggerTime = offset / judgeMultiplierAir;
+        if (triggerTime >= -judgeWidthAttack && triggerTime <= judgeWidthAttack) {
+            RecordTiming(note, AbilityNoteType::Air, -1, offset);
+            IncrementComboAir(note, (triggerTime < 0.0) ? 0.0 : triggerTime, { AbilityNoteType::Air, note->StartLane, note->StartLane + note->Length }, "");
             return true;
         }
     }
+    if (reltime > judgeWidthAttack) ResetCombo(note, { AbilityNoteType::Air, note->StartLane, note->StartLane + note->Length });
     return false;
 }
 
 bool PlayableProcessor::CheckHoldJudgement(const shared_ptr<SusDrawableNoteData>& note) const
 {
-    const auto reltime = player->currentTime - note->StartTime - judgeAdjustSlider;
+    const auto reltime = processTime - note->StartTime - judgeAdjustSlider;
     if (reltime < -judgeWidthAttack) return false;
     if (note->OnTheFlyData[size_t(NoteAttribute::Completed)]) return false;
 
@@ -325,24 +388,30 @@ bool PlayableProcessor::CheckHoldJudgement(const shared_ptr<SusDrawableNoteData>
     const auto left = note->StartLane;
     const auto right = left + note->Length;
     // left <= i < right で判定
-    auto held = false, trigger = false, release = false;
+    auto held = false, trigger = false;
+    auto triggerLane = -1;
     const int l = SU_TO_INT32(left), r = SU_TO_INT32(right);
     for (auto i = l; i < r; i++) {
-        held |= currentState->GetCurrentState(ControllerSource::IntegratedSliders, i);
-        trigger |= currentState->GetTriggerState(ControllerSource::IntegratedSliders, i);
-        release |= currentState->GetLastState(ControllerSource::IntegratedSliders, i) && !currentState->GetCurrentState(ControllerSource::IntegratedSliders, i);
+        held |= sliderHeld[i];
+        if (IsPressedNow(ControllerSource::IntegratedSliders, i)) {
+            trigger = true;
+            triggerLane = i;
+        }
     }
-    auto judgeTime = player->currentTime - note->StartTime - judgeAdjustSlider;
+    auto judgeTime = processTime - note->StartTime - judgeAdjustSlider;
     judgeTime /= judgeMultiplierSlider;
 
     // Start判定
     if (!note->OnTheFlyData[size_t(NoteAttribute::Finished)]) {
-        if (judgeTime >= judgeWidthAttack) {
-            ResetCombo(note, { AbilityNoteType::Hold, note->StartLane, note->StartLane + note->Length });
-        } else if (trigger) {
-            IncrementCombo(note, judgeTime, { AbilityNoteType::Hold, note->StartLane, note->StartLane + note->Length }, "");
+        const auto triggerOffset = processTime - note->StartTime - judgeAdjustSlider;
+        const auto triggerJudgeTime = triggerOffset / judgeMultiplierSlider;
+        if (trigger && triggerJudgeTime >= -judgeWidthAttack && triggerJudgeTime < judgeWidthAttack) {
+            RecordTiming(note, AbilityNoteType::Hold, triggerLane, triggerOffset);
+            IncrementCombo(note, triggerJudgeTime, { AbilityNoteType::Hold, note->StartLane, note->StartLane + note->Length }, "");
             player->EnqueueJudgeSound(JudgeSoundType::Tap);
             player->SpawnJudgeEffect(note, JudgeType::ShortNormal);
+        } else if (judgeTime >= judgeWidthAttack) {
+            ResetCombo(note, { AbilityNoteType::Hold, note->StartLane, note->StartLane + note->Length });
         }
 
         if (held) {
@@ -363,7 +432,7 @@ bool PlayableProcessor::CheckHoldJudgement(const shared_ptr<SusDrawableNoteData>
     // 0~Att: 判定が入ったタイミングで加算
     // Att~:  切る
     for (const auto &extra : note->ExtraData) {
-        judgeTime = player->currentTime - extra->StartTime - judgeAdjustSlider;
+        judgeTime = processTime - extra->StartTime - judgeAdjustSlider;
         judgeTime /= judgeMultiplierSlider;
         if (extra->OnTheFlyData[size_t(NoteAttribute::Finished)]) continue;
         if (extra->Type[size_t(SusNoteType::Control)]) continue;
@@ -398,7 +467,7 @@ bool PlayableProcessor::CheckHoldJudgement(const shared_ptr<SusDrawableNoteData>
 
 bool PlayableProcessor::CheckSlideJudgement(const shared_ptr<SusDrawableNoteData>& note) const
 {
-    const auto reltime = player->currentTime - note->StartTime - judgeAdjustSlider;
+    const auto reltime = processTime - note->StartTime - judgeAdjustSlider;
     if (reltime < -judgeWidthAttack) return false;
     if (note->OnTheFlyData[size_t(NoteAttribute::Completed)]) return false;
 
@@ -409,7 +478,7 @@ bool PlayableProcessor::CheckSlideJudgement(const shared_ptr<SusDrawableNoteData
     for (const auto &extra : note->ExtraData) {
         if (extra->Type[size_t(SusNoteType::Control)]) continue;
         if (extra->Type[size_t(SusNoteType::Injection)]) continue;
-        if (player->currentTime <= extra->StartTime) {
+        if (processTime <= extra->StartTime) {
             refNote = extra;
             break;
         }
@@ -425,19 +494,12 @@ bool PlayableProcessor::CheckSlideJudgement(const shared_ptr<SusDrawableNoteData
         right = left + note->Length;
     } else {
         // カーブデータ存在範囲内
-        auto &refcurve = player->curveData[refNote];
-        const auto timeInBlock = player->currentTime - lastStep->StartTime;
-        auto start = refcurve[0];
-        auto next = refcurve[0];
-        for (const auto &segment : refcurve) {
-            if (get<0>(segment) >= timeInBlock) {
-                next = segment;
-                break;
-            }
-            start = next = segment;
+        double x, width;
+        if (!player->slideMeshes.EvaluateCurve(note.get(), processTime, &x, &width)) {
+            x = (lastStep->StartLane + lastStep->Length / 2.0) / 16.0;
+            width = lastStep->Length;
         }
-        const auto center = glm::mix(get<1>(start), get<1>(next), (timeInBlock - get<0>(start)) / (get<0>(next) - get<0>(start))) * 16;
-        const auto width = glm::mix(lastStep->Length, refNote->Length, timeInBlock / (refNote->StartTime - lastStep->StartTime));
+        const auto center = x * 16;
         left = SU_TO_FLOAT(floor(center - width / 2.0));
         right = SU_TO_FLOAT(ceil(center + width / 2.0));
         ostringstream ss;
@@ -445,24 +507,30 @@ bool PlayableProcessor::CheckSlideJudgement(const shared_ptr<SusDrawableNoteData
         // WriteDebugConsole(ss.str().c_str());
     }
     // left <= i < right で判定
-    auto held = false, trigger = false, release = false;
+    auto held = false, trigger = false;
+    auto triggerLane = -1;
     const int l = SU_TO_INT32(left), r = SU_TO_INT32(right);
     for (auto i = l; i < r; i++) {
-        held |= currentState->GetCurrentState(ControllerSource::IntegratedSliders, i);
-        trigger |= currentState->GetTriggerState(ControllerSource::IntegratedSliders, i);
-        release |= currentState->GetLastState(ControllerSource::IntegratedSliders, i) && !currentState->GetCurrentState(ControllerSource::IntegratedSliders, i);
+        held |= sliderHeld[i];
+        if (IsPressedNow(ControllerSource::IntegratedSliders, i)) {
+            trigger = true;
+            triggerLane = i;
+        }
     }
-    auto judgeTime = player->currentTime - note->StartTime - judgeAdjustSlider;
+    auto judgeTime = processTime - note->StartTime - judgeAdjustSlider;
     judgeTime /= judgeMultiplierSlider;
 
     // Start判定
     if (!note->OnTheFlyData[size_t(NoteAttribute::Finished)]) {
-        if (judgeTime >= judgeWidthAttack) {
-            ResetCombo(note, { AbilityNoteType::Slide, note->StartLane, note->StartLane + note->Length });
-        } else if (trigger) {
-            IncrementCombo(note, judgeTime, { AbilityNoteType::Slide, note->StartLane, note->StartLane + note->Length }, "");
+        const auto triggerOffset = processTime - note->StartTime - judgeAdjustSlider;
+        const auto triggerJudgeTime = triggerOffset / judgeMultiplierSlider;
+        if (trigger && triggerJudgeTime >= -judgeWidthAttack && triggerJudgeTime < judgeWidthAttack) {
+            RecordTiming(note, AbilityNoteType::Slide, triggerLane, triggerOffset);
+            IncrementCombo(note, triggerJudgeTime, { AbilityNoteType::Slide, note->StartLane, note->StartLane + note->Length }, "");
             player->EnqueueJudgeSound(JudgeSoundType::SlideStep);
             player->SpawnJudgeEffect(note, JudgeType::ShortNormal);
+        } else if (judgeTime >= judgeWidthAttack) {
+            ResetCombo(note, { AbilityNoteType::Slide, note->StartLane, note->StartLane + note->Length });
         }
 
         if (held) {
@@ -482,7 +550,7 @@ bool PlayableProcessor::CheckSlideJudgement(const shared_ptr<SusDrawableNoteData
 
     // Step~End判定
     for (const auto &extra : note->ExtraData) {
-        judgeTime = player->currentTime - extra->StartTime - judgeAdjustSlider;
+        judgeTime = processTime - extra->StartTime - judgeAdjustSlider;
         judgeTime /= judgeMultiplierSlider;
         if (extra->OnTheFlyData[size_t(NoteAttribute::Finished)]) continue;
         if (extra->Type[size_t(SusNoteType::Control)]) continue;
@@ -518,11 +586,11 @@ bool PlayableProcessor::CheckSlideJudgement(const shared_ptr<SusDrawableNoteData
 
 bool PlayableProcessor::CheckAirActionJudgement(const shared_ptr<SusDrawableNoteData>& note) const
 {
-    const auto reltime = player->currentTime - note->StartTime - judgeAdjustAirString;
+    const auto reltime = processTime - note->StartTime - judgeAdjustAirString;
     if (reltime < -judgeWidthAttack * judgeMultiplierAir) return false;
     if (note->OnTheFlyData[size_t(NoteAttribute::Completed)]) return false;
 
-    const auto held = currentState->GetCurrentState(ControllerSource::IntegratedAir, int(AirControlSource::AirHold)) || isAutoAir;
+    const auto held = airHeld || isAutoAir;
 
     // Start判定
     // なし
@@ -534,7 +602,7 @@ bool PlayableProcessor::CheckAirActionJudgement(const shared_ptr<SusDrawableNote
 
     // Step~End判定
     for (const auto &extra : note->ExtraData) {
-        auto judgeTime = player->currentTime - extra->StartTime - judgeAdjustAirString;
+        auto judgeTime = processTime - extra->StartTime - judgeAdjustAirString;
         judgeTime /= judgeMultiplierAir;
 
         if (extra->OnTheFlyData[size_t(NoteAttribute::Finished)]) continue;
@@ -575,15 +643,15 @@ void PlayableProcessor::IncrementCombo(const shared_ptr<SusDrawableNoteData>& no
     if (reltime <= judgeWidthJusticeCritical) {
         note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
         player->currentResult->PerformJusticeCritical();
-        player->currentCharacterInstance->OnJusticeCritical(info, extra);
+        player->NotifyJudge(AbilityJudgeType::JusticeCritical, info, extra);
     } else if (reltime <= judgeWidthJustice) {
         note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
         player->currentResult->PerformJustice();
-        player->currentCharacterInstance->OnJustice(info, extra);
+        player->NotifyJudge(AbilityJudgeType::Justice, info, extra);
     } else {
         note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
         player->currentResult->PerformAttack();
-        player->currentCharacterInstance->OnAttack(info, extra);
+        player->NotifyJudge(AbilityJudgeType::Attack, info, extra);
     }
 }
 
@@ -591,7 +659,7 @@ void PlayableProcessor::IncrementComboEx(const shared_ptr<SusDrawableNoteData>&
 {
     note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
     player->currentResult->PerformJusticeCritical();
-    player->currentCharacterInstance->OnJusticeCritical({ note->Type[size_t(SusNoteType::AwesomeExTap)] ? AbilityNoteType::AwesomeExTap : AbilityNoteType::ExTap, note->StartLane, note->StartLane + note->Length }, extra);
+    player->NotifyJudge(AbilityJudgeType::JusticeCritical, { note->Type[size_t(SusNoteType::AwesomeExTap)] ? AbilityNoteType::AwesomeExTap : AbilityNoteType::ExTap, note->StartLane, note->StartLane + note->Length }, extra);
 }
 
 void PlayableProcessor::IncrementComboHell(const std::shared_ptr<SusDrawableNoteData>& note, const int state, const string& extra) const
@@ -603,7 +671,7 @@ void PlayableProcessor::IncrementComboHell(const std::shared_ptr<SusDrawableNote
             note->OnTheFlyData.reset(size_t(NoteAttribute::HellChecking));
             note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
             player->currentResult->PerformJusticeCritical();
-            player->currentCharacterInstance->OnJusticeCritical({ AbilityNoteType::HellTap, note->StartLane, note->StartLane + note->Length }, extra);
+            player->NotifyJudge(AbilityJudgeType::JusticeCritical, { AbilityNoteType::HellTap, note->StartLane, note->StartLane + note->Length }, extra);
             break;
         case 0:
             // とりあえず通過した
@@ -615,7 +683,7 @@ void PlayableProcessor::IncrementComboHell(const std::shared_ptr<SusDrawableNote
         case 1:
             // 判定失敗
             player->currentResult->PerformMiss();
-            player->currentCharacterInstance->OnMiss({ AbilityNoteType::HellTap, note->StartLane, note->StartLane + note->Length }, extra);
+            player->NotifyJudge(AbilityJudgeType::Miss, { AbilityNoteType::HellTap, note->StartLane, note->StartLane + note->Length }, extra);
             note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
             break;
         default: break;
@@ -628,21 +696,26 @@ void PlayableProcessor::IncrementComboAir(const std::shared_ptr<SusDrawableNoteD
     if (reltime <= judgeWidthJusticeCritical) {
         note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
         player->currentResult->PerformJusticeCritical();
-        player->currentCharacterInstance->OnJusticeCritical(info, extra);
+        player->NotifyJudge(AbilityJudgeType::JusticeCritical, info, extra);
     } else if (reltime <= judgeWidthJustice) {
         note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
         player->currentResult->PerformJustice();
-        player->currentCharacterInstance->OnJustice(info, extra);
+        player->NotifyJudge(AbilityJudgeType::Justice, info, extra);
     } else {
         note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
         player->currentResult->PerformAttack();
-        player->currentCharacterInstance->OnAttack(info, extra);
+        player->NotifyJudge(AbilityJudgeType::Attack, info, extra);
     }
 }
 
+void PlayableProcessor::RecordTiming(const shared_ptr<SusDrawableNoteData>& note, const AbilityNoteType type, const int lane, const double offset) const
+{
+    player->currentResult->RecordTiming(note->StartTime, type, lane, offset);
+}
+
 void PlayableProcessor::ResetCombo(const shared_ptr<SusDrawableNoteData>& note, const JudgeInformation &info) const
 {
     note->OnTheFlyData.set(size_t(NoteAttribute::Finished));
     player->currentResult->PerformMiss();
-    player->currentCharacterInstance->OnMiss(info, "");
+    player->NotifyJudge(AbilityJudgeType::Miss, info, "");
 }
@@ -47,7 +47,12 @@
 #include <exception>
 #include <future>
 #include <thread>
+#include <atomic>
 #include <numeric>
+#include <array>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
 
 //Boost
 #include <boost/config.hpp>
@@ -0,0 +1,160 @@
+﻿#include "Profiler.h"
+#include "Config.h"
+
+#ifdef SU_ENABLE_PROFILER
+
+using namespace std;
+using namespace std::chrono;
+
+namespace
+{
+    void WriteJsonString(ostream &stream, const char *text)
+    {
+        stream << '"';
+        for (auto p = text; *p; ++p) {
+            const auto c = static_cast<unsigned char>(*p);
+            switch (c) {
+                case '"': stream << "\\\""; break;
+                case '\\': stream << "\\\\"; break;
+                case '\n': stream << "\\n"; break;
+                case '\r': stream << "\\r"; break;
+                case '\t': stream << "\\t"; break;
+                default:
+                    if (c < 0x20) {
+                        stream << fmt::format("\\u{0:04x}", c);
+                    } else {
+                        stream << *p;
+                    }
+                    break;
+            }
+        }
+        stream << '"';
+    }
+
+    // trace event の ts/dur は us
+    string FormatMicroseconds(const int64_t nanoseconds)
+    {
+        return fmt::format("{0:.3f}", nanoseconds / 1000.0);
+    }
+}
+
+Profiler::Profiler()
+    : origin(steady_clock::now())
+    , recording(false)
+{
+    for (auto &counter : counters) counter = 0;
+}
+
+Profiler& Profiler::GetInstance()
+{
+    static Profiler instance;
+    return instance;
+}
+
+uint32_t Profiler::GetThreadIndex()
+{
+    static atomic<uint32_t> nextIndex { 1 };
+    thread_local const auto index = nextIndex++;
+    return index;
+}
+
+const char* Profiler::GetCounterName(const ProfileCounter counter)
+{
+    switch (counter) {
+        case ProfileCounter::DrawCalls: return "DrawCalls";
+        case ProfileCounter::SpriteQuads: return "SpriteQuads";
+        case ProfileCounter::NotesProcessed: return "NotesProcessed";
+        case ProfileCounter::ScriptExecutions: return "ScriptExecutions";
+        default: return "Unknown";
+    }
+}
+
+void Profiler::Start()
+{
+    for (auto &counter : counters) counter = 0;
+    recording = true;
+}
+
+void Profiler::Stop()
+{
+    recording = false;
+}
+
+void Profiler::Clear()
+{
+    lock_guard<mutex> lock(zoneMutex);
+    zones.clear();
+    frames.clear();
+}
+
+size_t Profiler::GetZoneCount() const
+{
+    lock_guard<mutex> lock(zoneMutex);
+    return zones.size();
+}
+
+int64_t Profiler::GetTime() const
+{
+    return duration_cast<nanoseconds>(steady_clock::now() - origin).count();
+}
+
+void Profiler::AddZone(const char *name, const int64_t begin, const int64_t end)
+{
+    if (!recording) return;
+    lock_guard<mutex> lock(zoneMutex);
+    if (zones.size() >= MaxZones) {
+        recording = false;
+        return;
+    }
+    zones.push_back({ name, GetThreadIndex(), begin, end });
+}
+
+void Profiler::AddCount(const ProfileCounter counter, const uint32_t value)
+{
+    if (!recording) return;
+    counters[size_t(counter)] += value;
+}
+
+void Profiler::EndFrame()
+{
+    if (!recording) return;
+    Frame frame;
+    frame.Time = GetTime();
+    for (size_t i = 0; i < counters.size(); i++) frame.Counters[i] = counters[i].exchange(0);
+    lock_guard<mutex> lock(zoneMutex);
+    frames.push_back(frame);
+}
+
+void Profiler::WriteChromeTrace(ostream &stream) const
+{
+    lock_guard<mutex> lock(zoneMutex);
+    stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    stream << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"" SU_APP_NAME "\"}}";
+    for (const auto &zone : zones) {
+        stream << ",\n{\"name\":";
+        WriteJsonString(stream, zone.Name);
+        stream << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << zone.Thread
+            << ",\"ts\":" << FormatMicroseconds(zone.Begin)
+            << ",\"dur\":" << FormatMicroseconds(zone.End - zone.Begin) << "}";
+    }
+    for (const auto &frame : frames) {
+        stream << ",\n{\"name\":\"Frame\",\"ph\":\"C\",\"pid\":1,\"ts\":" << FormatMicroseconds(frame.Time) << ",\"args\":{";
+        for (size_t i = 0; i < frame.Counters.size(); i++) {
+            if (i) stream << ",";
+            WriteJsonString(stream, GetCounterName(ProfileCounter(i)));
+            stream << ":" << frame.Counters[i];
+        }
+        stream << "}}";
+    }
+    stream << "\n]}\n";
+}
+
+bool Profiler::SaveChromeTrace(const wstring &fileName) const
+{
+    std::ofstream stream(fileName, ios::out | ios::trunc);
+    if (!stream) return false;
+    WriteChromeTrace(stream);
+    return !!stream;
+}
+
+#endif
@@ -0,0 +1,88 @@
+﻿#pragma once
+
+// フレームの中身を調べるための計測
+// SU_ENABLE_PROFILER を定義してビルドしたときだけ有効で、そうでなければマクロごと消える
+//   SU_PROFILE_ZONE("名前")         そのスコープの区間を記録する (名前は文字列リテラルにすること)
+//   SU_PROFILE_COUNT(カウンタ, 値)  今のフレームのカウンタに足す
+//   SU_PROFILE_FRAME()              フレームの区切り カウンタを確定してリセットする
+// 記録は Chrome の trace event 形式で書き出す (chrome://tracing や Perfetto で開ける)
+
+#ifdef SU_ENABLE_PROFILER
+
+enum class ProfileCounter {
+    DrawCalls,
+    SpriteQuads,
+    NotesProcessed,
+    ScriptExecutions,
+    Count,
+};
+
+class Profiler final {
+public:
+    // これを超えたら記録をやめる (1区間32バイトなので約64MB)
+    static const size_t MaxZones = 2 * 1024 * 1024;
+
+private:
+    struct Zone {
+        const char *Name;
+        uint32_t Thread;
+        int64_t Begin;      // origin からの ns
+        int64_t End;
+    };
+    struct Frame {
+        int64_t Time;
+        std::array<uint32_t, size_t(ProfileCounter::Count)> Counters;
+    };
+
+    const std::chrono::steady_clock::time_point origin;
+    mutable std::mutex zoneMutex;
+    std::vector<Zone> zones;
+    std::vector<Frame> frames;
+    std::array<std::atomic<uint32_t>, size_t(ProfileCounter::Count)> counters;
+    std::atomic<bool> recording;
+
+    Profiler();
+    static uint32_t GetThreadIndex();
+    static const char* GetCounterName(ProfileCounter counter);
+
+public:
+    static Profiler& GetInstance();
+
+    void Start();
+    void Stop();
+    void Clear();
+    bool IsRecording() const { return recording; }
+    size_t GetZoneCount() const;
+
+    int64_t GetTime() const;
+    void AddZone(const char *name, int64_t begin, int64_t end);
+    void AddCount(ProfileCounter counter, uint32_t value);
+    void EndFrame();
+
+    void WriteChromeTrace(std::ostream &stream) const;
+    bool SaveChromeTrace(const std::wstring &fileName) const;
+};
+
+class ProfileZone final {
+private:
+    const char * const name;
+    const int64_t begin;
+
+public:
+    explicit ProfileZone(const char *name) : name(name), begin(Profiler::GetInstance().GetTime()) {}
+    ~ProfileZone() { Profiler::GetInstance().AddZone(name, begin, Profiler::GetInstance().GetTime()); }
+};
+
+#define SU_PROFILE_CONCAT_INNER(a, b) a##b
+#define SU_PROFILE_CONCAT(a, b) SU_PROFILE_CONCAT_INNER(a, b)
+#define SU_PROFILE_ZONE(name) const ProfileZone SU_PROFILE_CONCAT(profileZone, __LINE__)(name)
+#define SU_PROFILE_COUNT(counter, value) Profiler::GetInstance().AddCount(ProfileCounter::counter, uint32_t(value))
+#define SU_PROFILE_FRAME() Profiler::GetInstance().EndFrame()
+
+#else
+
+#define SU_PROFILE_ZONE(name) ((void)0)
+#define SU_PROFILE_COUNT(counter, value) ((void)0)
+#define SU_PROFILE_FRAME() ((void)0)
+
+#endif
@@ -0,0 +1,795 @@
+﻿#include "RenderDevice.h"
+#include "Misc.h"
+
+using namespace std;
+
+const int RenderDevice::BackBuffer;
+RenderDevice *RenderDevice::current = nullptr;
+
+unique_ptr<RenderDevice> RenderDevice::CreateDxLib()
+{
+    return make_unique<DxLibRenderDevice>();
+}
+
+unique_ptr<RenderDevice> RenderDevice::CreateRecording(const int width, const int height, const bool rasterize)
+{
+    return make_unique<RecordingRenderDevice>(width, height, rasterize);
+}
+
+void RenderDevice::DrawImage(
+    const float x, const float y, const int srcX, const int srcY, const int srcWidth, const int srcHeight,
+    const float originX, const float originY, const double scaleX, const double scaleY, const double angle, const int texture, const bool alpha)
+{
+    const auto cosAngle = cos(angle);
+    const auto sinAngle = sin(angle);
+    float corners[4][2] = {
+        { 0, 0 },
+        { float(srcWidth), 0 },
+        { float(srcWidth), float(srcHeight) },
+        { 0, float(srcHeight) },
+    };
+    for (auto &corner : corners) {
+        const auto dx = (corner[0] - originX) * scaleX;
+        const auto dy = (corner[1] - originY) * scaleY;
+        corner[0] = float(x + dx * cosAngle - dy * sinAngle);
+        corner[1] = float(y + dx * sinAngle + dy * cosAngle);
+    }
+    DrawImageQuad(
+        corners[0][0], corners[0][1], corners[1][0], corners[1][1],
+        corners[2][0], corners[2][1], corners[3][0], corners[3][1],
+        srcX, srcY, srcWidth, srcHeight, texture, alpha);
+}
+
+void RenderDevice::DrawImageExtended(const float x1, const float y1, const float x2, const float y2, const int srcX, const int srcY, const int srcWidth, const int srcHeight, const int texture, const bool alpha)
+{
+    DrawImageQuad(x1, y1, x2, y1, x2, y2, x1, y2, srcX, srcY, srcWidth, srcHeight, texture, alpha);
+}
+
+// DxLibRenderDevice ------------------------
+namespace
+{
+    int ToDxLibBlendMode(const RenderBlendMode mode)
+    {
+        switch (mode) {
+            case RenderBlendMode::Alpha: return DX_BLENDMODE_ALPHA;
+            case RenderBlendMode::Add: return DX_BLENDMODE_ADD;
+            default: return DX_BLENDMODE_NOBLEND;
+        }
+    }
+
+    int ToDxLibDrawMode(const RenderFilterMode mode)
+    {
+        switch (mode) {
+            case RenderFilterMode::Bilinear: return DX_DRAWMODE_BILINEAR;
+            case RenderFilterMode::Anisotropic: return DX_DRAWMODE_ANISOTROPIC;
+            default: return DX_DRAWMODE_NEAREST;
+        }
+    }
+
+    unsigned int ToDxLibColor(const uint32_t color)
+    {
+        return GetColor(color >> 16 & 0xFF, color >> 8 & 0xFF, color & 0xFF);
+    }
+}
+
+int DxLibRenderDevice::LoadTexture(const wstring &file, const bool async)
+{
+    if (async) SetUseASyncLoadFlag(TRUE);
+    const auto handle = LoadGraph(reinterpret_cast<const char*>(file.c_str()));
+    if (async) SetUseASyncLoadFlag(FALSE);
+    return handle;
+}
+
+int DxLibRenderDevice::LoadTextureFromMemory(const void *buffer, const size_t size)
+{
+    return CreateGraphFromMem(buffer, SU_TO_INT32(size));
+}
+
+bool DxLibRenderDevice::LoadDividedTextures(const wstring &file, const int count, const int xCount, const int yCount, const int width, const int height, int *handles)
+{
+    return LoadDivGraph(reinterpret_cast<const char*>(file.c_str()), count, xCount, yCount, width, height, handles) != -1;
+}
+
+bool DxLibRenderDevice::LoadDividedTexturesFromMemory(const void *buffer, const size_t size, const int count, const int xCount, const int yCount, const int width, const int height, int *handles)
+{
+    return CreateDivGraphFromMem(buffer, SU_TO_INT32(size), count, xCount, yCount, width, height, handles) != -1;
+}
+
+int DxLibRenderDevice::CreateTextureFromSoftImage(const int softImage)
+{
+    return CreateGraphFromSoftImage(softImage);
+}
+
+bool DxLibRenderDevice::UpdateTextureFromSoftImage(const int softImage, const int texture)
+{
+    return ReCreateGraphFromSoftImage(softImage, texture) != -1;
+}
+
+int DxLibRenderDevice::CreateRenderTarget(const int width, const int height)
+{
+    return MakeScreen(width, height, TRUE);
+}
+
+void DxLibRenderDevice::DeleteTexture(const int texture)
+{
+    DeleteGraph(texture);
+}
+
+bool DxLibRenderDevice::GetTextureSize(const int texture, int *width, int *height)
+{
+    return GetGraphSize(texture, width, height) != -1;
+}
+
+void DxLibRenderDevice::SetRenderTarget(const int target)
+{
+    SetDrawScreen(target == BackBuffer ? int(DX_SCREEN_BACK) : target);
+}
+
+int DxLibRenderDevice::GetRenderTarget()
+{
+    const auto target = GetDrawScreen();
+    return target == int(DX_SCREEN_BACK) ? BackBuffer : target;
+}
+
+void DxLibRenderDevice::Clear()
+{
+    ClearDrawScreen();
+}
+
+void DxLibRenderDevice::Present()
+{
+    ScreenFlip();
+}
+
+void DxLibRenderDevice::SetBlendMode(const RenderBlendMode mode, const int param)
+{
+    SetDrawBlendMode(ToDxLibBlendMode(mode), param);
+}
+
+void DxLibRenderDevice::SetBright(const int r, const int g, const int b)
+{
+    SetDrawBright(r, g, b);
+}
+
+void DxLibRenderDevice::SetFilterMode(const RenderFilterMode mode)
+{
+    SetDrawMode(ToDxLibDrawMode(mode));
+}
+
+void DxLibRenderDevice::SetDepthTest(const bool enabled)
+{
+    SetUseZBuffer3D(enabled ? TRUE : FALSE);
+}
+
+void DxLibRenderDevice::SetBackCulling(const bool enabled)
+{
+    SetUseBackCulling(enabled ? TRUE : FALSE);
+}
+
+void DxLibRenderDevice::SetCamera(const VECTOR &position, const VECTOR &target)
+{
+    SetUseLighting(FALSE);
+    SetCameraPositionAndTarget_UpVecY(position, target);
+}
+
+void DxLibRenderDevice::DrawPolygon2D(const VERTEX2D *vertices, const int vertexCount, const uint16_t *indices, const int polygonCount, const int texture, const bool alpha)
+{
+    DrawPolygonIndexed2D(vertices, vertexCount, indices, polygonCount, texture, alpha ? TRUE : FALSE);
+}
+
+void DxLibRenderDevice::DrawImageQuad(
+    const float x1, const float y1, const float x2, const float y2, const float x3, const float y3, const float x4, const float y4,
+    const int srcX, const int srcY, const int srcWidth, const int srcHeight, const int texture, const bool alpha)
+{
+    DrawRectModiGraphF(x1, y1, x2, y2, x3, y3, x4, y4, srcX, srcY, srcWidth, srcHeight, texture, alpha ? TRUE : FALSE);
+}
+
+void DxLibRenderDevice::DrawImage(
+    const float x, const float y, const int srcX, const int srcY, const int srcWidth, const int srcHeight,
+    const float originX, const float originY, const double scaleX, const double scaleY, const double angle, const int texture, const bool alpha)
+{
+    DrawRectRotaGraph3F(
+        x, y,
+        srcX, srcY, srcWidth, srcHeight,
+        originX, originY,
+        scaleX, scaleY,
+        angle, texture,
+        alpha ? TRUE : FALSE, FALSE);
+}
+
+void DxLibRenderDevice::DrawLine(const float x1, const float y1, const float x2, const float y2, const uint32_t color, const float thickness)
+{
+    DrawLineAA(x1, y1, x2, y2, ToDxLibColor(color), thickness);
+}
+
+void DxLibRenderDevice::DrawTriangle(const float x1, const float y1, const float x2, const float y2, const float x3, const float y3, const uint32_t color, const bool fill)
+{
+    DrawTriangleAA(x1, y1, x2, y2, x3, y3, ToDxLibColor(color), fill ? TRUE : FALSE);
+}
+
+void DxLibRenderDevice::DrawQuadrangle(const float x1, const float y1, const float x2, const float y2, const float x3, const float y3, const float x4, const float y4, const uint32_t color, const bool fill)
+{
+    DrawQuadrangleAA(x1, y1, x2, y2, x3, y3, x4, y4, ToDxLibColor(color), fill ? TRUE : FALSE);
+}
+
+void DxLibRenderDevice::DrawPixel(const int x, const int y, const uint32_t color)
+{
+    ::DrawPixel(x, y, ToDxLibColor(color));
+}
+
+void DxLibRenderDevice::DrawDebugText(const int x, const int y, const wstring &text, const uint32_t color)
+{
+    DrawString(x, y, reinterpret_cast<const char*>(text.c_str()), ToDxLibColor(color));
+}
+
+void DxLibRenderDevice::DrawPolygon3D(const VERTEX3D *vertices, const int vertexCount, const uint16_t *indices, const int polygonCount, const int texture, const bool alpha)
+{
+    DrawPolygonIndexed3D(vertices, vertexCount, indices, polygonCount, texture, alpha ? TRUE : FALSE);
+}
+
+void DxLibRenderDevice::DrawTriangle3D(const VECTOR &p1, const VECTOR &p2, const VECTOR &p3, const uint32_t color, const bool fill)
+{
+    ::DrawTriangle3D(p1, p2, p3, ToDxLibColor(color), fill ? TRUE : FALSE);
+}
+
+// RecordingRenderDevice ------------------------
+namespace
+{
+    const float CameraNear = 10.0f;
+    const float CameraFieldOfView = float(M_PI / 3.0);
+
+    // a → b の辺に対する p の位置 (画面座標で時計回りの三角形なら内側が正)
+    float EdgeFunction(const float ax, const float ay, const float bx, const float by, const float px, const float py)
+    {
+        return (bx - ax) * (py - ay) - (by - ay) * (px - ax);
+    }
+
+    // 辺上の点を含めるか 隣り合う三角形で同じ点を二度塗らないように上辺と左辺だけ含める
+    bool IsTopLeftEdge(const float ax, const float ay, const float bx, const float by)
+    {
+        return (ay == by && bx > ax) || by < ay;
+    }
+
+    float ClampUnit(const float value)
+    {
+        return value < 0 ? 0 : (value > 1 ? 1 : value);
+    }
+
+    uint32_t PackColor(const float r, const float g, const float b, const float a)
+    {
+        const auto pack = [](const float value) { return uint32_t(ClampUnit(value) * 255.0f + 0.5f); };
+        return pack(a) << 24 | pack(r) << 16 | pack(g) << 8 | pack(b);
+    }
+
+    void UnpackColor(const uint32_t color, float *r, float *g, float *b, float *a)
+    {
+        *a = (color >> 24 & 0xFF) / 255.0f;
+        *r = (color >> 16 & 0xFF) / 255.0f;
+        *g = (color >> 8 & 0xFF) / 255.0f;
+        *b = (color & 0xFF) / 255.0f;
+    }
+}
+
+RecordingRenderDevice::RecordingRenderDevice(const int width, const int height, const bool rasterize) : rasterize(rasterize)
+{
+    Surface back;
+    back.Width = width;
+    back.Height = height;
+    back.Pixels.assign(size_t(width) * height, 0xFF000000);
+    surfaces[BackBuffer] = move(back);
+
+    // DxLib の既定と同じく、画面全体がちょうど z = 0 の平面に収まる位置から見る
+    const auto distance = height / 2.0f / tan(CameraFieldOfView / 2);
+    SetCamera(VGet(width / 2.0f, height / 2.0f, -distance), VGet(width / 2.0f, height / 2.0f, 0));
+}
+
+RecordingRenderDevice::Surface* RecordingRenderDevice::FindSurface(const int handle)
+{
+    const auto it = surfaces.find(handle);
+    return it == surfaces.end() ? nullptr : &it->second;
+}
+
+int RecordingRenderDevice::AddSurface(Surface &&surface)
+{
+    const auto handle = nextHandle++;
+    surfaces[handle] = move(surface);
+    return handle;
+}
+
+bool RecordingRenderDevice::ReadSoftImage(const int softImage, const int x, const int y, const int width, const int height, Surface *surface) const
+{
+    int imageWidth, imageHeight;
+    if (GetSoftImageSize(softImage, &imageWidth, &imageHeight) == -1) return false;
+    if (x < 0 || y < 0 || width <= 0 || height <= 0 || x + width > imageWidth || y + height > imageHeight) return false;
+
+    surface->Width = width;
+    surface->Height = height;
+    surface->Pixels.resize(size_t(width) * height);
+    surface->Depth.clear();
+    for (auto py = 0; py < height; py++) {
+        for (auto px = 0; px < width; px++) {
+            int r, g, b, a;
+            GetPixelSoftImage(softImage, x + px, y + py, &r, &g, &b, &a);
+            surface->Pixels[size_t(py) * width + px] = uint32_t(a) << 24 | uint32_t(r) << 16 | uint32_t(g) << 8 | uint32_t(b);
+        }
+    }
+    return true;
+}
+
+void RecordingRenderDevice::Record(const CommandType type, const int texture, const uint32_t primitives)
+{
+    commands.push_back({ type, target, texture, blendMode, blendParam, primitives });
+}
+
+int RecordingRenderDevice::LoadTexture(const wstring &file, const bool async)
+{
+    // 読み込みはいつも同期で行う
+    const auto softImage = LoadARGB8ColorSoftImage(reinterpret_cast<const char*>(file.c_str()));
+    if (softImage == -1) return -1;
+    const auto handle = CreateTextureFromSoftImage(softImage);
+    DeleteSoftImage(softImage);
+    return handle;
+}
+
+int RecordingRenderDevice::LoadTextureFromMemory(const void *buffer, const size_t size)
+{
+    const auto softImage = LoadARGB8ColorSoftImageToMem(buffer, SU_TO_INT32(size));
+    if (softImage == -1) return -1;
+    const auto handle = CreateTextureFromSoftImage(softImage);
+    DeleteSoftImage(softImage);
+    return handle;
+}
+
+bool RecordingRenderDevice::LoadDividedTextures(const wstring &file, const int count, const int xCount, const int yCount, const int width, const int height, int *handles)
+{
+    const auto softImage = LoadARGB8ColorSoftImage(reinterpret_cast<const char*>(file.c_str()));
+    if (softImage == -1) return false;
+    auto succeeded = xCount > 0 && count <= xCount * yCount;
+    for (auto i = 0; succeeded && i < count; i++) {
+        Surface surface;
+        succeeded = ReadSoftImage(softImage, i % xCount * width, i / xCount * height, width, height, &surface);
+        handles[i] = succeeded ? AddSurface(move(surface)) : -1;
+    }
+    DeleteSoftImage(softImage);
+    return succeeded;
+}
+
+bool RecordingRenderDevice::LoadDividedTexturesFromMemory(const void *buffer, const size_t size, const int count, const int xCount, const int yCount, const int width, const int height, int *handles)
+{
+    const auto softImage = LoadARGB8ColorSoftImageToMem(buffer, SU_TO_INT32(size));
+    if (softImage == -1) return false;
+    auto succeeded = xCount > 0 && count <= xCount * yCount;
+    for (auto i = 0; succeeded && i < count; i++) {
+        Surface surface;
+        succeeded = ReadSoftImage(softImage, i % xCount * width, i / xCount * height, width, height, &surface);
+        handles[i] = succeeded ? AddSurface(move(surface)) : -1;
+    }
+    DeleteSoftImage(softImage);
+    return succeeded;
+}
+
+int RecordingRenderDevice::CreateTextureFromSoftImage(const int softImage)
+{
+    int width, height;
+    if (GetSoftImageSize(softImage, &width, &height) == -1) return -1;
+    Surface surface;
+    if (!ReadSoftImage(softImage, 0, 0, width, height, &surface)) return -1;
+    return AddSurface(move(surface));
+}
+
+bool RecordingRenderDevice::UpdateTextureFromSoftImage(const int softImage, const int texture)
+{
+    const auto surface = FindSurface(texture);
+    int width, height;
+    if (!surface || GetSoftImageSize(softImage, &width, &height) == -1) return false;
+    return ReadSoftImage(softImage, 0, 0, width, height, surface);
+}
+
+int RecordingRenderDevice::CreateRenderTarget(const int width, const int height)
+{
+    if (width <= 0 || height <= 0) return -1;
+    Surface surface;
+    surface.Width = width;
+    surface.Height = height;
+    surface.Pixels.assign(size_t(width) * height, 0);
+    return AddSurface(move(surface));
+}
+
+void RecordingRenderDevice::DeleteTexture(const int texture)
+{
+    if (texture == BackBuffer) return;
+    surfaces.erase(texture);
+    if (target == texture) target = BackBuffer;
+}
+
+bool RecordingRenderDevice::GetTextureSize(const int texture, int *width, int *height)
+{
+    const auto surface = FindSurface(texture);
+    if (!surface) return false;
+    *width = surface->Width;
+    *height = surface->Height;
+    return true;
+}
+
+void RecordingRenderDevice::SetRenderTarget(const int target)
+{
+    this->target = FindSurface(target) ? target : BackBuffer;
+}
+
+void RecordingRenderDevice::Clear()
+{
+    Record(CommandType::Clear, -1, 0);
+    const auto surface = FindSurface(target);
+    if (!surface) return;
+    fill(surface->Pixels.begin(), surface->Pixels.end(), target == BackBuffer ? 0xFF000000 : 0);
+    surface->Depth.clear();
+}
+
+void RecordingRenderDevice::SetBlendMode(const RenderBlendMode mode, const int param)
+{
+    blendMode = mode;
+    blendParam = param;
+}
+
+void RecordingRenderDevice::SetBright(const int r, const int g, const int b)
+{
+    brightR = r;
+    brightG = g;
+    brightB = b;
+}
+
+void RecordingRenderDevice::SetCamera(const VECTOR &position, const VECTOR &target)
+{
+    // 左手系 Y+ が上
+    cameraPosition = position;
+    cameraForward = VNorm(VSub(target, position));
+    cameraRight = VNorm(VCross(VGet(0, 1, 0), cameraForward));
+    cameraUp = VCross(cameraForward, cameraRight);
+}
+
+bool RecordingRenderDevice::ProjectVertex(const VECTOR &position, const Surface &surface, float *x, float *y, float *inverseW) const
+{
+    const auto relative = VSub(position, cameraPosition);
+    const auto depth = VDot(relative, cameraForward);
+    if (depth < CameraNear) return false;
+
+    const auto scale = 1.0f / tan(CameraFieldOfView / 2);
+    const auto aspect = float(surface.Width) / surface.Height;
+    const auto ndcX = VDot(relative, cameraRight) * scale / aspect / depth;
+    const auto ndcY = VDot(relative, cameraUp) * scale / depth;
+    *x = surface.Width / 2.0f * (1 + ndcX);
+    *y = surface.Height / 2.0f * (1 - ndcY);
+    *inverseW = 1.0f / depth;
+    return true;
+}
+
+void RecordingRenderDevice::BlendPixel(Surface &surface, const int x, const int y, const float r, const float g, const float b, const float a)
+{
+    auto &pixel = surface.Pixels[size_t(y) * surface.Width + x];
+    float dr, dg, db, da;
+    UnpackColor(pixel, &dr, &dg, &db, &da);
+    const auto alpha = a * blendParam / 255.0f;
+    switch (blendMode) {
+        case RenderBlendMode::Alpha:
+            pixel = PackColor(r * alpha + dr * (1 - alpha), g * alpha + dg * (1 - alpha), b * alpha + db * (1 - alpha), alpha + da * (1 - alpha));
+            break;
+        case RenderBlendMode::Add:
+            pixel = PackColor(dr + r * alpha, dg + g * alpha, db + b * alpha, da);
+            break;
+        default:
+            pixel = PackColor(r, g, b, a);
+            break;
+    }
+}
+
+void RecordingRenderDevice::FillTriangle(const RasterVertex &v0, const RasterVertex &v1, const RasterVertex &v2, const Surface *texture, const bool alpha, const bool useDepth)
+{
+    const auto surface = FindSurface(target);
+    if (!surface) return;
+
+    const auto area = EdgeFunction(v0.X, v0.Y, v1.X, v1.Y, v2.X, v2.Y);
+    if (area == 0 || (backCulling && area < 0)) return;
+    // 時計回りに揃える
+    const auto &a = v0;
+    const auto &b = area > 0 ? v1 : v2;
+    const auto &c = area > 0 ? v2 : v1;
+    const auto signedArea = abs(area);
+
+    const auto minX = max(0, int(floor(min({ a.X, b.X, c.X }))));
+    const auto maxX = min(surface->Width - 1, int(ceil(max({ a.X, b.X, c.X }))));
+    const auto minY = max(0, int(floor(min({ a.Y, b.Y, c.Y }))));
+    const auto maxY = min(surface->Height - 1, int(ceil(max({ a.Y, b.Y, c.Y }))));
+    if (minX > maxX || minY > maxY) return;
+
+    const bool inclusive[] = {
+        IsTopLeftEdge(b.X, b.Y, c.X, c.Y),
+        IsTopLeftEdge(c.X, c.Y, a.X, a.Y),
+        IsTopLeftEdge(a.X, a.Y, b.X, b.Y),
+    };
+    if (useDepth && surface->Depth.empty()) surface->Depth.assign(surface->Pixels.size(), numeric_limits<float>::max());
+
+    for (auto y = minY; y <= maxY; y++) {
+        const auto py = y + 0.5f;
+        for (auto x = minX; x <= maxX; x++) {
+            const auto px = x + 0.5f;
+            const float edges[] = {
+                EdgeFunction(b.X, b.Y, c.X, c.Y, px, py),
+                EdgeFunction(c.X, c.Y, a.X, a.Y, px, py),
+                EdgeFunction(a.X, a.Y, b.X, b.Y, px, py),
+            };
+            auto inside = true;
+            for (auto i = 0; i < 3 && inside; i++) inside = edges[i] > 0 || (edges[i] == 0 && inclusive[i]);
+            if (!inside) continue;
+
+            // 3D では 1/w で割り戻して奥行きに対して正しく補間する
+            const auto wa = edges[0] / signedArea * a.InverseW;
+            const auto wb = edges[1] / signedArea * b.InverseW;
+            const auto wc = edges[2] / signedArea * c.InverseW;
+            const auto sum = wa + wb + wc;
+            if (useDepth) {
+                const auto depth = 1.0f / sum;
+                auto &stored = surface->Depth[size_t(y) * surface->Width + x];
+                if (depth > stored) continue;
+                stored = depth;
+            }
+            const auto interpolate = [&](const float RasterVertex::*field) { return (wa * (a.*field) + wb * (b.*field) + wc * (c.*field)) / sum; };
+
+            auto r = interpolate(&RasterVertex::R);
+            auto g = interpolate(&RasterVertex::G);
+            auto bl = interpolate(&RasterVertex::B);
+            auto al = interpolate(&RasterVertex::A);
+            if (texture) {
+                const auto u = interpolate(&RasterVertex::U) * texture->Width - 0.5f;
+                const auto v = interpolate(&RasterVertex::V) * texture->Height - 0.5f;
+                const auto texel = [texture](const int tx, const int ty) {
+                    const auto cx = max(0, min(texture->Width - 1, tx));
+                    const auto cy = max(0, min(texture->Height - 1, ty));
+                    return texture->Pixels[size_t(cy) * texture->Width + cx];
+                };
+                float tr, tg, tb, ta;
+                if (filterMode == RenderFilterMode::Nearest) {
+                    UnpackColor(texel(int(floor(u + 0.5f)), int(floor(v + 0.5f))), &tr, &tg, &tb, &ta);
+                } else {
+                    const auto x0 = int(floor(u)), y0 = int(floor(v));
+                    const auto fx = u - x0, fy = v - y0;
+                    float samples[4][4];
+                    UnpackColor(texel(x0, y0), &samples[0][0], &samples[0][1], &samples[0][2], &samples[0][3]);
+                    UnpackColor(texel(x0 + 1, y0), &samples[1][0], &samples[1][1], &samples[1][2], &samples[1][3]);
+                    UnpackColor(texel(x0, y0 + 1), &samples[2][0], &samples[2][1], &samples[2][2], &samples[2][3]);
+                    UnpackColor(texel(x0 + 1, y0 + 1), &samples[3][0], &samples[3][1], &samples[3][2], &samples[3][3]);
+                    float filtered[4];
+                    for (auto i = 0; i < 4; i++) {
+                        const auto top = samples[0][i] + (samples[1][i] - samples[0][i]) * fx;
+                        const auto bottom = samples[2][i] + (samples[3][i] - samples[2][i]) * fx;
+                        filtered[i] = top + (bottom - top) * fy;
+                    }
+                    tr = filtered[0];
+                    tg = filtered[1];
+                    tb = filtered[2];
+                    ta = filtered[3];
+                }
+                r *= tr;
+                g *= tg;
+                bl *= tb;
+                if (alpha) al *= ta;
+            }
+            BlendPixel(*surface, x, y, r, g, bl, al);
+        }
+    }
+}
+
+void RecordingRenderDevice::FillSolidTriangle(const float x1, const float y1, const float x2, const float y2, const float x3, const float y3, const uint32_t color)
+{
+    float r, g, b, a;
+    UnpackColor(color | 0xFF000000, &r, &g, &b, &a);
+    r *= brightR / 255.0f;
+    g *= brightG / 255.0f;
+    b *= brightB / 255.0f;
+    const RasterVertex v0 = { x1, y1, 1, 0, 0, r, g, b, a };
+    const RasterVertex v1 = { x2, y2, 1, 0, 0, r, g, b, a };
+    const RasterVertex v2 = { x3, y3, 1, 0, 0, r, g, b, a };
+    FillTriangle(v0, v1, v2, nullptr, false, false);
+}
+
+void RecordingRenderDevice::DrawPolygon2D(const VERTEX2D *vertices, const int vertexCount, const uint16_t *indices, const int polygonCount, const int texture, const bool alpha)
+{
+    Record(CommandType::Polygon2D, texture, uint32_t(polygonCount));
+    if (!rasterize) return;
+
+    const auto textureSurface = FindSurface(texture);
+    const auto convert = [this, vertices](const int index) {
+        const auto &vertex = vertices[index];
+        return RasterVertex {
+            vertex.pos.x, vertex.pos.y, 1, vertex.u, vertex.v,
+            vertex.dif.r / 255.0f * brightR / 255.0f, vertex.dif.g / 255.0f * brightG / 255.0f, vertex.dif.b / 255.0f * brightB / 255.0f,
+            vertex.dif.a / 255.0f
+        };
+    };
+    for (auto i = 0; i < polygonCount; i++) {
+        const auto i0 = indices[i * 3], i1 = indices[i * 3 + 1], i2 = indices[i * 3 + 2];
+        if (i0 >= vertexCount || i1 >= vertexCount || i2 >= vertexCount) continue;
+        FillTriangle(convert(i0), convert(i1), convert(i2), textureSurface, alpha, false);
+    }
+}
+
+void RecordingRenderDevice::DrawImageQuad(
+    const float x1, const float y1, const float x2, const float y2, const float x3, const float y3, const float x4, const float y4,
+    const int srcX, const int srcY, const int srcWidth, const int srcHeight, const int texture, const bool alpha)
+{
+    Record(CommandType::ImageQuad, texture, 2);
+    const auto textureSurface = FindSurface(texture);
+    if (!rasterize || !textureSurface) return;
+
+    const auto u1 = float(srcX) / textureSurface->Width;
+    const auto v1 = float(srcY) / textureSurface->Height;
+    const auto u2 = float(srcX + srcWidth) / textureSurface->Width;
+    const auto v2 = float(srcY + srcHeight) / textureSurface->Height;
+    const auto r = brightR / 255.0f, g = brightG / 255.0f, b = brightB / 255.0f;
+    const RasterVertex topLeft = { x1, y1, 1, u1, v1, r, g, b, 1 };
+    const RasterVertex topRight = { x2, y2, 1, u2, v1, r, g, b, 1 };
+    const RasterVertex bottomRight = { x3, y3, 1, u2, v2, r, g, b, 1 };
+    const RasterVertex bottomLeft = { x4, y4, 1, u1, v2, r, g, b, 1 };
+    FillTriangle(topLeft, topRight, bottomLeft, textureSurface, alpha, false);
+    FillTriangle(topRight, bottomRight, bottomLeft, textureSurface, alpha, false);
+}
+
+void RecordingRenderDevice::DrawLine(const float x1, const float y1, const float x2, const float y2, const uint32_t color, const float thickness)
+{
+    Record(CommandType::Line, -1, 2);
+    const auto length = hypot(x2 - x1, y2 - y1);
+    if (!rasterize || length == 0) return;
+
+    // 太さ分の幅を持った四角形として塗る
+    const auto nx = -(y2 - y1) / length * max(thickness, 1.0f) / 2;
+    const auto ny = (x2 - x1) / length * max(thickness, 1.0f) / 2;
+    FillSolidTriangle(x1 + nx, y1 + ny, x2 + nx, y2 + ny, x1 - nx, y1 - ny, color);
+    FillSolidTriangle(x2 + nx, y2 + ny, x2 - nx, y2 - ny, x1 - nx, y1 - ny, color);
+}
+
+void RecordingRenderDevice::DrawTriangle(const float x1, const float y1, const float x2, const float y2, const float x3, const float y3, const uint32_t color, const bool fill)
+{
+    if (!fill) {
+        DrawLine(x1, y1, x2, y2, color, 1);
+        DrawLine(x2, y2, x3, y3, color, 1);
+        DrawLine(x3, y3, x1, y1, color, 1);
+        return;
+    }
+    Record(CommandType::Triangle, -1, 1);
+    if (rasterize) FillSolidTriangle(x1, y1, x2, y2, x3, y3, color);
+}
+
+void RecordingRenderDevice::DrawQuadrangle(const float x1, const float y1, const float x2, const float y2, const float x3, const float y3, const float x4, const float y4, const uint32_t color, const bool fill)
+{
+    if (!fill) {
+        DrawLine(x1, y1, x2, y2, color, 1);
+        DrawLine(x2, y2, x3, y3, color, 1);
+        DrawLine(x3, y3, x4, y4, color, 1);
+        DrawLine(x4, y4, x1, y1, color, 1);
+        return;
+    }
+    Record(CommandType::Quadrangle, -1, 2);
+    if (!rasterize) return;
+    FillSolidTriangle(x1, y1, x2, y2, x4, y4, color);
+    FillSolidTriangle(x2, y2, x3, y3, x4, y4, color);
+}
+
+void RecordingRenderDevice::DrawPixel(const int x, const int y, const uint32_t color)
+{
+    Record(CommandType::Pixel, -1, 0);
+    const auto surface = FindSurface(target);
+    if (!rasterize || !surface || x < 0 || y < 0 || x >= surface->Width || y >= surface->Height) return;
+    float r, g, b, a;
+    UnpackColor(color | 0xFF000000, &r, &g, &b, &a);
+    BlendPixel(*surface, x, y, r * brightR / 255.0f, g * brightG / 255.0f, b * brightB / 255.0f, a);
+}
+
+void RecordingRenderDevice::DrawDebugText(const int x, const int y, const wstring &text, const uint32_t color)
+{
+    Record(CommandType::DebugText, -1, 0);
+}
+
+void RecordingRenderDevice::DrawPolygon3D(const VERTEX3D *vertices, const int vertexCount, const uint16_t *indices, const int polygonCount, const int texture, const bool alpha)
+{
+    Record(CommandType::Polygon3D, texture, uint32_t(polygonCount));
+    const auto surface = FindSurface(target);
+    if (!rasterize || !surface) return;
+
+    const auto textureSurface = FindSurface(texture);
+    const auto convert = [&](const int index, RasterVertex *result) {
+        const auto &vertex = vertices[index];
+        *result = {
+            0, 0, 0, vertex.u, vertex.v,
+            vertex.dif.r / 255.0f * brightR / 255.0f, vertex.dif.g / 255.0f * brightG / 255.0f, vertex.dif.b / 255.0f * brightB / 255.0f,
+            vertex.dif.a / 255.0f
+        };
+        return ProjectVertex(vertex.pos, *surface, &result->X, &result->Y, &result->InverseW);
+    };
+    for (auto i = 0; i < polygonCount; i++) {
+        const auto i0 = indices[i * 3], i1 = indices[i * 3 + 1], i2 = indices[i * 3 + 2];
+        if (i0 >= vertexCount || i1 >= vertexCount || i2 >= vertexCount) continue;
+        RasterVertex v0, v1, v2;
+        if (!convert(i0, &v0) || !convert(i1, &v1) || !convert(i2, &v2)) continue;
+        FillTriangle(v0, v1, v2, textureSurface, alpha, depthTest);
+    }
+}
+
+void RecordingRenderDevice::DrawTriangle3D(const VECTOR &p1, const VECTOR &p2, const VECTOR &p3, const uint32_t color, const bool fill)
+{
+    Record(CommandType::Triangle3D, -1, 1);
+    const auto surface = FindSurface(target);
+    if (!rasterize || !surface) return;
+
+    float r, g, b, a;
+    UnpackColor(color | 0xFF000000, &r, &g, &b, &a);
+    RasterVertex projected[3];
+    const VECTOR *positions[] = { &p1, &p2, &p3 };
+    for (auto i = 0; i < 3; i++) {
+        projected[i] = { 0, 0, 0, 0, 0, r * brightR / 255.0f, g * brightG / 255.0f, b * brightB / 255.0f, a };
+        if (!ProjectVertex(*positions[i], *surface, &projected[i].X, &projected[i].Y, &projected[i].InverseW)) return;
+    }
+    if (fill) {
+        FillTriangle(projected[0], projected[1], projected[2], nullptr, false, depthTest);
+        return;
+    }
+    for (auto i = 0; i < 3; i++) {
+        const auto &from = projected[i];
+        const auto &to = projected[(i + 1) % 3];
+        DrawLine(from.X, from.Y, to.X, to.Y, color, 1);
+    }
+}
+
+bool RecordingRenderDevice::SavePng(const int surface, const wstring &fileName)
+{
+    const auto source = FindSurface(surface);
+    if (!source) return false;
+    const auto file = _wfopen(fileName.c_str(), L"wb");
+    if (!file) return false;
+
+    vector<png_byte> pixels(size_t(source->Width) * source->Height * 4);
+    for (size_t i = 0; i < source->Pixels.size(); i++) {
+        const auto color = source->Pixels[i];
+        pixels[i * 4 + 0] = png_byte(color >> 16 & 0xFF);
+        pixels[i * 4 + 1] = png_byte(color >> 8 & 0xFF);
+        pixels[i * 4 + 2] = png_byte(color & 0xFF);
+        pixels[i * 4 + 3] = png_byte(color >> 24 & 0xFF);
+    }
+    vector<png_byte*> rows(source->Height);
+    for (auto i = 0; i < source->Height; i++) rows[i] = pixels.data() + size_t(source->Width) * i * 4;
+
+    auto png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    auto info = png_create_info_struct(png);
+    png_init_io(png, file);
+    png_set_IHDR(png, info, source->Width, source->Height, 8, PNG_COLOR_TYPE_RGB_ALPHA, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_set_rows(png, info, rows.data());
+    png_write_png(png, info, PNG_TRANSFORM_IDENTITY, nullptr);
+    png_destroy_write_struct(&png, &info);
+    fclose(file);
+    return true;
+}
+
+bool RecordingRenderDevice::GetPixels(const int surface, int *width, int *height, vector<uint32_t> *pixels) const
+{
+    const auto it = surfaces.find(surface);
+    if (it == surfaces.end()) return false;
+    *width = it->second.Width;
+    *height = it->second.Height;
+    *pixels = it->second.Pixels;
+    return true;
+}
+
+const char* RecordingRenderDevice::GetCommandTypeName(const CommandType type)
+{
+    switch (type) {
+        case CommandType::Clear: return "Clear";
+        case CommandType::Polygon2D: return "Polygon2D";
+        case CommandType::ImageQuad: return "ImageQuad";
+        case CommandType::Line: return "Line";
+        case CommandType::Triangle: return "Triangle";
+        case CommandType::Quadrangle: return "Quadrangle";
+        case CommandType::Pixel: return "Pixel";
+        case CommandType::DebugText: return "DebugText";
+        case CommandType::Polygon3D: return "Polygon3D";
+        case CommandType::Triangle3D: return "Triangle3D";
+        default: return "Unknown";
+    }
+}
@@ -0,0 +1,241 @@
+﻿#pragma once
+
+// 描画の出口
+// テクスチャ・描画先・合成方法の管理と2D/3Dのポリゴン送信をまとめ、描画する側は DxLib を直接呼ばずにここを通す
+// ハンドルは 0 (と -1) が無効 頂点は DxLib の VERTEX2D / VERTEX3D の並びをそのまま使う
+
+enum class RenderBlendMode {
+    None,       // そのまま上書き
+    Alpha,
+    Add,
+};
+
+enum class RenderFilterMode {
+    Nearest,
+    Bilinear,
+    Anisotropic,
+};
+
+// 0xRRGGBB
+inline uint32_t MakeRenderColor(const int r, const int g, const int b)
+{
+    return uint32_t((r & 0xFF) << 16 | (g & 0xFF) << 8 | (b & 0xFF));
+}
+
+class RenderDevice {
+private:
+    static RenderDevice *current;
+
+public:
+    static const int BackBuffer = -2;
+
+    virtual ~RenderDevice() = default;
+
+    // テクスチャ
+    virtual int LoadTexture(const std::wstring &file, bool async) = 0;
+    virtual int LoadTextureFromMemory(const void *buffer, size_t size) = 0;
+    // 横 xCount 個ずつ並んだ width x height のコマを count 個切り出して handles に入れる
+    virtual bool LoadDividedTextures(const std::wstring &file, int count, int xCount, int yCount, int width, int height, int *handles) = 0;
+    virtual bool LoadDividedTexturesFromMemory(const void *buffer, size_t size, int count, int xCount, int yCount, int width, int height, int *handles) = 0;
+    virtual int CreateTextureFromSoftImage(int softImage) = 0;
+    // ハンドルを変えずに中身だけ差し替える
+    virtual bool UpdateTextureFromSoftImage(int softImage, int texture) = 0;
+    virtual int CreateRenderTarget(int width, int height) = 0;
+    virtual void DeleteTexture(int texture) = 0;
+    virtual bool GetTextureSize(int texture, int *width, int *height) = 0;
+
+    // 状態
+    virtual void SetRenderTarget(int target) = 0;
+    virtual int GetRenderTarget() = 0;
+    virtual void Clear() = 0;
+    // 裏画面を表に出す
+    virtual void Present() = 0;
+    virtual void SetBlendMode(RenderBlendMode mode, int param) = 0;
+    virtual void SetBright(int r, int g, int b) = 0;
+    virtual void SetFilterMode(RenderFilterMode mode) = 0;
+    virtual void SetDepthTest(bool enabled) = 0;
+    virtual void SetBackCulling(bool enabled) = 0;
+    // 上方向は Y+
+    virtual void SetCamera(const VECTOR &position, const VECTOR &target) = 0;
+
+    // 2D
+    virtual void DrawPolygon2D(const VERTEX2D *vertices, int vertexCount, const uint16_t *indices, int polygonCount, int texture, bool alpha) = 0;
+    // テクスチャの (srcX, srcY, srcWidth, srcHeight) を4点 (左上, 右上, 右下, 左下) に合わせて描く
+    virtual void DrawImageQuad(
+        float x1, float y1, float x2, float y2, float x3, float y3, float x4, float y4,
+        int srcX, int srcY, int srcWidth, int srcHeight, int texture, bool alpha) = 0;
+    // DrawRectRotaGraph3F と同じ置き方 (画像上の origin を (x, y) に合わせて拡大・回転)
+    virtual void DrawImage(
+        float x, float y, int srcX, int srcY, int srcWidth, int srcHeight,
+        float originX, float originY, double scaleX, double scaleY, double angle, int texture, bool alpha);
+    void DrawImageExtended(float x1, float y1, float x2, float y2, int srcX, int srcY, int srcWidth, int srcHeight, int texture, bool alpha);
+    virtual void DrawLine(float x1, float y1, float x2, float y2, uint32_t color, float thickness) = 0;
+    virtual void DrawTriangle(float x1, float y1, float x2, float y2, float x3, float y3, uint32_t color, bool fill) = 0;
+    virtual void DrawQuadrangle(float x1, float y1, float x2, float y2, float x3, float y3, float x4, float y4, uint32_t color, bool fill) = 0;
+    virtual void DrawPixel(int x, int y, uint32_t color) = 0;
+    virtual void DrawDebugText(int x, int y, const std::wstring &text, uint32_t color) = 0;
+
+    // 3D
+    virtual void DrawPolygon3D(const VERTEX3D *vertices, int vertexCount, const uint16_t *indices, int polygonCount, int texture, bool alpha) = 0;
+    virtual void DrawTriangle3D(const VECTOR &p1, const VECTOR &p2, const VECTOR &p3, uint32_t color, bool fill) = 0;
+
+    static RenderDevice* GetCurrent() { return current; }
+    static void SetCurrent(RenderDevice *device) { current = device; }
+
+    static std::unique_ptr<RenderDevice> CreateDxLib();
+    // rasterize が false なら命令を記録するだけで描かない
+    static std::unique_ptr<RenderDevice> CreateRecording(int width, int height, bool rasterize);
+};
+
+// DxLib にそのまま流す
+class DxLibRenderDevice final : public RenderDevice {
+public:
+    int LoadTexture(const std::wstring &file, bool async) override;
+    int LoadTextureFromMemory(const void *buffer, size_t size) override;
+    bool LoadDividedTextures(const std::wstring &file, int count, int xCount, int yCount, int width, int height, int *handles) override;
+    bool LoadDividedTexturesFromMemory(const void *buffer, size_t size, int count, int xCount, int yCount, int width, int height, int *handles) override;
+    int CreateTextureFromSoftImage(int softImage) override;
+    bool UpdateTextureFromSoftImage(int softImage, int texture) override;
+    int CreateRenderTarget(int width, int height) override;
+    void DeleteTexture(int texture) override;
+    bool GetTextureSize(int texture, int *width, int *height) override;
+
+    void SetRenderTarget(int target) override;
+    int GetRenderTarget() override;
+    void Clear() override;
+    void Present() override;
+    void SetBlendMode(RenderBlendMode mode, int param) override;
+    void SetBright(int r, int g, int b) override;
+    void SetFilterMode(RenderFilterMode mode) override;
+    void SetDepthTest(bool enabled) override;
+    void SetBackCulling(bool enabled) override;
+    void SetCamera(const VECTOR &position, const VECTOR &target) override;
+
+    void DrawPolygon2D(const VERTEX2D *vertices, int vertexCount, const uint16_t *indices, int polygonCount, int texture, bool alpha) override;
+    void DrawImageQuad(
+        float x1, float y1, float x2, float y2, float x3, float y3, float x4, float y4,
+        int srcX, int srcY, int srcWidth, int srcHeight, int texture, bool alpha) override;
+    void DrawImage(
+        float x, float y, int srcX, int srcY, int srcWidth, int srcHeight,
+        float originX, float originY, double scaleX, double scaleY, double angle, int texture, bool alpha) override;
+    void DrawLine(float x1, float y1, float x2, float y2, uint32_t color, float thickness) override;
+    void DrawTriangle(float x1, float y1, float x2, float y2, float x3, float y3, uint32_t color, bool fill) override;
+    void DrawQuadrangle(float x1, float y1, float x2, float y2, float x3, float y3, float x4, float y4, uint32_t color, bool fill) override;
+    void DrawPixel(int x, int y, uint32_t color) override;
+    void DrawDebugText(int x, int y, const std::wstring &text, uint32_t color) override;
+
+    void DrawPolygon3D(const VERTEX3D *vertices, int vertexCount, const uint16_t *indices, int polygonCount, int texture, bool alpha) override;
+    void DrawTriangle3D(const VECTOR &p1, const VECTOR &p2, const VECTOR &p3, uint32_t color, bool fill) override;
+};
+
+// GPU を使わない実装 送られた命令を記録し、必要ならソフトウェアで描いて PNG に書き出せる
+// ウィンドウのない実行 (ヘッドレス・CI) での画像比較や描画負荷の計測に使う
+// 3D は DxLib の既定のカメラ (視野角60度, 手前10) に合わせた透視投影で、手前で切れるポリゴンは描かない
+// 文字列 (DrawDebugText) は記録だけして描かない
+class RecordingRenderDevice final : public RenderDevice {
+public:
+    enum class CommandType {
+        Clear,
+        Polygon2D,
+        ImageQuad,
+        Line,
+        Triangle,
+        Quadrangle,
+        Pixel,
+        DebugText,
+        Polygon3D,
+        Triangle3D,
+    };
+
+    struct Command {
+        CommandType Type;
+        int Target;
+        int Texture;
+        RenderBlendMode BlendMode;
+        int BlendParam;
+        uint32_t Primitives;    // 三角形の数 (Clear と DebugText は 0)
+    };
+
+private:
+    // 0xAARRGGBB
+    struct Surface {
+        int Width = 0;
+        int Height = 0;
+        std::vector<uint32_t> Pixels;
+        std::vector<float> Depth;   // 3D で使うまで空
+    };
+
+    struct RasterVertex {
+        float X, Y;             // 画面上の位置
+        float InverseW;         // 3D では 1 / 視点からの奥行き、2D では 1
+        float U, V;
+        float R, G, B, A;       // 0-1
+    };
+
+    const bool rasterize;
+    std::unordered_map<int, Surface> surfaces;
+    int nextHandle = 1;
+    int target = BackBuffer;
+    RenderBlendMode blendMode = RenderBlendMode::None;
+    int blendParam = 255;
+    int brightR = 255, brightG = 255, brightB = 255;
+    RenderFilterMode filterMode = RenderFilterMode::Nearest;
+    bool depthTest = false;
+    bool backCulling = false;
+    VECTOR cameraPosition, cameraRight, cameraUp, cameraForward;
+    std::vector<Command> commands;
+
+    Surface* FindSurface(int handle);
+    int AddSurface(Surface &&surface);
+    bool ReadSoftImage(int softImage, int x, int y, int width, int height, Surface *surface) const;
+    void Record(CommandType type, int texture, uint32_t primitives);
+    bool ProjectVertex(const VECTOR &position, const Surface &surface, float *x, float *y, float *inverseW) const;
+    void FillTriangle(const RasterVertex &v0, const RasterVertex &v1, const RasterVertex &v2, const Surface *texture, bool alpha, bool useDepth);
+    void FillSolidTriangle(float x1, float y1, float x2, float y2, float x3, float y3, uint32_t color);
+    void BlendPixel(Surface &surface, int x, int y, float r, float g, float b, float a);
+
+public:
+    RecordingRenderDevice(int width, int height, bool rasterize);
+
+    int LoadTexture(const std::wstring &file, bool async) override;
+    int LoadTextureFromMemory(const void *buffer, size_t size) override;
+    bool LoadDividedTextures(const std::wstring &file, int count, int xCount, int yCount, int width, int height, int *handles) override;
+    bool LoadDividedTexturesFromMemory(const void *buffer, size_t size, int count, int xCount, int yCount, int width, int height, int *handles) override;
+    int CreateTextureFromSoftImage(int softImage) override;
+    bool UpdateTextureFromSoftImage(int softImage, int texture) override;
+    int CreateRenderTarget(int width, int height) override;
+    void DeleteTexture(int texture) override;
+    bool GetTextureSize(int texture, int *width, int *height) override;
+
+    void SetRenderTarget(int target) override;
+    int GetRenderTarget() override { return target; }
+    void Clear() override;
+    void Present() override {}
+    void SetBlendMode(RenderBlendMode mode, int param) override;
+    void SetBright(int r, int g, int b) override;
+    void SetFilterMode(RenderFilterMode mode) override { filterMode = mode; }
+    void SetDepthTest(bool enabled) override { depthTest = enabled; }
+    void SetBackCulling(bool enabled) override { backCulling = enabled; }
+    void SetCamera(const VECTOR &position, const VECTOR &target) override;
+
+    void DrawPolygon2D(const VERTEX2D *vertices, int vertexCount, const uint16_t *indices, int polygonCount, int texture, bool alpha) override;
+    void DrawImageQuad(
+        float x1, float y1, float x2, float y2, float x3, float y3, float x4, float y4,
+        int srcX, int srcY, int srcWidth, int srcHeight, int texture, bool alpha) override;
+    void DrawLine(float x1, float y1, float x2, float y2, uint32_t color, float thickness) override;
+    void DrawTriangle(float x1, float y1, float x2, float y2, float x3, float y3, uint32_t color, bool fill) override;
+    void DrawQuadrangle(float x1, float y1, float x2, float y2, float x3, float y3, float x4, float y4, uint32_t color, bool fill) override;
+    void DrawPixel(int x, int y, uint32_t color) override;
+    void DrawDebugText(int x, int y, const std::wstring &text, uint32_t color) override;
+
+    void DrawPolygon3D(const VERTEX3D *vertices, int vertexCount, const uint16_t *indices, int polygonCount, int texture, bool alpha) override;
+    void DrawTriangle3D(const VECTOR &p1, const VECTOR &p2, const VECTOR &p3, uint32_t color, bool fill) override;
+
+    const std::vector<Command>& GetCommands() const { return commands; }
+    void ClearCommands() { commands.clear(); }
+    // 描画先 (BackBuffer か CreateRenderTarget の戻り値) を RGBA の PNG に書き出す
+    bool SavePng(int surface, const std::wstring &fileName);
+    // 描画先かテクスチャの中身を 0xAARRGGBB で取り出す (画像の比較用)
+    bool GetPixels(int surface, int *width, int *height, std::vector<uint32_t> *pixels) const;
+    static const char* GetCommandTypeName(CommandType type);
+};
@@ -0,0 +1,180 @@
+﻿#include "Replay.h"
+#include "Config.h"
+#include "Misc.h"
+
+using namespace std;
+
+namespace
+{
+    const uint32_t replaySignature = 0x50525553;    // "SURP"
+    const uint32_t replayVersion = 2;               // 形式を変えたら上げる 2: 入力を変化の列で持つ
+    // 要素数が残りに収まるかの確認に使う、要素1つあたりの最小バイト数
+    const size_t tickBytes = sizeof(double) + sizeof(uint8_t);
+    const size_t eventBytes = sizeof(uint8_t) * 3 + sizeof(double);
+    const size_t snapshotBytes = sizeof(uint16_t) * 3 + sizeof(uint8_t) + sizeof(uint16_t);    // イベントなし
+    const size_t inputBytes = sizeof(uint32_t) + sizeof(double) + snapshotBytes;
+    const size_t judgeBytes = sizeof(double) + sizeof(int32_t) * 2 + sizeof(double) * 2;
+
+    void WriteSnapshot(ostream &stream, const ControlSnapshot &state)
+    {
+        WriteBinaryValue(stream, state.SliderCurrent);
+        WriteBinaryValue(stream, state.SliderLast);
+        WriteBinaryValue(stream, state.SliderTrigger);
+        WriteBinaryValue(stream, state.Air);
+        WriteBinaryValue(stream, SU_TO_UINT16(state.Events.size()));
+        for (const auto &ev : state.Events) {
+            WriteBinaryValue(stream, SU_TO_UINT8(ev.Source));
+            WriteBinaryValue(stream, SU_TO_UINT8(ev.Number));
+            WriteBinaryValue(stream, SU_TO_UINT8(ev.Pressed));
+            WriteBinaryValue(stream, ev.Delay);
+        }
+    }
+
+    bool ReadSnapshot(istream &stream, ControlSnapshot &state)
+    {
+        state = ControlSnapshot();
+        uint16_t eventCount;
+        if (!(ReadBinaryValue(stream, state.SliderCurrent)
+            && ReadBinaryValue(stream, state.SliderLast)
+            && ReadBinaryValue(stream, state.SliderTrigger)
+            && ReadBinaryValue(stream, state.Air)
+            && ReadBinaryCount(stream, eventCount, eventBytes))) return false;
+        state.Events.resize(eventCount);
+        for (auto &ev : state.Events) {
+            uint8_t source, number, pressed;
+            if (!(ReadBinaryValue(stream, source)
+                && ReadBinaryValue(stream, number)
+                && ReadBinaryValue(stream, pressed)
+                && ReadBinaryValue(stream, ev.Delay))) return false;
+            if (source != uint8_t(ControllerSource::IntegratedSliders) && source != uint8_t(ControllerSource::IntegratedAir)) return false;
+            if (number >= (source == uint8_t(ControllerSource::IntegratedSliders) ? 16 : 4)) return false;
+            ev.Source = ControllerSource(source);
+            ev.Number = number;
+            ev.Pressed = !!pressed;
+        }
+        return true;
+    }
+}
+
+bool Replay::Save(const wstring &fileName) const
+{
+    // 書きかけのファイルを残さないよう、書き切ってから置き換える
+    return WriteFileAtomically(fileName, [this](ostream &stream) {
+        WriteBinaryValue(stream, replaySignature);
+        WriteBinaryValue(stream, replayVersion);
+        WriteBinaryString(stream, SU_APP_VERSION);
+
+        WriteBinaryValue(stream, Settings.ChartHash);
+        WriteBinaryString(stream, Settings.ChartFile);
+        WriteBinaryValue(stream, Settings.JudgeAdjustSlider);
+        WriteBinaryValue(stream, Settings.JudgeMultiplierSlider);
+        WriteBinaryValue(stream, Settings.JudgeAdjustAirString);
+        WriteBinaryValue(stream, Settings.JudgeMultiplierAirString);
+        WriteBinaryValue(stream, Settings.Hispeed);
+        WriteBinaryValue(stream, SU_TO_UINT8(Settings.AutoAir));
+
+        WriteBinaryValue(stream, SU_TO_UINT32(Ticks.size()));
+        for (const auto &tick : Ticks) {
+            WriteBinaryValue(stream, tick.Delta);
+            WriteBinaryValue(stream, SU_TO_UINT8(tick.Paused));
+        }
+
+        WriteBinaryValue(stream, SU_TO_UINT32(Inputs.size()));
+        for (const auto &input : Inputs) {
+            WriteBinaryValue(stream, input.Update);
+            WriteBinaryValue(stream, input.Time);
+            WriteSnapshot(stream, input.State);
+        }
+
+        WriteBinaryValue(stream, SU_TO_UINT32(Judges.size()));
+        for (const auto &judge : Judges) {
+            WriteBinaryValue(stream, judge.Time);
+            WriteBinaryValue(stream, SU_TO_INT32(judge.Judge));
+            WriteBinaryValue(stream, SU_TO_INT32(judge.Information.Note));
+            WriteBinaryValue(stream, judge.Information.Left);
+            WriteBinaryValue(stream, judge.Information.Right);
+        }
+        return !!stream;
+    });
+}
+
+bool Replay::Load(const wstring &fileName)
+{
+    ifstream stream(fileName, ios::in | ios::binary);
+    if (!stream) return false;
+
+    uint32_t signature, version;
+    string appVersion;
+    if (!ReadBinaryValue(stream, signature) || signature != replaySignature) return false;
+    if (!ReadBinaryValue(stream, version) || version != replayVersion) return false;
+    if (!ReadBinaryString(stream, appVersion)) return false;
+
+    uint8_t autoAir;
+    const auto settingsRead = ReadBinaryValue(stream, Settings.ChartHash)
+        && ReadBinaryString(stream, Settings.ChartFile)
+        && ReadBinaryValue(stream, Settings.JudgeAdjustSlider)
+        && ReadBinaryValue(stream, Settings.JudgeMultiplierSlider)
+        && ReadBinaryValue(stream, Settings.JudgeAdjustAirString)
+        && ReadBinaryValue(stream, Settings.JudgeMultiplierAirString)
+        && ReadBinaryValue(stream, Settings.Hispeed)
+        && ReadBinaryValue(stream, autoAir);
+    if (!settingsRead) return false;
+    Settings.AutoAir = !!autoAir;
+
+    uint32_t count;
+    if (!ReadBinaryCount(stream, count, tickBytes)) return false;
+    Ticks.resize(count);
+    for (auto &tick : Ticks) {
+        uint8_t paused;
+        if (!ReadBinaryValue(stream, tick.Delta) || !ReadBinaryValue(stream, paused)) return false;
+        tick.Paused = !!paused;
+    }
+
+    if (!ReadBinaryCount(stream, count, inputBytes)) return false;
+    Inputs.resize(count);
+    for (auto &input : Inputs) {
+        if (!ReadBinaryValue(stream, input.Update) || !ReadBinaryValue(stream, input.Time) || !ReadSnapshot(stream, input.State)) return false;
+    }
+
+    if (!ReadBinaryCount(stream, count, judgeBytes)) return false;
+    Judges.resize(count);
+    for (auto &judge : Judges) {
+        int32_t judgeType, noteType;
+        const auto judgeRead = ReadBinaryValue(stream, judge.Time)
+            && ReadBinaryValue(stream, judgeType)
+            && ReadBinaryValue(stream, noteType)
+            && ReadBinaryValue(stream, judge.Information.Left)
+            && ReadBinaryValue(stream, judge.Information.Right);
+        if (!judgeRead) return false;
+        judge.Judge = AbilityJudgeType(judgeType);
+        judge.Information.Note = AbilityNoteType(noteType);
+    }
+    return true;
+}
+
+ReplayRecorder::ReplayRecorder(const ReplaySettings &settings)
+{
+    replay.Settings = settings;
+}
+
+void ReplayRecorder::RecordTick(const double delta, const bool paused)
+{
+    replay.Ticks.push_back({ delta, paused });
+}
+
+void ReplayRecorder::RecordInput(const double time, const ControlState &state)
+{
+    ControlSnapshot current;
+    state.GetSnapshot(&current);
+    // 最初の更新は何も押していない状態との差として必ず残る
+    if (current != lastState || replay.Inputs.empty()) {
+        replay.Inputs.push_back({ updateCount, time, current });
+        lastState = current;
+    }
+    ++updateCount;
+}
+
+void ReplayRecorder::RecordJudge(const double time, const AbilityJudgeType judge, const JudgeInformation &info)
+{
+    replay.Judges.push_back({ time, judge, info });
+}
@@ -0,0 +1,71 @@
+﻿#pragma once
+
+#include "Controller.h"
+#include "Skill.h"
+#include "CharacterInstance.h"
+
+// リプレイ: 同じ譜面・同じ設定で同じ Tick と入力を与えれば、判定は完全に同じになる
+// 記録するのは PlayableProcessor が見るものだけ (Tick の刻み、統合済みの入力、判定結果)
+
+// 判定に効く設定の写し
+struct ReplaySettings {
+    uint32_t ChartHash = 0;     // CalculateFileCrc32 の値
+    std::string ChartFile;      // 記録時の譜面のパス (UTF-8)
+    double JudgeAdjustSlider = 0;
+    double JudgeMultiplierSlider = 1;
+    double JudgeAdjustAirString = 0;
+    double JudgeMultiplierAirString = 1;
+    double Hispeed = 6;
+    bool AutoAir = false;
+};
+
+// ScenePlayer::Tick 1回分
+struct ReplayTick {
+    double Delta;
+    bool Paused;
+};
+
+// 入力の変化 Update 番目の判定更新から State になる (次の変化までそのまま)
+struct ReplayInput {
+    uint32_t Update;
+    double Time;        // その時の曲中時刻 (確認用)
+    ControlSnapshot State;
+};
+
+struct ReplayJudge {
+    double Time;
+    AbilityJudgeType Judge;
+    JudgeInformation Information;
+};
+
+class Replay final {
+public:
+    ReplaySettings Settings;
+    std::vector<ReplayTick> Ticks;
+    std::vector<ReplayInput> Inputs;
+    std::vector<ReplayJudge> Judges;
+
+    bool Save(const std::wstring &fileName) const;
+    bool Load(const std::wstring &fileName);
+};
+
+class ReplayRecorder final {
+private:
+    Replay replay;
+    uint32_t updateCount = 0;
+    ControlSnapshot lastState;
+    bool valid = true;
+
+public:
+    explicit ReplayRecorder(const ReplaySettings &settings);
+
+    void RecordTick(double delta, bool paused);
+    // 判定更新の直前に呼ぶ
+    void RecordInput(double time, const ControlState &state);
+    void RecordJudge(double time, AbilityJudgeType judge, const JudgeInformation &info);
+    // シークなど再現できない操作をしたら呼ぶ
+    void Invalidate() { valid = false; }
+
+    bool IsValid() const { return valid; }
+    const Replay& GetReplay() const { return replay; }
+};
@@ -0,0 +1,36 @@
+﻿#include "ScoreProcessor.h"
+#include "ExecutionManager.h"
+#include "ScenePlayer.h"
+
+using namespace std;
+
+ReplayProcessor::ReplayProcessor(ScenePlayer *splayer) : PlayableProcessor(splayer)
+{
+    currentState = make_shared<ControlState>();
+    currentState->Initialize();
+}
+
+void ReplayProcessor::Reset()
+{
+    PlayableProcessor::Reset();
+
+    // 判定に効く設定は記録時のものに合わせる
+    replay = player->replaySource;
+    nextInput = 0;
+    updateCount = 0;
+    currentState->ApplySnapshot(ControlSnapshot());
+    if (!replay) return;
+    const auto &settings = replay->Settings;
+    SetJudgeAdjusts(settings.JudgeAdjustSlider, settings.JudgeMultiplierSlider, settings.JudgeAdjustAirString, settings.JudgeMultiplierAirString);
+    SetAutoAir(settings.AutoAir);
+}
+
+void ReplayProcessor::Update(vector<shared_ptr<SusDrawableNoteData>> &notes)
+{
+    if (replay && nextInput < replay->Inputs.size() && replay->Inputs[nextInput].Update == updateCount) {
+        currentState->ApplySnapshot(replay->Inputs[nextInput].State);
+        ++nextInput;
+    }
+    ++updateCount;
+    PlayableProcessor::Update(notes);
+}
@@ -18,6 +18,7 @@ void Result::Reset()
     gaugeValue = gaugeBoostBySkill = 0;
     currentScore = 0;
     currentCombo = maxCombo = 0;
+    timing.Reset();
 }
 
 void Result::PerformJusticeCritical()
@@ -115,6 +116,175 @@ void Result::GetCurrentResult(DrawableResult *result) const
     result->CurrentGaugeRatio = double(cg) / double(ng);
 }
 
+void Result::SetJudgeAdjusts(const double sliderAdjust, const double airStringAdjust)
+{
+    timing.SetJudgeAdjusts(sliderAdjust, airStringAdjust);
+}
+
+void Result::RecordTiming(const double time, const AbilityNoteType type, const int lane, const double offset)
+{
+    timing.Record(time, type, lane, offset);
+}
+
+const double JudgeTiming::HistogramRange = 0.1;
+
+void JudgeTiming::Accumulator::Add(const double offset)
+{
+    Earliest = Count ? std::min(Earliest, offset) : offset;
+    Latest = Count ? std::max(Latest, offset) : offset;
+    ++Count;
+    const auto delta = offset - Mean;
+    Mean += delta / Count;
+    SquaredDeviation += delta * (offset - Mean);
+
+    const auto position = (offset + HistogramRange) / (HistogramRange * 2) * HistogramBins;
+    const auto bin = SU_TO_INT32(floor(position));
+    ++Histogram[std::max(0, std::min(HistogramBins - 1, bin))];
+}
+
+void JudgeTiming::Accumulator::GetStatistics(TimingStatistics *statistics) const
+{
+    if (!statistics) return;
+    statistics->Count = Count;
+    statistics->Mean = Mean;
+    statistics->StandardDeviation = Count ? sqrt(SquaredDeviation / Count) : 0.0;
+    statistics->Earliest = Earliest;
+    statistics->Latest = Latest;
+}
+
+bool JudgeTiming::IsAirNote(const AbilityNoteType type)
+{
+    return type == AbilityNoteType::Air || type == AbilityNoteType::AirAction;
+}
+
+const JudgeTiming::Accumulator* JudgeTiming::GetNoteAccumulator(const AbilityNoteType type) const
+{
+    const auto index = size_t(type);
+    return index < notes.size() ? &notes[index] : nullptr;
+}
+
+const JudgeTiming::Accumulator* JudgeTiming::GetLaneAccumulator(const int lane) const
+{
+    return lane >= 0 && lane < Lanes ? &lanes[lane] : nullptr;
+}
+
+void JudgeTiming::Reset()
+{
+    records.clear();
+    notes.fill(Accumulator());
+    lanes.fill(Accumulator());
+    slider = airString = Accumulator();
+}
+
+void JudgeTiming::SetJudgeAdjusts(const double sliderAdjust, const double airStringAdjust)
+{
+    judgeAdjustSlider = sliderAdjust;
+    judgeAdjustAirString = airStringAdjust;
+}
+
+void JudgeTiming::Record(const double time, const AbilityNoteType type, const int lane, const double offset)
+{
+    const auto index = size_t(type);
+    if (index >= notes.size()) return;
+    records.push_back({ time, type, lane, offset });
+    notes[index].Add(offset);
+    if (IsAirNote(type)) {
+        airString.Add(offset);
+        return;
+    }
+    slider.Add(offset);
+    if (lane >= 0 && lane < Lanes) lanes[lane].Add(offset);
+}
+
+void JudgeTiming::GetSliderStatistics(TimingStatistics *statistics) const
+{
+    slider.GetStatistics(statistics);
+}
+
+void JudgeTiming::GetAirStringStatistics(TimingStatistics *statistics) const
+{
+    airString.GetStatistics(statistics);
+}
+
+void JudgeTiming::GetNoteStatistics(const AbilityNoteType type, TimingStatistics *statistics) const
+{
+    const auto accumulator = GetNoteAccumulator(type);
+    (accumulator ? *accumulator : Accumulator()).GetStatistics(statistics);
+}
+
+void JudgeTiming::GetLaneStatistics(const int lane, TimingStatistics *statistics) const
+{
+    const auto accumulator = GetLaneAccumulator(lane);
+    (accumulator ? *accumulator : Accumulator()).GetStatistics(statistics);
+}
+
+uint32_t JudgeTiming::GetNoteHistogram(const AbilityNoteType type, const int bin) const
+{
+    const auto accumulator = GetNoteAccumulator(type);
+    if (!accumulator || bin < 0 || bin >= HistogramBins) return 0;
+    return accumulator->Histogram[bin];
+}
+
+uint32_t JudgeTiming::GetLaneHistogram(const int lane, const int bin) const
+{
+    const auto accumulator = GetLaneAccumulator(lane);
+    if (!accumulator || bin < 0 || bin >= HistogramBins) return 0;
+    return accumulator->Histogram[bin];
+}
+
+int JudgeTiming::GetSuggestedAdjustSlider() const
+{
+    // 平均して遅れているなら判定中心を後ろにずらす
+    return SU_TO_INT32(round((judgeAdjustSlider + slider.Mean) * 1000.0));
+}
+
+int JudgeTiming::GetSuggestedAdjustAirString() const
+{
+    return SU_TO_INT32(round((judgeAdjustAirString + airString.Mean) * 1000.0));
+}
+
+void JudgeTiming::WriteJson(std::ostream &stream) const
+{
+    const auto writeAccumulator = [&stream](const Accumulator &accumulator) {
+        TimingStatistics statistics;
+        accumulator.GetStatistics(&statistics);
+        stream << fmt::format("{{\"count\":{0},\"mean\":{1:.6f},\"stddev\":{2:.6f},\"earliest\":{3:.6f},\"latest\":{4:.6f},\"histogram\":[",
+            statistics.Count, statistics.Mean, statistics.StandardDeviation, statistics.Earliest, statistics.Latest);
+        for (auto i = 0; i < HistogramBins; i++) stream << (i ? "," : "") << accumulator.Histogram[i];
+        stream << "]}";
+    };
+
+    stream << "{\n";
+    stream << fmt::format("  \"histogram\": {{\"range\":{0:.6f},\"bins\":{1}}},\n", HistogramRange, int(HistogramBins));
+    stream << fmt::format("  \"judgeAdjust\": {{\"slider\":{0},\"airString\":{1}}},\n",
+        SU_TO_INT32(round(judgeAdjustSlider * 1000.0)), SU_TO_INT32(round(judgeAdjustAirString * 1000.0)));
+    stream << fmt::format("  \"suggestedAdjust\": {{\"slider\":{0},\"airString\":{1}}},\n", GetSuggestedAdjustSlider(), GetSuggestedAdjustAirString());
+    stream << "  \"slider\": ";
+    writeAccumulator(slider);
+    stream << ",\n  \"airString\": ";
+    writeAccumulator(airString);
+    stream << ",\n  \"notes\": {";
+    auto first = true;
+    for (size_t i = size_t(AbilityNoteType::Tap); i < notes.size(); i++) {
+        stream << (first ? "\n" : ",\n") << "    \"" << GetAbilityNoteTypeName(AbilityNoteType(i)) << "\": ";
+        writeAccumulator(notes[i]);
+        first = false;
+    }
+    stream << "\n  },\n  \"lanes\": [";
+    for (auto i = 0; i < Lanes; i++) {
+        stream << (i ? ",\n    " : "\n    ");
+        writeAccumulator(lanes[i]);
+    }
+    stream << "\n  ],\n  \"records\": [";
+    for (size_t i = 0; i < records.size(); i++) {
+        const auto &record = records[i];
+        stream << (i ? ",\n    " : "\n    ");
+        stream << fmt::format("{{\"time\":{0:.6f},\"note\":\"{1}\",\"lane\":{2},\"offset\":{3:.6f}}}",
+            record.Time, GetAbilityNoteTypeName(record.Note), record.Lane, record.Offset);
+    }
+    stream << "\n  ]\n}\n";
+}
+
 void RegisterResultTypes(asIScriptEngine *engine)
 {
     engine->RegisterObjectType(SU_IF_DRESULT, sizeof(DrawableResult), asOBJ_VALUE | asOBJ_POD | asGetTypeTraits<DrawableResult>());
@@ -144,3 +314,27 @@ void RegisterResultTypes(asIScriptEngine *engine)
     engine->RegisterObjectMethod(SU_IF_RESULT, "void BoostGaugeMiss(double)", asMETHOD(Result, BoostGaugeMiss), asCALL_THISCALL);
     engine->RegisterObjectMethod(SU_IF_RESULT, "void GetCurrentResult(" SU_IF_DRESULT " &out)", asMETHOD(Result, GetCurrentResult), asCALL_THISCALL);
 }
+
+void RegisterJudgeTimingTypes(asIScriptEngine *engine)
+{
+    engine->RegisterObjectType(SU_IF_TIMING_STATISTICS, sizeof(TimingStatistics), asOBJ_VALUE | asOBJ_POD | asGetTypeTraits<TimingStatistics>());
+    engine->RegisterObjectProperty(SU_IF_TIMING_STATISTICS, "uint32 Count", asOFFSET(TimingStatistics, Count));
+    engine->RegisterObjectProperty(SU_IF_TIMING_STATISTICS, "double Mean", asOFFSET(TimingStatistics, Mean));
+    engine->RegisterObjectProperty(SU_IF_TIMING_STATISTICS, "double StandardDeviation", asOFFSET(TimingStatistics, StandardDeviation));
+    engine->RegisterObjectProperty(SU_IF_TIMING_STATISTICS, "double Earliest", asOFFSET(TimingStatistics, Earliest));
+    engine->RegisterObjectProperty(SU_IF_TIMING_STATISTICS, "double Latest", asOFFSET(TimingStatistics, Latest));
+
+    engine->RegisterObjectType(SU_IF_JUDGE_TIMING, 0, asOBJ_REF | asOBJ_NOCOUNT);
+    engine->RegisterObjectMethod(SU_IF_JUDGE_TIMING, "uint GetRecordCount()", asMETHOD(JudgeTiming, GetRecordCount), asCALL_THISCALL);
+    engine->RegisterObjectMethod(SU_IF_JUDGE_TIMING, "int GetHistogramBins()", asMETHOD(JudgeTiming, GetHistogramBins), asCALL_THISCALL);
+    engine->RegisterObjectMethod(SU_IF_JUDGE_TIMING, "double GetHistogramRange()", asMETHOD(JudgeTiming, GetHistogramRange), asCALL_THISCALL);
+    engine->RegisterObjectMethod(SU_IF_JUDGE_TIMING, "void GetSliderStatistics(" SU_IF_TIMING_STATISTICS " &out)", asMETHOD(JudgeTiming, GetSliderStatistics), asCALL_THISCALL);
+    engine->RegisterObjectMethod(SU_IF_JUDGE_TIMING, "void GetAirStringStatistics(" SU_IF_TIMING_STATISTICS " &out)", asMETHOD(JudgeTiming, GetAirStringStatistics), asCALL_THISCALL);
+    engine->RegisterObjectMethod(SU_IF_JUDGE_TIMING, "void GetNoteStatistics(" SU_IF_NOTETYPE ", " SU_IF_TIMING_STATISTICS " &out)", asMETHOD(JudgeTiming, GetNoteStatistics), asCALL_THISCALL);
+    engine->RegisterObjectMethod(SU_IF_JUDGE_TIMING, "void GetLaneStatistics(int, " SU_IF_TIMING_STATISTICS " &out)", asMETHOD(JudgeTiming, GetLaneStatistics), asCALL_THISCALL);
+    engine->RegisterObjectMethod(SU_IF_JUDGE_TIMING, "uint GetNoteHistogram(" SU_IF_NOTETYPE ", int)", asMETHOD(JudgeTiming, GetNoteHistogram), asCALL_THISCALL);
+    engine->RegisterObjectMethod(SU_IF_JUDGE_TIMING, "uint GetLaneHistogram(int, int)", asMETHOD(JudgeTiming, GetLaneHistogram), asCALL_THISCALL);
+    engine->RegisterObjectMethod(SU_IF_JUDGE_TIMING, "int GetSuggestedAdjustSlider()", asMETHOD(JudgeTiming, GetSuggestedAdjustSlider), asCALL_THISCALL);
+    engine->RegisterObjectMethod(SU_IF_JUDGE_TIMING, "int GetSuggestedAdjustAirString()", asMETHOD(JudgeTiming, GetSuggestedAdjustAirString), asCALL_THISCALL);
+    engine->RegisterObjectMethod(SU_IF_RESULT, SU_IF_JUDGE_TIMING "@ GetJudgeTiming()", asMETHOD(Result, GetTimingUnsafe), asCALL_THISCALL);
+}
@@ -1,7 +1,11 @@
 ﻿#pragma once
 
+#include "Skill.h"
+
 #define SU_IF_DRESULT "DrawableResult"
 #define SU_IF_RESULT "Result"
+#define SU_IF_TIMING_STATISTICS "TimingStatistics"
+#define SU_IF_JUDGE_TIMING "JudgeTiming"
 
 struct DrawableResult {
     uint32_t JusticeCritical;
@@ -23,6 +27,80 @@ struct DrawableResult {
     uint32_t Score;
 };
 
+// 判定1回分のずれ
+// Offset は判定中心 (ノーツの時刻+JudgeAdjust) から入力までの秒数 正なら遅い
+// 押した時刻で判定するもの (Tap/ExTap/AwesomeExTap/Flick/Air と Hold/Slide の始点) だけを記録する
+// Hold/Slide の中継点・終点と AirAction は押している間に判定するのでずれがなく、Miss と HellTap は押した時刻がないので含めない
+// なのでノーツ種別ごとの集計に Hold/Slide が出るのは始点の分だけで、AirAction と HellTap は常に0件になる
+struct JudgeTimingRecord {
+    double Time;            // ノーツの時刻
+    AbilityNoteType Note;
+    int32_t Lane;           // 押されたスライダーのレーン Air系は -1
+    double Offset;
+};
+
+struct TimingStatistics {
+    uint32_t Count;
+    double Mean;
+    double StandardDeviation;
+    double Earliest;
+    double Latest;
+};
+
+// 判定のずれの集計 ノーツ種別ごと・レーンごとに平均/標準偏差とヒストグラムを持つ
+// ヒストグラムは ±HistogramRange 秒を HistogramBins 等分したもので、範囲外は両端に入れる
+class JudgeTiming final {
+public:
+    static const int HistogramBins = 40;
+    static const int Lanes = 16;
+    static const double HistogramRange;
+
+private:
+    struct Accumulator {
+        uint32_t Count = 0;
+        double Mean = 0;
+        double SquaredDeviation = 0;    // Welford 法の M2
+        double Earliest = 0;
+        double Latest = 0;
+        std::array<uint32_t, HistogramBins> Histogram {};
+
+        void Add(double offset);
+        void GetStatistics(TimingStatistics *statistics) const;
+    };
+
+    std::vector<JudgeTimingRecord> records;
+    std::array<Accumulator, size_t(AbilityNoteType::AirAction) + 1> notes;
+    std::array<Accumulator, Lanes> lanes;
+    Accumulator slider;
+    Accumulator airString;
+    double judgeAdjustSlider = 0;
+    double judgeAdjustAirString = 0;
+
+    static bool IsAirNote(AbilityNoteType type);
+    const Accumulator* GetNoteAccumulator(AbilityNoteType type) const;
+    const Accumulator* GetLaneAccumulator(int lane) const;
+
+public:
+    void Reset();
+    void SetJudgeAdjusts(double sliderAdjust, double airStringAdjust);
+    void Record(double time, AbilityNoteType type, int lane, double offset);
+
+    const std::vector<JudgeTimingRecord>& GetRecords() const { return records; }
+    uint32_t GetRecordCount() const { return uint32_t(records.size()); }
+    int GetHistogramBins() const { return HistogramBins; }
+    double GetHistogramRange() const { return HistogramRange; }
+    void GetSliderStatistics(TimingStatistics *statistics) const;
+    void GetAirStringStatistics(TimingStatistics *statistics) const;
+    void GetNoteStatistics(AbilityNoteType type, TimingStatistics *statistics) const;
+    void GetLaneStatistics(int lane, TimingStatistics *statistics) const;
+    uint32_t GetNoteHistogram(AbilityNoteType type, int bin) const;
+    uint32_t GetLaneHistogram(int lane, int bin) const;
+    // 平均のずれを打ち消す JudgeAdjust の設定値 (ミリ秒) 記録がなければ今の値を返す
+    int GetSuggestedAdjustSlider() const;
+    int GetSuggestedAdjustAirString() const;
+    void WriteJson(std::ostream &stream) const;
+};
+
 class Result final {
 private:
     uint32_t notes = 0;
@@ -40,6 +118,8 @@ private:
     double currentScore = 0;
     double scorePerJusticeCritical = 0;
 
+    JudgeTiming timing;
+
 public:
     void SetAllNotes(uint32_t notes);
     void Reset();
@@ -53,6 +133,13 @@ public:
     void BoostGaugeAttack(double ratio);
     void BoostGaugeMiss(double ratio);
     void GetCurrentResult(DrawableResult *result) const;
+
+    void SetJudgeAdjusts(double sliderAdjust, double airStringAdjust);
+    void RecordTiming(double time, AbilityNoteType type, int lane, double offset);
+    const JudgeTiming& GetTiming() const { return timing; }
+    JudgeTiming* GetTimingUnsafe() { return &timing; }
 };
 
 void RegisterResultTypes(asIScriptEngine *engine);
+// NoteType を使うので RegisterSkillTypes の後に呼ぶ
+void RegisterJudgeTimingTypes(asIScriptEngine *engine);
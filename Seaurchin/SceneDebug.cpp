@@ -1,19 +1,37 @@
 ﻿#include "SceneDebug.h"
+#include "ExecutionManager.h"
+
+using namespace std;
+
+SceneDebug::SceneDebug()
+{
+    // 他のシーンより後に描いて最前面に出す
+    SetIndex(numeric_limits<int>::max());
+}
 
 void SceneDebug::Tick(const double delta)
+{}
+
+void SceneDebug::Draw()
 {
-    calc += delta;
+    // Tick は固定刻みで1フレームに何回も来ることがあるので、描画の回数で数える
+    const auto loop = manager->GetGameLoop();
+    calc += loop->GetFrameTimes().GetLatest();
     call++;
     if (calc >= 1.00) {
         fps = call / calc;
+        worst = loop->GetFrameTimes().GetPercentile(0.99);
         calc = call = 0;
     }
-}
 
-void SceneDebug::Draw()
-{
-    clsDx();
-    printfDx(reinterpret_cast<const char*>(L"%2.1f fps\n"), fps);
+    const auto device = RenderDevice::GetCurrent();
+    const auto lineHeight = 16;
+    const auto color = MakeRenderColor(255, 255, 255);
+    device->DrawDebugText(0, 0, fmt::format(L"{0:.1f} fps (99%: {1:.2f} ms)", fps, worst * 1000), color);
+    if (const auto batch = manager->GetSpriteBatch()) {
+        const auto &stats = batch->GetLastFrameStatistics();
+        device->DrawDebugText(0, lineHeight, fmt::format(L"{0} draw calls / {1} sprites", stats.Batches + stats.ImmediateDraws, stats.Quads), color);
+    }
 }
 
 bool SceneDebug::IsDead()
@@ -7,8 +7,10 @@ private:
     int call = 0;
     double calc = 0;
     double fps = 0;
+    double worst = 0;
 
 public:
+    SceneDebug();
     ~SceneDebug() = default;
 
     void Tick(double delta) override;
@@ -4,6 +4,7 @@
 #include "ExecutionManager.h"
 #include "Setting.h"
 #include "Config.h"
+#include "Profiler.h"
 
 using namespace std;
 
@@ -74,6 +75,26 @@ void ScenePlayer::LoadResources()
         soundMetronome = soundTap;
     }
 
+    // 単発の判定音はサンプル単位で発音位置を決められるミキサーに載せる
+    keysounds = make_unique<KeysoundScheduler>(44100, 2, soundBufferingLatency);
+    keysoundIds.fill(-1);
+    const auto registerKeysound = [&](const JudgeSoundType type, SSound *sound) {
+        if (sound) keysoundIds[size_t(type)] = keysounds->AddSample(sound->GetSample());
+    };
+    registerKeysound(JudgeSoundType::Tap, soundTap);
+    registerKeysound(JudgeSoundType::ExTap, soundExTap);
+    registerKeysound(JudgeSoundType::Flick, soundFlick);
+    registerKeysound(JudgeSoundType::Air, soundAir);
+    registerKeysound(JudgeSoundType::AirDown, soundAirDown);
+    registerKeysound(JudgeSoundType::AirAction, soundAirAction);
+    registerKeysound(JudgeSoundType::HoldStep, soundHoldStep);
+    registerKeysound(JudgeSoundType::SlideStep, soundSlideStep);
+    registerKeysound(JudgeSoundType::Metronome, soundMetronome);
+    if (!keysounds->Start()) {
+        spdlog::get("main")->warn(u8"判定音ミキサーを開始できませんでした");
+        keysounds.reset();
+    }
+
     vector<toml::Value> scv = { 0, 200, 255 };
     vector<toml::Value> aajcv = { 128, 255, 160 };
     scv = setting->ReadValue("Play", "ColorSlideLine", scv);
@@ -81,8 +102,8 @@ void ScenePlayer::LoadResources()
     showSlideLine = setting->ReadValue("Play", "ShowSlideLine", true);
     slideLineThickness = setting->ReadValue("Play", "SlideLineThickness", 16.0) / 2.0;
     showAirActionJudge = setting->ReadValue("Play", "ShowAirActionJudgeLine", true);
-    slideLineColor = GetColor(scv[0].as<int>(), scv[1].as<int>(), scv[2].as<int>());
-    airActionJudgeColor = GetColor(aajcv[0].as<int>(), aajcv[1].as<int>(), aajcv[2].as<int>());
+    slideLineColor = MakeRenderColor(scv[0].as<int>(), scv[1].as<int>(), scv[2].as<int>());
+    airActionJudgeColor = MakeRenderColor(aajcv[0].as<int>(), aajcv[1].as<int>(), aajcv[2].as<int>());
 
     // 2^x制限があるのでここで計算
     const auto exty = laneBufferX * SU_LANE_ASPECT_EXT;
@@ -90,8 +111,9 @@ void ScenePlayer::LoadResources()
     while (exty > bufferY) bufferY *= 2.0f;
     const auto bufferV = SU_TO_FLOAT(exty / bufferY);
     for (auto i = 2; i < 4; i++) groundVertices[i].v = bufferV;
-    if (hGroundBuffer) DeleteGraph(hGroundBuffer);
-    hGroundBuffer = MakeScreen(SU_TO_INT32(laneBufferX), SU_TO_INT32(bufferY), TRUE);
+    const auto device = RenderDevice::GetCurrent();
+    if (hGroundBuffer) device->DeleteTexture(hGroundBuffer);
+    hGroundBuffer = device->CreateRenderTarget(SU_TO_INT32(laneBufferX), SU_TO_INT32(bufferY));
 
     if (!spriteLane) {
         SSynthSprite *pSynthSprite = SSynthSprite::Factory(1024, 4224);
@@ -135,98 +157,126 @@ void ScenePlayer::TickGraphics(const double delta)
 
 void ScenePlayer::Draw()
 {
-    if (movieBackground) DrawExtendGraph(0, 0, SU_RES_WIDTH, SU_RES_HEIGHT, movieBackground, FALSE);
+    SU_PROFILE_ZONE("ScenePlayer::Draw");
+    const auto device = RenderDevice::GetCurrent();
+    const SpriteBatch::Immediate immediate;
+
+    // Tick の刻みが描画より細かくないときは、次の Tick までの進み具合の分だけ先の位置で描く
+    // 位置は次の CalculateNotes で Tick 時点のものに戻る
+    drawTime = currentTime + tickAdvance * manager->GetDrawInterpolation();
+    if (drawTime != currentTime) {
+        noteStore.UpdateTimelines(drawTime);
+        for (const auto i : seenIndices) noteStore.UpdatePositions(i);
+    }
+    if (movieBackground) {
+        int movieWidth, movieHeight;
+        device->GetTextureSize(movieBackground, &movieWidth, &movieHeight);
+        device->DrawImageExtended(0, 0, SU_RES_WIDTH, SU_RES_HEIGHT, 0, 0, movieWidth, movieHeight, movieBackground, false);
+    }
 
     BEGIN_DRAW_TRANSACTION(hGroundBuffer);
-    ClearDrawScreen();
+    device->Clear();
 
     // 背景部
     spriteLane->Draw();
-    SetDrawBlendMode(DX_BLENDMODE_ALPHA, 255);
-    SetDrawBright(255, 255, 255);
-    for (auto& note : seenData) {
-        auto &type = note->Type;
-        if (type[size_t(SusNoteType::MeasureLine)]) DrawMeasureLine(note);
+    device->SetBlendMode(RenderBlendMode::Alpha, 255);
+    device->SetBright(255, 255, 255);
+    for (const auto i : seenIndices) {
+        if (noteStore.Types[i] & (1u << size_t(SusNoteType::MeasureLine))) DrawMeasureLine(i);
     }
 
     // 下側のロングノーツ類
-    for (auto& note : seenData) {
-        auto &type = note->Type;
-        if (type[size_t(SusNoteType::Hold)]) DrawHoldNotes(note);
-        if (type[size_t(SusNoteType::Slide)]) DrawSlideNotes(note);
+    for (const auto i : seenIndices) {
+        const auto type = noteStore.Types[i];
+        if (type & (1u << size_t(SusNoteType::Hold))) DrawHoldNotes(i);
+        if (type & (1u << size_t(SusNoteType::Slide))) DrawSlideNotes(i);
     }
 
     // 上側のショートノーツ類
-    for (auto& note : seenData) {
-        const auto type = note->Type.to_ulong();
+    for (const auto i : seenIndices) {
+        const auto type = noteStore.Types[i];
 #define GET_BIT(num) (1UL << (int(num)))
         const auto mask = GET_BIT(SusNoteType::Tap) | GET_BIT(SusNoteType::ExTap) | GET_BIT(SusNoteType::AwesomeExTap) | GET_BIT(SusNoteType::Flick) | GET_BIT(SusNoteType::HellTap) | GET_BIT(SusNoteType::Grounded);
 #undef GET_BIT
-        if (type & mask) DrawShortNotes(note);
+        if (type & mask) DrawShortNotes(i);
     }
 
     FINISH_DRAW_TRANSACTION;
     Prepare3DDrawCall();
-    DrawPolygonIndexed3D(groundVertices, 4, rectVertexIndices, 2, hGroundBuffer, TRUE);
+    SU_PROFILE_COUNT(DrawCalls, 1);
+    device->DrawPolygon3D(groundVertices, 4, rectVertexIndices, 2, hGroundBuffer, true);
+    SU_PROFILE_COUNT(DrawCalls, sprites.size());
     for (auto& i : sprites) i->Draw();
 
     //3D系ノーツ
     Prepare3DDrawCall();
-    DrawAerialNotes(seenData);
+    DrawAerialNotes();
 
     if (airActionShown && showAirActionJudge) {
-        SetDrawBlendMode(DX_BLENDMODE_ADD, 192);
-        SetUseZBuffer3D(FALSE);
-        DrawTriangle3D(
+        device->SetBlendMode(RenderBlendMode::Add, 192);
+        device->SetDepthTest(false);
+        SU_PROFILE_COUNT(DrawCalls, 1);
+        device->DrawTriangle3D(
             VGet(SU_LANE_X_MIN_EXT, SU_LANE_Y_AIR - 5, SU_LANE_Z_MIN - 5),
             VGet(SU_LANE_X_MIN_EXT, SU_LANE_Y_AIR + 5, SU_LANE_Z_MIN + 5),
             VGet(SU_LANE_X_MAX_EXT, SU_LANE_Y_AIR + 5, SU_LANE_Z_MIN + 5),
-            airActionJudgeColor, TRUE);
-        DrawTriangle3D(
+            airActionJudgeColor, true);
+        SU_PROFILE_COUNT(DrawCalls, 1);
+        device->DrawTriangle3D(
             VGet(SU_LANE_X_MIN_EXT, SU_LANE_Y_AIR - 5, SU_LANE_Z_MIN - 5),
             VGet(SU_LANE_X_MAX_EXT, SU_LANE_Y_AIR + 5, SU_LANE_Z_MIN + 5),
             VGet(SU_LANE_X_MAX_EXT, SU_LANE_Y_AIR - 5, SU_LANE_Z_MIN - 5),
-            airActionJudgeColor, TRUE);
+            airActionJudgeColor, true);
     }
 }
 
-void ScenePlayer::DrawAerialNotes(const vector<shared_ptr<SusDrawableNoteData>>& notes)
+void ScenePlayer::DrawAerialNotes()
 {
+    SU_PROFILE_ZONE("ScenePlayer::DrawAerialNotes");
     vector<AirDrawQuery> airdraws, covers;
-    for (const auto &note : seenData) {
+    for (const auto i : seenIndices) {
+        const auto &note = noteStore.Sources[i];
         if (note->Type.test(size_t(SusNoteType::AirAction))) {
             // DrawAirActionNotes(note);
             AirDrawQuery head;
             head.Type = AirDrawType::AirActionStart;
-            head.Z = 1.0 - note->ModifiedPosition / seenDuration;
+            head.Z = GetRelativePosition(i);
             head.Note = note;
+            head.Index = i;
             airdraws.push_back(head);
             auto prev = note;
+            auto prevIndex = i;
             auto lastZ = head.Z;
-            for (const auto &extra : note->ExtraData) {
+            for (size_t e = 0; e < note->ExtraData.size(); ++e) {
+                const auto &extra = note->ExtraData[e];
                 if (extra->Type.test(size_t(SusNoteType::Control))) continue;
                 if (extra->Type.test(size_t(SusNoteType::Injection))) continue;
-                const auto z = 1.0 - extra->ModifiedPosition / seenDuration;
+                const auto index = noteStore.FirstSteps[i] + SU_TO_UINT32(e);
+                const auto z = GetRelativePosition(index);
                 if ((z >= 0 || lastZ >= 0) && (z < cullingLimit || lastZ < cullingLimit)) {
                     AirDrawQuery tail;
                     tail.Type = AirDrawType::AirActionStep;
                     tail.Z = z;
                     tail.Note = extra;
                     tail.PreviousNote = prev;
+                    tail.Index = index;
+                    tail.PreviousIndex = prevIndex;
                     airdraws.push_back(tail);
                     covers.push_back(tail);
                 }
                 prev = extra;
+                prevIndex = index;
                 lastZ = z;
             }
         }
         if (note->Type.test(size_t(SusNoteType::Air))) {
-            const auto z = 1.0 - note->ModifiedPosition / seenDuration;
+            const auto z = GetRelativePosition(i);
             if (z < 0 || z >= cullingLimit) continue;
             AirDrawQuery head;
             head.Type = AirDrawType::Air;
             head.Z = z;
             head.Note = note;
+            head.Index = i;
             airdraws.push_back(head);
         }
     }
@@ -256,6 +306,7 @@ void ScenePlayer::DrawAerialNotes(const vector<shared_ptr<SusDrawableNoteData>>&
 // position は 0 ~ 16
 void ScenePlayer::SpawnJudgeEffect(const shared_ptr<SusDrawableNoteData>& target, const JudgeType type)
 {
+    if (manager->IsHeadless()) return;
     Prepare3DDrawCall();
     const auto position = target->StartLane + target->Length / 2.0f;
     const auto x = glm::mix(SU_LANE_X_MIN, SU_LANE_X_MAX, position / 16.0f);
@@ -326,6 +377,7 @@ void ScenePlayer::SpawnJudgeEffect(const shared_ptr<SusDrawableNoteData>& target
 
 void ScenePlayer::SpawnSlideLoopEffect(const shared_ptr<SusDrawableNoteData>& target)
 {
+    if (manager->IsHeadless()) return;
     SpawnJudgeEffect(target, JudgeType::SlideTap);
 
     animeSlideLoop->AddRef();
@@ -352,6 +404,7 @@ void ScenePlayer::RemoveSlideEffect()
 
 void ScenePlayer::UpdateSlideEffect()
 {
+    if (manager->IsHeadless()) return;
     Prepare3DDrawCall();
     auto it = slideEffects.begin();
     while (it != slideEffects.end()) {
@@ -363,50 +416,24 @@ void ScenePlayer::UpdateSlideEffect()
             it = slideEffects.erase(it);
             continue;
         }
-        auto last = note;
-
-        for (auto &slideElement : note->ExtraData) {
-            if (slideElement->Type.test(size_t(SusNoteType::Control))) continue;
-            if (slideElement->Type.test(size_t(SusNoteType::Injection))) continue;
-            if (currentTime >= slideElement->StartTime) {
-                last = slideElement;
-                continue;
-            }
-            auto &segmentPositions = curveData[slideElement];
-
-            auto lastSegmentPosition = segmentPositions[0];
-            auto lastTimeInBlock = get<0>(lastSegmentPosition) / (slideElement->StartTime - last->StartTime);
-            auto comp = false;
-            for (auto &segmentPosition : segmentPositions) {
-                if (lastSegmentPosition == segmentPosition) continue;
-                const auto currentTimeInBlock = get<0>(segmentPosition) / (slideElement->StartTime - last->StartTime);
-                const auto cst = glm::mix(last->StartTime, slideElement->StartTime, currentTimeInBlock);
-                if (currentTime >= cst) {
-                    lastSegmentPosition = segmentPosition;
-                    lastTimeInBlock = currentTimeInBlock;
-                    continue;
-                }
-                const auto lst = glm::mix(last->StartTime, slideElement->StartTime, lastTimeInBlock);
-                const auto t = (currentTime - lst) / (cst - lst);
-                const auto x = glm::mix(get<1>(lastSegmentPosition), get<1>(segmentPosition), t);
-                const auto absx = glm::mix(SU_LANE_X_MIN, SU_LANE_X_MAX, x);
-                const auto at = ConvWorldPosToScreenPos(VGet(absx, SU_LANE_Y_GROUND, SU_LANE_Z_MIN));
-                effect->Transform.X = at.x;
-                effect->Transform.Y = at.y;
-                comp = true;
-                break;
-            }
-            if (comp) break;
+        double x, width;
+        if (slideMeshes.Evaluate(note.get(), currentTime, &x, &width)) {
+            const auto absx = glm::mix(SU_LANE_X_MIN, SU_LANE_X_MAX, x);
+            const auto at = ConvWorldPosToScreenPos(VGet(absx, SU_LANE_Y_GROUND, SU_LANE_Z_MIN));
+            effect->Transform.X = at.x;
+            effect->Transform.Y = at.y;
         }
         ++it;
     }
 }
 
 
-void ScenePlayer::DrawShortNotes(const shared_ptr<SusDrawableNoteData>& note) const
+void ScenePlayer::DrawShortNotes(const uint32_t index) const
 {
-    SetDrawBlendMode(DX_BLENDMODE_ALPHA, 255);
-    const auto relpos = 1.0 - note->ModifiedPosition / seenDuration;
+    const auto device = RenderDevice::GetCurrent();
+    device->SetBlendMode(RenderBlendMode::Alpha, 255);
+    const auto &note = noteStore.Sources[index];
+    const auto relpos = GetRelativePosition(index);
     const auto length = note->Length;
 #ifdef SU_ENABLE_NOTE_HORIZONTAL_MOVING
     const auto zlane = note->CenterAtZero - length / 2.0f;
@@ -436,6 +463,7 @@ void ScenePlayer::DrawShortNotes(const shared_ptr<SusDrawableNoteData>& note) co
 
 void ScenePlayer::DrawAirNotes(const AirDrawQuery &query) const
 {
+    const auto device = RenderDevice::GetCurrent();
     auto note = query.Note;
     const auto length = note->Length;
     const auto slane = note->StartLane;
@@ -444,11 +472,11 @@ void ScenePlayer::DrawAirNotes(const AirDrawQuery &query) const
     const auto right = glm::mix(SU_LANE_X_MIN, SU_LANE_X_MAX, (slane + length) / 16.0);
     double refroll;
     if (note->ExtraAttribute->RollTimeline) {
-        auto state = note->ExtraAttribute->RollTimeline->GetRawDrawStateAt(currentTime);
+        auto state = note->ExtraAttribute->RollTimeline->GetRawDrawStateAt(drawTime);
         const auto mp = note->StartTimeEx - get<1>(state);
         refroll = NormalizedFmod(-mp * airRollSpeed, 0.5);
     } else {
-        refroll = NormalizedFmod(-note->ModifiedPosition * airRollSpeed, 0.5);
+        refroll = NormalizedFmod(-noteStore.Positions[query.Index] * airRollSpeed, 0.5);
     }
     const auto roll = SU_TO_FLOAT(note->Type.test(size_t(SusNoteType::Up)) ? refroll : 0.5 - refroll);
     const auto xadjust = note->Type.test(size_t(SusNoteType::Left)) ? -80.0f : (note->Type.test(size_t(SusNoteType::Right)) ? 80.0f : 0.0f);
@@ -485,18 +513,21 @@ void ScenePlayer::DrawAirNotes(const AirDrawQuery &query) const
         }
     };
     Prepare3DDrawCall();
-    SetUseZBuffer3D(FALSE);
-    SetDrawBlendMode(DX_BLENDMODE_ALPHA, 255);
-    DrawPolygonIndexed3D(vertices, 4, rectVertexIndices, 2, handle, TRUE);
+    device->SetDepthTest(false);
+    device->SetBlendMode(RenderBlendMode::Alpha, 255);
+    SU_PROFILE_COUNT(DrawCalls, 1);
+    device->DrawPolygon3D(vertices, 4, rectVertexIndices, 2, handle, true);
 }
 
-void ScenePlayer::DrawHoldNotes(const shared_ptr<SusDrawableNoteData>& note) const
+void ScenePlayer::DrawHoldNotes(const uint32_t index) const
 {
+    const auto device = RenderDevice::GetCurrent();
+    const auto &note = noteStore.Sources[index];
     const auto length = note->Length;
     const auto slane = note->StartLane;
-    const auto endpoint = note->ExtraData.back();
-    const auto relpos = 1.0 - note->ModifiedPosition / seenDuration;
-    const auto reltailpos = 1.0 - endpoint->ModifiedPosition / seenDuration;
+    const auto firstStep = noteStore.FirstSteps[index];
+    const auto relpos = GetRelativePosition(index);
+    const auto reltailpos = GetRelativePosition(firstStep + noteStore.StepCounts[index] - 1);
     const auto begin = !!note->OnTheFlyData[size_t(NoteAttribute::Finished)]; // Hold全体の判定が行われ始めていればtrueにしたい、これだと判定としては少し遅いかもしれないがまぁ実用上問題ないのでは
     const auto activated = !!note->OnTheFlyData[size_t(NoteAttribute::Activated)]; // Holdが押されていればtrueにしたい、たぶん一致した論理になるはず
 
@@ -506,11 +537,11 @@ void ScenePlayer::DrawHoldNotes(const shared_ptr<SusDrawableNoteData>& note) con
     auto tail = reltailpos;
     if (!(head < 0 && tail < 0) && !(head >= cullingLimit && tail >= cullingLimit)) {
         if (!begin) { // 判定前
-            SetDrawBlendMode(DX_BLENDMODE_ADD, 239);
+            device->SetBlendMode(RenderBlendMode::Add, 239);
         } else if (activated) { // 判定中 : Hold時
-            SetDrawBlendMode(DX_BLENDMODE_ADD, 255);
+            device->SetBlendMode(RenderBlendMode::Add, 255);
         } else { // 判定中 : 非Hold時
-            SetDrawBlendMode(DX_BLENDMODE_ADD, 175);
+            device->SetBlendMode(RenderBlendMode::Add, 175);
         }
 
         if (begin && activated) {
@@ -526,17 +557,18 @@ void ScenePlayer::DrawHoldNotes(const shared_ptr<SusDrawableNoteData>& note) con
         const auto srcY = SU_TO_INT32((relpos - head) / wholelen * imageHoldStrut->GetHeight());
         const auto height = SU_TO_INT32(len / wholelen * imageHoldStrut->GetHeight());
 
-        DrawRectModiGraphF(
+        SU_PROFILE_COUNT(DrawCalls, 1);
+        device->DrawImageQuad(
             slane * widthPerLane, y1,
             (slane + length) * widthPerLane, y1,
             (slane + length) * widthPerLane, y2,
             slane * widthPerLane, y2,
             0, srcY, SU_TO_INT32(noteImageBlockX), height,
-            imageHoldStrut->GetHandle(), TRUE
+            imageHoldStrut->GetHandle(), true
         );
     }
 
-    SetDrawBlendMode(DX_BLENDMODE_ALPHA, 255);
+    device->SetBlendMode(RenderBlendMode::Alpha, 255);
 
     for (int i = note->ExtraData.size() - 1; i >= 0; --i) {
         const auto &ex = note->ExtraData[i];
@@ -544,7 +576,7 @@ void ScenePlayer::DrawHoldNotes(const shared_ptr<SusDrawableNoteData>& note) con
         if (ex->Type.test(size_t(SusNoteType::Injection))) continue;
         if (ex->OnTheFlyData[size_t(NoteAttribute::Finished)]/* && ノーツがAttack以上の判定*/) continue;
 
-        const auto relendpos = 1.0 - ex->ModifiedPosition / seenDuration;
+        const auto relendpos = GetRelativePosition(firstStep + i);
         const int len = SU_TO_INT32(length);
         if (ex->Type.test(size_t(SusNoteType::Start))) {
             DrawTap(slane, len, relendpos, imageHold->GetHandle());
@@ -558,15 +590,28 @@ void ScenePlayer::DrawHoldNotes(const shared_ptr<SusDrawableNoteData>& note) con
     }
 }
 
-void ScenePlayer::DrawSlideNotes(const shared_ptr<SusDrawableNoteData>& note)
+void ScenePlayer::DrawSlideNotesWith(SImage *image)
 {
-    auto lastStep = note;
-    auto offsetTimeInBlock = 0.0; /* そのslideElementの、不可視中継点のつながり等を考慮した時の先頭位置、的な */
+    const auto body = imageSlide, step = imageSlideStep, strut = imageSlideStrut;
+    imageSlide = imageSlideStep = imageSlideStrut = image;
+    for (const auto i : seenIndices) {
+        if (noteStore.Types[i] & (1u << size_t(SusNoteType::Slide))) DrawSlideNotes(i);
+    }
+    imageSlide = body;
+    imageSlideStep = step;
+    imageSlideStrut = strut;
+}
+
+void ScenePlayer::DrawSlideNotes(const uint32_t index)
+{
+    SU_PROFILE_ZONE("ScenePlayer::DrawSlideNotes");
+    const auto device = RenderDevice::GetCurrent();
+    const auto &note = noteStore.Sources[index];
+    const auto &positions = noteStore.Positions;
     const auto strutBottom = 1.0;
     const auto begin = !!note->OnTheFlyData[size_t(NoteAttribute::Finished)]; // Hold全体の判定が行われ始めていればtrueにしたい、これだと判定としては少し遅いかもしれないがまぁ実用上問題ないのでは
     const auto activated = !!note->OnTheFlyData[size_t(NoteAttribute::Activated)]; // Holdが押されていればtrueにしたい、たぶん一致した論理になるはず
-    slideVertices.clear();
-    slideIndices.clear();
+    const auto mesh = slideMeshes.Find(note.get());
 
     /* 基本方針 */
     /* 従来 : [始点,中継点,不可視中継点]から次の[中継点,不可視中継点,終点]にかけて(u,v)の計算を行っている */
@@ -574,246 +619,170 @@ void ScenePlayer::DrawSlideNotes(const shared_ptr<SusDrawableNoteData>& note)
     /*        分割点(?)の配置はすでに正しく計算されているので手を加えない */
     /*        従来の(u,v)計算を行っていた領域で、 0 <= v <= 1 であったところを a <= v <= b に変更し */
     /*        不可視中継点をまたいだ領域全体の時間からa,bを適当に定める */
+    /* 区間ごとの a,b と分割点は SlideMeshStore が読み込み時に計算してある */
 
     /* 重要 */
     /* すべての変数、演算の意味を理解したわけではないので、変拍子、ハイスピ設定等で死ぬ可能性が多分にある */
 
-    /* 各SlideElementに対応する追加情報を計算して格納する */
-    /* 起点時刻, 終点時刻 の2要素ベクターのベクター */
-    /* 起点時刻 : そのSlideElement以前に現れた始点or中継点の先頭時刻 */
-    /* 終点時刻 : そのSlideElement以降に現れる終点or中継点の終端時刻 */
-    std::vector<std::vector<double>> exData(note->ExtraData.size() + 1);
-    {
-        unsigned int i = 0;
-        std::vector<double> tmp(2);
-        auto lastStartTime = note->StartTime;
-
-        /* 先頭要素(note)はSusNoteType::Startになるはず(本当か?) */
-        tmp[0] = note->StartTime;
-        tmp[1] = 0;
-        exData[i] = tmp;
-        ++i;
-
-        /* 直前のSlideElementの開始時刻を共有する */
-        /* 中継点の場合は開始時刻を共有した”後”に、共有する開始時刻を更新する */
-        /* 中継点、終点の場合は終了時刻が決定するので保存しておく(それ以外なら終端時刻はとりあえず0にしておく) */
-        for (auto &slideElement : note->ExtraData) {
-            tmp[0] = lastStartTime;
-            tmp[1] = 0;
-
-            if (slideElement->Type.test(size_t(SusNoteType::Step))) {
-                lastStartTime = slideElement->StartTime;
-                tmp[1] = slideElement->StartTime;
-            }
-            if (slideElement->Type.test(size_t(SusNoteType::End))) {
-                /* これSlide終端の後にデータ来ない前提になってるけど(大丈夫か?) */
-                tmp[1] = slideElement->StartTime;
-            }
+    if (!begin) { // 判定前
+        device->SetBlendMode(RenderBlendMode::Add, 239);
+    } else if (activated) { // 判定中 : Slide時
+        device->SetBlendMode(RenderBlendMode::Add, 255);
+    } else { // 判定中 : 非Slide時
+        device->SetBlendMode(RenderBlendMode::Add, 175);
+    }
+    device->SetBackCulling(false);
 
-            exData[i] = tmp;
-            ++i;
+    // 支柱
+    // 頂点はリングバッファに書き、一杯になるかこのSlideが終わったら書いた分を描く
+    auto start = slideVertexHead;
+    const auto flush = [&] {
+        const auto quads = (slideVertexHead - start) / 4;
+        if (quads) {
+            SU_PROFILE_COUNT(DrawCalls, 1);
+            device->DrawPolygon2D(slideVertices.data() + start, SU_TO_INT32(quads * 4), slideIndices.data(), SU_TO_INT32(quads * 2), imageSlideStrut->GetHandle(), true);
         }
+        start = slideVertexHead;
+    };
+    const auto white = GetColorU8(255, 255, 255, 255);
+    const auto putVertex = [&](VERTEX2D &vertex, const double x, const double y, const float u, const double v) {
+        vertex.pos = VGet(SU_TO_FLOAT(x), SU_TO_FLOAT(y), 0);
+        vertex.rhw = 1.0f;
+        vertex.dif = white;
+        vertex.u = u;
+        vertex.v = float(v);
+    };
 
-        for (i = exData.size() - 1; i > 0; --i) {
-            /* 自分自身の直前の何かが開始時刻を共有している */
-            if (exData[i - 1][0] == exData[i][0]) {
-                /* 終了時刻も共有したい */
-                exData[i - 1][1] = exData[i][1];
-            } else {
-                /* 終了時刻は既にexData[i - 1][1]に入っているはず(本当か?) */
+    uint32_t first, last;
+    for (auto b = 0u; mesh && b < mesh->BlockCount; ++b) {
+        const auto &block = slideMeshes.Blocks[mesh->FirstBlock + b];
+        if (!slideMeshes.FindVisibleSegments(block, positions, seenDuration, cullingLimit, &first, &last)) continue;
+        const auto offsetTimeInBlock = block.Offset;
+
+        // 見えている最初の線分の始点から
+        const auto &lastPoint = slideMeshes.Points[first - 1];
+        auto lastSegmentX = lastPoint.X;
+        auto lastSegmentLength = lastPoint.Length;
+        auto lsRelY = SlideMeshStore::GetRelativeY(block, lastPoint, positions, seenDuration);
+        auto lastTimeInBlock2 = lastPoint.TimeInBlock2;
+
+        for (auto p = first; p <= last; ++p) {
+            const auto &point = slideMeshes.Points[p];
+            const auto currentTimeInBlock2 = point.TimeInBlock2;
+            auto csRelY = SlideMeshStore::GetRelativeY(block, point, positions, seenDuration);
+            auto currentTimeDiff = 0.0;
+            const auto lastTimeDiff = 0.0;
+
+            if (begin && activated) {
+                if (csRelY >= 1 && lsRelY >= 1) {
+                    // セグメントの全体が判定ラインを超えているとき
+                    // 表示はしたくないけど内部数値は普通に処理した時と一致させたい
+                    //    => 描画先座標を一致させてお茶を濁す
+                    lsRelY = csRelY;
+                } else if (csRelY >= 1) {
+                    // セグメントの始点が判定ラインより手前、終点が判定ラインを超えているとき
+                    // 始点はそのまま、終点は判定ラインに一致させ、次の始点は判定ラインから
+                    csRelY = 1;
+
+                    const auto sep = (1.0 - csRelY) * seenDuration;
+                    const auto ctib = (sep - positions[block.FromIndex]) / (positions[block.ToIndex] - positions[block.FromIndex]);
+                    const auto g0Sp = ctib * block.Duration;
+                    const auto ctib2 = g0Sp / block.ExDuration;
+
+                    currentTimeDiff = ctib2 - currentTimeInBlock2;
+                } else if (lsRelY >= 1) {
+                    // セグメントの終点は判定ラインより手前、始点が判定ラインを超えているとき(ハイスピ指定を行った場合に起こりうるはず)
+                    // どうしたいんだろう
+                    const auto ratio = (1.0 - csRelY) / (lsRelY - csRelY);
+                    lastTimeInBlock2 = currentTimeInBlock2 + (lastTimeInBlock2 - currentTimeInBlock2) * ratio;
+                    lsRelY = 1;
+                }
+            }
+
+            if (slideVertexHead == slideVertices.size()) {
+                flush();
+                slideVertexHead = start = 0;
             }
+            const auto vertices = &slideVertices[slideVertexHead];
+            const auto lastV = (offsetTimeInBlock + lastTimeInBlock2 + lastTimeDiff) * strutBottom;
+            const auto currentV = (offsetTimeInBlock + currentTimeInBlock2 + currentTimeDiff) * strutBottom;
+            putVertex(vertices[0], lastSegmentX * laneBufferX - lastSegmentLength / 2 * widthPerLane, laneBufferY * lsRelY, 0.0f, lastV);
+            putVertex(vertices[1], lastSegmentX * laneBufferX + lastSegmentLength / 2 * widthPerLane, laneBufferY * lsRelY, 1.0f, lastV);
+            putVertex(vertices[2], point.X * laneBufferX - point.Length / 2 * widthPerLane, laneBufferY * csRelY, 0.0f, currentV);
+            putVertex(vertices[3], point.X * laneBufferX + point.Length / 2 * widthPerLane, laneBufferY * csRelY, 1.0f, currentV);
+            slideVertexHead += 4;
+
+            lastSegmentX = point.X;
+            lastSegmentLength = point.Length;
+            lsRelY = csRelY;
+            lastTimeInBlock2 = currentTimeInBlock2;
         }
     }
+    flush();
 
-    // 支柱
-    auto drawcount = 0;
-    uint16_t base = 0;
-    unsigned int i = 0;
-    for (auto &slideElement : note->ExtraData) {
-        ++i; /* exData[0] はnoteそのものの情報だからこのインクリメントは必須 */
-        if (slideElement->Type.test(size_t(SusNoteType::Control))) continue;
-        if (slideElement->Type.test(size_t(SusNoteType::Injection))) continue;
-        auto &segmentPositions = curveData[slideElement];
-
-        auto lastSegmentPosition = segmentPositions[0];
-        auto lastSegmentLength = double(lastStep->Length);
-        auto lastSegmentRelativeY = 1.0 - lastStep->ModifiedPosition / seenDuration;
-        auto lsRelY = lastSegmentRelativeY;
-        auto lastTimeInBlock2 = get<0>(lastSegmentPosition) / (exData[i][1] - exData[i][0]);
-
-        for (const auto &segmentPosition : segmentPositions) {
-            if (lastSegmentPosition == segmentPosition) continue;
-            const auto currentTimeInBlock = get<0>(segmentPosition) / (slideElement->StartTime - lastStep->StartTime);
-            const auto currentTimeInBlock2 = get<0>(segmentPosition) / (exData[i][1] - exData[i][0]);
-            const auto currentSegmentLength = glm::mix(double(lastStep->Length), double(slideElement->Length), currentTimeInBlock);
-            const auto segmentExPosition = glm::mix(lastStep->ModifiedPosition, slideElement->ModifiedPosition, currentTimeInBlock);
-            const auto currentSegmentRelativeY = 1.0 - segmentExPosition / seenDuration;
-            auto csRelY = currentSegmentRelativeY;
-            if ((currentSegmentRelativeY >= 0 || lastSegmentRelativeY >= 0)
-                && (currentSegmentRelativeY < cullingLimit || lastSegmentRelativeY < cullingLimit)) {
-                auto currentTimeDiff = 0.0;
-                const auto lastTimeDiff = 0.0;
+    // 中心線
+    if (showSlideLine) {
+        if (!begin) { // 判定前
+            device->SetBlendMode(RenderBlendMode::Alpha, 239);
+        } else if (activated) { // 判定中 : Hold時
+            device->SetBlendMode(RenderBlendMode::Alpha, 255);
+        } else { // 判定中 : 非Hold時
+            device->SetBlendMode(RenderBlendMode::Alpha, 175);
+        }
+
+        for (auto b = 0u; mesh && b < mesh->BlockCount; ++b) {
+            const auto &block = slideMeshes.Blocks[mesh->FirstBlock + b];
+            if (!slideMeshes.FindVisibleSegments(block, positions, seenDuration, cullingLimit, &first, &last)) continue;
+            auto lastSegmentRelativeX = slideMeshes.Points[first - 1].X;
+            auto lastSegmentRelativeY = SlideMeshStore::GetRelativeY(block, slideMeshes.Points[first - 1], positions, seenDuration);
 
+            for (auto p = first; p <= last; ++p) {
+                const auto &point = slideMeshes.Points[p];
+                auto currentSegmentRelativeX = point.X;
+                auto currentSegmentRelativeY = SlideMeshStore::GetRelativeY(block, point, positions, seenDuration);
                 if (begin && activated) {
-                    if (csRelY >= 1 && lsRelY >= 1) {
+                    if (currentSegmentRelativeY >= 1 && lastSegmentRelativeY >= 1) {
                         // セグメントの全体が判定ラインを超えているとき
                         // 表示はしたくないけど内部数値は普通に処理した時と一致させたい
                         //    => 描画先座標を一致させてお茶を濁す
-                        lsRelY = csRelY;
-                    } else if (csRelY >= 1) {
+                        lastSegmentRelativeX = currentSegmentRelativeX;
+                        lastSegmentRelativeY = currentSegmentRelativeY;
+                    } else if (currentSegmentRelativeY >= 1) {
                         // セグメントの始点が判定ラインより手前、終点が判定ラインを超えているとき
                         // 始点はそのまま、終点は判定ラインに一致させ、次の始点は判定ラインから
-                        csRelY = 1;
+                        currentSegmentRelativeX = lastSegmentRelativeX - (lastSegmentRelativeX - currentSegmentRelativeX) / (lastSegmentRelativeY - currentSegmentRelativeY) * (lastSegmentRelativeY - 1.0);
+                        currentSegmentRelativeY = 1;
 
-                        const auto sep = (1.0 - csRelY) * seenDuration;
-                        const auto ctib = (sep - lastStep->ModifiedPosition) / (slideElement->ModifiedPosition - lastStep->ModifiedPosition);
-                        const auto g0Sp = ctib * (slideElement->StartTime - lastStep->StartTime);
-                        const auto ctib2 = g0Sp / (exData[i][1] - exData[i][0]);
-
-                        currentTimeDiff = ctib2 - currentTimeInBlock2;
-                    } else if (lsRelY >= 1) {
+                    } else if (lastSegmentRelativeY >= 1) {
                         // セグメントの終点は判定ラインより手前、始点が判定ラインを超えているとき(ハイスピ指定を行った場合に起こりうるはず)
                         // どうしたいんだろう
-                        const auto ratio = (1.0 - csRelY) / (lsRelY - csRelY);
-                        lastTimeInBlock2 = currentTimeInBlock2 + (lastTimeInBlock2 - currentTimeInBlock2) * ratio;
-                        lsRelY = 1;
+                        lastSegmentRelativeX = currentSegmentRelativeX - (currentSegmentRelativeX - lastSegmentRelativeX) / (currentSegmentRelativeY - lastSegmentRelativeY) * (currentSegmentRelativeY - 1.0);
+                        lastSegmentRelativeY = 1;
                     }
                 }
 
-
-                slideVertices.push_back(
-                    {
-                        VGet(SU_TO_FLOAT(get<1>(lastSegmentPosition) * laneBufferX - lastSegmentLength / 2 * widthPerLane), SU_TO_FLOAT(laneBufferY * lsRelY), 0),
-                        1.0f,
-                        GetColorU8(255, 255, 255, 255),
-                        0.0f, float((offsetTimeInBlock + lastTimeInBlock2 + lastTimeDiff) * strutBottom)
-                    }
-                );
-                slideVertices.push_back(
-                    {
-                        VGet(SU_TO_FLOAT(get<1>(lastSegmentPosition) * laneBufferX + lastSegmentLength / 2 * widthPerLane), SU_TO_FLOAT(laneBufferY * lsRelY), 0),
-                        1.0f,
-                        GetColorU8(255, 255, 255, 255),
-                        1.0f, float((offsetTimeInBlock + lastTimeInBlock2 + lastTimeDiff) * strutBottom)
-                    }
-                );
-                slideVertices.push_back(
-                    {
-                        VGet(SU_TO_FLOAT(get<1>(segmentPosition) * laneBufferX - currentSegmentLength / 2 * widthPerLane), SU_TO_FLOAT(laneBufferY * csRelY), 0),
-                        1.0f,
-                        GetColorU8(255, 255, 255, 255),
-                        0.0f, float((offsetTimeInBlock + currentTimeInBlock2 + currentTimeDiff) * strutBottom)
-                    }
+                SU_PROFILE_COUNT(DrawCalls, 1);
+                device->DrawTriangle(
+                    SU_TO_FLOAT(lastSegmentRelativeX * laneBufferX - slideLineThickness), SU_TO_FLOAT(laneBufferY * lastSegmentRelativeY),
+                    SU_TO_FLOAT(lastSegmentRelativeX * laneBufferX + slideLineThickness), SU_TO_FLOAT(laneBufferY * lastSegmentRelativeY),
+                    SU_TO_FLOAT(currentSegmentRelativeX * laneBufferX - slideLineThickness), SU_TO_FLOAT(laneBufferY * currentSegmentRelativeY),
+                    slideLineColor, true
                 );
-                slideVertices.push_back(
-                    {
-                        VGet(SU_TO_FLOAT(get<1>(segmentPosition) * laneBufferX + currentSegmentLength / 2 * widthPerLane), SU_TO_FLOAT(laneBufferY * csRelY), 0),
-                        1.0f,
-                        GetColorU8(255, 255, 255, 255),
-                        1.0f, float((offsetTimeInBlock + currentTimeInBlock2 + currentTimeDiff) * strutBottom)
-                    }
+                SU_PROFILE_COUNT(DrawCalls, 1);
+                device->DrawTriangle(
+                    SU_TO_FLOAT(lastSegmentRelativeX * laneBufferX + slideLineThickness), SU_TO_FLOAT(laneBufferY * lastSegmentRelativeY),
+                    SU_TO_FLOAT(currentSegmentRelativeX * laneBufferX - slideLineThickness), SU_TO_FLOAT(laneBufferY * currentSegmentRelativeY),
+                    SU_TO_FLOAT(currentSegmentRelativeX * laneBufferX + slideLineThickness), SU_TO_FLOAT(laneBufferY * currentSegmentRelativeY),
+                    slideLineColor, true
                 );
-                vector<uint16_t> here = { base, uint16_t(base + 2), uint16_t(base + 1), uint16_t(base + 2), uint16_t(base + 1), uint16_t(base + 3) };
-                slideIndices.insert(slideIndices.end(), here.begin(), here.end());
-                base += 4;
-                drawcount += 2;
-            }
-            lastSegmentPosition = segmentPosition;
-            lastSegmentLength = currentSegmentLength;
-            lastSegmentRelativeY = currentSegmentRelativeY;
-            lsRelY = csRelY;
-            lastTimeInBlock2 = currentTimeInBlock2;
-        }
-        if (slideElement->Type.test(size_t(SusNoteType::Step))) {
-            offsetTimeInBlock = 0;
-        } else {
-            offsetTimeInBlock += lastTimeInBlock2;
-        }
-        lastStep = slideElement;
-    }
-
-    if (!begin) { // 判定前
-        SetDrawBlendMode(DX_BLENDMODE_ADD, 239);
-    } else if (activated) { // 判定中 : Slide時
-        SetDrawBlendMode(DX_BLENDMODE_ADD, 255);
-    } else { // 判定中 : 非Slide時
-        SetDrawBlendMode(DX_BLENDMODE_ADD, 175);
-    }
-
-    SetUseBackCulling(FALSE);
-    DrawPolygonIndexed2D(slideVertices.data(), slideVertices.size(), slideIndices.data(), drawcount, imageSlideStrut->GetHandle(), TRUE);
-
-    // 中心線
-    if (showSlideLine) {
-        if (!begin) { // 判定前
-            SetDrawBlendMode(DX_BLENDMODE_ALPHA, 239);
-        } else if (activated) { // 判定中 : Hold時
-            SetDrawBlendMode(DX_BLENDMODE_ALPHA, 255);
-        } else { // 判定中 : 非Hold時
-            SetDrawBlendMode(DX_BLENDMODE_ALPHA, 175);
-        }
-
-        lastStep = note;
-        for (auto &slideElement : note->ExtraData) {
-            if (slideElement->Type.test(size_t(SusNoteType::Control))) continue;
-            if (slideElement->Type.test(size_t(SusNoteType::Injection))) continue;
-            auto &segmentPositions = curveData[slideElement];
-            auto lastSegmentPosition = segmentPositions[0];
-            auto lastSegmentRelativeX = get<1>(lastSegmentPosition);
-            auto lastSegmentRelativeY = 1.0 - lastStep->ModifiedPosition / seenDuration;
-
-            for (auto &segmentPosition : segmentPositions) {
-                if (lastSegmentPosition == segmentPosition) continue;
-                const auto currentTimeInBlock = get<0>(segmentPosition) / (slideElement->StartTime - lastStep->StartTime);
-                const auto segmentExPosition = glm::mix(lastStep->ModifiedPosition, slideElement->ModifiedPosition, currentTimeInBlock);
-                auto currentSegmentRelativeX = get<1>(segmentPosition);
-                auto currentSegmentRelativeY = 1.0 - segmentExPosition / seenDuration;
-                if ((currentSegmentRelativeY >= 0 || lastSegmentRelativeY >= 0)
-                    && (currentSegmentRelativeY < cullingLimit || lastSegmentRelativeY < cullingLimit)) {
-                    if (begin && activated) {
-                        if (currentSegmentRelativeY >= 1 && lastSegmentRelativeY >= 1) {
-                            // セグメントの全体が判定ラインを超えているとき
-                            // 表示はしたくないけど内部数値は普通に処理した時と一致させたい
-                            //    => 描画先座標を一致させてお茶を濁す
-                            lastSegmentRelativeX = currentSegmentRelativeX;
-                            lastSegmentRelativeY = currentSegmentRelativeY;
-                        } else if (currentSegmentRelativeY >= 1) {
-                            // セグメントの始点が判定ラインより手前、終点が判定ラインを超えているとき
-                            // 始点はそのまま、終点は判定ラインに一致させ、次の始点は判定ラインから
-                            currentSegmentRelativeX = lastSegmentRelativeX - (lastSegmentRelativeX - currentSegmentRelativeX) / (lastSegmentRelativeY - currentSegmentRelativeY) * (lastSegmentRelativeY - 1.0);
-                            currentSegmentRelativeY = 1;
-
-                        } else if (lastSegmentRelativeY >= 1) {
-                            // セグメントの終点は判定ラインより手前、始点が判定ラインを超えているとき(ハイスピ指定を行った場合に起こりうるはず)
-                            // どうしたいんだろう
-                            lastSegmentRelativeX = currentSegmentRelativeX - (currentSegmentRelativeX - lastSegmentRelativeX) / (currentSegmentRelativeY - lastSegmentRelativeY) * (currentSegmentRelativeY - 1.0);
-                            lastSegmentRelativeY = 1;
-                        }
-                    }
-
-                    DrawTriangleAA(
-                        SU_TO_FLOAT(lastSegmentRelativeX * laneBufferX - slideLineThickness), SU_TO_FLOAT(laneBufferY * lastSegmentRelativeY),
-                        SU_TO_FLOAT(lastSegmentRelativeX * laneBufferX + slideLineThickness), SU_TO_FLOAT(laneBufferY * lastSegmentRelativeY),
-                        SU_TO_FLOAT(currentSegmentRelativeX * laneBufferX - slideLineThickness), SU_TO_FLOAT(laneBufferY * currentSegmentRelativeY),
-                        slideLineColor, 16
-                    );
-                    DrawTriangleAA(
-                        SU_TO_FLOAT(lastSegmentRelativeX * laneBufferX + slideLineThickness), SU_TO_FLOAT(laneBufferY * lastSegmentRelativeY),
-                        SU_TO_FLOAT(currentSegmentRelativeX * laneBufferX - slideLineThickness), SU_TO_FLOAT(laneBufferY * currentSegmentRelativeY),
-                        SU_TO_FLOAT(currentSegmentRelativeX * laneBufferX + slideLineThickness), SU_TO_FLOAT(laneBufferY * currentSegmentRelativeY),
-                        slideLineColor, 16
-                    );
-                }
-                lastSegmentPosition = segmentPosition;
                 lastSegmentRelativeX = currentSegmentRelativeX;
                 lastSegmentRelativeY = currentSegmentRelativeY;
             }
-            lastStep = slideElement;
         }
     }
 
     // Tap
-    SetDrawBlendMode(DX_BLENDMODE_ALPHA, 255);
+    device->SetBlendMode(RenderBlendMode::Alpha, 255);
     for (int si = note->ExtraData.size() - 1; si >= 0; --si) {
         const auto &slideElement = note->ExtraData[si];
         if (slideElement->Type.test(size_t(SusNoteType::Control))) continue;
@@ -821,7 +790,7 @@ void ScenePlayer::DrawSlideNotes(const shared_ptr<SusDrawableNoteData>& note)
         if (slideElement->Type.test(size_t(SusNoteType::Invisible))) continue;
         if (slideElement->OnTheFlyData[size_t(NoteAttribute::Finished)]/* && ノーツがAttack以上の判定*/) continue;
 
-        const auto currentStepRelativeY = 1.0 - slideElement->ModifiedPosition / seenDuration;
+        const auto currentStepRelativeY = GetRelativePosition(noteStore.FirstSteps[index] + si);
         if (currentStepRelativeY >= 0 && currentStepRelativeY < cullingLimit) {
             const int length = SU_TO_INT32(slideElement->Length);
             if (slideElement->Type.test(size_t(SusNoteType::Start))) {
@@ -833,12 +802,13 @@ void ScenePlayer::DrawSlideNotes(const shared_ptr<SusDrawableNoteData>& note)
     }
     if (!(note->OnTheFlyData[size_t(NoteAttribute::Finished)]/* && ノーツがAttack以上の判定*/)) {
         const int length = SU_TO_INT32(note->Length);
-        DrawTap(note->StartLane, length, 1.0 - note->ModifiedPosition / seenDuration, imageSlide->GetHandle());
+        DrawTap(note->StartLane, length, GetRelativePosition(index), imageSlide->GetHandle());
     }
 }
 
 void ScenePlayer::DrawAirActionStart(const AirDrawQuery &query) const
 {
+    const auto device = RenderDevice::GetCurrent();
     const auto lastStep = query.Note;
     const auto lastStepRelativeY = query.Z;
 
@@ -875,16 +845,18 @@ void ScenePlayer::DrawAirActionStart(const AirDrawQuery &query) const
             1.0000f, 1.0f, 0.0f, 0.0f
         },
     };
-    DrawPolygonIndexed3D(vertices, 4, rectVertexIndices, 2, imageAirAction->GetHandle(), TRUE);
+    SU_PROFILE_COUNT(DrawCalls, 1);
+    device->DrawPolygon3D(vertices, 4, rectVertexIndices, 2, imageAirAction->GetHandle(), true);
 }
 
 void ScenePlayer::DrawAirActionStepBox(const AirDrawQuery &query) const
 {
+    const auto device = RenderDevice::GetCurrent();
     const auto slideElement = query.Note;
     const auto currentStepRelativeY = query.Z;
 
-    SetUseZBuffer3D(TRUE);
-    SetDrawBlendMode(DX_BLENDMODE_ALPHA, 255);
+    device->SetDepthTest(true);
+    device->SetBlendMode(RenderBlendMode::Alpha, 255);
     if (!slideElement->Type.test(size_t(SusNoteType::Invisible))) {
         const auto atLeft = (slideElement->StartLane) / 16.0;
         const auto atRight = (slideElement->StartLane + slideElement->Length) / 16.0;
@@ -952,18 +924,20 @@ void ScenePlayer::DrawAirActionStepBox(const AirDrawQuery &query) const
             14, 15, 19,
             14, 19, 18,
         };
-        SetUseZBuffer3D(TRUE);
-        DrawPolygonIndexed3D(vertices, 22, indices + 6, 16, imageAirAction->GetHandle(), TRUE);
+        device->SetDepthTest(true);
+        SU_PROFILE_COUNT(DrawCalls, 1);
+        device->DrawPolygon3D(vertices, 22, indices + 6, 16, imageAirAction->GetHandle(), true);
     }
 }
 
 void ScenePlayer::DrawAirActionStep(const AirDrawQuery &query) const
 {
+    const auto device = RenderDevice::GetCurrent();
     const auto slideElement = query.Note;
     const auto currentStepRelativeY = query.Z;
 
-    SetUseZBuffer3D(TRUE);
-    SetDrawBlendMode(DX_BLENDMODE_ALPHA, 255);
+    device->SetDepthTest(true);
+    device->SetBlendMode(RenderBlendMode::Alpha, 255);
     if (!slideElement->Type.test(size_t(SusNoteType::Invisible))) {
         const auto atLeft = (slideElement->StartLane) / 16.0;
         const auto atRight = (slideElement->StartLane + slideElement->Length) / 16.0;
@@ -981,33 +955,38 @@ void ScenePlayer::DrawAirActionStep(const AirDrawQuery &query) const
             0, 1, 3,
             0, 3, 2,
         };
-        SetUseZBuffer3D(FALSE);
-        DrawPolygonIndexed3D(vertices, 4, indices, 2, imageAirAction->GetHandle(), TRUE);
+        device->SetDepthTest(false);
+        SU_PROFILE_COUNT(DrawCalls, 1);
+        device->DrawPolygon3D(vertices, 4, indices, 2, imageAirAction->GetHandle(), true);
     }
 }
 
 void ScenePlayer::DrawAirActionCover(const AirDrawQuery &query)
 {
+    const auto device = RenderDevice::GetCurrent();
     const auto slideElement = query.Note;
     const auto lastStep = query.PreviousNote;
-    const auto &segmentPositions = curveData[slideElement];
+    const auto segmentPositions = curveData.Find(slideElement.get());
+    if (segmentPositions.empty()) return;
 
     auto lastSegmentPosition = segmentPositions[0];
     const auto blockDuration = slideElement->StartTime - lastStep->StartTime;
     auto lastSegmentLength = double(lastStep->Length);
     auto lastTimeInBlock = get<0>(lastSegmentPosition) / blockDuration;
-    auto lastSegmentRelativeY = 1.0 - lastStep->ModifiedPosition / seenDuration;
+    const auto lastStepPosition = noteStore.Positions[query.PreviousIndex];
+    const auto stepPosition = noteStore.Positions[query.Index];
+    auto lastSegmentRelativeY = 1.0 - lastStepPosition / seenDuration;
     for (const auto &segmentPosition : segmentPositions) {
         if (lastSegmentPosition == segmentPosition) continue;
         const auto currentTimeInBlock = get<0>(segmentPosition) / (slideElement->StartTime - lastStep->StartTime);
         const auto currentSegmentLength = glm::mix(double(lastStep->Length), double(slideElement->Length), currentTimeInBlock);
-        const auto segmentExPosition = glm::mix(lastStep->ModifiedPosition, slideElement->ModifiedPosition, currentTimeInBlock);
+        const auto segmentExPosition = glm::mix(lastStepPosition, stepPosition, currentTimeInBlock);
         const auto currentSegmentRelativeY = 1.0 - segmentExPosition / seenDuration;
 
         if ((currentSegmentRelativeY >= 0 || lastSegmentRelativeY >= 0)
             && (currentSegmentRelativeY < cullingLimit || lastSegmentRelativeY < cullingLimit)) {
-            SetUseZBuffer3D(FALSE);
-            SetUseBackCulling(FALSE);
+            device->SetDepthTest(false);
+            device->SetBackCulling(false);
             const auto back = glm::mix(SU_LANE_Z_MAX, SU_LANE_Z_MIN, currentSegmentRelativeY);
             const auto front = glm::mix(SU_LANE_Z_MAX, SU_LANE_Z_MIN, lastSegmentRelativeY);
             const auto backLeft = get<1>(segmentPosition) - currentSegmentLength / 32.0;
@@ -1026,7 +1005,8 @@ void ScenePlayer::DrawAirActionCover(const AirDrawQuery &query)
                 VERTEX3D { VGet(pbr, SU_LANE_Y_AIR * pbz, back), VGet(0, 0, -1), GetColorU8(255, 255, 255, 255), GetColorU8(0, 0, 0, 0), 0.9375f, 0.0f, 0.0f, 0.0f },
                 VERTEX3D { VGet(pfr, SU_LANE_Y_AIR * pfz, front), VGet(0, 0, -1), GetColorU8(255, 255, 255, 255), GetColorU8(0, 0, 0, 0), 0.9375f, 1.0f, 0.0f, 0.0f },
             };
-            DrawPolygonIndexed3D(vertices, 4, rectVertexIndices, 2, imageAirAction->GetHandle(), TRUE);
+            SU_PROFILE_COUNT(DrawCalls, 1);
+            device->DrawPolygon3D(vertices, 4, rectVertexIndices, 2, imageAirAction->GetHandle(), true);
 
             vertices[0].pos.x = glm::mix(SU_LANE_X_MIN, SU_LANE_X_MAX, get<1>(lastSegmentPosition)) - 10;
             vertices[1].pos.x = glm::mix(SU_LANE_X_MIN, SU_LANE_X_MAX, get<1>(segmentPosition)) - 10;
@@ -1036,7 +1016,8 @@ void ScenePlayer::DrawAirActionCover(const AirDrawQuery &query)
             vertices[1].u = 0.9375f; vertices[1].v = 0.0f;
             vertices[2].u = 1.0000f; vertices[2].v = 0.0f;
             vertices[3].u = 1.0000f; vertices[3].v = 1.0f;
-            DrawPolygonIndexed3D(vertices, 4, rectVertexIndices, 2, imageAirAction->GetHandle(), TRUE);
+            SU_PROFILE_COUNT(DrawCalls, 1);
+            device->DrawPolygon3D(vertices, 4, rectVertexIndices, 2, imageAirAction->GetHandle(), true);
         }
 
         lastSegmentPosition = segmentPosition;
@@ -1048,26 +1029,29 @@ void ScenePlayer::DrawAirActionCover(const AirDrawQuery &query)
 
 void ScenePlayer::DrawTap(const float lane, const int length, const double relpos, const int handle) const
 {
+    const auto device = RenderDevice::GetCurrent();
     for (auto i = 0; i < length * 2; i++) {
         const auto type = i ? (i == length * 2 - 1 ? 2 : 1) : 0;
-        DrawRectRotaGraph3F(
+        SU_PROFILE_COUNT(DrawCalls, 1);
+        device->DrawImage(
             (lane * 2 + i) * widthPerLane / 2, SU_TO_FLOAT(laneBufferY * relpos),
             SU_TO_INT32(noteImageBlockX * type), (0),
             SU_TO_INT32(noteImageBlockX), SU_TO_INT32(noteImageBlockY),
             0, noteImageBlockY / 2,
             actualNoteScaleX, actualNoteScaleY, 0,
-            handle, TRUE, FALSE);
+            handle, true);
     }
 }
 
-void ScenePlayer::DrawMeasureLine(const shared_ptr<SusDrawableNoteData>& note) const
+void ScenePlayer::DrawMeasureLine(const uint32_t index) const
 {
-    const auto relpos = SU_TO_FLOAT(1.0 - note->ModifiedPosition / seenDuration);
-    DrawLineAA(0, relpos * laneBufferY, laneBufferX, relpos * laneBufferY, GetColor(255, 255, 255), 6);
+    const auto device = RenderDevice::GetCurrent();
+    const auto relpos = SU_TO_FLOAT(GetRelativePosition(index));
+    SU_PROFILE_COUNT(DrawCalls, 1);
+    device->DrawLine(0, relpos * laneBufferY, laneBufferX, relpos * laneBufferY, MakeRenderColor(255, 255, 255), 6);
 }
 
 void ScenePlayer::Prepare3DDrawCall() const
 {
-    SetUseLighting(FALSE);
-    SetCameraPositionAndTarget_UpVecY(VGet(0, SU_TO_FLOAT(cameraY), SU_TO_FLOAT(cameraZ)), VGet(0, SU_LANE_Y_GROUND, SU_TO_FLOAT(cameraTargetZ)));
+    RenderDevice::GetCurrent()->SetCamera(VGet(0, SU_TO_FLOAT(cameraY), SU_TO_FLOAT(cameraZ)), VGet(0, SU_LANE_Y_GROUND, SU_TO_FLOAT(cameraTargetZ)));
 }
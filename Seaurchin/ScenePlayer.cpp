@@ -7,6 +7,7 @@
 #include "Setting.h"
 #include "Misc.h"
 #include "Config.h"
+#include "Profiler.h"
 
 using namespace std;
 
@@ -44,6 +45,8 @@ void RegisterPlayerScene(ExecutionManager * manager)
     engine->RegisterObjectMethod(SU_IF_SCENE_PLAYER, "double GetCurrentTime()", asMETHOD(ScenePlayer, GetPlayingTime), asCALL_THISCALL);
     engine->RegisterObjectMethod(SU_IF_SCENE_PLAYER, SU_IF_CHARACTER_INSTANCE "@ GetCharacterInstance()", asMETHOD(ScenePlayer, GetCharacterInstance), asCALL_THISCALL);
     engine->RegisterObjectMethod(SU_IF_SCENE_PLAYER, "void GetCurrentResult(" SU_IF_DRESULT " &out)", asMETHOD(ScenePlayer, GetCurrentResult), asCALL_THISCALL);
+    engine->RegisterObjectMethod(SU_IF_SCENE_PLAYER, SU_IF_JUDGE_TIMING "@ GetJudgeTiming()", asMETHOD(ScenePlayer, GetJudgeTiming), asCALL_THISCALL);
+    engine->RegisterObjectMethod(SU_IF_SCENE_PLAYER, "void StoreResult()", asMETHOD(ScenePlayer, StoreResult), asCALL_THISCALL);
     engine->RegisterObjectMethod(SU_IF_SCENE_PLAYER, "void MovePositionBySecond(double)", asMETHOD(ScenePlayer, MovePositionBySecond), asCALL_THISCALL);
     engine->RegisterObjectMethod(SU_IF_SCENE_PLAYER, "void MovePositionByMeasure(int)", asMETHOD(ScenePlayer, MovePositionByMeasure), asCALL_THISCALL);
     engine->RegisterObjectMethod(SU_IF_SCENE_PLAYER, "void SetJudgeCallback(" SU_IF_JUDGE_CALLBACK "@)", asMETHOD(ScenePlayer, SetJudgeCallback), asCALL_THISCALL);
@@ -61,6 +64,7 @@ namespace
         case 0: return new PlayableProcessor(src);
         case 1: return new AutoPlayerProcessor(src);
         case 2: return new PlayableProcessor(src, true);
+        case 3: return new ReplayProcessor(src);
         default: return nullptr;
         }
 
@@ -70,7 +74,6 @@ namespace
 ScenePlayer::ScenePlayer(ExecutionManager *exm)
     : manager(exm)
     , soundManager(manager->GetSoundManagerUnsafe())
-    , judgeSoundQueue(32)
     , analyzer(make_unique<SusAnalyzer>(192))
     , processor(CreateScoreProcessor(exm, this))
     , isLoadCompleted(false) // 若干危険ですけどね……
@@ -93,7 +96,9 @@ ScenePlayer::~ScenePlayer()
 
 void ScenePlayer::Initialize()
 {
-    LoadResources();
+    // ヘッドレス実行では描画資源を一切作らない
+    if (!manager->IsHeadless()) LoadResources();
+    else LoadOfflineAudio();
 
     const auto cp = manager->GetCharacterManagerSafe()->GetCharacterParameterSafe(0);
     const auto sp = manager->GetSkillManagerSafe()->GetSkillParameterSafe(0);
@@ -112,17 +117,113 @@ void ScenePlayer::SetProcessorOptions(ScoreProcessor *processor) const
 
 void ScenePlayer::EnqueueJudgeSound(const JudgeSoundType type)
 {
-    judgeSoundQueue.push(type);
+    judgeSoundQueue.Push(type);
+}
+
+void ScenePlayer::ScheduleJudgeSound(const JudgeSoundType type, const double time)
+{
+    if (ReserveJudgeSound(type, time)) return;
+    EnqueueJudgeSound(type);
+}
+
+bool ScenePlayer::ReserveJudgeSound(const JudgeSoundType type, const double time)
+{
+    return keysounds && keysounds->Schedule(keysoundIds[size_t(type)], time);
+}
+
+// 予約済みの判定音を捨てる 先読みで予約していた分は判定のときに改めて鳴らす
+void ScenePlayer::ClearKeysounds()
+{
+    if (!keysounds) return;
+    keysounds->Clear();
+    for (auto &note : data) {
+        note->OnTheFlyData.reset(size_t(NoteAttribute::SoundReserved));
+        for (auto &extra : note->ExtraData) extra->OnTheFlyData.reset(size_t(NoteAttribute::SoundReserved));
+    }
+}
+
+double ScenePlayer::GetKeysoundLookahead() const
+{
+    if (!keysounds) return 0;
+    return keysounds->GetScheduleAhead() + KeysoundScheduler::FrameMargin;
+}
+
+void ScenePlayer::NotifyJudge(const AbilityJudgeType judge, const JudgeInformation &info, const string &extra)
+{
+    switch (judge) {
+        case AbilityJudgeType::JusticeCritical:
+            currentCharacterInstance->OnJusticeCritical(info, extra);
+            break;
+        case AbilityJudgeType::Justice:
+            currentCharacterInstance->OnJustice(info, extra);
+            break;
+        case AbilityJudgeType::Attack:
+            currentCharacterInstance->OnAttack(info, extra);
+            break;
+        case AbilityJudgeType::Miss:
+            currentCharacterInstance->OnMiss(info, extra);
+            break;
+        default: break;
+    }
+    if (judgeRecorder) judgeRecorder(currentTime, judge, info);
+    if (replayRecorder) replayRecorder->RecordJudge(currentTime, judge, info);
+}
+
+ReplaySettings ScenePlayer::GetReplaySettings() const
+{
+    auto setting = manager->GetSettingInstanceSafe();
+    ReplaySettings settings;
+    settings.ChartHash = loadedScoreHash;
+    settings.ChartFile = ConvertUnicodeToUTF8(loadedScoreFile.wstring());
+    settings.JudgeAdjustSlider = setting->ReadValue<int>("Play", "JudgeAdjustSlider", 0) / 1000.0;
+    settings.JudgeMultiplierSlider = setting->ReadValue<double>("Play", "JudgeMultiplierSlider", 1);
+    settings.JudgeAdjustAirString = setting->ReadValue<int>("Play", "JudgeAdjustAirString", 200) / 1000.0;
+    settings.JudgeMultiplierAirString = setting->ReadValue<double>("Play", "JudgeMultiplierAirString", 4);
+    settings.Hispeed = hispeedMultiplier;
+    settings.AutoAir = manager->GetData<int>("AutoPlay", 1) == 2;
+    return settings;
+}
+
+void ScenePlayer::SaveReplay()
+{
+    auto log = spdlog::get("main");
+    const auto recorder = move(replayRecorder);
+    if (!recorder->IsValid()) {
+        log->info(u8"途中でシーク・リロードしたのでリプレイは保存しません");
+        return;
+    }
+
+    const auto directory = boost::filesystem::path(Setting::GetRootDirectory()) / SU_DATA_DIR / SU_REPLAY_DIR;
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(directory, ec);
+    const auto now = time(nullptr);
+    tm local {};
+    localtime_s(&local, &now);
+    const auto file = directory / fmt::format(L"{0:04d}{1:02d}{2:02d}-{3:02d}{4:02d}{5:02d}_{6:08x}" SU_REPLAY_EXTENSION,
+        local.tm_year + 1900, local.tm_mon + 1, local.tm_mday, local.tm_hour, local.tm_min, local.tm_sec, loadedScoreHash);
+    if (recorder->GetReplay().Save(file.wstring())) {
+        log->info(u8"リプレイを保存しました: {0}", ConvertUnicodeToUTF8(file.wstring()));
+    } else {
+        log->error(u8"リプレイ {0} を保存できませんでした", ConvertUnicodeToUTF8(file.wstring()));
+    }
 }
 
 
 void ScenePlayer::Finalize()
 {
-    isTerminating = true;
     if (loadWorkerThread.joinable()) loadWorkerThread.join();
-    SoundManager::StopGlobal(soundHoldLoop->GetSample());
-    SoundManager::StopGlobal(soundSlideLoop->GetSample());
-    SoundManager::StopGlobal(soundAirLoop->GetSample());
+    // 発音中に音声リソースを解放しないよう、先に音声スレッドを止める
+    judgeSoundQueue.Close();
+    judgeSoundThread.join();
+    if (offlineAudio) for (const auto id : offlineSources) offlineAudio->RemoveSource(id);
+    offlineSources.clear();
+    keysounds.reset();
+    if (offlineBgmMixer) BASS_StreamFree(offlineBgmMixer);
+    if (offlineBgmFile) BASS_StreamFree(offlineBgmFile);
+    offlineBgmMixer = offlineBgmFile = 0;
+    if (soundHoldLoop) SoundManager::StopGlobal(soundHoldLoop->GetSample());
+    if (soundSlideLoop) SoundManager::StopGlobal(soundSlideLoop->GetSample());
+    if (soundAirLoop) SoundManager::StopGlobal(soundAirLoop->GetSample());
     for (auto& res : resources) if (res.second) res.second->Release();
     if (spriteLane) spriteLane->Release();
     for (auto &i : sprites) i->Release();
@@ -131,13 +232,19 @@ void ScenePlayer::Finalize()
     spritesPending.clear();
     for (auto &i : slideEffects) i.second->Release();
     slideEffects.clear();
-    SoundManager::StopGlobal(bgmStream);
+    if (bgmStream) SoundManager::StopGlobal(bgmStream);
     delete processor;
     delete bgmStream;
 
-    DeleteGraph(hGroundBuffer);
-    if (movieBackground) DeleteGraph(movieBackground);
-    judgeSoundThread.join();
+    RenderDevice::GetCurrent()->DeleteTexture(hGroundBuffer);
+    if (movieBackground) RenderDevice::GetCurrent()->DeleteTexture(movieBackground);
+    if (judgeSoundQueue.GetDispatchedCount()) {
+        spdlog::get("main")->info(u8"判定音: {0}件 最大キュー長{1} 遅延 p50:{2:.3f}ms p99:{3:.3f}ms",
+            judgeSoundQueue.GetDispatchedCount(),
+            judgeSoundQueue.GetMaxDepth(),
+            judgeSoundQueue.GetLatencyPercentile(0.5) * 1000,
+            judgeSoundQueue.GetLatencyPercentile(0.99) * 1000);
+    }
 }
 
 void ScenePlayer::LoadWorker()
@@ -148,13 +255,26 @@ void ScenePlayer::LoadWorker()
     }
 
     auto mm = manager->GetMusicsManager();
-    auto scorefile = mm->GetSelectedScorePath();
+    auto scorefile = scoreFileOverride.empty() ? mm->GetSelectedScorePath() : scoreFileOverride;
 
     // 譜面の読み込み
-    analyzer->Reset();
-    analyzer->LoadFromFile(scorefile.wstring());
+    // 元譜面が変わっていなければコンパイル済みのものを使う
+    const auto sourceHash = CalculateFileCrc32(scorefile.wstring());
+    loadedScoreFile = scorefile;
+    loadedScoreHash = sourceHash;
+    const auto chartCacheDirectory = Setting::GetRootDirectory() / SU_DATA_DIR / SU_CACHE_DIR / SU_CHART_CACHE_DIR;
+    const auto chartCacheFile = chartCacheDirectory / (fmt::format(L"{0:08x}", Crc32Rec(0xffffffff, ConvertUnicodeToUTF8(scorefile.wstring()).c_str())) + SU_CACHE_CHART_EXTENSION);
+    // スライド曲線の許容誤差はレーン背景バッファのピクセル数で指定する 0以下なら譜面の SegmentsPerSecond で等分
+    // 分割は描画だけに効き、判定は曲線そのものを使う
+    analyzer->SetCurveTolerance(manager->GetSettingInstanceSafe()->ReadValue<double>("Graphic", "SlideCurveTolerance", SU_SLIDE_CURVE_TOLERANCE * laneBufferX) / laneBufferX);
+    if (!analyzer->LoadCompiledChart(chartCacheFile.wstring(), sourceHash, data, curveData)) {
+        analyzer->LoadFromFile(scorefile.wstring());
+        analyzer->RenderScoreData(data, curveData);
+        boost::system::error_code ec;
+        boost::filesystem::create_directories(chartCacheDirectory, ec);
+        analyzer->SaveCompiledChart(chartCacheFile.wstring(), sourceHash, data, curveData);
+    }
     metronomeAvailable = !analyzer->SharedMetaData.ExtraFlags[size_t(SusMetaDataFlags::DisableMetronome)];
-    analyzer->RenderScoreData(data, curveData);
     // 各種情報の設定
     segmentsPerSecond = analyzer->SharedMetaData.SegmentsPerSecond;
     usePrioritySort = analyzer->SharedMetaData.ExtraFlags[size_t(SusMetaDataFlags::EnableDrawPriority)];
@@ -162,35 +282,66 @@ void ScenePlayer::LoadWorker()
     scoreDuration = analyzer->SharedMetaData.ScoreDuration;
     // Processor
     processor->Reset();
-    // スライド描画バッファ
-    uint32_t maxElements = 0;
-    for (const auto& note : data) {
-        if (!note->Type[size_t(SusNoteType::Slide)]) continue;
-        const auto reserved = accumulate(note->ExtraData.begin(), note->ExtraData.end(), 2, [this](const int current, const shared_ptr<SusDrawableNoteData> part) {
-            if (part->Type.test(size_t(SusNoteType::Control))) return current;
-            if (part->Type.test(size_t(SusNoteType::Injection))) return current;
-            return current + int(curveData[part].size()) + 1;
-        });
-        maxElements = max(maxElements, uint32_t(reserved));
+    // 表示範囲
+    {
+        // ----------------------
+        // (HSx1000)px / 4beats
+        const auto referenceBpm = 120.0;
+        // ----------------------
+
+        // スクロール速度は譜面先頭のBPMを基準にする(途中のBPM変化には追従しない)
+        const auto cbpm = analyzer->GetTempoMap().GetInitialBpm();
+        const auto bpmMultiplier = (cbpm / analyzer->SharedMetaData.BaseBpm);
+        const auto sizeFor4Beats = bpmMultiplier * hispeedMultiplier * 1000.0;
+        const auto seenRatio = (SU_LANE_Z_MAX - SU_LANE_Z_MIN) / sizeFor4Beats;
+        seenDuration = 60.0 * 4.0 * seenRatio / referenceBpm;
+    }
+    noteStore.Build(data);
+    BuildNoteWindows(seenDuration, preloadingTime);
+    slideMeshes.Build(noteStore, curveData);
+    // スライド描画バッファ 1回に描く矩形は16bitのインデックスで届く分まで
+    const auto slideRingQuads = min(max(slideMeshes.GetMaxPointCount(), 256u), 16384u);
+    slideVertices.resize(slideRingQuads * 4);
+    slideIndices.resize(slideRingQuads * 6);
+    for (uint16_t i = 0; i < slideRingQuads; ++i) {
+        const uint16_t base = i * 4;
+        const uint16_t pattern[] = { base, uint16_t(base + 2), uint16_t(base + 1), uint16_t(base + 2), uint16_t(base + 1), uint16_t(base + 3) };
+        copy(begin(pattern), end(pattern), slideIndices.begin() + i * 6);
     }
-    slideVertices.reserve(maxElements * 4);
-    slideIndices.reserve(maxElements * 6);
+    slideVertexHead = 0;
 
 
     // 動画・音声の読み込み
-    auto file = boost::filesystem::path(scorefile).parent_path() / ConvertUTF8ToUnicode(analyzer->SharedMetaData.UWaveFileName);
-    bgmStream = SoundStream::CreateFromFile(file.wstring());
+    // ヘッドレス実行では BGM を鳴らさずに譜面の時刻だけで進める (WAV に書き出すならデコードだけする)
+    const auto bgmFile = boost::filesystem::path(scorefile).parent_path() / ConvertUTF8ToUnicode(analyzer->SharedMetaData.UWaveFileName);
+    if (!manager->IsHeadless()) {
+        bgmStream = soundManager->CreateStream(bgmFile.wstring());
+    } else if (offlineAudio) {
+        offlineBgmFile = BASS_StreamCreateFile(FALSE, bgmFile.wstring().c_str(), 0, 0, BASS_STREAM_DECODE | BASS_SAMPLE_FLOAT | BASS_UNICODE);
+        if (offlineBgmFile) {
+            // 周波数とチャンネル数は出力に合わせて変換させる
+            offlineBgmMixer = BASS_Mixer_StreamCreate(offlineAudio->GetFrequency(), WaveFileAudioBackend::Channels, BASS_STREAM_DECODE | BASS_SAMPLE_FLOAT | BASS_MIXER_END);
+            BASS_Mixer_StreamAddChannel(offlineBgmMixer, offlineBgmFile, BASS_MIXER_NORAMPIN);
+        }
+    }
     state = PlayingState::ReadyToStart;
 
-    if (!analyzer->SharedMetaData.UMovieFileName.empty()) {
+    if (!manager->IsHeadless() && !analyzer->SharedMetaData.UMovieFileName.empty()) {
         movieFileName = (boost::filesystem::path(scorefile).parent_path() / ConvertUTF8ToUnicode(analyzer->SharedMetaData.UMovieFileName)).wstring();
     }
 
     // 前カウントの計算
+    // 0小節目と同じ拍子・BPM変化の小節を前に置いたものとして、拍の時刻もテンポマップから引く
     // WaveOffsetが1小節分より長いとめんどくさそうなので差し引いてく
-    backingTime = -60.0 / analyzer->GetBpmAt(0, 0) * analyzer->GetBeatsAt(0);
-    nextMetronomeTime = backingTime;
-    while (backingTime > analyzer->SharedMetaData.WaveOffset) backingTime -= 60.0 / analyzer->GetBpmAt(0, 0) * analyzer->GetBeatsAt(0);
+    const auto &tempoMap = analyzer->GetTempoMap();
+    const auto firstMeasureDuration = tempoMap.GetAbsoluteTime(1, 0);
+    metronomeTimes.clear();
+    for (uint32_t beat = 0; beat < tempoMap.GetBeatsAt(0); ++beat) {
+        metronomeTimes.push_back(tempoMap.GetAbsoluteTime(0, beat * tempoMap.GetTicksPerBeat()) - firstMeasureDuration);
+    }
+    nextMetronome = 0;
+    backingTime = -firstMeasureDuration;
+    while (backingTime > analyzer->SharedMetaData.WaveOffset) backingTime -= firstMeasureDuration;
     currentTime = backingTime;
 
     {
@@ -202,61 +353,127 @@ void ScenePlayer::LoadWorker()
     }
 }
 
-void ScenePlayer::CalculateNotes(double time, double duration, double preced)
+void ScenePlayer::BuildNoteWindows(const double duration, const double preced)
+{
+    const auto &store = noteStore;
+    const auto infinity = numeric_limits<double>::infinity();
+    // 位置が [-preced, duration] に入りうる時刻の範囲(ハイスピード込み)
+    const auto enterAt = [&](const uint32_t i) {
+        return store.TimelineTable[store.Timelines[i]]->GetEarliestTimeReaching(store.StartTimesEx[i] - duration);
+    };
+    const auto leaveAt = [&](const uint32_t i) {
+        return store.TimelineTable[store.Timelines[i]]->GetLatestTimeWithin(store.StartTimesEx[i] + preced);
+    };
+    // 端の誤差で1フレーム早く消えたりしないように少し広げておく
+    const auto epsilon = 1e-6;
+
+    // 描画順: StartTime降順、優先度付き描画なら優先度昇順が先
+    vector<uint32_t> seenOrder(store.GetRootCount());
+    iota(seenOrder.begin(), seenOrder.end(), 0);
+    stable_sort(seenOrder.begin(), seenOrder.end(), [&](const uint32_t a, const uint32_t b) {
+        return store.StartTimes[a] > store.StartTimes[b];
+    });
+    if (usePrioritySort) stable_sort(seenOrder.begin(), seenOrder.end(), [&](const uint32_t a, const uint32_t b) {
+        return store.Sources[a]->ExtraAttribute->Priority < store.Sources[b]->ExtraAttribute->Priority;
+    });
+
+    vector<tuple<double, double>> lifetimes;
+    lifetimes.reserve(seenOrder.size());
+    for (const auto i : seenOrder) {
+        const auto types = store.Types[i];
+        auto enter = infinity;
+        auto leave = -infinity;
+        if (types & SU_NOTE_LONG_MASK) {
+            // 先頭か中継点のどれかが範囲に入っている間
+            enter = enterAt(i);
+            leave = leaveAt(i);
+            const auto last = store.FirstSteps[i] + store.StepCounts[i];
+            for (auto step = store.FirstSteps[i]; step < last; ++step) {
+                if (store.Timelines[step] == SusNoteStore::NoTimeline) continue;
+                enter = min(enter, enterAt(step));
+                leave = max(leave, leaveAt(step));
+            }
+            leave = min(leave, store.StartTimes[i] + store.Durations[i]);
+        } else if (types & SU_NOTE_SHORT_MASK) {
+            enter = enterAt(i);
+            leave = min(leaveAt(i), store.StartTimes[i]);
+        } else if (types & (1u << size_t(SusNoteType::MeasureLine))) {
+            enter = enterAt(i);
+            leave = leaveAt(i);
+        }
+        lifetimes.emplace_back(enter - epsilon, leave + epsilon);
+    }
+    seenWindow.Reset(seenOrder, lifetimes);
+
+    // 判定対象の余裕は processor 側が知っているので、ここでは素の区間だけ
+    vector<uint32_t> judgeOrder(store.GetRootCount());
+    iota(judgeOrder.begin(), judgeOrder.end(), 0);
+    lifetimes.clear();
+    for (const auto i : judgeOrder) lifetimes.emplace_back(store.StartTimes[i], store.StartTimes[i] + store.Durations[i]);
+    judgeWindow.Reset(judgeOrder, lifetimes);
+}
+
+void ScenePlayer::CalculateNotes(const double time, const double duration, const double preced)
 {
-    judgeData.clear();
-    copy_if(data.begin(), data.end(), back_inserter(judgeData), [&](const shared_ptr<SusDrawableNoteData> n) {
-        return this->processor->ShouldJudge(n);
+    SU_PROFILE_ZONE("ScenePlayer::CalculateNotes");
+    auto &store = noteStore;
+
+    // 区間にかかっているものだけを見る 並びは data / 描画順のまま
+    judgeWindow.Update(time, processor->GetJudgeMargin());
+    judgeWindow.Collect(noteIndices, [&](const uint32_t i) {
+        return this->processor->ShouldJudge(store.Sources[i]);
     });
+    judgeData.clear();
+    for (const auto i : noteIndices) judgeData.push_back(store.Sources[i]);
 
-    seenData.clear();
-    copy_if(data.begin(), data.end(), back_inserter(seenData), [&](shared_ptr<SusDrawableNoteData> n) {
-        const auto types = n->Type.to_ulong();
+    store.UpdateTimelines(time);
+    seenWindow.Update(time);
+    seenWindow.Collect(seenIndices, [&](const uint32_t i) {
+        const auto types = store.Types[i];
         if (types & SU_NOTE_LONG_MASK) {
             // ロング
-            if (time > n->StartTime + n->Duration) return false;
-            auto st = n->GetStateAt(time);
+            if (time > store.StartTimes[i] + store.Durations[i]) return false;
+            store.UpdatePositions(i);
+            const auto position = store.Positions[i];
             // 先頭が見えてるならもちろん見える
-            if (n->ModifiedPosition >= -preced && n->ModifiedPosition <= duration) return get<0>(st);
+            if (position >= -preced && position <= duration) return store.IsVisible(i);
+            const auto first = store.Positions.begin() + store.FirstSteps[i];
+            const auto last = first + store.StepCounts[i];
             // 先頭含めて全部-precedより手前なら見えない
-            if (all_of(n->ExtraData.begin(), n->ExtraData.end(), [preced](const shared_ptr<SusDrawableNoteData> en) {
-                if (isnan(en->ModifiedPosition)) return true;
-                if (en->ModifiedPosition < -preced) return true;
+            if (all_of(first, last, [preced](const double ep) {
+                if (isnan(ep)) return true;
+                if (ep < -preced) return true;
                 return false;
-            }) && n->ModifiedPosition < -preced) return false;
+            }) && position < -preced) return false;
             //先頭含めて全部durationより後なら見えない
-            if (all_of(n->ExtraData.begin(), n->ExtraData.end(), [duration](const shared_ptr<SusDrawableNoteData> en) {
-                if (isnan(en->ModifiedPosition)) return true;
-                if (en->ModifiedPosition > duration) return true;
+            if (all_of(first, last, [duration](const double ep) {
+                if (isnan(ep)) return true;
+                if (ep > duration) return true;
                 return false;
-            }) && n->ModifiedPosition > duration) return false;
+            }) && position > duration) return false;
             return true;
         }
         if (types & SU_NOTE_SHORT_MASK) {
             // ショート
-            if (time > n->StartTime) return false;
-            auto st = n->GetStateAt(time);
-            if (n->ModifiedPosition < -preced || n->ModifiedPosition > duration) return false;
-            return get<0>(st);
+            if (time > store.StartTimes[i]) return false;
+            store.UpdatePositions(i);
+            if (store.Positions[i] < -preced || store.Positions[i] > duration) return false;
+            return store.IsVisible(i);
         }
-        if (n->Type[size_t(SusNoteType::MeasureLine)]) {
-            auto st = n->GetStateAt(time);
-            if (n->ModifiedPosition < -preced || n->ModifiedPosition > duration) return false;
-            return get<0>(st);
+        if (types & (1u << size_t(SusNoteType::MeasureLine))) {
+            store.UpdatePositions(i);
+            if (store.Positions[i] < -preced || store.Positions[i] > duration) return false;
+            return store.IsVisible(i);
         }
         return false;
     });
-
-    sort(seenData.begin(), seenData.end(), [](const shared_ptr<SusDrawableNoteData> a, const shared_ptr<SusDrawableNoteData> b) {
-        return a->StartTime > b->StartTime;
-    });
-    if (usePrioritySort) sort(seenData.begin(), seenData.end(), [](const shared_ptr<SusDrawableNoteData> a, const shared_ptr<SusDrawableNoteData> b) {
-        return a->ExtraAttribute->Priority < b->ExtraAttribute->Priority;
-    });
+    SU_PROFILE_COUNT(NotesProcessed, judgeData.size() + seenIndices.size());
 }
 
 void ScenePlayer::Tick(const double delta)
 {
+    SU_PROFILE_ZONE("ScenePlayer::Tick");
+    if (replayRecorder) replayRecorder->RecordTick(delta, state == PlayingState::Paused);
     for (auto& sprite : spritesPending) sprites.emplace(sprite);
     spritesPending.clear();
     auto i = sprites.begin();
@@ -274,56 +491,52 @@ void ScenePlayer::Tick(const double delta)
         spriteLane->Tick(delta);
     }
 
+    tickAdvance = 0;
     if (state != PlayingState::Paused) {
-        if (state >= PlayingState::ReadyCounting) currentTime += delta;
+        if (state >= PlayingState::ReadyCounting) tickAdvance = delta;
+        currentTime += tickAdvance;
         currentSoundTime = currentTime + soundBufferingLatency;
     }
 
-    if (state >= PlayingState::Paused) {
-        // ----------------------
-        // (HSx1000)px / 4beats
-        const auto referenceBpm = 120.0;
-        // ----------------------
-
-        auto cbpm = get<1>(analyzer->SharedBpmChanges[0]);
-        if (currentTime >= 0) {
-            for (const auto &bc : analyzer->SharedBpmChanges) {
-                if (get<0>(bc) < currentTime) break;
-                cbpm = get<1>(bc);
-            }
-        }
-        const auto bpmMultiplier = (cbpm / analyzer->SharedMetaData.BaseBpm);
-        const auto sizeFor4Beats = bpmMultiplier * hispeedMultiplier * 1000.0;
-        const auto seenRatio = (SU_LANE_Z_MAX - SU_LANE_Z_MIN) / sizeFor4Beats;
-        seenDuration = 60.0 * 4.0 * seenRatio / referenceBpm;
-
-        CalculateNotes(currentTime, seenDuration, preloadingTime);
-    }
+    if (state >= PlayingState::Paused) CalculateNotes(currentTime, seenDuration, preloadingTime);
 
     previousStatus = status;
-    if (state != PlayingState::Paused) processor->Update(judgeData);
+    if (state != PlayingState::Paused) {
+        SU_PROFILE_ZONE("ScoreProcessor::Update");
+        if (replayRecorder) replayRecorder->RecordInput(currentTime, *manager->GetControlStateSafe());
+        processor->Update(judgeData);
+    }
     currentResult->GetCurrentResult(&status);
 
     TickGraphics(delta);
     ProcessSound();
+    if (replayRecorder && state == PlayingState::Completed) SaveReplay();
 }
 
 void ScenePlayer::ProcessSound()
 {
     const auto actualOffset = analyzer->SharedMetaData.WaveOffset - soundBufferingLatency;
     if (state < PlayingState::ReadyCounting) return;
+    if (keysounds && offlineAudio) {
+        keysounds->Synchronize(currentTime, offlineAudio->GetClockFrame() - offlineKeysoundFrame);
+    } else if (keysounds) {
+        keysounds->Synchronize(currentTime);
+    }
 
     switch (state) {
         case PlayingState::ReadyCounting:
             if (actualOffset < 0 && currentTime >= actualOffset) {
-                SoundManager::PlayGlobal(bgmStream);
+                if (bgmStream) SoundManager::PlayGlobal(bgmStream);
+                StartOfflineBgm(currentTime - actualOffset);
                 state = PlayingState::BgmPreceding;
             } else if (currentTime >= 0) {
                 state = PlayingState::OnlyScoreOngoing;
-            } else if (nextMetronomeTime < 0 && currentTime >= nextMetronomeTime) {
-                // TODO: NextMetronomeにもLatency適用？
-                if (metronomeAvailable) SoundManager::PlayGlobal(soundMetronome->GetSample());
-                nextMetronomeTime += 60 / analyzer->GetBpmAt(0, 0);
+            } else {
+                // 自動再生の判定音と同じだけ先読みして、拍の時刻ちょうどに鳴るよう予約する
+                const auto limit = currentTime + soundBufferingLatency + GetKeysoundLookahead();
+                KeysoundScheduler::ScheduleUntil(metronomeTimes, &nextMetronome, limit, [this](const double time) {
+                    if (metronomeAvailable) ScheduleJudgeSound(JudgeSoundType::Metronome, time);
+                });
             }
             break;
         case PlayingState::BgmPreceding:
@@ -331,12 +544,13 @@ void ScenePlayer::ProcessSound()
             break;
         case PlayingState::OnlyScoreOngoing:
             if (currentTime >= actualOffset) {
-                SoundManager::PlayGlobal(bgmStream);
+                if (bgmStream) SoundManager::PlayGlobal(bgmStream);
+                StartOfflineBgm(currentTime - actualOffset);
                 state = PlayingState::BothOngoing;
             }
             break;
         case PlayingState::BothOngoing:
-            if (bgmStream->GetStatus() == BASS_ACTIVE_STOPPED) {
+            if (!bgmStream || bgmStream->GetStatus() == BASS_ACTIVE_STOPPED) {
                 if (currentTime >= scoreDuration) {
                     hasEnded = true;
                     manager->Fire("Player:Completed");
@@ -352,7 +566,7 @@ void ScenePlayer::ProcessSound()
             }
             break;
         case PlayingState::BgmLasting:
-            if (bgmStream->GetStatus() == BASS_ACTIVE_STOPPED) {
+            if (!bgmStream || bgmStream->GetStatus() == BASS_ACTIVE_STOPPED) {
                 manager->Fire("Player:Completed");
                 state = PlayingState::Completed;
             }
@@ -380,11 +594,7 @@ void ScenePlayer::ProcessSound()
 void ScenePlayer::ProcessSoundQueue()
 {
     JudgeSoundType type;
-    while (!isTerminating) {
-        if (!judgeSoundQueue.pop(type)) {
-            Sleep(0);
-            continue;
-        }
+    while (judgeSoundQueue.Pop(type)) {
         switch (type) {
             case JudgeSoundType::Tap:
                 if (soundTap) SoundManager::PlayGlobal(soundTap->GetSample());
@@ -428,11 +638,84 @@ void ScenePlayer::ProcessSoundQueue()
             case JudgeSoundType::AirHoldingStop:
                 if (soundAirLoop) SoundManager::StopGlobal(soundAirLoop->GetSample());
                 break;
+            case JudgeSoundType::Metronome:
+                if (soundMetronome) SoundManager::PlayGlobal(soundMetronome->GetSample());
+                break;
             default: break;
         }
     }
 }
 
+// ヘッドレスで WAV に書き出す場合の準備
+// スキンのスクリプトは動かさないので、設定中のスキンの Sounds から既定のスキンと同じ名前の判定音を読んで波形に展開する
+// 読めなかったものは短いクリック音で代用する
+void ScenePlayer::LoadOfflineAudio()
+{
+    offlineAudio = dynamic_cast<WaveFileAudioBackend*>(soundManager->GetBackend());
+    if (!offlineAudio) return;
+
+    const auto frequency = offlineAudio->GetFrequency();
+    const auto channels = WaveFileAudioBackend::Channels;
+    vector<float> click(frequency / 50 * channels);
+    for (size_t i = 0; i < click.size() / channels; i++) {
+        const auto t = double(i) / frequency;
+        const auto value = float(0.5 * sin(2 * M_PI * 2000 * t) * exp(-t * 300));
+        for (auto c = 0; c < channels; c++) click[i * channels + c] = value;
+    }
+
+    keysounds = make_unique<KeysoundScheduler>(frequency, channels, soundBufferingLatency);
+    keysoundIds.fill(-1);
+    const auto clickId = keysounds->AddWaveform(click);
+    const auto setting = manager->GetSettingInstanceSafe();
+    const auto skinName = setting->ReadValue<string>(SU_SETTING_GENERAL, SU_SETTING_SKIN, "Default");
+    const auto soundDirectory = Setting::GetRootDirectory() / SU_DATA_DIR / SU_SKIN_DIR / ConvertUTF8ToUnicode(skinName) / SU_SOUND_DIR;
+    const auto registerKeysound = [&](const JudgeSoundType type, const wstring &fileName, const string &volumeKey, const int fallback) {
+        const auto file = soundDirectory / fileName;
+        auto id = -1;
+        if (boost::filesystem::exists(file)) {
+            const unique_ptr<SoundSample> sample(soundManager->CreateSample(file.wstring(), 1));
+            sample->SetVolume(setting->ReadValue("Sound", volumeKey, 1.0));
+            id = keysounds->AddSample(sample.get());
+        }
+        if (id < 0) {
+            spdlog::get("main")->warn(u8"判定音 {0} を読み込めなかったので代わりの音を使います", ConvertUnicodeToUTF8(file.wstring()));
+            id = fallback;
+        }
+        keysoundIds[size_t(type)] = id;
+    };
+    registerKeysound(JudgeSoundType::Tap, L"Tap.wav", "VolumeTap", clickId);
+    registerKeysound(JudgeSoundType::ExTap, L"ExTap.wav", "VolumeExTap", clickId);
+    registerKeysound(JudgeSoundType::Flick, L"Flick.wav", "VolumeFlick", clickId);
+    registerKeysound(JudgeSoundType::Air, L"Air.wav", "VolumeAir", clickId);
+    registerKeysound(JudgeSoundType::AirDown, L"AirDown.wav", "VolumeAir", clickId);
+    registerKeysound(JudgeSoundType::AirAction, L"AirAction.wav", "VolumeAirAction", clickId);
+    registerKeysound(JudgeSoundType::HoldStep, L"HoldStep.wav", "VolumeHold", clickId);
+    registerKeysound(JudgeSoundType::SlideStep, L"SlideStep.wav", "VolumeSlide", clickId);
+    // メトロノームがなければタップ音で鳴らす (GetReady と同じ)
+    registerKeysound(JudgeSoundType::Metronome, L"Metronome.wav", "VolumeTap", keysoundIds[size_t(JudgeSoundType::Tap)]);
+
+    offlineKeysoundFrame = offlineAudio->GetRenderedFrames();
+    offlineSources.push_back(offlineAudio->AddSource([this](float *buffer, const size_t frames) {
+        keysounds->Render(buffer, frames);
+    }));
+}
+
+void ScenePlayer::StartOfflineBgm(const double late)
+{
+    if (!offlineAudio || !offlineBgmMixer) return;
+
+    // 開始時刻より前の分は無音にして、BGM の頭を本来の位置に合わせる
+    const auto startFrame = offlineAudio->GetClockFrame() - llround(late * offlineAudio->GetFrequency());
+    auto position = offlineAudio->GetRenderedFrames();
+    offlineSources.push_back(offlineAudio->AddSource([this, startFrame, position](float *buffer, const size_t frames) mutable {
+        const auto silent = size_t(min<int64_t>(max<int64_t>(startFrame - position, 0), frames));
+        position += frames;
+        if (silent == frames) return;
+        const auto bytes = (frames - silent) * WaveFileAudioBackend::Channels * sizeof(float);
+        BASS_ChannelGetData(offlineBgmMixer, buffer + silent * WaveFileAudioBackend::Channels, DWORD(bytes) | BASS_DATA_FLOAT);
+    }));
+}
+
 // スクリプト側から呼べるやつら
 
 void ScenePlayer::Load()
@@ -458,7 +741,7 @@ void ScenePlayer::GetReady()
 
     // これはUIスレッドでやる必要あり マジかよ
     if (!movieFileName.empty()) {
-        movieBackground = LoadGraph(reinterpret_cast<const char*>(movieFileName.c_str()));
+        movieBackground = RenderDevice::GetCurrent()->LoadTexture(movieFileName, false);
         const auto offset = analyzer->SharedMetaData.MovieOffset;
         if (offset < 0) {
             // 先にシークして0.0から再生開始
@@ -494,6 +777,12 @@ void ScenePlayer::Play()
     if (!isLoadCompleted || !isReady) return;
     if (state < PlayingState::ReadyToStart) return;
     state = PlayingState::ReadyCounting;
+
+    // 手で遊んでいるときだけ記録する
+    const auto playable = dynamic_cast<PlayableProcessor*>(processor) && !dynamic_cast<ReplayProcessor*>(processor);
+    if (playable && manager->GetSettingInstanceSafe()->ReadValue<bool>("Play", "SaveReplay", false)) {
+        replayRecorder = make_unique<ReplayRecorder>(GetReplaySettings());
+    }
 }
 
 double ScenePlayer::GetPlayingTime() const
@@ -506,6 +795,11 @@ void ScenePlayer::GetCurrentResult(DrawableResult *result) const
     currentResult->GetCurrentResult(result);
 }
 
+JudgeTiming* ScenePlayer::GetJudgeTiming() const
+{
+    return currentResult->GetTimingUnsafe();
+}
+
 CharacterInstance* ScenePlayer::GetCharacterInstance() const
 {
     currentCharacterInstance->AddRef();
@@ -525,7 +819,9 @@ void ScenePlayer::MovePositionBySecond(const double sec)
     newBgmPos = max(0.0, newBgmPos);
     bgmStream->SetPlayingPosition(newBgmPos);
     currentTime = newBgmPos + gap;
+    if (replayRecorder) replayRecorder->Invalidate();
     processor->MovePosition(currentTime - oldTime);
+    ClearKeysounds();
     SeekMovieToGraph(movieBackground, int((currentTime - oldTime + movieCurrentPosition) * 1000.0));
 }
 
@@ -543,7 +839,9 @@ void ScenePlayer::MovePositionByMeasure(const int meas)
     newBgmPos = max(0.0, newBgmPos);
     bgmStream->SetPlayingPosition(newBgmPos);
     currentTime = newBgmPos + gap;
+    if (replayRecorder) replayRecorder->Invalidate();
     processor->MovePosition(currentTime - oldTime);
+    ClearKeysounds();
     SeekMovieToGraph(movieBackground, int((currentTime - oldTime + movieCurrentPosition) * 1000.0));
 }
 
@@ -552,7 +850,9 @@ void ScenePlayer::Pause()
     if (state <= PlayingState::Paused || hasEnded) return;
     lastState = state;
     state = PlayingState::Paused;
-    bgmStream->Pause();
+    tickAdvance = 0;
+    ClearKeysounds();
+    if (bgmStream) bgmStream->Pause();
     PauseMovieToGraph(movieBackground);
 }
 
@@ -560,7 +860,7 @@ void ScenePlayer::Resume()
 {
     if (state != PlayingState::Paused) return;
     state = lastState;
-    bgmStream->Resume();
+    if (bgmStream) bgmStream->Resume();
     PlayMovieToGraph(movieBackground);
 }
 
@@ -569,6 +869,7 @@ void ScenePlayer::Reload()
     // TODO: 非同期ローディングに対応する方法を考える
     // TODO: 再生中リロードに対応
     if (state != PlayingState::Paused) return;
+    if (replayRecorder) replayRecorder->Invalidate();
     // LoadWorker()で破壊される情報をとっておく
     const auto prevCurrentTime = currentTime;
     const auto prevOffset = analyzer->SharedMetaData.WaveOffset;
@@ -626,21 +927,15 @@ void ScenePlayer::GetMetrics(ScenePlayerMetrics *metrics)
 void ScenePlayer::StoreResult() const
 {
     currentResult->GetCurrentResult(&manager->lastResult);
+    manager->lastTiming = currentResult->GetTiming();
 }
 
 double ScenePlayer::GetFirstNoteTime() const
 {
     auto time = DBL_MAX;
-    for (const auto &note : data) {
-        if (note->Type.to_ulong() & SU_NOTE_SHORT_MASK) {
-            if (note->StartTime < time) time = note->StartTime;
-        } else if (note->Type.to_ulong() & SU_NOTE_SHORT_MASK) {
-            if (note->StartTime < time) time = note->StartTime;
-
-            for (const auto &ex : note->ExtraData) {
-                if (note->StartTime < time) time = note->StartTime;
-            }
-        }
+    for (uint32_t i = 0; i < noteStore.GetRootCount(); ++i) {
+        if (!(noteStore.Types[i] & SU_NOTE_SHORT_MASK)) continue;
+        if (noteStore.StartTimes[i] < time) time = noteStore.StartTimes[i];
     }
     return time;
 }
@@ -648,16 +943,17 @@ double ScenePlayer::GetFirstNoteTime() const
 double ScenePlayer::GetLastNoteTime() const
 {
     auto time = 0.0;
-    for (const auto &note : data) {
-        if (note->Type.to_ulong() & SU_NOTE_SHORT_MASK) {
-            if (note->StartTime > time) time = note->StartTime;
-        } else if (note->Type.to_ulong() & SU_NOTE_SHORT_MASK) {
-            if (note->StartTime > time) time = note->StartTime;
-
-            for (const auto &ex : note->ExtraData) {
-                if (note->StartTime > time) time = note->StartTime;
-            }
-        }
+    for (uint32_t i = 0; i < noteStore.GetRootCount(); ++i) {
+        if (!(noteStore.Types[i] & SU_NOTE_SHORT_MASK)) continue;
+        if (noteStore.StartTimes[i] > time) time = noteStore.StartTimes[i];
     }
     return time;
 }
+
+void ScenePlayer::SetReplaySource(const shared_ptr<const Replay> &replay)
+{
+    replaySource = replay;
+    // ハイスピードは LoadWorker で表示範囲を決めるのでその前に合わせる
+    // 判定幅の補正とエアー自動は ReplayProcessor::Reset が合わせる
+    if (replay) hispeedMultiplier = replay->Settings.Hispeed;
+}
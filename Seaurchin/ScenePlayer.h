@@ -5,8 +5,14 @@
 #include "ScriptResource.h"
 #include "SusAnalyzer.h"
 #include "ScoreProcessor.h"
+#include "NoteWindow.h"
+#include "SusNoteStore.h"
+#include "SlideMesh.h"
 #include "SoundManager.h"
+#include "JudgeSoundQueue.h"
+#include "KeysoundScheduler.h"
 #include "Result.h"
+#include "Replay.h"
 #include "CharacterInstance.h"
 
 #define SU_IF_SCENE_PLAYER "ScenePlayer"
@@ -34,24 +40,6 @@ enum class JudgeType {
     Action,
 };
 
-enum class JudgeSoundType {
-    Tap,
-    ExTap,
-    Flick,
-    Air,
-    AirDown,
-    AirAction,
-    Holding,
-    HoldStep,
-    HoldingStop,
-    Sliding,
-    SlideStep,
-    SlidingStop,
-    AirHolding,
-    AirHoldingStop,
-    Metronome,
-};
-
 enum class PlayingState {
     ScoreNotLoaded,
     BgmNotLoaded,
@@ -77,6 +65,7 @@ struct AirDrawQuery {
     double Z = 0.0;
     AirDrawType Type = AirDrawType::Air;
     std::shared_ptr<SusDrawableNoteData> Note, PreviousNote;
+    uint32_t Index = 0, PreviousIndex = 0;     // Note/PreviousNote の SusNoteStore 上の番号
 };
 
 struct ScenePlayerMetrics {
@@ -92,12 +81,15 @@ class ScenePlayer : public SSprite {
     friend class ScoreProcessor;
     friend class AutoPlayerProcessor;
     friend class PlayableProcessor;
+    friend class ReplayProcessor;
 
 protected:
     int hGroundBuffer {};
     ExecutionManager *manager;
     SoundManager * const soundManager; // soundManager のアドレスが不変、 soundManager の実体が持つ値は変わりうる
-    boost::lockfree::queue<JudgeSoundType> judgeSoundQueue;
+    JudgeSoundQueue judgeSoundQueue;
+    std::unique_ptr<KeysoundScheduler> keysounds;  // 単発の判定音を曲中時刻で鳴らす LoadResourcesで作る
+    std::array<int, size_t(JudgeSoundType::Metronome) + 1> keysoundIds;
     std::thread judgeSoundThread;
     std::mutex asyncMutex;
     std::thread loadWorkerThread;
@@ -106,12 +98,16 @@ protected:
     std::vector<SSprite*> spritesPending;
 
     SoundStream *bgmStream {};
+    // ヘッドレスで WAV に書き出すときだけ使う
+    WaveFileAudioBackend *offlineAudio {};
+    std::vector<int> offlineSources;
+    int64_t offlineKeysoundFrame = 0;               // 判定音ミキサーの0フレーム目が出力される位置
+    HSTREAM offlineBgmFile {}, offlineBgmMixer {};
     ScoreProcessor * const processor; // processor のアドレスが不変、 processor の実体が持つ値は変わりうる
 
     // 状態管理変数
     bool isLoadCompleted = false;   // LoadWorkerで書き換え 譜面読み込みが完了していればtrue
     bool isReady = false;           // GetReadyで書き換え 譜面読み込み完了後、動画再生位置設定とキャラクタースキル発動完了でtrue
-    bool isTerminating = false;     // Finalizeで書き換え インスタンス破棄時にtrue これをもって音声スレッドを破棄
     bool usePrioritySort = false;   // LoadWorkerで書き換え 優先度付きノーツ描画が有効ならtrue
     bool hasEnded = false;          // ProcessSoundで書き換え すべてのノーツの判定が終わっていればtrue
 
@@ -146,8 +142,8 @@ protected:
     SSprite *spriteLane {};
 
     // LoadResourcesで初期化 (設定ファイルから取得)
-    unsigned int slideLineColor = GetColor(0, 200, 255);        // Slide中心線色
-    unsigned int airActionJudgeColor = GetColor(128, 255, 160); // Air入力線色
+    uint32_t slideLineColor = MakeRenderColor(0, 200, 255);        // Slide中心線色
+    uint32_t airActionJudgeColor = MakeRenderColor(128, 255, 160); // Air入力線色
     bool showSlideLine {}, showAirActionJudge {};                     // Slide中心線/Air入力線が有効でtrue
     double slideLineThickness {};                                  // Slide中心線太さ
 
@@ -159,8 +155,10 @@ protected:
 
     // Slide描画関係
     int segmentsPerSecond {};                  // Slide分解能
-    std::vector<VERTEX2D> slideVertices;    // Slide描画用頂点座標配列 関数内ローカル変数で頻繁に生成,破棄されるのを嫌って宣言
-    std::vector<uint16_t> slideIndices;     // Slide描画用頂点番号指定配列 同上
+    SlideMeshStore slideMeshes;             // LoadWorkerで構築 Slideの帯の形
+    std::vector<VERTEX2D> slideVertices;    // Slide描画用頂点のリングバッファ LoadWorkerで確保し、一杯になったら描いて先頭に戻る
+    std::vector<uint16_t> slideIndices;     // 矩形ごとに同じ並びの頂点番号 同上
+    size_t slideVertexHead = 0;             // slideVertices の次の書き込み位置
 
     const std::shared_ptr<Result> currentResult;
     DrawableResult previousStatus {}, status {};
@@ -168,16 +166,23 @@ protected:
     std::shared_ptr<CharacterInstance> currentCharacterInstance;
 
     DrawableNotesList data;
-    DrawableNotesList seenData, judgeData;
+    DrawableNotesList judgeData;
+    SusNoteStore noteStore;                 // LoadWorkerでdata/curveDataから構築 毎フレームの走査と描画位置はこちらで持つ
+    NoteWindow seenWindow, judgeWindow;     // LoadWorkerで構築 seenIndices/judgeDataの候補を時刻で絞る
+    std::vector<uint32_t> noteIndices;      // CalculateNotes用 関数内ローカル変数で頻繁に生成,破棄されるのを嫌って宣言
+    std::vector<uint32_t> seenIndices;      // 描画するノーツの noteStore 上の番号 描画順
     std::unordered_map<std::shared_ptr<SusDrawableNoteData>, SSprite*> slideEffects;
     NoteCurvesList curveData;
     double currentTime = 0;
     double currentSoundTime = 0;
+    double tickAdvance = 0;                 // 直前の Tick で進めた曲中時刻 Tick の合間の描画を補間するのに使う
+    double drawTime = 0;                    // Draw 中の曲中時刻 currentTime から次の Tick までの間
     double seenDuration = 0.8;
-    const double hispeedMultiplier; // = 6.0
+    double hispeedMultiplier; // = 6.0 リプレイの再生では記録時の値に合わせる
     const double preloadingTime = 0.5;
     double backingTime = 0.0;
-    double nextMetronomeTime = 0.0;
+    std::vector<double> metronomeTimes;     // LoadWorkerで構築 前カウントの拍の曲中時刻
+    size_t nextMetronome = 0;               // metronomeTimes のうち次に予約するもの
     double scoreDuration = 0.0;
     const double soundBufferingLatency; // = 0.030
     const double airRollSpeed; // = 1.5
@@ -185,34 +190,55 @@ protected:
     PlayingState lastState;
     bool airActionShown = false;
     bool metronomeAvailable = true;
+    boost::filesystem::path scoreFileOverride;  // 空でなければMusicsManagerの選択より優先して読み込む
+    std::function<void(double, AbilityJudgeType, const JudgeInformation&)> judgeRecorder;  // 判定ごとに呼ばれる (時刻, 判定, ノーツ)
+    std::shared_ptr<const Replay> replaySource;     // AutoPlay が 3 (ReplayProcessor) のときの入力
+    std::unique_ptr<ReplayRecorder> replayRecorder; // Play で作り、完走したら保存する
+    boost::filesystem::path loadedScoreFile;        // LoadWorkerで書き換え
+    uint32_t loadedScoreHash = 0;                   // LoadWorkerで書き換え
 
     void TickGraphics(double delta);
     void AddSprite(SSprite *sprite);
     void SetProcessorOptions(ScoreProcessor *processor) const;
     void LoadResources();
+    void LoadOfflineAudio();
     void LoadWorker();
     void RemoveSlideEffect();
     void UpdateSlideEffect();
+    void BuildNoteWindows(double duration, double preced);
     void CalculateNotes(double time, double duration, double preced);
-    void DrawShortNotes(const std::shared_ptr<SusDrawableNoteData>& note) const;
+    // 描画系の index は noteStore 上の番号
+    double GetRelativePosition(const uint32_t index) const { return 1.0 - noteStore.Positions[index] / seenDuration; }
+    void DrawShortNotes(uint32_t index) const;
     void DrawAirNotes(const AirDrawQuery &query) const;
-    void DrawHoldNotes(const std::shared_ptr<SusDrawableNoteData>& note) const;
-    void DrawSlideNotes(const std::shared_ptr<SusDrawableNoteData>& note);
+    void DrawHoldNotes(uint32_t index) const;
+    void DrawSlideNotes(uint32_t index);
     void DrawAirActionStart(const AirDrawQuery &query) const;
     void DrawAirActionStep(const AirDrawQuery &query) const;
     void DrawAirActionStepBox(const AirDrawQuery &query) const;
     void DrawAirActionCover(const AirDrawQuery &query);
     void DrawTap(float lane, int length, double relpos, int handle) const;
-    void DrawMeasureLine(const std::shared_ptr<SusDrawableNoteData>& note) const;
+    void DrawMeasureLine(uint32_t index) const;
     void Prepare3DDrawCall() const;
-    void DrawAerialNotes(const std::vector<std::shared_ptr<SusDrawableNoteData>>& notes);
+    void DrawAerialNotes();
 
     void ProcessSound();
     void ProcessSoundQueue();
+    // late は本来の開始時刻から何秒過ぎているか
+    void StartOfflineBgm(double late);
 
     void SpawnJudgeEffect(const std::shared_ptr<SusDrawableNoteData>& target, JudgeType type);
     void SpawnSlideLoopEffect(const std::shared_ptr<SusDrawableNoteData>& target);
     void EnqueueJudgeSound(JudgeSoundType type);
+    // time は曲中時刻 ミキサーが使えなければ即座に鳴らす
+    void ScheduleJudgeSound(JudgeSoundType type, double time);
+    // ミキサーに予約できたときだけ true 判定の前に呼んでおけば発音位置がずれない
+    bool ReserveJudgeSound(JudgeSoundType type, double time);
+    double GetKeysoundLookahead() const;
+    void ClearKeysounds();
+    void NotifyJudge(AbilityJudgeType judge, const JudgeInformation &info, const std::string &extra);
+    ReplaySettings GetReplaySettings() const;
+    void SaveReplay();
 
 public:
     explicit ScenePlayer(ExecutionManager *exm);
@@ -234,6 +260,7 @@ public:
     double GetPlayingTime() const;
     CharacterInstance* GetCharacterInstance() const;
     void GetCurrentResult(DrawableResult *result) const;
+    JudgeTiming* GetJudgeTiming() const;
     void MovePositionBySecond(double sec);
     void MovePositionByMeasure(int meas);
     void SetJudgeCallback(asIScriptFunction *func) const;
@@ -243,6 +270,31 @@ public:
     void StoreResult() const;
     double GetFirstNoteTime() const;
     double GetLastNoteTime() const;
+
+    // ヘッドレス実行用 Initialize の前に設定し、Load の代わりに LoadSynchronously で同期に読み込む
+    void SetScoreFile(const boost::filesystem::path &file) { scoreFileOverride = file; }
+    void SetJudgeRecorder(std::function<void(double, AbilityJudgeType, const JudgeInformation&)> recorder) { judgeRecorder = std::move(recorder); }
+    // AutoPlay が 3 のときの入力 ハイスピードも記録時の値に合わせる
+    void SetReplaySource(const std::shared_ptr<const Replay> &replay);
+    void LoadSynchronously() { LoadWorker(); }
+    // Play で始めたリプレイの記録をやめる 検証の実行を Replays に残さないため
+    void DiscardReplayRecording() { replayRecorder.reset(); }
+    PlayingState GetState() const { return state; }
+    double GetScoreDuration() const { return scoreDuration; }
+    ScoreProcessor* GetProcessor() const { return processor; }
+
+    // 計測用 再生中と同じ経路でノーツを絞り、結果を読み出す
+    void CalculateNotesAt(double time) { CalculateNotes(time, seenDuration, preloadingTime); }
+    // 見えている Slide を、Slide の画像をすべて image にして描く
+    void DrawSlideNotesWith(SImage *image);
+    const DrawableNotesList& GetNotes() const { return data; }
+    const DrawableNotesList& GetJudgeNotes() const { return judgeData; }
+    const std::vector<uint32_t>& GetSeenIndices() const { return seenIndices; }
+    const SusNoteStore& GetNoteStore() const { return noteStore; }
+    const NoteCurvesList& GetCurves() const { return curveData; }
+    double GetSeenDuration() const { return seenDuration; }
+    double GetPreloadingTime() const { return preloadingTime; }
+    bool IsPrioritySorted() const { return usePrioritySort; }
 };
 
 void RegisterPlayerScene(ExecutionManager *exm);
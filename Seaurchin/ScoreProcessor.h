@@ -2,9 +2,11 @@
 
 #include "SusAnalyzer.h"
 #include "Controller.h"
+#include "Replay.h"
 #include "ScriptResource.h"
 #include "Skill.h"
 #include "CharacterInstance.h"
+#include "JudgeSoundQueue.h"
 
 enum class NoteAttribute {
     Invisible = 0,
@@ -12,6 +14,7 @@ enum class NoteAttribute {
     HellChecking,
     Completed,
     Activated,
+    SoundReserved,      // 判定音をミキサーに予約済み
 };
 
 class ScenePlayer;
@@ -26,6 +29,8 @@ public:
     virtual void MovePosition(double relative) = 0;
     virtual void Draw() = 0;
     virtual bool ShouldJudge(std::shared_ptr<SusDrawableNoteData> note) = 0;
+    // ShouldJudge が真になりうる、ノーツの [StartTime, StartTime + Duration] からのはみ出し幅
+    virtual double GetJudgeMargin() = 0;
 };
 
 class PlayableProcessor : public ScoreProcessor {
@@ -39,12 +44,24 @@ protected:
     double judgeWidthAttack;
     double judgeWidthJustice;
     double judgeWidthJusticeCritical;
-    double judgeAdjustSlider;
-    double judgeAdjustAirString;
-    double judgeMultiplierSlider;
-    double judgeMultiplierAir;
+    double judgeAdjustSlider = 0;
+    double judgeAdjustAirString = 0;
+    double judgeMultiplierSlider = 1;
+    double judgeMultiplierAir = 1;
     bool isAutoAir = false;
+    // 判定している曲中時刻 入力の変化を判定している間はその変化が起きた時刻で、currentEvent がその変化
+    double processTime = 0;
+    double lastProcessTime = 0;
+    const ControlEvent *currentEvent = nullptr;
+    // processTime の時点で押されているか
+    std::array<bool, 16> sliderHeld {};
+    bool airHeld = false;
 
+    void ResetInput();
+    void ApplyEvent(const ControlEvent &ev);
+    // currentEvent がその入力を押したものか
+    bool IsPressedNow(ControllerSource source, int number) const;
+    void ProcessNotes(std::vector<std::shared_ptr<SusDrawableNoteData>> &notes);
     void ProcessScore(const std::shared_ptr<SusDrawableNoteData>& notes);
     bool CheckJudgement(const std::shared_ptr<SusDrawableNoteData>& note) const;
     bool CheckHellJudgement(const std::shared_ptr<SusDrawableNoteData>& note) const;
@@ -56,6 +73,8 @@ protected:
     void IncrementComboEx(const std::shared_ptr<SusDrawableNoteData>& note, const std::string& extra) const;
     void IncrementComboHell(const std::shared_ptr<SusDrawableNoteData>& note, int state, const std::string& extra) const;
     void IncrementComboAir(const std::shared_ptr<SusDrawableNoteData>& note, double reltime, const JudgeInformation &info, const std::string& extra) const;
+    // offset は JudgeAdjust 込みの判定中心からの実時間 (倍率をかける前)
+    void RecordTiming(const std::shared_ptr<SusDrawableNoteData>& note, AbilityNoteType type, int lane, double offset) const;
     void ResetCombo(const std::shared_ptr<SusDrawableNoteData>& note, const JudgeInformation &info) const;
 
 public:
@@ -67,11 +86,27 @@ public:
     void SetJudgeAdjusts(double jas, double jms, double jaa, double jma) override;
     void Reset() override;
     bool ShouldJudge(std::shared_ptr<SusDrawableNoteData> note) override;
+    double GetJudgeMargin() override;
     void Update(std::vector<std::shared_ptr<SusDrawableNoteData>> &notes) override;
     void MovePosition(double relative) override;
     void Draw() override;
 };
 
+// リプレイの入力で PlayableProcessor を動かす
+// 入力は共有の ControlState ではなく自前のものに、判定更新の回数に合わせて流し込む
+class ReplayProcessor : public PlayableProcessor {
+protected:
+    std::shared_ptr<const Replay> replay;
+    size_t nextInput = 0;
+    uint32_t updateCount = 0;
+
+public:
+    ReplayProcessor(ScenePlayer *player);
+
+    void Reset() override;
+    void Update(std::vector<std::shared_ptr<SusDrawableNoteData>> &notes) override;
+};
+
 class AutoPlayerProcessor : public ScoreProcessor {
 protected:
     ScenePlayer *player;
@@ -80,6 +115,8 @@ protected:
     bool wasInHold = false, wasInSlide = false, wasInAA = false;
 
     void ProcessScore(const std::shared_ptr<SusDrawableNoteData>& notes);
+    void ReserveSounds(const std::shared_ptr<SusDrawableNoteData>& note, double lookahead) const;
+    void PlayJudgeSound(const std::shared_ptr<SusDrawableNoteData>& note, JudgeSoundType type) const;
     void IncrementCombo(const JudgeInformation &info, const std::string& extra) const;
 
 public:
@@ -88,6 +125,7 @@ public:
     void SetJudgeAdjusts(double jas, double jms, double jaa, double jma) override;
     void Reset() override;
     bool ShouldJudge(std::shared_ptr<SusDrawableNoteData> note) override;
+    double GetJudgeMargin() override;
     void Update(std::vector<std::shared_ptr<SusDrawableNoteData>> &notes) override;
     void MovePosition(double relative) override;
     void Draw() override;
@@ -1,5 +1,6 @@
 ﻿#include "ScriptResource.h"
 #include "ExecutionManager.h"
+#include "TextureAtlas.h"
 #include "Misc.h"
 
 using namespace std;
@@ -24,7 +25,7 @@ void SResource::Release()
 
 void SImage::ObtainSize()
 {
-    GetGraphSize(handle, &width, &height);
+    RenderDevice::GetCurrent()->GetTextureSize(handle, &width, &height);
 }
 
 SImage::SImage(const int ih)
@@ -34,7 +35,7 @@ SImage::SImage(const int ih)
 
 SImage::~SImage()
 {
-    if (handle) DeleteGraph(handle);
+    if (handle) RenderDevice::GetCurrent()->DeleteTexture(handle);
     handle = 0;
 }
 
@@ -50,6 +51,23 @@ int SImage::GetHeight()
     return height;
 }
 
+bool SImage::GetSpriteTexture(SpriteTexture *texture)
+{
+    if (!handle) return false;
+    if (atlasPage) {
+        texture->Handle = atlasPage->GetGraphHandle();
+        texture->Width = texture->Height = TextureAtlas::PageSize;
+        texture->OffsetX = atlasX;
+        texture->OffsetY = atlasY;
+    } else {
+        texture->Handle = handle;
+        texture->Width = GetWidth();
+        texture->Height = GetHeight();
+        texture->OffsetX = texture->OffsetY = 0;
+    }
+    return texture->Handle != 0;
+}
+
 SImage * SImage::CreateBlankImage()
 {
     auto result = new SImage(0);
@@ -61,9 +79,7 @@ SImage * SImage::CreateBlankImage()
 
 SImage * SImage::CreateLoadedImageFromFile(const string &file, const bool async)
 {
-    if (async) SetUseASyncLoadFlag(TRUE);
-    auto result = new SImage(LoadGraph(reinterpret_cast<const char*>(ConvertUTF8ToUnicode(file).c_str())));
-    if (async) SetUseASyncLoadFlag(FALSE);
+    auto result = new SImage(RenderDevice::GetCurrent()->LoadTexture(ConvertUTF8ToUnicode(file), async));
     result->AddRef();
 
     BOOST_ASSERT(result->GetRefCount() == 1);
@@ -72,7 +88,44 @@ SImage * SImage::CreateLoadedImageFromFile(const string &file, const bool async)
 
 SImage * SImage::CreateLoadedImageFromMemory(void * buffer, const size_t size)
 {
-    auto result = new SImage(CreateGraphFromMem(buffer, size));
+    auto result = new SImage(RenderDevice::GetCurrent()->LoadTextureFromMemory(buffer, size));
+    result->AddRef();
+
+    BOOST_ASSERT(result->GetRefCount() == 1);
+    return result;
+}
+
+namespace
+{
+    SImage* CreateAtlasImageFromSoftImage(const int softImage, TextureAtlas *atlas)
+    {
+        if (softImage == -1) return nullptr;
+        shared_ptr<TextureAtlasPage> page;
+        int x = 0, y = 0;
+        const auto inserted = atlas && atlas->Insert(softImage, &page, &x, &y);
+        auto result = new SImage(RenderDevice::GetCurrent()->CreateTextureFromSoftImage(softImage));
+        DeleteSoftImage(softImage);
+        if (inserted) result->SetAtlasRegion(page, x, y);
+        return result;
+    }
+}
+
+SImage * SImage::CreateAtlasImageFromFile(const string &file, TextureAtlas *atlas)
+{
+    const auto softImage = LoadARGB8ColorSoftImage(reinterpret_cast<const char*>(ConvertUTF8ToUnicode(file).c_str()));
+    const auto result = CreateAtlasImageFromSoftImage(softImage, atlas);
+    if (!result) return CreateLoadedImageFromFile(file, false);
+    result->AddRef();
+
+    BOOST_ASSERT(result->GetRefCount() == 1);
+    return result;
+}
+
+SImage * SImage::CreateAtlasImageFromMemory(void *buffer, const size_t size, TextureAtlas *atlas)
+{
+    const auto softImage = LoadARGB8ColorSoftImageToMem(buffer, SU_TO_INT32(size));
+    const auto result = CreateAtlasImageFromSoftImage(softImage, atlas);
+    if (!result) return CreateLoadedImageFromMemory(buffer, size);
     result->AddRef();
 
     BOOST_ASSERT(result->GetRefCount() == 1);
@@ -86,7 +139,7 @@ SRenderTarget::SRenderTarget(const int w, const int h)
 {
     width = w;
     height = h;
-    if (w * h) handle = MakeScreen(w, h, TRUE);
+    if (w * h) handle = RenderDevice::GetCurrent()->CreateRenderTarget(w, h);
 }
 
 SRenderTarget * SRenderTarget::CreateBlankTarget(const int w, const int h)
@@ -105,7 +158,7 @@ SNinePatchImage::SNinePatchImage(const int ih)
 
 SNinePatchImage::~SNinePatchImage()
 {
-    DeleteGraph(handle);
+    RenderDevice::GetCurrent()->DeleteTexture(handle);
     handle = 0;
     leftSideWidth = topSideHeight = bodyWidth = bodyHeight = 0;
 }
@@ -131,7 +184,7 @@ SAnimatedImage::SAnimatedImage(const int w, const int h, const int count, const
 
 SAnimatedImage::~SAnimatedImage()
 {
-    for (auto &img : images) DeleteGraph(img);
+    for (auto &img : images) RenderDevice::GetCurrent()->DeleteTexture(img);
 }
 
 SAnimatedImage * SAnimatedImage::CreateLoadedImageFromFile(const std::string & file, const int xc, const int yc, const int w, const int h, const int count, const double time)
@@ -140,7 +193,7 @@ SAnimatedImage * SAnimatedImage::CreateLoadedImageFromFile(const std::string & f
     result->AddRef();
 
     result->images.resize(count);
-    LoadDivGraph(reinterpret_cast<const char*>(ConvertUTF8ToUnicode(file).c_str()), count, xc, yc, w, h, result->images.data());
+    RenderDevice::GetCurrent()->LoadDividedTextures(ConvertUTF8ToUnicode(file), count, xc, yc, w, h, result->images.data());
 
     BOOST_ASSERT(result->GetRefCount() == 1);
     return result;
@@ -152,7 +205,7 @@ SAnimatedImage * SAnimatedImage::CreateLoadedImageFromMemory(void * buffer, cons
     result->AddRef();
 
     result->images.resize(count);
-    CreateDivGraphFromMem(buffer, size, count, xc, yc, w, h, result->images.data());
+    RenderDevice::GetCurrent()->LoadDividedTexturesFromMemory(buffer, size, count, xc, yc, w, h, result->images.data());
 
     BOOST_ASSERT(result->GetRefCount() == 1);
     return result;
@@ -175,11 +228,12 @@ tuple<double, double, int> SFont::RenderRaw(SRenderTarget *rt, const string &utf
     uint32_t cx = 0, cy = 0;
     uint32_t mx = 0;
     auto line = 1;
+    const auto device = RenderDevice::GetCurrent();
     if (rt) {
         BEGIN_DRAW_TRANSACTION(rt->GetHandle());
-        ClearDrawScreen();
-        SetDrawBlendMode(DX_BLENDMODE_ALPHA, 255);
-        SetDrawBright(255, 255, 255);
+        device->Clear();
+        device->SetBlendMode(RenderBlendMode::Alpha, 255);
+        device->SetBright(255, 255, 255);
     }
     const auto *ccp = reinterpret_cast<const uint8_t*>(utf8Str.c_str());
     while (*ccp) {
@@ -206,12 +260,13 @@ tuple<double, double, int> SFont::RenderRaw(SRenderTarget *rt, const string &utf
         }
         const auto sg = glyphs[gi];
         if (!sg) continue;
-        if (rt) DrawRectGraph(
-            cx + sg->BearX, cy + sg->BearY,
+        if (rt) device->DrawImageExtended(
+            SU_TO_FLOAT(cx + sg->BearX), SU_TO_FLOAT(cy + sg->BearY),
+            SU_TO_FLOAT(cx + sg->BearX + sg->GlyphWidth), SU_TO_FLOAT(cy + sg->BearY + sg->GlyphHeight),
             sg->GlyphX, sg->GlyphY,
             sg->GlyphWidth, sg->GlyphHeight,
             Images[sg->ImageNumber]->GetHandle(),
-            TRUE, FALSE);
+            true);
         cx += sg->WholeAdvance;
     }
     if (rt) {
@@ -237,12 +292,13 @@ tuple<double, double, int> SFont::RenderRich(SRenderTarget *rt, const string &ut
     auto cr = defcol.R, cg = defcol.G, cb = defcol.B;
     float cw = 1;
 
+    const auto device = RenderDevice::GetCurrent();
     if (rt) {
         BEGIN_DRAW_TRANSACTION(rt->GetHandle());
-        ClearDrawScreen();
-        SetDrawBlendMode(DX_BLENDMODE_ALPHA, 255);
-        SetDrawBright(cr, cg, cb);
-        SetDrawMode(DX_DRAWMODE_ANISOTROPIC);
+        device->Clear();
+        device->SetBlendMode(RenderBlendMode::Alpha, 255);
+        device->SetBright(cr, cg, cb);
+        device->SetFilterMode(RenderFilterMode::Anisotropic);
     }
     auto ccp = utf8Str.begin();
     bx::smatch match;
@@ -334,20 +390,20 @@ tuple<double, double, int> SFont::RenderRich(SRenderTarget *rt, const string &ut
         const auto sg = glyphs[gi];
         if (!sg) continue;
         if (rt) {
-            SetDrawBright(cr, cg, cb);
-            DrawRectRotaGraph3F(
+            device->SetBright(cr, cg, cb);
+            device->DrawImage(
                 SU_TO_FLOAT(cx + sg->BearX) - (cw - 1.0f) * 0.5f * sg->GlyphWidth, SU_TO_FLOAT(cy + sg->BearY),
                 sg->GlyphX, sg->GlyphY,
                 sg->GlyphWidth, sg->GlyphHeight,
                 0, 0,
                 cw, 1, 0,
                 Images[sg->ImageNumber]->GetHandle(),
-                TRUE, FALSE);
+                true);
         }
         cx += sg->WholeAdvance;
     }
     if (rt) {
-        SetDrawMode(DX_DRAWMODE_NEAREST);
+        device->SetFilterMode(RenderFilterMode::Nearest);
         FINISH_DRAW_TRANSACTION;
     }
     mx = max(mx, cx);
@@ -431,7 +487,7 @@ void SSoundMixer::Stop(SSound *sound) const
 
 SSoundMixer * SSoundMixer::CreateMixer(SoundManager * manager)
 {
-    auto result = new SSoundMixer(SoundManager::CreateMixerStream());
+    auto result = new SSoundMixer(manager->CreateMixerStream());
     result->AddRef();
 
     BOOST_ASSERT(result->GetRefCount() == 1);
@@ -471,7 +527,7 @@ SSound * SSound::CreateSound(SoundManager *smanager)
 
 SSound * SSound::CreateSoundFromFile(SoundManager *smanager, const std::string &file, const int simul)
 {
-    const auto hs = SoundSample::CreateFromFile(ConvertUTF8ToUnicode(file), simul);
+    const auto hs = smanager->CreateSample(ConvertUTF8ToUnicode(file), simul);
     auto result = new SSound(hs);
     result->AddRef();
 
@@ -13,6 +13,9 @@
 #define SU_IF_ANIMEIMAGE "AnimatedImage"
 #define SU_IF_SETTING_ITEM "SettingItem"
 
+class TextureAtlas;
+class TextureAtlasPage;
+
 //リソース基底クラス
 class SResource {
 protected:
@@ -28,11 +31,22 @@ public:
     int GetRefCount() const { return reference; }
 };
 
+// バッチ描画で使うテクスチャと、その中での画像の位置
+struct SpriteTexture {
+    int Handle;
+    int Width;      // テクスチャ全体の大きさ (UV の分母)
+    int Height;
+    int OffsetX;    // テクスチャ内での画像の左上
+    int OffsetY;
+};
+
 //画像
 class SImage : public SResource {
 protected:
     int width = 0;
     int height = 0;
+    std::shared_ptr<TextureAtlasPage> atlasPage;
+    int atlasX = 0, atlasY = 0;
 
     void ObtainSize();
 public:
@@ -41,10 +55,16 @@ public:
 
     int GetWidth();
     int GetHeight();
+    // アトラスに入っていればそのページ、そうでなければ自分自身
+    bool GetSpriteTexture(SpriteTexture *texture);
+    void SetAtlasRegion(const std::shared_ptr<TextureAtlasPage> &page, int x, int y) { atlasPage = page; atlasX = x; atlasY = y; }
 
     static SImage* CreateBlankImage();
     static SImage* CreateLoadedImageFromFile(const std::string &file, bool async);
     static SImage* CreateLoadedImageFromMemory(void *buffer, size_t size);
+    // 小さい画像ならアトラスにも詰める 詰められなければ普通に読み込む
+    static SImage* CreateAtlasImageFromFile(const std::string &file, TextureAtlas *atlas);
+    static SImage* CreateAtlasImageFromMemory(void *buffer, size_t size, TextureAtlas *atlas);
 };
 
 //描画タゲ
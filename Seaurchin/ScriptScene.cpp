@@ -3,6 +3,7 @@
 #include "Config.h"
 #include "ExecutionManager.h"
 #include "Misc.h"
+#include "Profiler.h"
 
 using namespace std;
 using namespace boost::filesystem;
@@ -120,11 +121,14 @@ void ScriptScene::KillCoroutine(const string &name)
 
 void ScriptScene::Tick(const double delta)
 {
+    SU_PROFILE_ZONE("ScriptScene::Tick");
     TickSprite(delta);
     TickCoroutine(delta);
 
     if (!mainMethod) return;
 
+    SU_PROFILE_ZONE("ScriptScene::Main");
+    SU_PROFILE_COUNT(ScriptExecutions, 1);
     mainMethod->Prepare();
     mainMethod->SetArg(0, delta);
     mainMethod->Execute();
@@ -145,6 +149,7 @@ void ScriptScene::OnEvent(const string &message)
 
 void ScriptScene::Draw()
 {
+    SU_PROFILE_ZONE("ScriptScene::Draw");
     DrawSprite();
 }
 
@@ -174,6 +179,7 @@ void ScriptScene::RegisterDisposalCallback(CallbackObject *callback)
 
 void ScriptScene::TickCoroutine(const double delta)
 {
+    SU_PROFILE_ZONE("ScriptScene::TickCoroutine");
     if (!coroutinesPending.empty()) {
         for (auto& coroutine : coroutinesPending) {
             coroutine->SetUserData(this, SU_UDTYPE_SCENE);
@@ -191,6 +197,7 @@ void ScriptScene::TickCoroutine(const double delta)
             continue;
         }
 
+        SU_PROFILE_COUNT(ScriptExecutions, 1);
         const auto result = c->Execute();
         if (result == asEXECUTION_FINISHED) {
             delete c;
@@ -208,8 +215,10 @@ void ScriptScene::TickCoroutine(const double delta)
     }
 }
 
+// スプライトの Tick はほぼ Mover の実行
 void ScriptScene::TickSprite(const double delta)
 {
+    SU_PROFILE_ZONE("ScriptScene::TickSprite");
     if (!spritesPending.empty()) {
         for (auto& sprite : spritesPending) sprites.emplace(sprite);
         spritesPending.clear();
@@ -229,7 +238,19 @@ void ScriptScene::TickSprite(const double delta)
 
 void ScriptScene::DrawSprite()
 {
-    for (auto& i : sprites) i->Draw();
+    const auto batch = manager->GetSpriteBatch();
+    if (!batch) {
+        SU_PROFILE_COUNT(DrawCalls, sprites.size());
+        for (auto& i : sprites) i->Draw();
+        return;
+    }
+
+    batch->Begin();
+    for (auto& i : sprites) {
+        batch->SetLayer(i->ZIndex);
+        i->Draw();
+    }
+    batch->End();
 }
 
 
@@ -264,6 +285,8 @@ void ScriptCoroutineScene::Tick(const double delta)
         return;
     }
 
+    SU_PROFILE_ZONE("ScriptCoroutineScene::Run");
+    SU_PROFILE_COUNT(ScriptExecutions, 1);
     const auto result = mainMethod->Execute();
     if (result != asEXECUTION_SUSPENDED) {
         finished = true;
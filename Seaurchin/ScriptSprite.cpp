@@ -1,6 +1,7 @@
 ﻿#include "ScriptSprite.h"
 #include "ScriptSpriteMover.h"
 #include "ExecutionManager.h"
+#include "SpriteBatch.h"
 #include "Misc.h"
 
 #define BOOST_RESULT_OF_USE_DECLTYPE
@@ -290,14 +291,18 @@ void SSprite::Draw(const Transform2D &parent, const ColorTint &color)
 void SSprite::DrawBy(const Transform2D &tf, const ColorTint &ct)
 {
     if (!Image) return;
-    SetDrawBright(ct.R, ct.G, ct.B);
-    SetDrawBlendMode(DX_BLENDMODE_ALPHA, ct.A);
-    DrawRotaGraph3F(
+    const auto batch = SpriteBatch::GetActive();
+    if (batch && batch->AddImage(Image, tf, ct, HasAlpha)) return;
+    const auto device = RenderDevice::GetCurrent();
+    device->SetBright(ct.R, ct.G, ct.B);
+    device->SetBlendMode(RenderBlendMode::Alpha, ct.A);
+    device->DrawImage(
         tf.X, tf.Y,
+        0, 0, Image->GetWidth(), Image->GetHeight(),
         tf.OriginX, tf.OriginY,
         tf.ScaleX, tf.ScaleY,
         tf.Angle, Image->GetHandle(),
-        HasAlpha ? TRUE : FALSE, FALSE);
+        HasAlpha);
 }
 
 SSprite * SSprite::Clone()
@@ -401,11 +406,14 @@ SShape::SShape()
 
 void SShape::DrawBy(const Transform2D & tf, const ColorTint & ct)
 {
-    SetDrawBright(ct.R, ct.G, ct.B);
-    SetDrawBlendMode(DX_BLENDMODE_ALPHA, ct.A);
+    const SpriteBatch::Immediate immediate;
+    const auto device = RenderDevice::GetCurrent();
+    const auto white = MakeRenderColor(255, 255, 255);
+    device->SetBright(ct.R, ct.G, ct.B);
+    device->SetBlendMode(RenderBlendMode::Alpha, ct.A);
     switch (Type) {
         case SShapeType::Pixel:
-            DrawPixel(SU_TO_INT32(tf.X), SU_TO_INT32(tf.Y), GetColor(255, 255, 255));
+            device->DrawPixel(SU_TO_INT32(tf.X), SU_TO_INT32(tf.Y), white);
             break;
         case SShapeType::Box: {
             const glm::vec2 points[] = {
@@ -414,12 +422,12 @@ void SShape::DrawBy(const Transform2D & tf, const ColorTint & ct)
                 glm::rotate(glm::vec2(-Width * tf.ScaleX / 2.0, -Height * tf.ScaleY / 2.0), float(tf.Angle)),
                 glm::rotate(glm::vec2(+Width * tf.ScaleX / 2.0, -Height * tf.ScaleY / 2.0), float(tf.Angle))
             };
-            DrawQuadrangleAA(
+            device->DrawQuadrangle(
                 tf.X + points[0].x, tf.Y - points[0].y,
                 tf.X + points[1].x, tf.Y - points[1].y,
                 tf.X + points[2].x, tf.Y - points[2].y,
                 tf.X + points[3].x, tf.Y - points[3].y,
-                GetColor(255, 255, 255), FALSE
+                white, false
             );
             break;
         }
@@ -430,12 +438,12 @@ void SShape::DrawBy(const Transform2D & tf, const ColorTint & ct)
                 glm::rotate(glm::vec2(-Width * tf.ScaleX / 2.0, -Height * tf.ScaleY / 2.0), float(tf.Angle)),
                 glm::rotate(glm::vec2(+Width * tf.ScaleX / 2.0, -Height * tf.ScaleY / 2.0), float(tf.Angle))
             };
-            DrawQuadrangleAA(
+            device->DrawQuadrangle(
                 tf.X + points[0].x, tf.Y - points[0].y,
                 tf.X + points[1].x, tf.Y - points[1].y,
                 tf.X + points[2].x, tf.Y - points[2].y,
                 tf.X + points[3].x, tf.Y - points[3].y,
-                GetColor(255, 255, 255), TRUE
+                white, true
             );
             break;
         }
@@ -450,12 +458,12 @@ void SShape::DrawBy(const Transform2D & tf, const ColorTint & ct)
                     glm::vec2(Width * tf.ScaleX / 2.0 * glm::cos(angle), Height * tf.ScaleY / 2.0 * glm::sin(angle)),
                     float(tf.Angle)
                 );
-                DrawLineAA(
+                device->DrawLine(
                     float(tf.X + prev.x),
                     float(tf.Y - prev.y),
                     float(tf.X + next.x),
                     float(tf.Y - next.y),
-                    GetColor(255, 255, 255)
+                    white, 1.0f
                 );
                 prev = next;
             }
@@ -472,15 +480,15 @@ void SShape::DrawBy(const Transform2D & tf, const ColorTint & ct)
                     glm::vec2(Width * tf.ScaleX / 2.0 * glm::cos(angle), Height * tf.ScaleY / 2.0 * glm::sin(angle)),
                     float(tf.Angle)
                 );
-                DrawTriangleAA(
+                device->DrawTriangle(
                     float(tf.X),
                     float(tf.Y),
                     float(tf.X + prev.x),
                     float(tf.Y - prev.y),
                     float(tf.X + next.x),
                     float(tf.Y - next.y),
-                    GetColor(255, 255, 255),
-                    TRUE
+                    white,
+                    true
                 );
                 prev = next;
             }
@@ -562,64 +570,71 @@ void STextSprite::Refresh()
 
 void STextSprite::DrawNormal(const Transform2D &tf, const ColorTint &ct)
 {
-    SetDrawBlendMode(DX_BLENDMODE_ALPHA, ct.A);
-    SetDrawMode(DX_DRAWMODE_ANISOTROPIC);
+    // 描画モードを変えるので積まない
+    const SpriteBatch::Immediate immediate;
+    const auto device = RenderDevice::GetCurrent();
+    device->SetBlendMode(RenderBlendMode::Alpha, ct.A);
+    device->SetFilterMode(RenderFilterMode::Anisotropic);
     if (isRich) {
-        SetDrawBright(255, 255, 255);
+        device->SetBright(255, 255, 255);
     } else {
-        SetDrawBright(ct.R, ct.G, ct.B);
+        device->SetBright(ct.R, ct.G, ct.B);
     }
     const auto tox = SU_TO_FLOAT(get<0>(size) / 2 * int(horizontalAlignment));
     const auto toy = SU_TO_FLOAT(get<1>(size) / 2 * int(verticalAlignment));
-    DrawRotaGraph3F(
+    device->DrawImage(
         tf.X, tf.Y,
+        0, 0, target->GetWidth(), target->GetHeight(),
         tf.OriginX + tox, tf.OriginY + toy,
         tf.ScaleX, tf.ScaleY,
-        tf.Angle, target->GetHandle(), TRUE, FALSE);
+        tf.Angle, target->GetHandle(), true);
 }
 
 void STextSprite::DrawScroll(const Transform2D &tf, const ColorTint &ct)
 {
-    const auto pds = GetDrawScreen();
-    SetDrawScreen(scrollBuffer->GetHandle());
-    SetDrawBright(255, 255, 255);
-    SetDrawBlendMode(DX_BLENDMODE_ALPHA, 255);
-    ClearDrawScreen();
+    const SpriteBatch::Immediate immediate;
+    const auto device = RenderDevice::GetCurrent();
+    const auto pds = device->GetRenderTarget();
+    device->SetRenderTarget(scrollBuffer->GetHandle());
+    device->SetBright(255, 255, 255);
+    device->SetBlendMode(RenderBlendMode::Alpha, 255);
+    device->Clear();
     if (scrollSpeed >= 0) {
         auto reach = -scrollPosition + int(scrollPosition / (get<0>(size) + scrollMargin)) * (get<0>(size) + scrollMargin);
         while (reach < scrollWidth) {
-            DrawRectGraphF(
-                SU_TO_FLOAT(reach), 0,
+            device->DrawImageExtended(
+                SU_TO_FLOAT(reach), 0, SU_TO_FLOAT(reach + SU_TO_INT32(get<0>(size))), SU_TO_FLOAT(SU_TO_INT32(get<1>(size))),
                 0, 0, SU_TO_INT32(get<0>(size)), SU_TO_INT32(get<1>(size)),
-                target->GetHandle(), TRUE, FALSE);
+                target->GetHandle(), true);
             reach += get<0>(size) + scrollMargin;
         }
     } else {
         auto reach = -scrollPosition - int(scrollPosition / (get<0>(size) + scrollMargin)) * (get<0>(size) + scrollMargin);
         while (reach > 0) {
-            DrawRectGraphF(
-                SU_TO_FLOAT(reach), 0,
+            device->DrawImageExtended(
+                SU_TO_FLOAT(reach), 0, SU_TO_FLOAT(reach + SU_TO_INT32(get<0>(size))), SU_TO_FLOAT(SU_TO_INT32(get<1>(size))),
                 0, 0, SU_TO_INT32(get<0>(size)), SU_TO_INT32(get<1>(size)),
-                target->GetHandle(), TRUE, FALSE);
+                target->GetHandle(), true);
             reach -= get<0>(size) + scrollMargin;
         }
     }
-    SetDrawScreen(pds);
+    device->SetRenderTarget(pds);
 
     if (isRich) {
-        SetDrawBright(255, 255, 255);
+        device->SetBright(255, 255, 255);
     } else {
-        SetDrawBright(ct.R, ct.G, ct.B);
+        device->SetBright(ct.R, ct.G, ct.B);
     }
-    SetDrawBlendMode(DX_BLENDMODE_ALPHA, ct.A);
-    SetDrawMode(DX_DRAWMODE_ANISOTROPIC);
+    device->SetBlendMode(RenderBlendMode::Alpha, ct.A);
+    device->SetFilterMode(RenderFilterMode::Anisotropic);
     const auto tox = SU_TO_FLOAT(scrollWidth / 2 * int(horizontalAlignment));
     const auto toy = SU_TO_FLOAT(get<1>(size) / 2 * int(verticalAlignment));
-    DrawRotaGraph3F(
+    device->DrawImage(
         tf.X, tf.Y,
+        0, 0, scrollBuffer->GetWidth(), scrollBuffer->GetHeight(),
         tf.OriginX + tox, tf.OriginY + toy,
         tf.ScaleX, tf.ScaleY,
-        tf.Angle, scrollBuffer->GetHandle(), TRUE, FALSE);
+        tf.Angle, scrollBuffer->GetHandle(), true);
 }
 
 void STextSprite::SetFont(SFont * font)
@@ -855,14 +870,18 @@ void STextInput::RegisterType(asIScriptEngine *engine)
 void SSynthSprite::DrawBy(const Transform2D & tf, const ColorTint & ct)
 {
     if (!target) return;
-    SetDrawBright(ct.R, ct.G, ct.B);
-    SetDrawBlendMode(DX_BLENDMODE_ALPHA, ct.A);
-    DrawRotaGraph3F(
+    const auto batch = SpriteBatch::GetActive();
+    if (batch && batch->AddImage(target, tf, ct, HasAlpha)) return;
+    const auto device = RenderDevice::GetCurrent();
+    device->SetBright(ct.R, ct.G, ct.B);
+    device->SetBlendMode(RenderBlendMode::Alpha, ct.A);
+    device->DrawImage(
         tf.X, tf.Y,
+        0, 0, target->GetWidth(), target->GetHeight(),
         tf.OriginX, tf.OriginY,
         tf.ScaleX, tf.ScaleY,
         tf.Angle, target->GetHandle(),
-        HasAlpha ? TRUE : FALSE, FALSE);
+        HasAlpha);
 }
 
 SSynthSprite::SSynthSprite(const int w, const int h)
@@ -888,6 +907,7 @@ void SSynthSprite::Transfer(SSprite *sprite)
 {
     if (!sprite) return;
 
+    const SpriteBatch::Immediate immediate;
     BEGIN_DRAW_TRANSACTION(target->GetHandle());
     sprite->Draw();
     FINISH_DRAW_TRANSACTION;
@@ -900,10 +920,15 @@ void SSynthSprite::Transfer(SImage * image, const double x, const double y)
 {
     if (!image) return;
 
+    const SpriteBatch::Immediate immediate;
     BEGIN_DRAW_TRANSACTION(target->GetHandle());
-    SetDrawBright(255, 255, 255);
-    SetDrawBlendMode(DX_BLENDMODE_ALPHA, 255);
-    DrawGraphF(SU_TO_FLOAT(x), SU_TO_FLOAT(y), image->GetHandle(), HasAlpha ? TRUE : FALSE);
+    const auto device = RenderDevice::GetCurrent();
+    device->SetBright(255, 255, 255);
+    device->SetBlendMode(RenderBlendMode::Alpha, 255);
+    device->DrawImageExtended(
+        SU_TO_FLOAT(x), SU_TO_FLOAT(y), SU_TO_FLOAT(x + image->GetWidth()), SU_TO_FLOAT(y + image->GetHeight()),
+        0, 0, image->GetWidth(), image->GetHeight(),
+        image->GetHandle(), HasAlpha);
     FINISH_DRAW_TRANSACTION;
 
     image->Release();
@@ -970,15 +995,18 @@ void SClippingSprite::DrawBy(const Transform2D & tf, const ColorTint & ct)
     const auto y = SU_TO_INT32(height * v1);
     const auto w = SU_TO_INT32(width * u2);
     const auto h = SU_TO_INT32(height * v2);
-    SetDrawBright(ct.R, ct.G, ct.B);
-    SetDrawBlendMode(DX_BLENDMODE_ALPHA, ct.A);
-    DrawRectRotaGraph3F(
+    const auto batch = SpriteBatch::GetActive();
+    if (batch && batch->AddImage(target, x, y, w, h, tf, ct, HasAlpha)) return;
+    const auto device = RenderDevice::GetCurrent();
+    device->SetBright(ct.R, ct.G, ct.B);
+    device->SetBlendMode(RenderBlendMode::Alpha, ct.A);
+    device->DrawImage(
         tf.X, tf.Y,
         x, y, w, h,
         tf.OriginX, tf.OriginY,
         tf.ScaleX, tf.ScaleY,
         tf.Angle, target->GetHandle(),
-        HasAlpha ? TRUE : FALSE, FALSE);
+        HasAlpha);
 }
 
 SClippingSprite::SClippingSprite(const int w, const int h)
@@ -1059,14 +1087,18 @@ void SAnimeSprite::DrawBy(const Transform2D &tf, const ColorTint &ct)
     const auto at = images->GetCellTime() * images->GetFrameCount() - time;
     const auto ih = images->GetImageHandleAt(at);
     if (!ih) return;
-    SetDrawBright(Color.R, Color.G, Color.B);
-    SetDrawBlendMode(DX_BLENDMODE_ALPHA, Color.A);
-    DrawRotaGraph3F(
+    // コマは分割読み込みした部分画像なので積めない
+    const SpriteBatch::Immediate immediate;
+    const auto device = RenderDevice::GetCurrent();
+    device->SetBright(Color.R, Color.G, Color.B);
+    device->SetBlendMode(RenderBlendMode::Alpha, Color.A);
+    device->DrawImage(
         Transform.X, Transform.Y,
+        0, 0, images->GetWidth(), images->GetHeight(),
         Transform.OriginX, Transform.OriginY,
         Transform.ScaleX, Transform.ScaleY,
         Transform.Angle, ih,
-        HasAlpha ? TRUE : FALSE, FALSE);
+        HasAlpha);
 }
 
 SAnimeSprite::SAnimeSprite(SAnimatedImage * img)
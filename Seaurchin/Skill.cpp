@@ -198,6 +198,33 @@ SImage* SkillIndicators::GetSkillIndicatorImage(const uint32_t index)
     return result;
 }
 
+const char* GetAbilityNoteTypeName(const AbilityNoteType type)
+{
+    switch (type) {
+        case AbilityNoteType::Tap: return "Tap";
+        case AbilityNoteType::ExTap: return "ExTap";
+        case AbilityNoteType::AwesomeExTap: return "AwesomeExTap";
+        case AbilityNoteType::Flick: return "Flick";
+        case AbilityNoteType::Air: return "Air";
+        case AbilityNoteType::HellTap: return "HellTap";
+        case AbilityNoteType::Hold: return "Hold";
+        case AbilityNoteType::Slide: return "Slide";
+        case AbilityNoteType::AirAction: return "AirAction";
+        default: return "Unknown";
+    }
+}
+
+const char* GetAbilityJudgeTypeName(const AbilityJudgeType type)
+{
+    switch (type) {
+        case AbilityJudgeType::JusticeCritical: return "JusticeCritical";
+        case AbilityJudgeType::Justice: return "Justice";
+        case AbilityJudgeType::Attack: return "Attack";
+        case AbilityJudgeType::Miss: return "Miss";
+        default: return "Unknown";
+    }
+}
+
 void RegisterSkillTypes(asIScriptEngine *engine)
 {
     engine->RegisterEnum(SU_IF_NOTETYPE);
@@ -109,4 +109,8 @@ public:
     void TriggerSkillIndicator(int index) const;
 };
 
+// ログやファイル出力用の名前
+const char* GetAbilityNoteTypeName(AbilityNoteType type);
+const char* GetAbilityJudgeTypeName(AbilityJudgeType type);
+
 void RegisterSkillTypes(asIScriptEngine *engine);
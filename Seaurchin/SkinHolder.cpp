@@ -12,11 +12,12 @@ bool SkinHolder::IncludeScript(std::wstring include, std::wstring from, CWScript
     return false;
 }
 
-SkinHolder::SkinHolder(const wstring &name, const shared_ptr<AngelScript> &script, const std::shared_ptr<SoundManager>& sound)
+SkinHolder::SkinHolder(const wstring &name, const shared_ptr<AngelScript> &script, const std::shared_ptr<SoundManager>& sound, const bool useAtlas)
     : scriptInterface(script)
     , soundInterface(sound)
     , skinName(name)
     , skinRoot(Setting::GetRootDirectory() / SU_DATA_DIR / SU_SKIN_DIR / skinName)
+    , atlas(useAtlas ? new TextureAtlas() : nullptr)
 {}
 
 SkinHolder::~SkinHolder()
@@ -118,13 +119,14 @@ asIScriptObject* SkinHolder::ExecuteSkinScript(const wstring &file, const bool f
 void SkinHolder::LoadSkinImage(const string &key, const string &filename)
 {
     if (images[key]) images[key]->Release();
-    images[key] = SImage::CreateLoadedImageFromFile(ConvertUnicodeToUTF8((skinRoot / SU_IMAGE_DIR / ConvertUTF8ToUnicode(filename)).wstring()), false);
+    const auto path = ConvertUnicodeToUTF8((skinRoot / SU_IMAGE_DIR / ConvertUTF8ToUnicode(filename)).wstring());
+    images[key] = atlas ? SImage::CreateAtlasImageFromFile(path, atlas.get()) : SImage::CreateLoadedImageFromFile(path, false);
 }
 
 void SkinHolder::LoadSkinImageFromMem(const string &key, void *buffer, const size_t size)
 {
     if (images[key]) images[key]->Release();
-    images[key] = SImage::CreateLoadedImageFromMemory(buffer, size);
+    images[key] = atlas ? SImage::CreateAtlasImageFromMemory(buffer, size, atlas.get()) : SImage::CreateLoadedImageFromMemory(buffer, size);
 }
 
 void SkinHolder::LoadSkinFont(const string &key, const string &filename)
@@ -3,6 +3,7 @@
 #include "AngelScriptManager.h"
 #include "SoundManager.h"
 #include "ScriptResource.h"
+#include "TextureAtlas.h"
 
 #define SU_IF_SKIN "Skin"
 #define SU_IF_SIZE "Size"
@@ -14,6 +15,7 @@ private:
     const std::shared_ptr<SoundManager> soundInterface;
     const std::wstring skinName;
     const boost::filesystem::path skinRoot;
+    const std::unique_ptr<TextureAtlas> atlas;     // 使わなければ空
 
     std::unordered_map<std::string, SImage*> images;
     std::unordered_map<std::string, SFont*> fonts;
@@ -24,7 +26,7 @@ private:
     static bool IncludeScript(std::wstring include, std::wstring from, CWScriptBuilder *builder);
 
 public:
-    SkinHolder(const std::wstring &name, const std::shared_ptr<AngelScript>& script, const std::shared_ptr<SoundManager> &sound);
+    SkinHolder(const std::wstring &name, const std::shared_ptr<AngelScript>& script, const std::shared_ptr<SoundManager> &sound, bool useAtlas = true);
     ~SkinHolder();
 
     void Initialize();
@@ -0,0 +1,244 @@
+﻿#include "SlideMesh.h"
+#include "Misc.h"
+
+using namespace std;
+
+void SlideMeshStore::Build(const SusNoteStore &store, const NoteCurvesList &curveData)
+{
+    Clear();
+    for (uint32_t i = 0; i < store.GetRootCount(); ++i) {
+        if (store.Types[i] & (1u << size_t(SusNoteType::Slide))) Push(store, i, curveData);
+    }
+}
+
+void SlideMeshStore::Clear()
+{
+    Points.clear();
+    Blocks.clear();
+    meshes.clear();
+}
+
+const SlideMeshStore::Mesh* SlideMeshStore::Find(const SusDrawableNoteData *note) const
+{
+    const auto it = meshes.find(note);
+    return it == meshes.end() ? nullptr : &it->second;
+}
+
+uint32_t SlideMeshStore::GetMaxPointCount() const
+{
+    uint32_t result = 0;
+    for (const auto &mesh : meshes) {
+        uint32_t points = 0;
+        for (auto i = mesh.second.FirstBlock; i < mesh.second.FirstBlock + mesh.second.BlockCount; ++i) points += Blocks[i].PointCount;
+        result = max(result, points);
+    }
+    return result;
+}
+
+void SlideMeshStore::Push(const SusNoteStore &store, const uint32_t index, const NoteCurvesList &curveData)
+{
+    const auto &note = store.Sources[index];
+    /* 各SlideElementに対応する区間の 起点時刻, 終点時刻 */
+    /* 起点時刻 : そのSlideElement以前に現れた始点or中継点の先頭時刻 */
+    /* 終点時刻 : そのSlideElement以降に現れる終点or中継点の終端時刻 */
+    vector<tuple<double, double>> exData(note->ExtraData.size() + 1);
+    {
+        auto lastStartTime = note->StartTime;
+        exData[0] = make_tuple(note->StartTime, 0.0);
+        for (size_t i = 0; i < note->ExtraData.size(); ++i) {
+            const auto &slideElement = note->ExtraData[i];
+            auto endTime = 0.0;
+            const auto startTime = lastStartTime;
+            if (slideElement->Type.test(size_t(SusNoteType::Step))) {
+                lastStartTime = slideElement->StartTime;
+                endTime = slideElement->StartTime;
+            }
+            if (slideElement->Type.test(size_t(SusNoteType::End))) endTime = slideElement->StartTime;
+            exData[i + 1] = make_tuple(startTime, endTime);
+        }
+        /* 開始時刻を共有しているものは終了時刻も共有する */
+        for (auto i = exData.size() - 1; i > 0; --i) {
+            if (get<0>(exData[i - 1]) == get<0>(exData[i])) get<1>(exData[i - 1]) = get<1>(exData[i]);
+        }
+    }
+
+    Mesh mesh;
+    mesh.FirstBlock = SU_TO_UINT32(Blocks.size());
+    mesh.CursorBlock = mesh.FirstBlock;
+    mesh.CursorPoint = SU_TO_UINT32(Points.size());
+    auto lastStep = note.get();
+    auto lastStepIndex = index;
+    auto offsetTimeInBlock = 0.0;
+    for (size_t i = 0; i < note->ExtraData.size(); ++i) {
+        const auto &slideElement = note->ExtraData[i];
+        if (slideElement->Type.test(size_t(SusNoteType::Control))) continue;
+        if (slideElement->Type.test(size_t(SusNoteType::Injection))) continue;
+
+        Block block;
+        block.From = lastStep;
+        block.To = slideElement.get();
+        block.FromIndex = lastStepIndex;
+        block.ToIndex = store.FirstSteps[index] + SU_TO_UINT32(i);
+        block.Duration = slideElement->StartTime - lastStep->StartTime;
+        block.ExDuration = get<1>(exData[i + 1]) - get<0>(exData[i + 1]);
+        block.Offset = offsetTimeInBlock;
+        block.FirstPoint = SU_TO_UINT32(Points.size());
+
+        const auto segmentPositions = curveData.Find(slideElement.get());
+        if (!segmentPositions.empty()) {
+            auto lastSegmentPosition = segmentPositions[0];
+            // 先頭は直前の中継点そのもの
+            Points.push_back({ get<1>(lastSegmentPosition), double(lastStep->Length), 0.0, get<0>(lastSegmentPosition) / block.ExDuration, get<0>(lastSegmentPosition) });
+            for (const auto &segmentPosition : segmentPositions) {
+                if (lastSegmentPosition == segmentPosition) continue;
+                const auto timeInBlock = get<0>(segmentPosition) / block.Duration;
+                Points.push_back({
+                    get<1>(segmentPosition),
+                    glm::mix(double(lastStep->Length), double(slideElement->Length), timeInBlock),
+                    timeInBlock,
+                    get<0>(segmentPosition) / block.ExDuration,
+                    get<0>(segmentPosition)
+                });
+                lastSegmentPosition = segmentPosition;
+            }
+        }
+        block.PointCount = SU_TO_UINT32(Points.size()) - block.FirstPoint;
+        Blocks.push_back(block);
+
+        if (slideElement->Type.test(size_t(SusNoteType::Step))) {
+            offsetTimeInBlock = 0;
+        } else if (block.PointCount) {
+            offsetTimeInBlock += Points.back().TimeInBlock2;
+        }
+        lastStep = slideElement.get();
+        lastStepIndex = block.ToIndex;
+    }
+    mesh.BlockCount = SU_TO_UINT32(Blocks.size()) - mesh.FirstBlock;
+    // 区間は Control と Injection を飛ばした同じ並びになる
+    auto curveBlock = mesh.FirstBlock;
+    ForEachSlideCurve(*note, [&](const SusDrawableNoteData &, const SusDrawableNoteData &, const SusBezierCurve &curve) { Blocks[curveBlock++].Curve = curve; });
+    meshes[note.get()] = mesh;
+}
+
+bool SlideMeshStore::FindVisibleSegments(const Block &block, const vector<double> &positions, const double seenDuration, const double limit, uint32_t *first, uint32_t *last) const
+{
+    if (block.PointCount < 2) return false;
+    // -1: 手前 (0 未満), 1: 奥 (limit 以上), 0: 範囲内
+    const auto side = [&](const uint32_t index) {
+        const auto y = GetRelativeY(block, Points[index], positions, seenDuration);
+        return y < 0 ? -1 : (y >= limit ? 1 : 0);
+    };
+    const auto begin = block.FirstPoint;
+    const auto end = block.FirstPoint + block.PointCount;
+    const auto firstSide = side(begin);
+    const auto lastSide = side(end - 1);
+    if (firstSide && firstSide == lastSide) return false;
+
+    // 点を位置で二分探索する
+    const auto partition = [&](uint32_t low, uint32_t high, const int outside, const bool inPrefix) {
+        while (low < high) {
+            const auto middle = low + (high - low) / 2;
+            if ((side(middle) == outside) == inPrefix) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        return low;
+    };
+    // 最初の線分は、外側にある先頭の点の並びを抜けた最初の点で終わる
+    *first = firstSide ? partition(begin + 1, end, firstSide, true) : begin + 1;
+    // 最後の線分は、外側にある末尾の点の並びの最初の点で終わる
+    *last = lastSide ? partition(begin, end, lastSide, false) : end - 1;
+    return *first <= *last;
+}
+
+bool SlideMeshStore::Evaluate(const SusDrawableNoteData *note, const double time, double *x, double *length)
+{
+    const auto it = meshes.find(note);
+    if (it == meshes.end() || !it->second.BlockCount) return false;
+    auto &mesh = it->second;
+    Advance(mesh, time);
+    Interpolate(Blocks[mesh.CursorBlock], mesh.CursorPoint, time, x, length);
+    return true;
+}
+
+bool SlideMeshStore::EvaluateCurve(const SusDrawableNoteData *note, const double time, double *x, double *length)
+{
+    const auto it = meshes.find(note);
+    if (it == meshes.end() || !it->second.BlockCount) return false;
+    auto &mesh = it->second;
+    Advance(mesh, time);
+    const auto &block = Blocks[mesh.CursorBlock];
+    const auto localTime = time - block.From->StartTime;
+    *x = block.Curve.GetPositionAt(localTime);
+    *length = block.Duration > 0 ? glm::mix(double(block.From->Length), double(block.To->Length), max(0.0, min(localTime / block.Duration, 1.0))) : block.To->Length;
+    return true;
+}
+
+void SlideMeshStore::Advance(Mesh &mesh, const double time)
+{
+    const auto lastBlock = mesh.FirstBlock + mesh.BlockCount - 1;
+    auto block = mesh.CursorBlock;
+    auto point = mesh.CursorPoint;
+
+    if (block > mesh.FirstBlock && time <= Blocks[block - 1].To->StartTime) {
+        // 前の区間に戻った
+        Locate(mesh, time, &block, &point);
+    } else {
+        while (block < lastBlock && time > Blocks[block].To->StartTime) point = Blocks[++block].FirstPoint;
+        const auto &current = Blocks[block];
+        const auto end = current.FirstPoint + current.PointCount;
+        const auto localTime = time - current.From->StartTime;
+        if (point > current.FirstPoint && Points[point - 1].Time >= localTime) {
+            // 区間内で戻った
+            Locate(mesh, time, &block, &point);
+        } else {
+            while (point < end && Points[point].Time < localTime) ++point;
+        }
+    }
+    mesh.CursorBlock = block;
+    mesh.CursorPoint = point;
+}
+
+bool SlideMeshStore::Evaluate(const Mesh &mesh, const double time, double *x, double *length) const
+{
+    if (!mesh.BlockCount) return false;
+    uint32_t block, point;
+    Locate(mesh, time, &block, &point);
+    Interpolate(Blocks[block], point, time, x, length);
+    return true;
+}
+
+void SlideMeshStore::Locate(const Mesh &mesh, const double time, uint32_t *block, uint32_t *point) const
+{
+    const auto firstBlock = Blocks.begin() + mesh.FirstBlock;
+    const auto lastBlock = firstBlock + mesh.BlockCount - 1;
+    const auto found = partition_point(firstBlock, lastBlock, [time](const Block &b) { return time > b.To->StartTime; });
+    const auto localTime = time - found->From->StartTime;
+    const auto firstPoint = Points.begin() + found->FirstPoint;
+    const auto endPoint = firstPoint + found->PointCount;
+    *block = SU_TO_UINT32(found - Blocks.begin());
+    *point = SU_TO_UINT32(partition_point(firstPoint, endPoint, [localTime](const Point &p) { return p.Time < localTime; }) - Points.begin());
+}
+
+void SlideMeshStore::Interpolate(const Block &block, const uint32_t point, const double time, double *x, double *length) const
+{
+    if (!block.PointCount) {
+        *x = (block.To->StartLane + block.To->Length / 2.0) / 16.0;
+        *length = block.To->Length;
+        return;
+    }
+    if (point == block.FirstPoint || point == block.FirstPoint + block.PointCount) {
+        // 区間の前後は端の点
+        const auto &edge = Points[point == block.FirstPoint ? point : point - 1];
+        *x = edge.X;
+        *length = edge.Length;
+        return;
+    }
+    const auto &previous = Points[point - 1];
+    const auto &next = Points[point];
+    const auto ratio = (time - block.From->StartTime - previous.Time) / (next.Time - previous.Time);
+    *x = glm::mix(previous.X, next.X, ratio);
+    *length = glm::mix(previous.Length, next.Length, ratio);
+}
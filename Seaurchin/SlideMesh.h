@@ -0,0 +1,77 @@
+﻿#pragma once
+
+#include "SusNoteStore.h"
+
+// Slide の帯を譜面時刻の空間で前計算したもの
+// 形は譜面だけで決まるので読み込み時に一度だけ作り、毎フレームはハイスピの投影と切り取りだけを行う
+// Block は [始点,中継点] から次の [中継点,終点] までの1区間で、Points はその中の分割点 (重複は除いてある)
+// エフェクト用に曲中時刻での中心位置と幅も引ける 判定用には分割によらない曲線そのものの位置も引ける
+class SlideMeshStore final {
+public:
+    struct Point {
+        double X;               // レーン全体を 0-1 とした中心位置
+        double Length;          // 幅 (レーン数)
+        double TimeInBlock;     // 区間内の時刻 (0-1) 投影に使う
+        double TimeInBlock2;    // 不可視中継点をまたいだ区間での時刻 テクスチャの v に使う
+        double Time;            // 区間先頭からの時間 区間内では昇順
+    };
+
+    struct Block {
+        SusDrawableNoteData *From;
+        SusDrawableNoteData *To;
+        uint32_t FromIndex;         // From/To の SusNoteStore 上の番号 描画位置は Positions から読む
+        uint32_t ToIndex;
+        double Duration;            // From から To までの時間
+        double ExDuration;          // 不可視中継点をまたいだ区間の時間
+        double Offset;              // 不可視中継点をまたいできた分の v
+        uint32_t FirstPoint;
+        uint32_t PointCount;
+        SusBezierCurve Curve;       // 判定用 区間先頭からの時間で引く
+    };
+
+    struct Mesh {
+        uint32_t FirstBlock;
+        uint32_t BlockCount;
+        uint32_t CursorBlock;   // 再生位置のカーソル 前回 Evaluate した位置から前に進めて探す
+        uint32_t CursorPoint;
+    };
+
+    std::vector<Point> Points;
+    std::vector<Block> Blocks;
+
+private:
+    std::unordered_map<const SusDrawableNoteData*, Mesh> meshes;
+
+    void Push(const SusNoteStore &store, uint32_t index, const NoteCurvesList &curveData);
+    // カーソルを time まで動かす 戻ったときは二分探索し直す
+    void Advance(Mesh &mesh, double time);
+    // time を含む区間と、区間内で時間が time 以上の最初の点を二分探索する
+    void Locate(const Mesh &mesh, double time, uint32_t *block, uint32_t *point) const;
+    void Interpolate(const Block &block, uint32_t point, double time, double *x, double *length) const;
+
+public:
+    // 区間の両端は store の番号で持つので、描画にはこの store の Positions を渡すこと
+    void Build(const SusNoteStore &store, const NoteCurvesList &curveData);
+    void Clear();
+    // 無ければ nullptr
+    const Mesh* Find(const SusDrawableNoteData *note) const;
+    // 最大の Points 数 (描画バッファの見積もり用)
+    uint32_t GetMaxPointCount() const;
+
+    // 曲中時刻 time での中心位置 (レーン全体を 0-1) と幅 (レーン数) を分割点の線形補間で求める
+    // 区間は From->StartTime < time <= To->StartTime のものを使い、Slide の前後では端の値になる 形が無ければ false
+    // カーソルを使う方は再生のように時刻が進んでいく間は償却 O(1)、戻ったときは二分探索し直す
+    bool Evaluate(const SusDrawableNoteData *note, double time, double *x, double *length);
+    bool Evaluate(const Mesh &mesh, double time, double *x, double *length) const;
+    // Evaluate と同じ区間の取り方で、分割点ではなく曲線そのものの位置を求める 分割の細かさで判定が変わらないように判定ではこちらを使う
+    bool EvaluateCurve(const SusDrawableNoteData *note, double time, double *x, double *length);
+
+    // 判定ラインを 1 とした相対位置 positions は SusNoteStore::Positions
+    static double GetRelativeY(const Block &block, const Point &point, const std::vector<double> &positions, const double seenDuration)
+    {
+        return 1.0 - glm::mix(positions[block.FromIndex], positions[block.ToIndex], point.TimeInBlock) / seenDuration;
+    }
+    // 区間内で [0, limit) にかかる線分を求める 線分 k は点 k - 1 から点 k まで (Points 上の位置)
+    // 区間内の相対位置は時刻に対して単調なので、見えない線分は前後にまとまっている
+    bool FindVisibleSegments(const Block &block, const std::vector<double> &positions, double seenDuration, double limit, uint32_t *first, uint32_t *last) const;
+};
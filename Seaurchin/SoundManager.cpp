@@ -20,31 +20,26 @@ SoundSample::~SoundSample()
 
 DWORD SoundSample::GetSoundHandle()
 {
-    return BASS_SampleGetChannel(hSample, FALSE);
+    return hSample ? BASS_SampleGetChannel(hSample, FALSE) : 0;
 }
 
 void SoundSample::StopSound()
 {
-    BASS_SampleStop(hSample);
+    if (hSample) BASS_SampleStop(hSample);
 }
 
 void SoundSample::SetVolume(const double vol)
 {
+    if (!hSample) return;
     BASS_SAMPLE si = { 0 };
     BASS_SampleGetInfo(hSample, &si);
     si.volume = SU_TO_FLOAT(vol);
     BASS_SampleSetInfo(hSample, &si);
 }
 
-SoundSample *SoundSample::CreateFromFile(const wstring &fileNameW, const int maxChannels)
-{
-    const auto handle = BASS_SampleLoad(FALSE, fileNameW.c_str(), 0, 0, maxChannels, BASS_SAMPLE_OVER_POS | BASS_UNICODE);
-    const auto result = new SoundSample(handle);
-    return result;
-}
-
 void SoundSample::SetLoop(const bool looping) const
 {
+    if (!hSample) return;
     BASS_SAMPLE info;
     BASS_SampleGetInfo(hSample, &info);
     if (looping) {
@@ -75,47 +70,42 @@ DWORD SoundStream::GetSoundHandle()
 
 void SoundStream::StopSound()
 {
-    BASS_ChannelStop(hStream);
+    if (hStream) BASS_ChannelStop(hStream);
 }
 
 void SoundStream::SetVolume(const double vol)
 {
-    BASS_ChannelSetAttribute(hStream, BASS_ATTRIB_VOL, SU_TO_FLOAT(clamp(vol, 0.0f, 1.0f)));
+    if (hStream) BASS_ChannelSetAttribute(hStream, BASS_ATTRIB_VOL, SU_TO_FLOAT(clamp(vol, 0.0f, 1.0f)));
 }
 
 void SoundStream::Pause() const
 {
-    BASS_ChannelPause(hStream);
+    if (hStream) BASS_ChannelPause(hStream);
 }
 
 void SoundStream::Resume() const
 {
-    BASS_ChannelPlay(hStream, FALSE);
-}
-
-SoundStream *SoundStream::CreateFromFile(const wstring &fileNameW)
-{
-    const auto handle = BASS_StreamCreateFile(FALSE, fileNameW.c_str(), 0, 0, BASS_UNICODE);
-    const auto result = new SoundStream(handle);
-    return result;
+    if (hStream) BASS_ChannelPlay(hStream, FALSE);
 }
 
 double SoundStream::GetPlayingPosition() const
 {
+    if (!hStream) return 0;
     const auto pos = BASS_ChannelGetPosition(hStream, BASS_POS_BYTE);
     return BASS_ChannelBytes2Seconds(hStream, pos);
 }
 
 void SoundStream::SetPlayingPosition(const double pos) const
 {
+    if (!hStream) return;
     const auto bp = BASS_ChannelSeconds2Bytes(hStream, pos);
     BASS_ChannelSetPosition(hStream, bp, BASS_POS_BYTE);
 }
 
 // SoundMixerStream ------------------------
-SoundMixerStream::SoundMixerStream(const int ch, const int freq)
+SoundMixerStream::SoundMixerStream(const HSTREAM mixer)
 {
-    hMixerStream = BASS_Mixer_StreamCreate(freq, ch, 0);
+    hMixerStream = mixer;
 }
 
 SoundMixerStream::~SoundMixerStream()
@@ -146,6 +136,7 @@ void SoundMixerStream::Update()
 void SoundMixerStream::Play(Sound * sound)
 {
     auto ch = sound->GetSoundHandle();
+    if (!hMixerStream || !ch) return;
     playingSounds.emplace(ch);
     BASS_Mixer_StreamAddChannel(hMixerStream, ch, 0);
     BASS_ChannelPlay(ch, FALSE);
@@ -159,34 +150,44 @@ void SoundMixerStream::Stop(Sound *sound)
 
 void SoundMixerStream::SetVolume(const double vol) const
 {
-    BASS_ChannelSetAttribute(hMixerStream, BASS_ATTRIB_VOL, SU_TO_FLOAT(vol));
+    if (hMixerStream) BASS_ChannelSetAttribute(hMixerStream, BASS_ATTRIB_VOL, SU_TO_FLOAT(vol));
 }
 
 // SoundManager -----------------------------
-SoundManager::SoundManager()
+SoundManager::SoundManager(unique_ptr<AudioBackend> output) : backend(move(output))
 {
     auto log = spdlog::get("main");
-    //よろしくない
-    if (!BASS_Init(-1, 44100, 0, GetMainWindowHandle(), nullptr)) {
-        log->critical(u8"BASS Libraryの初期化に失敗しました");
+    if (!backend->Initialize()) {
+        log->critical(u8"音声出力の初期化に失敗しました");
         abort();
     }
-    spdlog::get("main")->info(u8"BASS Library初期化終了");
+    spdlog::get("main")->info(u8"音声出力初期化終了");
 }
 
 SoundManager::~SoundManager()
 {
-    BASS_Free();
+    backend->Terminate();
+}
+
+SoundSample *SoundManager::CreateSample(const wstring &fileName, const int maxChannels) const
+{
+    return new SoundSample(backend->LoadSample(fileName, maxChannels));
+}
+
+SoundStream *SoundManager::CreateStream(const wstring &fileName) const
+{
+    return new SoundStream(backend->LoadStream(fileName));
 }
 
-SoundMixerStream *SoundManager::CreateMixerStream()
+SoundMixerStream *SoundManager::CreateMixerStream() const
 {
-    return new SoundMixerStream(2, 44100);
+    return new SoundMixerStream(backend->CreateMixer(2, 44100));
 }
 
 void SoundManager::PlayGlobal(Sound *sound)
 {
-    BASS_ChannelPlay(sound->GetSoundHandle(), FALSE);
+    const auto ch = sound->GetSoundHandle();
+    if (ch) BASS_ChannelPlay(ch, FALSE);
 }
 
 void SoundManager::StopGlobal(Sound *sound)
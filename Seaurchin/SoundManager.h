@@ -1,5 +1,7 @@
 ﻿#pragma once
 
+#include "AudioBackend.h"
+
 class SoundManager;
 
 enum class SoundType {
@@ -31,8 +33,8 @@ public:
     DWORD GetSoundHandle() override;
     void StopSound() override;
     void SetVolume(double vol) override;
+    HSAMPLE GetSampleHandle() const { return hSample; }
 
-    static SoundSample *CreateFromFile(const std::wstring &fileNameW, int maxChannels = 16);
     void SetLoop(bool looping) const;
 };
 
@@ -53,10 +55,9 @@ public:
     void Pause() const;
     void Resume() const;
 
-    static SoundStream *CreateFromFile(const std::wstring &fileNameW);
     double GetPlayingPosition() const;
     void SetPlayingPosition(double pos) const;
-    DWORD GetStatus() const { return BASS_ChannelIsActive(hStream); }
+    DWORD GetStatus() const { return hStream ? BASS_ChannelIsActive(hStream) : BASS_ACTIVE_STOPPED; }
 };
 
 class SoundMixerStream {
@@ -65,7 +66,7 @@ protected:
     std::unordered_set<HCHANNEL> playingSounds;
 
 public:
-    SoundMixerStream(int ch, int freq);
+    explicit SoundMixerStream(HSTREAM mixer);
     ~SoundMixerStream();
 
     void Update();
@@ -76,12 +77,18 @@ public:
 
 class SoundManager final {
 private:
+    const std::unique_ptr<AudioBackend> backend;
 
 public:
-    SoundManager();
+    explicit SoundManager(std::unique_ptr<AudioBackend> output);
     ~SoundManager();
 
-    static SoundMixerStream *CreateMixerStream();
+    AudioBackend* GetBackend() const { return backend.get(); }
+
+    // 読み込みは出力先に任せる 鳴らさない出力では中身のない (何もしない) ものが返る
+    SoundSample *CreateSample(const std::wstring &fileName, int maxChannels = 16) const;
+    SoundStream *CreateStream(const std::wstring &fileName) const;
+    SoundMixerStream *CreateMixerStream() const;
     static void PlayGlobal(Sound *sound);
     static void StopGlobal(Sound *sound);
 };
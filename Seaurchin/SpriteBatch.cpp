@@ -0,0 +1,173 @@
+﻿#include "SpriteBatch.h"
+#include "Profiler.h"
+#include "Misc.h"
+
+using namespace std;
+
+unique_ptr<SpriteBatchBackend> SpriteBatchBackend::CreateDevice()
+{
+    return make_unique<DeviceSpriteBatchBackend>();
+}
+
+unique_ptr<SpriteBatchBackend> SpriteBatchBackend::CreateRecording()
+{
+    return make_unique<RecordingSpriteBatchBackend>();
+}
+
+DeviceSpriteBatchBackend::DeviceSpriteBatchBackend()
+{
+    indices.reserve(SpriteBatch::MaxQuadsPerBatch * 6);
+    for (uint32_t i = 0; i < SpriteBatch::MaxQuadsPerBatch; i++) {
+        const auto base = uint16_t(i * 4);
+        for (const auto offset : { 0, 1, 2, 2, 1, 3 }) indices.push_back(uint16_t(base + offset));
+    }
+}
+
+void DeviceSpriteBatchBackend::Submit(const SpriteBatchKey &key, const VERTEX2D *vertices, const uint32_t quads)
+{
+    // 色と不透明度は頂点に入っている
+    const auto device = RenderDevice::GetCurrent();
+    device->SetBright(255, 255, 255);
+    device->SetBlendMode(key.BlendMode, key.BlendParam);
+    device->DrawPolygon2D(vertices, SU_TO_INT32(quads * 4), indices.data(), SU_TO_INT32(quads * 2), key.Texture, key.Alpha);
+}
+
+void RecordingSpriteBatchBackend::Submit(const SpriteBatchKey &key, const VERTEX2D *vertices, const uint32_t quads)
+{
+    batches.push_back({ key, quads });
+}
+
+SpriteBatch *SpriteBatch::active = nullptr;
+
+SpriteBatch::SpriteBatch(unique_ptr<SpriteBatchBackend> backend) : backend(move(backend))
+{}
+
+SpriteBatch::Immediate::Immediate() : suspended(active)
+{
+    if (!suspended) return;
+    suspended->Flush();
+    suspended->current.ImmediateDraws++;
+    active = nullptr;
+}
+
+SpriteBatch::Immediate::~Immediate()
+{
+    active = suspended;
+}
+
+void SpriteBatch::BeginFrame()
+{
+    current = Statistics();
+}
+
+void SpriteBatch::EndFrame()
+{
+    Flush();
+    last = current;
+    SU_PROFILE_COUNT(DrawCalls, last.Batches + last.ImmediateDraws);
+    SU_PROFILE_COUNT(SpriteQuads, last.Quads);
+}
+
+void SpriteBatch::Begin()
+{
+    active = this;
+    layer = 0;
+}
+
+void SpriteBatch::End()
+{
+    Flush();
+    if (active == this) active = nullptr;
+}
+
+void SpriteBatch::AddQuad(const SpriteBatchKey &key, const VERTEX2D *vertices)
+{
+    auto left = vertices[0].pos.x, right = left;
+    auto top = vertices[0].pos.y, bottom = top;
+    for (auto i = 1; i < 4; i++) {
+        left = min(left, vertices[i].pos.x);
+        right = max(right, vertices[i].pos.x);
+        top = min(top, vertices[i].pos.y);
+        bottom = max(bottom, vertices[i].pos.y);
+    }
+    current.Quads++;
+
+    // 同じキーのバッチまで、間のバッチと重ならない限りさかのぼる
+    Run *target = nullptr;
+    for (size_t i = runCount, steps = 0; i > 0 && steps < LookBehind; --i, ++steps) {
+        auto &run = runs[i - 1];
+        if (run.Layer != layer) break;
+        if (run.Key == key && run.Vertices.size() < MaxQuadsPerBatch * 4) {
+            target = &run;
+            break;
+        }
+        if (left < run.Right && run.Left < right && top < run.Bottom && run.Top < bottom) break;
+    }
+    if (!target) {
+        if (runCount == runs.size()) runs.emplace_back();
+        target = &runs[runCount++];
+        target->Key = key;
+        target->Layer = layer;
+        target->Left = left;
+        target->Top = top;
+        target->Right = right;
+        target->Bottom = bottom;
+        target->Vertices.clear();
+    } else {
+        target->Left = min(target->Left, left);
+        target->Top = min(target->Top, top);
+        target->Right = max(target->Right, right);
+        target->Bottom = max(target->Bottom, bottom);
+    }
+    target->Vertices.insert(target->Vertices.end(), vertices, vertices + 4);
+}
+
+bool SpriteBatch::AddImage(SImage *image, const int srcX, const int srcY, const int srcWidth, const int srcHeight, const Transform2D &tf, const ColorTint &ct, const bool alpha)
+{
+    SpriteTexture texture;
+    if (!image || !image->GetSpriteTexture(&texture)) return false;
+
+    const auto cosAngle = cos(tf.Angle);
+    const auto sinAngle = sin(tf.Angle);
+    const auto u1 = float(texture.OffsetX + srcX) / texture.Width;
+    const auto v1 = float(texture.OffsetY + srcY) / texture.Height;
+    const auto u2 = float(texture.OffsetX + srcX + srcWidth) / texture.Width;
+    const auto v2 = float(texture.OffsetY + srcY + srcHeight) / texture.Height;
+    const float corners[4][4] = {
+        { 0, 0, u1, v1 },
+        { float(srcWidth), 0, u2, v1 },
+        { 0, float(srcHeight), u1, v2 },
+        { float(srcWidth), float(srcHeight), u2, v2 },
+    };
+
+    VERTEX2D vertices[4];
+    for (auto i = 0; i < 4; i++) {
+        // 画像上の原点を中心に拡大・回転して (X, Y) に置く
+        const auto dx = (corners[i][0] - tf.OriginX) * tf.ScaleX;
+        const auto dy = (corners[i][1] - tf.OriginY) * tf.ScaleY;
+        auto &vertex = vertices[i];
+        vertex.pos = VGet(tf.X + dx * cosAngle - dy * sinAngle, tf.Y + dx * sinAngle + dy * cosAngle, 0.0f);
+        vertex.rhw = 1.0f;
+        vertex.dif = GetColorU8(ct.R, ct.G, ct.B, ct.A);
+        vertex.u = corners[i][2];
+        vertex.v = corners[i][3];
+    }
+    AddQuad({ texture.Handle, RenderBlendMode::Alpha, 255, alpha }, vertices);
+    return true;
+}
+
+bool SpriteBatch::AddImage(SImage *image, const Transform2D &tf, const ColorTint &ct, const bool alpha)
+{
+    if (!image) return false;
+    return AddImage(image, 0, 0, image->GetWidth(), image->GetHeight(), tf, ct, alpha);
+}
+
+void SpriteBatch::Flush()
+{
+    for (size_t i = 0; i < runCount; i++) {
+        const auto &run = runs[i];
+        backend->Submit(run.Key, run.Vertices.data(), uint32_t(run.Vertices.size() / 4));
+        current.Batches++;
+    }
+    runCount = 0;
+}
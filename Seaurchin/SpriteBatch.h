@@ -0,0 +1,124 @@
+﻿#pragma once
+
+#include "ScriptSpriteMisc.h"
+#include "ScriptResource.h"
+#include "RenderDevice.h"
+
+// 同じテクスチャ・同じ合成方法の矩形をまとめる単位
+struct SpriteBatchKey {
+    int Texture;
+    RenderBlendMode BlendMode;
+    int BlendParam;
+    bool Alpha;     // テクスチャのアルファを使うか (DrawRotaGraph の TransFlag)
+
+    bool operator==(const SpriteBatchKey &other) const
+    {
+        return Texture == other.Texture && BlendMode == other.BlendMode && BlendParam == other.BlendParam && Alpha == other.Alpha;
+    }
+    bool operator!=(const SpriteBatchKey &other) const { return !(*this == other); }
+};
+
+// まとめた矩形の出力先
+class SpriteBatchBackend {
+public:
+    virtual ~SpriteBatchBackend() = default;
+
+    // vertices は1矩形4頂点 (左上, 右上, 左下, 右下) で quads 個並んでいる
+    virtual void Submit(const SpriteBatchKey &key, const VERTEX2D *vertices, uint32_t quads) = 0;
+
+    static std::unique_ptr<SpriteBatchBackend> CreateDevice();
+    static std::unique_ptr<SpriteBatchBackend> CreateRecording();
+};
+
+// RenderDevice の DrawPolygon2D で描く
+class DeviceSpriteBatchBackend final : public SpriteBatchBackend {
+private:
+    std::vector<uint16_t> indices;
+
+public:
+    DeviceSpriteBatchBackend();
+
+    void Submit(const SpriteBatchKey &key, const VERTEX2D *vertices, uint32_t quads) override;
+};
+
+// 描かずに何が送られたかだけ覚える (計測用)
+class RecordingSpriteBatchBackend final : public SpriteBatchBackend {
+public:
+    struct Batch {
+        SpriteBatchKey Key;
+        uint32_t Quads;
+    };
+
+private:
+    std::vector<Batch> batches;
+
+public:
+    void Submit(const SpriteBatchKey &key, const VERTEX2D *vertices, uint32_t quads) override;
+
+    const std::vector<Batch>& GetBatches() const { return batches; }
+    void Clear() { batches.clear(); }
+};
+
+// スプライトの矩形を溜めて、まとめて描く
+// ScriptScene が Begin/End で挟んだ間だけ有効で、SSprite などはここに矩形を積む
+// 積めない描画 (図形や文字、3D、描画先の切り替えなど) をする間は Immediate を置いておく
+// それまでの分が先に描かれ、その間に描かれるスプライトも積まずにそのまま描かれる
+//
+// 並べ替えは (Z, テクスチャ, 合成方法) の順 ただし Z の違うものや、間にある別の矩形と重なるものは追い越さない
+// (描画結果は1枚ずつ描いたときと変わらない)
+class SpriteBatch final {
+public:
+    static const uint32_t MaxQuadsPerBatch = 16384;     // 16bit のインデックスで届く範囲
+    static const int LookBehind = 16;                   // まとめ先を探すのは直近この数のバッチまで
+
+    class Immediate final {
+    private:
+        SpriteBatch * const suspended;
+
+    public:
+        Immediate();
+        ~Immediate();
+    };
+
+    struct Statistics {
+        uint32_t Quads = 0;
+        uint32_t Batches = 0;           // バックエンドに送った回数
+        uint32_t ImmediateDraws = 0;    // バッチを切ってそのまま描いた回数
+    };
+
+private:
+    struct Run {
+        SpriteBatchKey Key;
+        int32_t Layer;
+        float Left, Top, Right, Bottom;
+        std::vector<VERTEX2D> Vertices;
+    };
+
+    static SpriteBatch *active;
+
+    const std::unique_ptr<SpriteBatchBackend> backend;
+    std::vector<Run> runs;      // 使い回すので有効なのは runCount 個まで
+    size_t runCount = 0;
+    int32_t layer = 0;
+    Statistics current, last;
+
+public:
+    explicit SpriteBatch(std::unique_ptr<SpriteBatchBackend> backend);
+
+    static SpriteBatch* GetActive() { return active; }
+
+    void BeginFrame();
+    void EndFrame();
+    void Begin();
+    void End();
+    void SetLayer(int32_t z) { layer = z; }
+
+    void AddQuad(const SpriteBatchKey &key, const VERTEX2D *vertices);
+    // DrawRectRotaGraph3F と同じ置き方で image の (srcX, srcY, srcWidth, srcHeight) を積む 積めなければ false
+    bool AddImage(SImage *image, int srcX, int srcY, int srcWidth, int srcHeight, const Transform2D &tf, const ColorTint &ct, bool alpha);
+    bool AddImage(SImage *image, const Transform2D &tf, const ColorTint &ct, bool alpha);
+    void Flush();
+
+    SpriteBatchBackend* GetBackend() const { return backend.get(); }
+    const Statistics& GetLastFrameStatistics() const { return last; }
+};
@@ -0,0 +1,368 @@
+﻿#include "SusAnalyzer.h"
+#include "Misc.h"
+
+using namespace std;
+
+// コンパイル済み譜面キャッシュ
+// RenderScoreData 直後の状態(ノーツ、曲線、ハイスピ、BPM)をそのまま書き出しておき、
+// 元譜面のハッシュ、形式のバージョン、解析の設定が一致すれば解析をすっ飛ばして読み込む
+
+namespace
+{
+    const uint32_t compiledChartSignature = 0x43535553;    // "SUSC"
+    const uint32_t compiledChartVersion = 3;                // 形式か解析結果を変えたら上げる
+    // 要素数が残りに収まるかの確認に使う、要素1つあたりの最小バイト数
+    const size_t measureBytes = sizeof(float) + sizeof(double) + sizeof(float);
+    const size_t segmentBytes = sizeof(uint32_t) * 2 + sizeof(double) * 2;
+    const size_t noteBytes = sizeof(uint32_t) + sizeof(int32_t) * 2 + sizeof(uint8_t) + sizeof(float) * 3 + sizeof(double) * 5 + sizeof(uint8_t) + sizeof(uint32_t);   // 曲線も子ノーツもないもの
+
+    // 共有されているオブジェクトを通し番号にする(未登録なら登録する)
+    template<typename T>
+    int32_t RegisterIndex(unordered_map<T*, int32_t> &indices, vector<T*> &list, const shared_ptr<T> &item)
+    {
+        if (!item) return -1;
+        const auto it = indices.find(item.get());
+        if (it != indices.end()) return it->second;
+        const auto index = SU_TO_INT32(list.size());
+        indices[item.get()] = index;
+        list.push_back(item.get());
+        return index;
+    }
+
+    template<typename T>
+    bool ResolveIndex(const vector<shared_ptr<T>> &list, const int32_t index, shared_ptr<T> &result)
+    {
+        if (index < 0) {
+            result = nullptr;
+            return true;
+        }
+        if (SU_TO_UINT32(index) >= list.size()) return false;
+        result = list[index];
+        return true;
+    }
+
+    void WriteMetaData(ostream &stream, const SusMetaData &meta)
+    {
+        WriteBinaryString(stream, meta.UTitle);
+        WriteBinaryString(stream, meta.USubTitle);
+        WriteBinaryString(stream, meta.UArtist);
+        WriteBinaryString(stream, meta.UJacketFileName);
+        WriteBinaryString(stream, meta.UDesigner);
+        WriteBinaryString(stream, meta.USongId);
+        WriteBinaryString(stream, meta.UWaveFileName);
+        WriteBinaryString(stream, meta.UBackgroundFileName);
+        WriteBinaryString(stream, meta.UMovieFileName);
+        WriteBinaryValue(stream, meta.WaveOffset);
+        WriteBinaryValue(stream, meta.MovieOffset);
+        WriteBinaryValue(stream, meta.BaseBpm);
+        WriteBinaryValue(stream, meta.ShowBpm);
+        WriteBinaryValue(stream, meta.ScoreDuration);
+        WriteBinaryValue(stream, SU_TO_INT32(meta.SegmentsPerSecond));
+        WriteBinaryValue(stream, meta.Level);
+        WriteBinaryValue(stream, meta.DifficultyType);
+        WriteBinaryString(stream, meta.UExtraDifficulty);
+        WriteBinaryValue(stream, SU_TO_UINT32(meta.ExtraFlags.to_ulong()));
+    }
+
+    bool ReadMetaData(istream &stream, SusMetaData &meta)
+    {
+        int32_t segmentsPerSecond;
+        uint32_t extraFlags;
+        const auto succeeded = ReadBinaryString(stream, meta.UTitle)
+            && ReadBinaryString(stream, meta.USubTitle)
+            && ReadBinaryString(stream, meta.UArtist)
+            && ReadBinaryString(stream, meta.UJacketFileName)
+            && ReadBinaryString(stream, meta.UDesigner)
+            && ReadBinaryString(stream, meta.USongId)
+            && ReadBinaryString(stream, meta.UWaveFileName)
+            && ReadBinaryString(stream, meta.UBackgroundFileName)
+            && ReadBinaryString(stream, meta.UMovieFileName)
+            && ReadBinaryValue(stream, meta.WaveOffset)
+            && ReadBinaryValue(stream, meta.MovieOffset)
+            && ReadBinaryValue(stream, meta.BaseBpm)
+            && ReadBinaryValue(stream, meta.ShowBpm)
+            && ReadBinaryValue(stream, meta.ScoreDuration)
+            && ReadBinaryValue(stream, segmentsPerSecond)
+            && ReadBinaryValue(stream, meta.Level)
+            && ReadBinaryValue(stream, meta.DifficultyType)
+            && ReadBinaryString(stream, meta.UExtraDifficulty)
+            && ReadBinaryValue(stream, extraFlags);
+        if (!succeeded) return false;
+        meta.SegmentsPerSecond = segmentsPerSecond;
+        meta.ExtraFlags = bitset<8>(extraFlags);
+        return true;
+    }
+}
+
+// 譜面の外から与えられて解析結果を変える設定 (曲線の許容誤差、譜面で指定されなかったときの既定値)
+uint32_t SusAnalyzer::CalculateSettingsHash() const
+{
+    boost::crc_32_type crc;
+    crc.process_bytes(&curveTolerance, sizeof(curveTolerance));
+    crc.process_bytes(&defaultBeats, sizeof(defaultBeats));
+    crc.process_bytes(&defaultBpm, sizeof(defaultBpm));
+    return crc.checksum();
+}
+
+void SusAnalyzer::SaveCompiledChart(const wstring &fileName, const uint32_t sourceHash, const DrawableNotesList &data, const NoteCurvesList &curveData) const
+{
+    // 共有されているタイムラインとアトリビュートを先に集めておく
+    unordered_map<SusHispeedTimeline*, int32_t> timelineIndices;
+    vector<SusHispeedTimeline*> timelines;
+    unordered_map<SusNoteExtraAttribute*, int32_t> attributeIndices;
+    vector<SusNoteExtraAttribute*> attributes;
+    const auto registerNote = [&](const shared_ptr<SusDrawableNoteData> &note) {
+        RegisterIndex(timelineIndices, timelines, note->Timeline);
+        if (RegisterIndex(attributeIndices, attributes, note->ExtraAttribute) >= 0) {
+            RegisterIndex(timelineIndices, timelines, note->ExtraAttribute->RollTimeline);
+        }
+    };
+    for (const auto &note : data) {
+        registerNote(note);
+        for (const auto &extra : note->ExtraData) registerNote(extra);
+    }
+
+    // 書きかけのキャッシュを次回読み込まないよう、書き切ってから置き換える
+    WriteFileAtomically(fileName, [&](ostream &stream) {
+        WriteBinaryValue(stream, compiledChartSignature);
+        WriteBinaryValue(stream, compiledChartVersion);
+        WriteBinaryValue(stream, CalculateSettingsHash());
+        WriteBinaryValue(stream, sourceHash);
+
+        WriteMetaData(stream, SharedMetaData);
+
+        // BPM・拍数
+        WriteBinaryValue(stream, ticksPerBeat);
+        WriteBinaryValue(stream, SU_TO_UINT32(beatsDefinitions.size()));
+        for (const auto &beats : beatsDefinitions) {
+            WriteBinaryValue(stream, beats.first);
+            WriteBinaryValue(stream, beats.second);
+        }
+        WriteBinaryValue(stream, tempoMap.ticksPerBeat);
+        WriteBinaryValue(stream, tempoMap.defaultBpm);
+        WriteBinaryValue(stream, SU_TO_UINT32(tempoMap.measures.size()));
+        for (const auto &measure : tempoMap.measures) {
+            WriteBinaryValue(stream, measure.Beats);
+            WriteBinaryValue(stream, measure.StartTime);
+            WriteBinaryValue(stream, measure.StartTicks);
+        }
+        WriteBinaryValue(stream, SU_TO_UINT32(tempoMap.segments.size()));
+        for (const auto &segment : tempoMap.segments) {
+            WriteBinaryValue(stream, segment.Time.Measure);
+            WriteBinaryValue(stream, segment.Time.Tick);
+            WriteBinaryValue(stream, segment.StartTime);
+            WriteBinaryValue(stream, segment.Bpm);
+        }
+        WriteBinaryValue(stream, SU_TO_UINT32(SharedBpmChanges.size()));
+        for (const auto &bpmChange : SharedBpmChanges) {
+            WriteBinaryValue(stream, get<0>(bpmChange));
+            WriteBinaryValue(stream, get<1>(bpmChange));
+        }
+
+        // ハイスピ(Finialize済みなので data だけ持てばよい)
+        WriteBinaryValue(stream, SU_TO_UINT32(timelines.size()));
+        for (const auto timeline : timelines) {
+            WriteBinaryValue(stream, SU_TO_UINT32(timeline->data.size()));
+            for (const auto &point : timeline->data) {
+                WriteBinaryValue(stream, get<0>(point));
+                WriteBinaryValue(stream, get<1>(point));
+                WriteBinaryValue(stream, SU_TO_INT32(get<2>(point).VisibilityState));
+                WriteBinaryValue(stream, get<2>(point).Speed);
+            }
+        }
+
+        WriteBinaryValue(stream, SU_TO_UINT32(attributes.size()));
+        for (const auto attribute : attributes) {
+            WriteBinaryValue(stream, attribute->Priority);
+            WriteBinaryValue(stream, attribute->RollHispeedNumber);
+            WriteBinaryValue(stream, RegisterIndex(timelineIndices, timelines, attribute->RollTimeline));
+            WriteBinaryValue(stream, attribute->HeightScale);
+        }
+
+        // ノーツ 子ノーツはその親の直後に書く
+        const function<void(const shared_ptr<SusDrawableNoteData>&)> writeNote = [&](const shared_ptr<SusDrawableNoteData> &note) {
+            WriteBinaryValue(stream, SU_TO_UINT32(note->Type.to_ulong()));
+            WriteBinaryValue(stream, RegisterIndex(timelineIndices, timelines, note->Timeline));
+            WriteBinaryValue(stream, RegisterIndex(attributeIndices, attributes, note->ExtraAttribute));
+            WriteBinaryValue(stream, SU_TO_UINT8(note->OnTheFlyData.to_ulong()));
+            WriteBinaryValue(stream, note->StartLane);
+            WriteBinaryValue(stream, note->Length);
+            WriteBinaryValue(stream, note->CenterAtZero);
+            WriteBinaryValue(stream, note->ModifiedPosition);
+            WriteBinaryValue(stream, note->StartTimeEx);
+            WriteBinaryValue(stream, note->DurationEx);
+            WriteBinaryValue(stream, note->StartTime);
+            WriteBinaryValue(stream, note->Duration);
+
+            const auto curve = curveData.Find(note.get());
+            WriteBinaryValue(stream, SU_TO_UINT8(!curve.empty()));
+            if (!curve.empty()) {
+                WriteBinaryValue(stream, SU_TO_UINT32(curve.size()));
+                for (const auto &point : curve) {
+                    WriteBinaryValue(stream, get<0>(point));
+                    WriteBinaryValue(stream, get<1>(point));
+                }
+            }
+
+            WriteBinaryValue(stream, SU_TO_UINT32(note->ExtraData.size()));
+            for (const auto &extra : note->ExtraData) writeNote(extra);
+        };
+        WriteBinaryValue(stream, SU_TO_UINT32(data.size()));
+        for (const auto &note : data) writeNote(note);
+        return bool(stream);
+    });
+}
+
+bool SusAnalyzer::LoadCompiledChart(const wstring &fileName, const uint32_t sourceHash, DrawableNotesList &data, NoteCurvesList &curveData)
+{
+    Reset();
+    data.clear();
+    curveData.Clear();
+
+    ifstream file(fileName, ios::in | ios::binary);
+    if (!file) return false;
+    stringstream stream;
+    stream << file.rdbuf();
+    file.close();
+
+    uint32_t signature, version, settingsHash, hash;
+    if (!ReadBinaryValue(stream, signature) || signature != compiledChartSignature) return false;
+    if (!ReadBinaryValue(stream, version) || version != compiledChartVersion) return false;
+    // 曲線の分割数などが変わるので、解析の設定が違えば作り直す
+    if (!ReadBinaryValue(stream, settingsHash) || settingsHash != CalculateSettingsHash()) return false;
+    if (!ReadBinaryValue(stream, hash) || hash != sourceHash) return false;
+
+    const auto fail = [&] {
+        spdlog::get("main")->warn(u8"コンパイル済み譜面が壊れているため解析しなおします");
+        Reset();
+        data.clear();
+        curveData.Clear();
+        return false;
+    };
+    uint32_t count;
+
+    if (!ReadMetaData(stream, SharedMetaData)) return fail();
+
+    // BPM・拍数
+    if (!ReadBinaryValue(stream, ticksPerBeat)) return fail();
+    if (!ReadBinaryValue(stream, count)) return fail();
+    beatsDefinitions.clear();
+    for (auto i = 0u; i < count; i++) {
+        uint32_t measure;
+        float beats;
+        if (!ReadBinaryValue(stream, measure) || !ReadBinaryValue(stream, beats)) return fail();
+        beatsDefinitions[measure] = beats;
+    }
+    if (!ReadBinaryValue(stream, tempoMap.ticksPerBeat) || !ReadBinaryValue(stream, tempoMap.defaultBpm)) return fail();
+    if (!ReadBinaryCount(stream, count, measureBytes) || !count) return fail();
+    tempoMap.measures.resize(count);
+    for (auto &measure : tempoMap.measures) {
+        if (!ReadBinaryValue(stream, measure.Beats) || !ReadBinaryValue(stream, measure.StartTime) || !ReadBinaryValue(stream, measure.StartTicks)) return fail();
+    }
+    if (!ReadBinaryCount(stream, count, segmentBytes)) return fail();
+    tempoMap.segments.resize(count);
+    for (auto &segment : tempoMap.segments) {
+        const auto succeeded = ReadBinaryValue(stream, segment.Time.Measure)
+            && ReadBinaryValue(stream, segment.Time.Tick)
+            && ReadBinaryValue(stream, segment.StartTime)
+            && ReadBinaryValue(stream, segment.Bpm);
+        if (!succeeded) return fail();
+    }
+    if (!ReadBinaryValue(stream, count)) return fail();
+    for (auto i = 0u; i < count; i++) {
+        double time, bpm;
+        if (!ReadBinaryValue(stream, time) || !ReadBinaryValue(stream, bpm)) return fail();
+        SharedBpmChanges.emplace_back(time, bpm);
+    }
+
+    // ハイスピ
+    if (!ReadBinaryValue(stream, count)) return fail();
+    vector<shared_ptr<SusHispeedTimeline>> timelines;
+    for (auto i = 0u; i < count; i++) {
+        auto timeline = make_shared<SusHispeedTimeline>([&](const uint32_t m, const uint32_t t) { return GetAbsoluteTime(m, t); });
+        timeline->keys.clear();
+        uint32_t points;
+        if (!ReadBinaryValue(stream, points) || !points) return fail();
+        for (auto j = 0u; j < points; j++) {
+            double time, position, speed;
+            int32_t visibility;
+            const auto succeeded = ReadBinaryValue(stream, time)
+                && ReadBinaryValue(stream, position)
+                && ReadBinaryValue(stream, visibility)
+                && ReadBinaryValue(stream, speed);
+            if (!succeeded) return fail();
+            timeline->data.emplace_back(time, position, SusHispeedData(SusHispeedData::Visibility(visibility), speed));
+        }
+        timelines.push_back(timeline);
+    }
+
+    if (!ReadBinaryValue(stream, count)) return fail();
+    vector<shared_ptr<SusNoteExtraAttribute>> attributes;
+    for (auto i = 0u; i < count; i++) {
+        auto attribute = make_shared<SusNoteExtraAttribute>();
+        int32_t rollTimeline;
+        const auto succeeded = ReadBinaryValue(stream, attribute->Priority)
+            && ReadBinaryValue(stream, attribute->RollHispeedNumber)
+            && ReadBinaryValue(stream, rollTimeline)
+            && ResolveIndex(timelines, rollTimeline, attribute->RollTimeline)
+            && ReadBinaryValue(stream, attribute->HeightScale);
+        if (!succeeded) return fail();
+        attributes.push_back(attribute);
+    }
+
+    // ノーツ
+    const function<shared_ptr<SusDrawableNoteData>()> readNote = [&]() -> shared_ptr<SusDrawableNoteData> {
+        auto note = make_shared<SusDrawableNoteData>();
+        uint32_t type;
+        int32_t timeline, attribute;
+        uint8_t onTheFlyData, hasCurve;
+        auto succeeded = ReadBinaryValue(stream, type)
+            && ReadBinaryValue(stream, timeline)
+            && ResolveIndex(timelines, timeline, note->Timeline)
+            && ReadBinaryValue(stream, attribute)
+            && ResolveIndex(attributes, attribute, note->ExtraAttribute)
+            && ReadBinaryValue(stream, onTheFlyData)
+            && ReadBinaryValue(stream, note->StartLane)
+            && ReadBinaryValue(stream, note->Length)
+            && ReadBinaryValue(stream, note->CenterAtZero)
+            && ReadBinaryValue(stream, note->ModifiedPosition)
+            && ReadBinaryValue(stream, note->StartTimeEx)
+            && ReadBinaryValue(stream, note->DurationEx)
+            && ReadBinaryValue(stream, note->StartTime)
+            && ReadBinaryValue(stream, note->Duration)
+            && ReadBinaryValue(stream, hasCurve);
+        if (!succeeded) return nullptr;
+        note->Type = bitset<32>(type);
+        note->OnTheFlyData = bitset<8>(onTheFlyData);
+
+        if (hasCurve) {
+            uint32_t points;
+            if (!ReadBinaryValue(stream, points)) return nullptr;
+            for (auto i = 0u; i < points; i++) {
+                double time, position;
+                if (!ReadBinaryValue(stream, time) || !ReadBinaryValue(stream, position)) return nullptr;
+                curveData.AddPoint(time, position);
+            }
+            curveData.EndCurve(note.get());
+        }
+
+        uint32_t extras;
+        if (!ReadBinaryCount(stream, extras, noteBytes)) return nullptr;
+        note->ExtraData.reserve(extras);
+        for (auto i = 0u; i < extras; i++) {
+            auto extra = readNote();
+            if (!extra) return nullptr;
+            note->ExtraData.push_back(extra);
+        }
+        return note;
+    };
+    if (!ReadBinaryCount(stream, count, noteBytes)) return fail();
+    data.reserve(count);
+    for (auto i = 0u; i < count; i++) {
+        auto note = readNote();
+        if (!note) return fail();
+        data.push_back(note);
+    }
+
+    return true;
+}
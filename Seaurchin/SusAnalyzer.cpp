@@ -6,12 +6,105 @@ using namespace std;
 using namespace crc32_constexpr;
 namespace b = boost;
 namespace ba = boost::algorithm;
-namespace xp = boost::xpressive;
 
-xp::sregex SusAnalyzer::regexSusCommand = "#" >> (xp::s1 = +xp::alnum) >> !(+xp::space >> (xp::s2 = +(~xp::_n)));
-xp::sregex SusAnalyzer::regexSusData = "#" >> (xp::s1 = xp::repeat<3, 3>(xp::alnum)) >> (xp::s2 = xp::repeat<2, 3>(xp::alnum)) >> ":" >> *xp::space >> (xp::s3 = +(~xp::_n));
+namespace
+{
+    // 1行分の字句解析結果 各値は読み込んだバッファ内の範囲を指す
+    struct SusLineToken {
+        const char *Name, *NameEnd;
+        const char *Lane, *LaneEnd;     // データ行のみ
+        const char *Value, *ValueEnd;
+    };
+
+    bool IsAsciiAlnum(const char c)
+    {
+        return (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+    }
+
+    bool IsAsciiSpace(const char c)
+    {
+        return c == ' ' || (c >= '\t' && c <= '\r');
+    }
+
+    bool IsAllNumeric(const string &str)
+    {
+        return !str.empty() && all_of(str.begin(), str.end(), [](const char c) { return c >= '0' && c <= '9'; });
+    }
+
+    // 区切りの空白を読み飛ばした残りを値とする
+    // 残りが全部空白なら最後の1文字を値として残す(値は1文字以上必要)
+    bool SkipSpacesToValue(const char *begin, const char *end, const char *&value)
+    {
+        if (begin == end) return false;
+        value = find_if_not(begin, end, IsAsciiSpace);
+        if (value == end) --value;
+        return true;
+    }
+
+    // #名前 値
+    bool TokenizeSusCommand(const char *begin, const char *end, SusLineToken &token)
+    {
+        auto p = begin + 1;
+        token.Name = p;
+        while (p != end && IsAsciiAlnum(*p)) ++p;
+        token.NameEnd = p;
+        if (token.Name == token.NameEnd) return false;
+        if (p == end) {
+            token.Value = token.ValueEnd = end;
+            return true;
+        }
+        if (!IsAsciiSpace(*p)) return false;
+        token.ValueEnd = end;
+        return SkipSpacesToValue(p + 1, end, token.Value);
+    }
+
+    // #mmmLL: 値 (mmm: 英数3文字、LL: 英数2~3文字)
+    bool TokenizeSusData(const char *begin, const char *end, SusLineToken &token)
+    {
+        const auto name = begin + 1;
+        auto alnums = 0;
+        while (name + alnums != end && alnums < 6 && IsAsciiAlnum(name[alnums])) ++alnums;
+        const auto colon = name + alnums;
+        if (alnums < 5 || colon == end || *colon != ':') return false;
+
+        token.Name = name;
+        token.NameEnd = token.Lane = name + 3;
+        token.LaneEnd = colon;
+        token.ValueEnd = end;
+        return SkipSpacesToValue(colon + 1, end, token.Value);
+    }
+
+    // ロングノーツ種類(Hold/Slide/AirAction のビット)とチャンネルから索引キーを作る
+    uint64_t MakeLongNoteKey(const unsigned long longBits, const uint32_t channel)
+    {
+        return (uint64_t(longBits & SU_NOTE_LONG_MASK) << 32) | channel;
+    }
+
+    // 小節・tickから索引キーを作る(正規化はしない、比較は生の値で行うため)
+    uint64_t MakeTimeKey(const SusRelativeNoteTime &time)
+    {
+        return (uint64_t(time.Measure) << 32) | time.Tick;
+    }
 
-static xp::sregex allNumeric = xp::bos >> +(xp::digit) >> xp::eos;
+    const int maxCurveDepth = 10;   // 区間1つを最大で2^10分割する
+
+    // 曲線の t = from ~ to を、折れ線との誤差が tolerance に収まるまで二分して to 側の点を足していく (from 側は足してある前提)
+    void SubdivideBezier(
+        const SusBezierCurve &curve, const double tolerance,
+        const double from, const tuple<double, double> &fromPoint,
+        const double to, const tuple<double, double> &toPoint,
+        const int depth, NoteCurvesList &curveData)
+    {
+        if (depth < maxCurveDepth && curve.GetChordErrorBound(from, fromPoint, to, toPoint) > tolerance) {
+            const auto middle = (from + to) / 2;
+            const auto middlePoint = curve.Evaluate(middle);
+            SubdivideBezier(curve, tolerance, from, fromPoint, middle, middlePoint, depth + 1, curveData);
+            SubdivideBezier(curve, tolerance, middle, middlePoint, to, toPoint, depth + 1, curveData);
+            return;
+        }
+        curveData.AddPoint(get<0>(toPoint), get<1>(toPoint));
+    }
+}
 
 auto toUpper = [](const char c) {
     return (c >= 'a' && c <= 'z') ? char(c - 0x20) : c;
@@ -71,7 +164,13 @@ SusAnalyzer::SusAnalyzer(const uint32_t tpb)
     , measureCountOffset(0)
     , longNoteChannelOffset(0)
     , longInjectionPerBeat(2)
-{}
+    , curveTolerance(0)
+{
+    errorCallbacks.emplace_back([](auto type, auto message) {
+        auto log = spdlog::get("main");
+        log->error(message);
+    });
+}
 
 SusAnalyzer::~SusAnalyzer()
 {
@@ -80,12 +179,6 @@ SusAnalyzer::~SusAnalyzer()
 
 void SusAnalyzer::Reset()
 {
-    errorCallbacks.clear();
-    errorCallbacks.emplace_back([](auto type, auto message) {
-        auto log = spdlog::get("main");
-        log->error(message);
-    });
-
     ticksPerBeat = 192;
     longInjectionPerBeat = 2;
     measureCountOffset = 0;
@@ -99,6 +192,7 @@ void SusAnalyzer::Reset()
     extraAttributes.clear();
 
     bpmChanges.clear();
+    tempoMap = SusTempoMap();
 
     SharedMetaData.Reset();
     SharedBpmChanges.clear();
@@ -129,98 +223,142 @@ void SusAnalyzer::SetMessageCallBack(const function<void(string, string)>& func)
 void SusAnalyzer::LoadFromFile(const wstring &fileName, const bool analyzeOnlyMetaData)
 {
     auto log = spdlog::get("main");
-    ifstream file;
-    string rawline;
-    xp::smatch match;
     uint32_t line = 0;
 
     Reset();
     if (!analyzeOnlyMetaData) log->info(u8"{0}の解析を開始…", ConvertUnicodeToUTF8(fileName));
 
-    file.open(fileName, ios::in);
+    ifstream file(fileName, ios::in | ios::binary);
+    const string buffer((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    file.close();
 
-    char bom[3] = { 0 };
-    file.read(bom, 3);
-    if (file.gcount() != 3 || bom[0] != char(0xEF) || bom[1] != char(0xBB) || bom[2] != char(0xBF)) file.seekg(0);
+    auto cursor = buffer.data();
+    const auto bufferEnd = cursor + buffer.size();
+    if (buffer.size() >= 3 && buffer[0] == char(0xEF) && buffer[1] == char(0xBB) && buffer[2] == char(0xBF)) cursor += 3;
 
-    while (getline(file, rawline)) {
+    // 行ごとに確保しなおさないよう使い回す
+    string name, lane, value;
+    SusLineToken token = {};
+    while (cursor != bufferEnd) {
         ++line;
-        if (rawline.empty() || rawline[0] != '#') continue;
-
-        if (xp::regex_match(rawline, match, regexSusCommand)) {
-            ProcessCommand(match, analyzeOnlyMetaData, line);
-        } else if (xp::regex_match(rawline, match, regexSusData)) {
-            if (!analyzeOnlyMetaData || boost::starts_with(rawline, "#BPM")) ProcessData(match, line);
+        // 改行は CRLF・LF・CR のどれでもよい 行の中に CR は残さない
+        const auto lineBegin = cursor;
+        const auto lineEnd = find_if(cursor, bufferEnd, [](const char c) { return c == '\n' || c == '\r'; });
+        cursor = lineEnd;
+        if (cursor != bufferEnd && *cursor++ == '\r' && cursor != bufferEnd && *cursor == '\n') ++cursor;
+        if (lineBegin == lineEnd || *lineBegin != '#') continue;
+
+        if (TokenizeSusCommand(lineBegin, lineEnd, token)) {
+            name.assign(token.Name, token.NameEnd);
+            value.assign(token.Value, token.ValueEnd);
+            ProcessCommand(name, value, analyzeOnlyMetaData, line);
+        } else if (TokenizeSusData(lineBegin, lineEnd, token)) {
+            if (analyzeOnlyMetaData && !ba::starts_with(boost::make_iterator_range(lineBegin, lineEnd), "#BPM")) continue;
+            name.assign(token.Name, token.NameEnd);
+            lane.assign(token.Lane, token.LaneEnd);
+            value.clear();
+            remove_copy(token.Value, token.ValueEnd, back_inserter(value), ' ');
+            ProcessData(name, lane, value, line);
         } else {
             MakeMessage(line, u8"SUS有効行ですが解析できませんでした。");
         }
     }
-    file.close();
 
     if (!analyzeOnlyMetaData) log->info(u8"…終了");
-    if (!analyzeOnlyMetaData) {
-        // いい感じにソート
-        stable_sort(notes.begin(), notes.end(), [](tuple<SusRelativeNoteTime, SusRawNoteData> a, tuple<SusRelativeNoteTime, SusRawNoteData> b) {
-            const auto &at = get<0>(a);
-            const auto &bt = get<0>(b);
-
-            return at < bt || (at == bt && get<1>(a).Type.to_ulong() > get<1>(b).Type.to_ulong());
-        });
-
-        // 小節線ノーツ
-        // この時点でケツは最終ノーツのはず
-        const auto lastMeasure = get<0>(notes[notes.size() - 1]).Measure + 2;
-        for (auto i = 0u; i <= lastMeasure; i++) {
-            SusRawNoteData ml;
-            SusRelativeNoteTime t = { i, 0 };
-            ml.Type.set(size_t(SusNoteType::MeasureLine));
-            ml.Timeline = hispeedToMeasure;
-            ml.ExtraAttribute = extraAttributes[defaultExtraAttributeNumber];
-            notes.emplace_back(t, ml);
-        }
+    if (!analyzeOnlyMetaData) FinishLoading();
+}
 
-        copy_if(notes.begin(), notes.end(), back_inserter(bpmChanges), [](tuple<SusRelativeNoteTime, SusRawNoteData> n) {
-            return get<1>(n).Type.test(size_t(SusNoteType::Undefined));
-        });
-        if (bpmChanges.empty()) {
-            SusRawNoteData noteData;
-            SusRelativeNoteTime time = { 0, 0 };
-            noteData.Type.set(size_t(SusNoteType::Undefined));
-            noteData.DefinitionNumber = 1; // リセット時にbpmDefinitions[1]が設定されていることより、1は必ず有効であると仮定している。(0 basedじゃないのはなぜ?)
-            bpmChanges.emplace_back(time, noteData);
+void SusAnalyzer::LoadFromLines(const vector<SusTokenizedLine> &lines)
+{
+    Reset();
+    for (const auto &line : lines) {
+        switch (line.LineKind) {
+            case SusTokenizedLine::Kind::Command:
+                ProcessCommand(line.Name, line.Value, false, line.Line);
+                break;
+            case SusTokenizedLine::Kind::Data:
+                ProcessData(line.Name, line.Lane, line.Value, line.Line);
+                break;
+            default:
+                MakeMessage(line.Line, u8"SUS有効行ですが解析できませんでした。");
+                break;
         }
+    }
+    FinishLoading();
+}
 
-        for (auto &hs : hispeedDefinitions) hs.second->Finialize();
-        if (SharedMetaData.BaseBpm == 0) SharedMetaData.BaseBpm = GetBpmAt(0, 0);
-        for (const auto& bpm : bpmChanges) {
-            SusRelativeNoteTime t = {};
-            SusRawNoteData d = {};
-            tie(t, d) = bpm;
-            SharedBpmChanges.emplace_back(GetAbsoluteTime(t.Measure, t.Tick), bpmDefinitions[d.DefinitionNumber]);
-        }
+// 全行を読んだ後に、ノーツを並べて小節線とテンポマップを作る
+void SusAnalyzer::FinishLoading()
+{
+    // いい感じにソート
+    stable_sort(notes.begin(), notes.end(), [](tuple<SusRelativeNoteTime, SusRawNoteData> a, tuple<SusRelativeNoteTime, SusRawNoteData> b) {
+        const auto &at = get<0>(a);
+        const auto &bt = get<0>(b);
+
+        return at < bt || (at == bt && get<1>(a).Type.to_ulong() > get<1>(b).Type.to_ulong());
+    });
+
+    // 小節線ノーツ
+    // この時点でケツは最終ノーツのはず
+    const auto lastMeasure = get<0>(notes[notes.size() - 1]).Measure + 2;
+    for (auto i = 0u; i <= lastMeasure; i++) {
+        SusRawNoteData ml;
+        SusRelativeNoteTime t = { i, 0 };
+        ml.Type.set(size_t(SusNoteType::MeasureLine));
+        ml.Timeline = hispeedToMeasure;
+        ml.ExtraAttribute = extraAttributes[defaultExtraAttributeNumber];
+        notes.emplace_back(t, ml);
+    }
+
+    copy_if(notes.begin(), notes.end(), back_inserter(bpmChanges), [](tuple<SusRelativeNoteTime, SusRawNoteData> n) {
+        return get<1>(n).Type.test(size_t(SusNoteType::Undefined));
+    });
+    if (bpmChanges.empty()) {
+        SusRawNoteData noteData;
+        SusRelativeNoteTime time = { 0, 0 };
+        noteData.Type.set(size_t(SusNoteType::Undefined));
+        noteData.DefinitionNumber = 1; // リセット時にbpmDefinitions[1]が設定されていることより、1は必ず有効であると仮定している。(0 basedじゃないのはなぜ?)
+        bpmChanges.emplace_back(time, noteData);
+    }
+
+    vector<tuple<SusRelativeNoteTime, double>> resolvedBpmChanges;
+    for (const auto &bc : bpmChanges) {
+        const auto bpmDefinition = bpmDefinitions.find(get<1>(bc).DefinitionNumber);
+        if (bpmDefinition == bpmDefinitions.end()) continue;
+        resolvedBpmChanges.emplace_back(get<0>(bc), bpmDefinition->second);
+    }
+    tempoMap.Compile(ticksPerBeat, beatsDefinitions, resolvedBpmChanges, defaultBeats, defaultBpm);
+
+    for (auto &hs : hispeedDefinitions) hs.second->Finialize();
+    if (SharedMetaData.BaseBpm == 0) SharedMetaData.BaseBpm = GetBpmAt(0, 0);
+    for (const auto& bpm : bpmChanges) {
+        SusRelativeNoteTime t = {};
+        SusRawNoteData d = {};
+        tie(t, d) = bpm;
+        SharedBpmChanges.emplace_back(GetAbsoluteTime(t.Measure, t.Tick), bpmDefinitions[d.DefinitionNumber]);
     }
 }
 
-void SusAnalyzer::ProcessCommand(const xp::smatch &result, const bool onlyMeta, const uint32_t line)
+void SusAnalyzer::ProcessCommand(const string &command, const string &value, const bool onlyMeta, const uint32_t line)
 {
-    auto name = result[1].str();
+    auto name = command;
     transform(name.cbegin(), name.cend(), name.begin(), toUpper);
     switch (Crc32Rec(0xffffffff, name.c_str())) {
         case "TITLE"_crc32:
-            SharedMetaData.UTitle = convertRawString(result[2]);
+            SharedMetaData.UTitle = convertRawString(value);
             break;
         case "SUBTITLE"_crc32:
-            SharedMetaData.USubTitle = convertRawString(result[2]);
+            SharedMetaData.USubTitle = convertRawString(value);
             break;
         case "ARTIST"_crc32:
-            SharedMetaData.UArtist = convertRawString(result[2]);
+            SharedMetaData.UArtist = convertRawString(value);
             break;
         case "GENRE"_crc32:
-            // SharedMetaData.UGenre = ConvertRawString(result[2]);
+            // SharedMetaData.UGenre = ConvertRawString(value);
             break;
         case "DESIGNER"_crc32:
         case "SUBARTIST"_crc32:  // BMS互換
-            SharedMetaData.UDesigner = convertRawString(result[2]);
+            SharedMetaData.UDesigner = convertRawString(value);
             break;
         case "PLAYLEVEL"_crc32: {
             if (SharedMetaData.DifficultyType == 4) {
@@ -228,7 +366,7 @@ void SusAnalyzer::ProcessCommand(const xp::smatch &result, const bool onlyMeta,
                 break;
             }
 
-            string lstr = result[2];
+            string lstr = value;
             const auto pluspos = lstr.find('+');
             if (pluspos != string::npos) {
                 SharedMetaData.UExtraDifficulty = u8"+";
@@ -240,9 +378,9 @@ void SusAnalyzer::ProcessCommand(const xp::smatch &result, const bool onlyMeta,
             break;
         }
         case "DIFFICULTY"_crc32: {
-            if (xp::regex_match(result[2], allNumeric)) {
+            if (IsAllNumeric(value)) {
                 //通常記法
-                const auto difficultyType = ConvertInteger(result[2]);
+                const auto difficultyType = ConvertInteger(value);
                 if (difficultyType < 0 || 3 < difficultyType) {
                     MakeMessage(line, u8"不明な難易度指定です。");
                     break;
@@ -258,7 +396,7 @@ void SusAnalyzer::ProcessCommand(const xp::smatch &result, const bool onlyMeta,
                 SharedMetaData.DifficultyType = difficultyType;
             } else {
                 //WE記法
-                auto dd = convertRawString(result[2]);
+                auto dd = convertRawString(value);
                 vector<string> params;
                 ba::split(params, dd, ba::is_any_of(":"));
                 if (params.size() < 2) {
@@ -272,37 +410,37 @@ void SusAnalyzer::ProcessCommand(const xp::smatch &result, const bool onlyMeta,
             break;
         }
         case "SONGID"_crc32:
-            SharedMetaData.USongId = convertRawString(result[2]);
+            SharedMetaData.USongId = convertRawString(value);
             break;
         case "WAVE"_crc32:
-            SharedMetaData.UWaveFileName = convertRawString(result[2]);
+            SharedMetaData.UWaveFileName = convertRawString(value);
             break;
         case "WAVEOFFSET"_crc32:
-            SharedMetaData.WaveOffset = ConvertFloat(result[2]);
+            SharedMetaData.WaveOffset = ConvertFloat(value);
             break;
         case "MOVIE"_crc32:
-            SharedMetaData.UMovieFileName = convertRawString(result[2]);
+            SharedMetaData.UMovieFileName = convertRawString(value);
             break;
         case "MOVIEOFFSET"_crc32:
-            SharedMetaData.MovieOffset = ConvertFloat(result[2]);
+            SharedMetaData.MovieOffset = ConvertFloat(value);
             break;
         case "JACKET"_crc32:
-            SharedMetaData.UJacketFileName = convertRawString(result[2]);
+            SharedMetaData.UJacketFileName = convertRawString(value);
             break;
         case "BACKGROUND"_crc32:
-            SharedMetaData.UBackgroundFileName = convertRawString(result[2]);
+            SharedMetaData.UBackgroundFileName = convertRawString(value);
             break;
         case "REQUEST"_crc32:
-            ProcessRequest(convertRawString(result[2]), line);
+            ProcessRequest(convertRawString(value), line);
             break;
         case "BASEBPM"_crc32:
-            SharedMetaData.BaseBpm = ConvertFloat(result[2]);
+            SharedMetaData.BaseBpm = ConvertFloat(value);
             break;
 
             //此処から先はデータ内で使う用
         case "HISPEED"_crc32: {
             if (onlyMeta) break;
-            const auto hsn = ConvertHexatridecimal(result[2]);
+            const auto hsn = ConvertHexatridecimal(value);
             if (hispeedDefinitions.find(hsn) == hispeedDefinitions.end()) {
                 MakeMessage(line, u8"指定されたタイムラインが存在しません。");
                 break;
@@ -319,7 +457,7 @@ void SusAnalyzer::ProcessCommand(const xp::smatch &result, const bool onlyMeta,
         case "ATTRIBUTE"_crc32: {
             if (onlyMeta) break;
 
-            const auto ean = ConvertHexatridecimal(result[2]);
+            const auto ean = ConvertHexatridecimal(value);
             if (extraAttributes.find(ean) == extraAttributes.end()) {
                 MakeMessage(line, u8"指定されたアトリビュートが存在しません。");
                 break;
@@ -336,7 +474,7 @@ void SusAnalyzer::ProcessCommand(const xp::smatch &result, const bool onlyMeta,
         case "MEASUREHS"_crc32: {
             if (onlyMeta) break;
 
-            const auto hsn = ConvertHexatridecimal(result[2]);
+            const auto hsn = ConvertHexatridecimal(value);
             if (hispeedDefinitions.find(hsn) == hispeedDefinitions.end()) {
                 MakeMessage(line, u8"指定されたタイムラインが存在しません。");
                 break;
@@ -348,7 +486,7 @@ void SusAnalyzer::ProcessCommand(const xp::smatch &result, const bool onlyMeta,
         case "MEASUREBS"_crc32: {
             if (onlyMeta) break;
 
-            const auto bsc = ConvertInteger(result[2]);
+            const auto bsc = ConvertInteger(value);
             if (bsc < 0) {
                 MakeMessage(line, u8"小節オフセットの値が不正です。");
                 break;
@@ -360,7 +498,7 @@ void SusAnalyzer::ProcessCommand(const xp::smatch &result, const bool onlyMeta,
         case "CHANNELBS"_crc32: {
             if (onlyMeta) break;
 
-            const auto bsc = ConvertInteger(result[2]);
+            const auto bsc = ConvertInteger(value);
             if (bsc < 0) {
                 MakeMessage(line, u8"チャンネルオフセットの値が不正です。");
                 break;
@@ -407,12 +545,10 @@ void SusAnalyzer::ProcessRequest(const string &cmd, const uint32_t line)
     }
 }
 
-void SusAnalyzer::ProcessData(const xp::smatch &result, const uint32_t line)
+// pattern は空白除去済みのものを渡す
+void SusAnalyzer::ProcessData(const string &measure, const string &lane, const string &pattern, const uint32_t line)
 {
-    auto meas = result[1].str();
-    auto lane = result[2].str();
-    auto pattern = result[3].str();
-    ba::erase_all(pattern, " ");
+    auto meas = measure;
 
     /*
      判定順について
@@ -426,7 +562,7 @@ void SusAnalyzer::ProcessData(const xp::smatch &result, const uint32_t line)
     const auto noteCount = pattern.length() / 2;
     const auto step = uint32_t(ticksPerBeat * GetBeatsAt(GetMeasureCount(ConvertInteger(meas)))) / (!noteCount ? 1 : noteCount);
 
-    if (!regex_match(meas, allNumeric)) {
+    if (!IsAllNumeric(meas)) {
         // コマンドデータ
         transform(meas.cbegin(), meas.cend(), meas.begin(), toUpper);
         if (meas == "BPM") {
@@ -691,117 +827,35 @@ void SusAnalyzer::MakeMessage(const uint32_t meas, const uint32_t tick, const ui
 
 float SusAnalyzer::GetBeatsAt(const uint32_t measure) const
 {
-    auto result = defaultBeats;
-    auto last = 0u;
-    for (auto &t : beatsDefinitions) {
-        if (t.first >= last && t.first <= measure) {
-            result = t.second;
-            last = t.first;
-        }
-    }
-    return result;
+    // 解析途中でも呼ばれるので tempoMap ではなく定義そのものを見る
+    auto it = beatsDefinitions.upper_bound(measure);
+    if (it == beatsDefinitions.begin()) return defaultBeats;
+    return (--it)->second;
 }
 
 double SusAnalyzer::GetBpmAt(const uint32_t measure, const uint32_t tick) const
 {
-    uint32_t nm, nt;
-    tie(nm, nt) = NormalizeRelativeTime(measure, tick);
-    auto result = defaultBpm;
-    auto lastMeasure = 0u;
-    auto lastTick = 0u;
-    for (const auto &t : bpmChanges) {
-        const auto bcTime = get<0>(t);
-        if (bcTime.Measure > nm || bcTime.Measure < lastMeasure) continue;
-        if (bcTime.Measure == lastMeasure && lastTick > bcTime.Tick) continue;
-
-        const auto &bpmDef = bpmDefinitions.find(get<1>(t).DefinitionNumber);
-        if (bpmDef != bpmDefinitions.end()) {
-            result = bpmDef->second;
-        }
-        lastMeasure = bcTime.Measure;
-        lastTick = bcTime.Tick;
-    }
-    return result;
+    return tempoMap.GetBpmAt(measure, tick);
 }
 
 tuple<uint32_t, uint32_t> SusAnalyzer::NormalizeRelativeTime(const uint32_t meas, const uint32_t tick) const
 {
-    auto nm = meas;
-    auto nt = tick;
-    while (nt >= GetBeatsAt(nm) * ticksPerBeat) nt -= SU_TO_UINT32(GetBeatsAt(nm++) * ticksPerBeat);
-    return make_tuple(nm, nt);
+    return tempoMap.NormalizeRelativeTime(meas, tick);
 }
 
-
 double SusAnalyzer::GetAbsoluteTime(const uint32_t meas, const uint32_t tick) const
 {
-    auto time = 0.0;
-    auto lastBpm = defaultBpm;
-    //超過したtick指定にも対応したほうが使いやすいよね
-    uint32_t nm, nt;
-    tie(nm, nt) = NormalizeRelativeTime(meas, tick);
-
-    for (auto i = 0u; i < nm + 1; i++) {
-        const auto beats = GetBeatsAt(i);
-        auto lastChangeTick = 0u;
-        for (auto& bc : bpmChanges) {
-            if (get<0>(bc).Measure != i) continue;
-            const auto timing = get<0>(bc);
-            if (i == nm && timing.Tick >= nt) break;
-            const auto dur = (60.0 / lastBpm) * (double(timing.Tick - lastChangeTick) / ticksPerBeat);
-            time += dur;
-            lastChangeTick = timing.Tick;
-            const auto bpmDefinition = bpmDefinitions.find(get<1>(bc).DefinitionNumber);
-            if (bpmDefinition != bpmDefinitions.end()) {
-                lastBpm = bpmDefinition->second;
-            }
-        }
-        if (i == nm) {
-            time += (60.0 / lastBpm) * (double(nt - lastChangeTick) / ticksPerBeat);
-        } else {
-            time += (60.0 / lastBpm) * (double(ticksPerBeat * beats - lastChangeTick) / ticksPerBeat);
-        }
-    }
-
-    return time;
+    return tempoMap.GetAbsoluteTime(meas, tick);
 }
 
 tuple<uint32_t, uint32_t> SusAnalyzer::GetRelativeTime(const double time) const
 {
-    auto restTime = time;
-    uint32_t meas = 0;
-    auto secPerBeat = (60.0 / 120.0);
-
-    while (true) {
-        const auto beats = GetBeatsAt(meas);
-        auto lastChangeTick = 0u;
-
-        for (auto& bc : bpmChanges) {
-            const auto timing = get<0>(bc);
-            if (timing.Measure != meas) continue;
-            const auto dur = secPerBeat * (double(timing.Tick - lastChangeTick) / ticksPerBeat);
-            if (dur >= restTime) return make_tuple(meas, lastChangeTick + static_cast<uint32_t>(restTime / secPerBeat * ticksPerBeat));
-            restTime -= dur;
-            lastChangeTick = timing.Tick;
-            const auto bpmDef = bpmDefinitions.find(get<1>(bc).DefinitionNumber);
-
-            if (bpmDef != bpmDefinitions.end()) {
-                secPerBeat = 60.0 / bpmDef->second;
-            }
-        }
-        const double restTicks = ticksPerBeat * beats - lastChangeTick;
-        const auto restDuration = restTicks / ticksPerBeat * secPerBeat;
-        if (restDuration >= restTime) return make_tuple(meas, lastChangeTick + static_cast<uint32_t>(restTime / secPerBeat * ticksPerBeat));
-        restTime -= restDuration;
-        meas++;
-    }
+    return tempoMap.GetRelativeTime(time);
 }
 
 uint32_t SusAnalyzer::GetRelativeTicks(const uint32_t measure, const uint32_t tick) const
 {
-    float result = 0;
-    for (auto i = 0u; i < measure; i++) result += GetBeatsAt(i) * ticksPerBeat;
-    return SU_TO_UINT32(result) + tick;
+    return tempoMap.GetRelativeTicks(measure, tick);
 }
 
 void SusAnalyzer::RenderScoreData(DrawableNotesList &data, NoteCurvesList &curveData)
@@ -811,6 +865,25 @@ void SusAnalyzer::RenderScoreData(DrawableNotesList &data, NoteCurvesList &curve
     // ホールド: ケツ無しアウト(ケツ連は無視)、Step/Control問答無用アウト、ケツ違いアウト
     // スライド、AA: ケツ無しアウト(ケツ連は無視)
     data.clear();
+
+    // notes を一度だけ走査して索引を作っておく
+    // 各リスト内は notes の並び順(= 時刻順)を保つので、元の全走査と同じ順序で候補を辿れる
+    unordered_map<uint64_t, vector<size_t>> longNoteIndex;  // (ロング種類, チャンネル) -> Start以外の構成ノーツ
+    unordered_map<uint64_t, vector<size_t>> timeIndex;      // 小節'tick -> その時刻の全ノーツ
+    for (auto i = 0u; i < notes.size(); i++) {
+        const auto &info = get<1>(notes[i]);
+        timeIndex[MakeTimeKey(get<0>(notes[i]))].push_back(i);
+        if (info.Type.test(size_t(SusNoteType::Start))) continue;
+        const auto bits = info.Type.to_ulong();
+        if (!(bits & SU_NOTE_LONG_MASK)) continue;
+        longNoteIndex[MakeLongNoteKey(bits, info.Extra)].push_back(i);
+    }
+    const vector<size_t> emptyIndex;
+    const auto findIndex = [&emptyIndex](const unordered_map<uint64_t, vector<size_t>> &index, const uint64_t key) -> const vector<size_t>& {
+        const auto it = index.find(key);
+        return it == index.end() ? emptyIndex : it->second;
+    };
+
     for (const auto& note : notes) {
         const auto time = get<0>(note);
         const auto &info = get<1>(note);
@@ -858,14 +931,16 @@ void SusAnalyzer::RenderScoreData(DrawableNotesList &data, NoteCurvesList &curve
 
             auto completed = false;
             auto lastStep = note;
-            for (const auto &it : notes) {
+            const auto &candidates = findIndex(longNoteIndex, MakeLongNoteKey(1UL << size_t(ltype), info.Extra));
+            // 始点より前の候補は二分探索で読み飛ばす
+            const auto firstCandidate = lower_bound(candidates.begin(), candidates.end(), time, [this](const size_t index, const SusRelativeNoteTime &t) {
+                return get<0>(notes[index]) < t;
+            });
+            for (auto ci = firstCandidate; ci != candidates.end(); ++ci) {
+                const auto &it = notes[*ci];
                 const auto curPos = get<0>(it);
                 const auto &curNo = get<1>(it);
 
-                if (curNo.Type.test(size_t(SusNoteType::Start))) continue;
-                if (!curNo.Type.test(size_t(ltype)) || curNo.Extra != info.Extra) continue;
-                if (curPos < time) continue;
-
                 if (curNo.NotePosition.StartLane + curNo.NotePosition.Length > 16) {
                     MakeMessage(time.Measure, time.Tick, info.NotePosition.StartLane, u8"ノーツがはみ出しています。");
                     continue;
@@ -928,46 +1003,17 @@ void SusAnalyzer::RenderScoreData(DrawableNotesList &data, NoteCurvesList &curve
             SharedMetaData.ScoreDuration = max(SharedMetaData.ScoreDuration, noteData->StartTime + noteData->Duration);
             if (genCurve) {
                 CalculateCurves(noteData, curveData);
-                // Injection の幅を決定する
-                for (const auto &extra : noteData->ExtraData) {
-                    if (!extra->Type[size_t(SusNoteType::Injection)]) continue;
-
-                    auto last = noteData;
-                    for (auto &slideElement : noteData->ExtraData) {
-                        if (slideElement->Type.test(size_t(SusNoteType::Control))) continue;
-                        if (slideElement->Type.test(size_t(SusNoteType::Injection))) continue;
-                        if (extra->StartTime >= slideElement->StartTime) {
-                            last = slideElement;
-                            continue;
-                        }
-                        const auto width = glm::mix(
-                            last->Length, slideElement->Length,
-                            (extra->StartTime - last->StartTime) / (slideElement->StartTime - last->StartTime)
-                        );
-                        auto &segmentPositions = curveData[slideElement];
-
-                        auto lastSegmentPosition = segmentPositions[0];
-                        auto lastTimeInBlock = get<0>(lastSegmentPosition) / (slideElement->StartTime - last->StartTime);
-                        for (auto &segmentPosition : segmentPositions) {
-                            if (lastSegmentPosition == segmentPosition) continue;
-                            const auto currentTimeInBlock = get<0>(segmentPosition) / (slideElement->StartTime - last->StartTime);
-                            const auto cst = glm::mix(last->StartTime, slideElement->StartTime, currentTimeInBlock);
-                            if (extra->StartTime >= cst) {
-                                lastSegmentPosition = segmentPosition;
-                                lastTimeInBlock = currentTimeInBlock;
-                                continue;
-                            }
-                            const auto lst = glm::mix(last->StartTime, slideElement->StartTime, lastTimeInBlock);
-                            const auto t = (extra->StartTime - lst) / (cst - lst);
-                            const auto x = glm::mix(get<1>(lastSegmentPosition), get<1>(segmentPosition), t);
-                            const auto center = x * 16.0;
-                            extra->StartLane = SU_TO_FLOAT(center - width / 2.0);
-                            extra->Length = width;
-                            break;
-                        }
-                        break;
+                // Injection の位置と幅を決定する 判定に使うので、分割した折れ線ではなく曲線そのものから求める
+                ForEachSlideCurve(*noteData, [&](const SusDrawableNoteData &from, const SusDrawableNoteData &to, const SusBezierCurve &curve) {
+                    for (const auto &extra : noteData->ExtraData) {
+                        if (!extra->Type[size_t(SusNoteType::Injection)]) continue;
+                        if (extra->StartTime < from.StartTime || extra->StartTime >= to.StartTime) continue;
+                        const auto width = glm::mix(from.Length, to.Length, (extra->StartTime - from.StartTime) / (to.StartTime - from.StartTime));
+                        const auto center = curve.GetPositionAt(extra->StartTime - from.StartTime) * 16.0;
+                        extra->StartLane = SU_TO_FLOAT(center - width / 2.0);
+                        extra->Length = width;
                     }
-                }
+                });
             }
         } else if (bits & SU_NOTE_SHORT_MASK) {
             // RollHispeed組み込み
@@ -984,12 +1030,9 @@ void SusAnalyzer::RenderScoreData(DrawableNotesList &data, NoteCurvesList &curve
             // if ((下に別ノーツがある && それはロング終点) || 下に別ノーツがない)
             if (info.Type[size_t(SusNoteType::Air)] && !info.Type[size_t(SusNoteType::Grounded)]) {
                 auto require = true;
-                for (const auto &target : notes) {
-                    const auto gtime = get<0>(target);
-                    const auto &ginfo = get<1>(target);
-
-                    // 判定時刻が異なるノーツは処理対象からはじく
-                    if (time != gtime) continue;
+                // 判定時刻が同じノーツだけを索引から取り出す
+                for (const auto targetIndex : findIndex(timeIndex, MakeTimeKey(time))) {
+                    const auto &ginfo = get<1>(notes[targetIndex]);
 
                     // 自分自身と位置、サイズが異なるノーツは処理対象からはじく
                     if (info.DefinitionNumber != ginfo.DefinitionNumber) continue;
@@ -1028,10 +1071,8 @@ void SusAnalyzer::RenderScoreData(DrawableNotesList &data, NoteCurvesList &curve
 #ifdef SU_ENABLE_NOTE_HORIZONTAL_MOVING
             // 移動レーン処理
             if (SharedMetaData.ExtraFlags[size_t(SusMetaDataFlags::EnableMovingLane)]) {
-                for (const auto &startSource : notes) {
-                    const auto mltime = get<0>(startSource);
-                    const auto &mlinfo = get<1>(startSource);
-                    if (mltime != time) continue;
+                for (const auto startSourceIndex : findIndex(timeIndex, MakeTimeKey(time))) {
+                    const auto &mlinfo = get<1>(notes[startSourceIndex]);
                     if (mlinfo.NotePosition.StartLane != info.NotePosition.StartLane) continue;
                     if (!mlinfo.Type[size_t(SusNoteType::StartPosition)]) continue;
                     noteData->CenterAtZero = mlinfo.Extra + mlinfo.NotePosition.Length / 2.0;
@@ -1052,49 +1093,306 @@ void SusAnalyzer::RenderScoreData(DrawableNotesList &data, NoteCurvesList &curve
 
 void SusAnalyzer::CalculateCurves(const shared_ptr<SusDrawableNoteData>& note, NoteCurvesList &curveData) const
 {
-    auto lastStep = note;
+    ForEachSlideCurve(*note, [&](const SusDrawableNoteData &from, const SusDrawableNoteData &to, const SusBezierCurve &curve) {
+        if (curveTolerance > 0) {
+            // 誤差に収まる範囲で点を減らす 制御点の無い直線は両端の2点だけになる
+            const auto first = curve.Evaluate(0), last = curve.Evaluate(1);
+            curveData.AddPoint(get<0>(first), get<1>(first));
+            SubdivideBezier(curve, curveTolerance, 0, first, 1, last, 0, curveData);
+        } else {
+            const auto segmentPoints = SU_TO_INT32(SharedMetaData.SegmentsPerSecond * (to.StartTime - from.StartTime) + 2);
+            for (auto j = 0; j < segmentPoints; j++) {
+                const auto point = curve.Evaluate(j / double(segmentPoints - 1));
+                curveData.AddPoint(get<0>(point), get<1>(point));
+            }
+        }
+        curveData.EndCurve(&to);
+    });
+}
+
+uint32_t SusAnalyzer::GetMeasureCount(const uint32_t relativeMeasureCount) const
+{
+    return measureCountOffset + relativeMeasureCount;
+}
+
+uint32_t SusAnalyzer::GetLongNoteChannel(const uint32_t relativeLongNoteChannel) const
+{
+    return longNoteChannelOffset + relativeLongNoteChannel;
+}
+
+// SusBezierCurve ---------------------------------------------------------------------
+
+void SusBezierCurve::Set(const vector<tuple<double, double>> &controlPoints)
+{
+    const auto degree = SU_TO_INT32(controlPoints.size()) - 1;
+    coefficients.resize(controlPoints.size());
+    auto binomial = 1.0;
+    for (auto i = 0; i <= degree; i++) {
+        coefficients[i] = make_tuple(get<0>(controlPoints[i]) * binomial, get<1>(controlPoints[i]) * binomial);
+        binomial = binomial * (degree - i) / (i + 1);
+    }
+
+    // 2階微分も Bézier 曲線なので、制御点の2階差分の最大値で抑えられる
+    timeCurvature = positionCurvature = 0;
+    for (auto i = 0; i + 2 <= degree; i++) {
+        timeCurvature = max(timeCurvature, abs(get<0>(controlPoints[i]) - 2 * get<0>(controlPoints[i + 1]) + get<0>(controlPoints[i + 2])));
+        positionCurvature = max(positionCurvature, abs(get<1>(controlPoints[i]) - 2 * get<1>(controlPoints[i + 1]) + get<1>(controlPoints[i + 2])));
+    }
+    timeCurvature *= degree * (degree - 1);
+    positionCurvature *= degree * (degree - 1);
+}
+
+tuple<double, double> SusBezierCurve::Evaluate(const double t) const
+{
+    const auto degree = SU_TO_INT32(coefficients.size()) - 1;
+    if (!degree) return coefficients[0];
+    const auto s = 1.0 - t;
+    auto power = 1.0;
+    auto time = get<0>(coefficients[0]) * s;
+    auto position = get<1>(coefficients[0]) * s;
+    for (auto i = 1; i < degree; i++) {
+        power *= t;
+        time = (time + power * get<0>(coefficients[i])) * s;
+        position = (position + power * get<1>(coefficients[i])) * s;
+    }
+    power *= t;
+    return make_tuple(time + power * get<0>(coefficients[degree]), position + power * get<1>(coefficients[degree]));
+}
+
+double SusBezierCurve::GetPositionAt(const double time) const
+{
+    // 制御点の時間は昇順なので時間は t に対して単調 t を二分法で倍精度の限界まで詰める
+    auto low = 0.0, high = 1.0;
+    if (time <= get<0>(Evaluate(low))) return get<1>(Evaluate(low));
+    if (time >= get<0>(Evaluate(high))) return get<1>(Evaluate(high));
+    while (true) {
+        const auto middle = (low + high) / 2;
+        if (middle <= low || middle >= high) break;
+        if (get<0>(Evaluate(middle)) < time) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    return get<1>(Evaluate(high));
+}
+
+// 両端で0になる関数なので、2階微分の上限 × 区間長^2 / 8 で抑えられる
+// 時間幅の無い区間は描画にも判定にも使われないので0とする
+double SusBezierCurve::GetChordErrorBound(const double from, const tuple<double, double> &fromPoint, const double to, const tuple<double, double> &toPoint) const
+{
+    const auto span = get<0>(toPoint) - get<0>(fromPoint);
+    if (span <= 0) return 0;
+    const auto slope = (get<1>(toPoint) - get<1>(fromPoint)) / span;
+    return (to - from) * (to - from) / 8 * (positionCurvature + abs(slope) * timeCurvature);
+}
+
+void ForEachSlideCurve(const SusDrawableNoteData &note, const function<void(const SusDrawableNoteData &from, const SusDrawableNoteData &to, const SusBezierCurve &curve)> &callback)
+{
+    auto lastStep = &note;
     vector<tuple<double, double>> controlPoints;    // lastStepからの時間, X中央位置(0~1)
-    vector<tuple<double, double>> bezierBuffer;
+    SusBezierCurve curve;
 
     controlPoints.emplace_back(0, lastStep->CenterAtZero / 16.0);
-    for (auto &slideElement : note->ExtraData) {
+    for (auto &slideElement : note.ExtraData) {
         if (slideElement->Type.test(size_t(SusNoteType::Injection))) continue;
 
-        const auto cpi = make_tuple(slideElement->StartTime - lastStep->StartTime, slideElement->CenterAtZero / 16.0);
-        controlPoints.push_back(cpi);
+        controlPoints.emplace_back(slideElement->StartTime - lastStep->StartTime, slideElement->CenterAtZero / 16.0);
         if (slideElement->Type.test(size_t(SusNoteType::Control))) continue;
 
         // EndかStepかInvisible
-        const auto segmentPoints = SU_TO_INT32(SharedMetaData.SegmentsPerSecond * (slideElement->StartTime - lastStep->StartTime) + 2);
-        vector<tuple<double, double>> segmentPositions;
-        for (auto j = 0; j < segmentPoints; j++) {
-            const auto relativeTimeInBlock = j / double(segmentPoints - 1);
-            bezierBuffer.clear();
-            copy(controlPoints.begin(), controlPoints.end(), back_inserter(bezierBuffer));
-            for (int k = controlPoints.size() - 1; k >= 0; k--) {
-                for (auto l = 0; l < k; l++) {
-                    auto derivedTime = glm::mix(get<0>(bezierBuffer[l]), get<0>(bezierBuffer[l + 1]), relativeTimeInBlock);
-                    auto derivedPosition = glm::mix(get<1>(bezierBuffer[l]), get<1>(bezierBuffer[l + 1]), relativeTimeInBlock);
-                    bezierBuffer[l] = make_tuple(derivedTime, derivedPosition);
-                }
-            }
-            segmentPositions.push_back(bezierBuffer[0]);
-        }
-        curveData[slideElement] = segmentPositions;
-        lastStep = slideElement;
+        curve.Set(controlPoints);
+        callback(*lastStep, *slideElement, curve);
+        lastStep = slideElement.get();
         controlPoints.clear();
         controlPoints.emplace_back(0, slideElement->CenterAtZero / 16.0);
     }
 }
 
-uint32_t SusAnalyzer::GetMeasureCount(const uint32_t relativeMeasureCount) const
+// NoteCurvesList ---------------------------------------------------------------------
+
+void NoteCurvesList::Clear()
 {
-    return measureCountOffset + relativeMeasureCount;
+    points.clear();
+    ranges.clear();
+    pendingFirst = 0;
 }
 
-uint32_t SusAnalyzer::GetLongNoteChannel(const uint32_t relativeLongNoteChannel) const
+void NoteCurvesList::EndCurve(const SusDrawableNoteData *note)
 {
-    return longNoteChannelOffset + relativeLongNoteChannel;
+    const auto count = SU_TO_UINT32(points.size()) - pendingFirst;
+    ranges[note] = make_tuple(pendingFirst, count);
+    pendingFirst = SU_TO_UINT32(points.size());
+}
+
+NoteCurve NoteCurvesList::Find(const SusDrawableNoteData *note) const
+{
+    NoteCurve result;
+    const auto range = ranges.find(note);
+    if (range == ranges.end()) return result;
+    result.First = points.data() + get<0>(range->second);
+    result.Count = get<1>(range->second);
+    return result;
+}
+
+// SusTempoMap ------------------------------------------------------------------------
+
+SusTempoMap::SusTempoMap()
+{
+    Compile(ticksPerBeat, {}, {}, 4.0f, defaultBpm);
+}
+
+void SusTempoMap::Compile(const uint32_t tpb, const map<uint32_t, float> &beatsDefinitions, const vector<tuple<SusRelativeNoteTime, double>> &bpmChanges, const float defBeats, const double defBpm)
+{
+    ticksPerBeat = tpb;
+    defaultBpm = defBpm;
+    measures.clear();
+    segments.clear();
+
+    // 変化点を含まない小節を最低1つ末尾に置き、それ以降はその小節の長さで外挿する
+    auto lastMeasure = 0u;
+    if (!beatsDefinitions.empty()) lastMeasure = max(lastMeasure, beatsDefinitions.rbegin()->first);
+    if (!bpmChanges.empty()) lastMeasure = max(lastMeasure, get<0>(bpmChanges.back()).Measure);
+    ++lastMeasure;
+    measures.reserve(lastMeasure + 1);
+    segments.reserve(bpmChanges.size());
+
+    auto beats = defBeats;
+    auto beatsDefinition = beatsDefinitions.begin();
+    auto bpmChange = bpmChanges.begin();
+    auto bpm = defaultBpm;
+    auto time = 0.0;
+    auto ticks = 0.0f;
+    for (auto i = 0u; i <= lastMeasure; i++) {
+        for (; beatsDefinition != beatsDefinitions.end() && beatsDefinition->first <= i; ++beatsDefinition) beats = beatsDefinition->second;
+        measures.push_back({ beats, time, ticks });
+
+        auto lastChangeTick = 0u;
+        for (; bpmChange != bpmChanges.end() && get<0>(*bpmChange).Measure == i; ++bpmChange) {
+            const auto timing = get<0>(*bpmChange);
+            time += (60.0 / bpm) * (double(timing.Tick - lastChangeTick) / ticksPerBeat);
+            lastChangeTick = timing.Tick;
+            bpm = get<1>(*bpmChange);
+            segments.push_back({ timing, time, bpm });
+        }
+        time += (60.0 / bpm) * (double(ticksPerBeat * beats - lastChangeTick) / ticksPerBeat);
+        ticks += beats * ticksPerBeat;
+    }
+}
+
+double SusTempoMap::GetLastBpm() const
+{
+    return segments.empty() ? defaultBpm : segments.back().Bpm;
+}
+
+double SusTempoMap::GetMeasureStartTime(const uint32_t measure) const
+{
+    if (measure < measures.size()) return measures[measure].StartTime;
+
+    const auto &last = measures.back();
+    const auto duration = (60.0 / GetLastBpm()) * (double(ticksPerBeat * last.Beats) / ticksPerBeat);
+    return last.StartTime + duration * (measure - (measures.size() - 1));
+}
+
+float SusTempoMap::GetBeatsAt(const uint32_t measure) const
+{
+    return measure < measures.size() ? measures[measure].Beats : measures.back().Beats;
+}
+
+double SusTempoMap::GetBpmAt(const uint32_t measure, const uint32_t tick) const
+{
+    // 正規化後の小節までに含まれる最後の変化点を採用する(小節内のtickは見ない)
+    uint32_t nm, nt;
+    tie(nm, nt) = NormalizeRelativeTime(measure, tick);
+    const auto it = upper_bound(segments.begin(), segments.end(), nm, [](const uint32_t m, const BpmSegment &s) {
+        return m < s.Time.Measure;
+    });
+    return it == segments.begin() ? defaultBpm : prev(it)->Bpm;
+}
+
+double SusTempoMap::GetInitialBpm() const
+{
+    return segments.empty() ? defaultBpm : segments.front().Bpm;
+}
+
+tuple<uint32_t, uint32_t> SusTempoMap::NormalizeRelativeTime(const uint32_t meas, const uint32_t tick) const
+{
+    auto nm = meas;
+    auto nt = tick;
+    while (nt >= GetBeatsAt(nm) * ticksPerBeat) nt -= SU_TO_UINT32(GetBeatsAt(nm++) * ticksPerBeat);
+    return make_tuple(nm, nt);
+}
+
+double SusTempoMap::GetAbsoluteTime(const uint32_t meas, const uint32_t tick) const
+{
+    //超過したtick指定にも対応したほうが使いやすいよね
+    uint32_t nm, nt;
+    tie(nm, nt) = NormalizeRelativeTime(meas, tick);
+    const SusRelativeNoteTime at = { nm, nt };
+
+    // at ちょうどの変化点はまだ適用しない
+    const auto it = lower_bound(segments.begin(), segments.end(), at, [](const BpmSegment &s, const SusRelativeNoteTime &t) {
+        return s.Time < t;
+    });
+    if (it == segments.begin()) return GetMeasureStartTime(nm) + (60.0 / defaultBpm) * (double(nt) / ticksPerBeat);
+
+    const auto &segment = *prev(it);
+    if (segment.Time.Measure == nm) return segment.StartTime + (60.0 / segment.Bpm) * (double(nt - segment.Time.Tick) / ticksPerBeat);
+    return GetMeasureStartTime(nm) + (60.0 / segment.Bpm) * (double(nt) / ticksPerBeat);
+}
+
+tuple<uint32_t, uint32_t> SusTempoMap::GetRelativeTime(const double time) const
+{
+    if (time <= 0) return make_tuple(0u, 0u);
+
+    // 小節末尾ちょうどの時刻はその小節に含める
+    uint32_t meas;
+    const auto measureIt = lower_bound(measures.begin() + 1, measures.end(), time, [](const MeasureEntry &m, const double t) {
+        return m.StartTime < t;
+    });
+    if (measureIt != measures.end()) {
+        meas = SU_TO_UINT32(measureIt - measures.begin()) - 1;
+    } else {
+        const auto &last = measures.back();
+        const auto duration = (60.0 / GetLastBpm()) * (double(ticksPerBeat * last.Beats) / ticksPerBeat);
+        const auto offset = max(0.0, ceil((time - last.StartTime) / duration) - 1);
+        meas = SU_TO_UINT32(measures.size() - 1 + offset);
+        // 割り算の丸めで境目の前後にずれた分を戻す
+        if (meas >= measures.size() && GetMeasureStartTime(meas) >= time) --meas;
+        if (GetMeasureStartTime(meas + 1) < time) ++meas;
+    }
+
+    // meas 内で time より前(同時刻を含まない)の最後の変化点
+    const auto first = lower_bound(segments.begin(), segments.end(), SusRelativeNoteTime { meas, 0 }, [](const BpmSegment &s, const SusRelativeNoteTime &t) {
+        return s.Time < t;
+    });
+    const auto last = find_if(first, segments.end(), [meas](const BpmSegment &s) { return s.Time.Measure != meas; });
+    const auto it = lower_bound(first, last, time, [](const BpmSegment &s, const double t) {
+        return s.StartTime < t;
+    });
+
+    auto baseTick = 0u;
+    auto baseTime = GetMeasureStartTime(meas);
+    auto bpm = defaultBpm;
+    if (it != first) {
+        const auto &segment = *prev(it);
+        baseTick = segment.Time.Tick;
+        baseTime = segment.StartTime;
+        bpm = segment.Bpm;
+    } else if (first != segments.begin()) {
+        bpm = prev(first)->Bpm;
+    }
+    const auto secPerBeat = 60.0 / bpm;
+    return make_tuple(meas, baseTick + static_cast<uint32_t>((time - baseTime) / secPerBeat * ticksPerBeat));
+}
+
+uint32_t SusTempoMap::GetRelativeTicks(const uint32_t measure, const uint32_t tick) const
+{
+    if (measure < measures.size()) return SU_TO_UINT32(measures[measure].StartTicks) + tick;
+
+    auto result = measures.back().StartTicks;
+    for (auto i = measures.size() - 1; i < measure; i++) result += measures.back().Beats * ticksPerBeat;
+    return SU_TO_UINT32(result) + tick;
 }
 
 // SusHispeedTimeline ------------------------------------------------------------------
@@ -1221,31 +1519,96 @@ void SusHispeedTimeline::Finialize()
     keys.clear();
 }
 
-tuple<bool, double> SusHispeedTimeline::GetRawDrawStateAt(const double time)
+// data[1..] のうち時刻が time 未満の最後のもの、なければ先頭
+size_t SusHispeedTimeline::FindSegment(const double time) const
 {
-    auto lastData = data[0];
-    auto check = 0;
-    for (const auto &d : data) {
-        if (!check++) continue;
-        const auto keyTime = get<0>(d);
-        if (keyTime >= time) break;
-        lastData = d;
-    }
+    const auto next = lower_bound(data.begin() + 1, data.end(), time, [](const tuple<double, double, SusHispeedData> &d, const double t) {
+        return get<0>(d) < t;
+    });
+    return next - data.begin() - 1;
+}
+
+size_t SusHispeedTimeline::FindSegment(const double time, size_t &cursor) const
+{
+    const auto contains = [&](const size_t index) {
+        if (index != 0 && get<0>(data[index]) >= time) return false;
+        return index + 1 == data.size() || get<0>(data[index + 1]) >= time;
+    };
+    if (cursor < data.size() && contains(cursor)) return cursor;
+    if (cursor + 1 < data.size() && contains(cursor + 1)) return ++cursor;
+    cursor = FindSegment(time);
+    return cursor;
+}
+
+tuple<bool, double> SusHispeedTimeline::GetRawDrawState(const size_t segment, const double time) const
+{
+    const auto &lastData = data[segment];
     const auto lastDifference = time - get<0>(lastData);
     return make_tuple(get<2>(lastData).VisibilityState == SusHispeedData::Visibility::Visible, get<1>(lastData) + lastDifference * get<2>(lastData).Speed);
 }
 
-double SusHispeedTimeline::GetSpeedAt(const double time)
+tuple<bool, double> SusHispeedTimeline::GetRawDrawStateAt(const double time) const
+{
+    return GetRawDrawState(FindSegment(time), time);
+}
+
+tuple<bool, double> SusHispeedTimeline::GetRawDrawStateAt(const double time, size_t &cursor) const
 {
-    auto lastData = data[0];
-    auto check = 0;
-    for (const auto &d : data) {
-        if (!check++) continue;
-        const auto keyTime = get<0>(d);
-        if (keyTime >= time) break;
-        lastData = d;
+    return GetRawDrawState(FindSegment(time, cursor), time);
+}
+
+// 昇順に並んだ times ならカーソルが前に進むだけで済む
+void SusHispeedTimeline::GetRawDrawStatesAt(const vector<double> &times, vector<tuple<bool, double>> &states) const
+{
+    states.resize(times.size());
+    size_t cursor = 0;
+    for (size_t i = 0; i < times.size(); ++i) states[i] = GetRawDrawState(FindSegment(times[i], cursor), times[i]);
+}
+
+double SusHispeedTimeline::GetSpeedAt(const double time) const
+{
+    return get<2>(data[FindSegment(time)]).Speed;
+}
+
+// 描画位置は区間ごとの一次関数なので、区間を順に見て境界時刻を求める
+// 先頭区間は GetRawDrawStateAt と同様に負の方向へも延長して扱う
+double SusHispeedTimeline::GetEarliestTimeReaching(const double position) const
+{
+    const auto infinity = numeric_limits<double>::infinity();
+    for (size_t i = 0; i < data.size(); ++i) {
+        const auto start = get<0>(data[i]);
+        const auto sum = get<1>(data[i]);
+        const auto speed = get<2>(data[i]).Speed;
+        const auto end = i + 1 < data.size() ? get<0>(data[i + 1]) : infinity;
+        if (i == 0) {
+            if (speed < 0 || (speed == 0 && sum >= position)) return -infinity;
+        } else {
+            if (sum >= position) return start;
+        }
+        if (speed <= 0) continue;
+        const auto reach = start + (position - sum) / speed;
+        if (reach <= end) return reach;
+    }
+    return infinity;
+}
+
+double SusHispeedTimeline::GetLatestTimeWithin(const double position) const
+{
+    const auto infinity = numeric_limits<double>::infinity();
+    for (auto i = data.size(); i-- > 0;) {
+        const auto start = get<0>(data[i]);
+        const auto sum = get<1>(data[i]);
+        const auto speed = get<2>(data[i]).Speed;
+        if (i + 1 < data.size()) {
+            if (get<1>(data[i + 1]) <= position) return get<0>(data[i + 1]);
+        } else {
+            if (speed < 0 || (speed == 0 && sum <= position)) return infinity;
+        }
+        if (speed <= 0) continue;
+        const auto leave = start + (position - sum) / speed;
+        if (i == 0 || leave >= start) return leave;
     }
-    return get<2>(lastData).Speed;
+    return -infinity;
 }
 
 tuple<bool, double> SusDrawableNoteData::GetStateAt(const double time)
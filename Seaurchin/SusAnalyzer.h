@@ -2,6 +2,8 @@
 
 #define SU_NOTE_LONG_MASK  0b00000000001110000000
 #define SU_NOTE_SHORT_MASK 0b00000000000001111110
+// スライド曲線の許容誤差の既定値 (レーン全幅を1とした単位) レーンの背景バッファ (横1024px) で 0.5px
+#define SU_SLIDE_CURVE_TOLERANCE (0.5 / 1024.0)
 
 enum class SusNoteType : uint16_t {
     Undefined = 0,
@@ -61,6 +63,43 @@ struct SusRelativeNoteTime {
     }
 };
 
+// 小節・BPM定義から前計算した時刻変換表
+// 小節頭の絶対時刻とBPM変化点の累積時刻を持っておき、相対時刻<->絶対時刻を二分探索で求める
+class SusTempoMap final {
+    friend class SusAnalyzer;
+private:
+    struct MeasureEntry {
+        float Beats;        // 拍数
+        double StartTime;   // 小節頭の絶対時刻
+        float StartTicks;   // 小節頭までの累積tick
+    };
+    struct BpmSegment {
+        SusRelativeNoteTime Time;
+        double StartTime;   // 変化点の絶対時刻
+        double Bpm;         // 変化後のBPM
+    };
+
+    uint32_t ticksPerBeat = 192;
+    double defaultBpm = 120.0;
+    std::vector<MeasureEntry> measures;     // 最後の要素以降はBPM・拍数とも変化しないので外挿する
+    std::vector<BpmSegment> segments;       // 時刻順
+
+    double GetLastBpm() const;
+    double GetMeasureStartTime(uint32_t measure) const;
+
+public:
+    SusTempoMap();
+
+    void Compile(uint32_t tpb, const std::map<uint32_t, float> &beatsDefinitions, const std::vector<std::tuple<SusRelativeNoteTime, double>> &bpmChanges, float defBeats, double defBpm);
+    float GetBeatsAt(uint32_t measure) const;
+    double GetBpmAt(uint32_t measure, uint32_t tick) const;
+    double GetInitialBpm() const;
+    uint32_t GetTicksPerBeat() const { return ticksPerBeat; }
+    double GetAbsoluteTime(uint32_t meas, uint32_t tick) const;
+    std::tuple<uint32_t, uint32_t> GetRelativeTime(double time) const;
+    uint32_t GetRelativeTicks(uint32_t measure, uint32_t tick) const;
+    std::tuple<uint32_t, uint32_t> NormalizeRelativeTime(uint32_t meas, uint32_t tick) const;
+};
 
 struct SusHispeedData {
     enum class Visibility {
@@ -88,19 +127,33 @@ struct SusHispeedData {
 };
 
 class SusHispeedTimeline final {
+    friend class SusAnalyzer;
 private:
     std::vector<std::pair<SusRelativeNoteTime, SusHispeedData>> keys;
     std::vector<std::tuple<double, double, SusHispeedData>> data;
     std::function<double(uint32_t, uint32_t)> relToAbs;
 
+    // 区間を二分探索する タイムラインは複数のスレッドから引かれるので状態は持たない
+    size_t FindSegment(double time) const;
+    // cursor (前回引いた区間) とその次を先に見て、外れたら二分探索して cursor を書き換える
+    size_t FindSegment(double time, size_t &cursor) const;
+    std::tuple<bool, double> GetRawDrawState(size_t segment, double time) const;
+
 public:
     SusHispeedTimeline(std::function<double(uint32_t, uint32_t)> func);
     void AddKeysByString(const std::string &def, const std::function<std::shared_ptr<SusHispeedTimeline>(uint32_t)>& resolver);
     void AddKeyByData(uint32_t meas, uint32_t tick, double hs);
     void AddKeyByData(uint32_t meas, uint32_t tick, bool vis);
     void Finialize();
-    std::tuple<bool, double> GetRawDrawStateAt(double time);
-    double GetSpeedAt(double time);
+    std::tuple<bool, double> GetRawDrawStateAt(double time) const;
+    // 再生中のように時刻が単調に進むとき用 cursor は呼び出し側がタイムラインごとに持ち、最初は0にしておく
+    std::tuple<bool, double> GetRawDrawStateAt(double time, size_t &cursor) const;
+    void GetRawDrawStatesAt(const std::vector<double> &times, std::vector<std::tuple<bool, double>> &states) const;
+    double GetSpeedAt(double time) const;
+    double GetEarliestTimeReaching(double position) const;  // これより前は常に position 未満
+    double GetLatestTimeWithin(double position) const;      // これより後は常に position 超過
+    // Finialize で作った区間 (開始時刻, 開始位置, 状態) 時刻順
+    const std::vector<std::tuple<double, double, SusHispeedData>> &GetSegments() const { return data; }
 };
 
 class SusNoteExtraAttribute final {
@@ -215,14 +268,77 @@ struct SusDrawableNoteData {
 
 
 using DrawableNotesList = std::vector<std::shared_ptr<SusDrawableNoteData>>;
-using NoteCurvesList = std::unordered_map<std::shared_ptr<SusDrawableNoteData>, std::vector<std::tuple<double, double>>>;
+
+// Slide の1区間分の Bézier 曲線 (区間先頭からの時間, X中央位置(0~1))
+// 二項係数を掛けた制御点を持っておき、Bernstein 多項式のまま Horner 法で評価する (途中の点の配列を作らない)
+class SusBezierCurve final {
+private:
+    std::vector<std::tuple<double, double>> coefficients;
+    double timeCurvature = 0;       // 2階微分の絶対値の上限
+    double positionCurvature = 0;
+
+public:
+    void Set(const std::vector<std::tuple<double, double>> &controlPoints);
+    bool IsEmpty() const { return coefficients.empty(); }
+    std::tuple<double, double> Evaluate(double t) const;
+    // 区間先頭からの時間 time での X中央位置 分割した折れ線によらないので判定に使う
+    double GetPositionAt(double time) const;
+    // t = from ~ to を両端を結ぶ線分で置き換えたときの、同じ時刻でのX位置の誤差の上限
+    double GetChordErrorBound(double from, const std::tuple<double, double> &fromPoint, double to, const std::tuple<double, double> &toPoint) const;
+};
+
+// Slide の区間 (始点か中継点から、次の中継点か終点まで) ごとに、間の制御点を含めた曲線を作って渡す Injection は飛ばす
+void ForEachSlideCurve(const SusDrawableNoteData &note, const std::function<void(const SusDrawableNoteData &from, const SusDrawableNoteData &to, const SusBezierCurve &curve)> &callback);
+
+// スライド1区間分の曲線 (直前の中継点からの時間, X中央位置(0~1)) の並び
+// NoteCurvesList の中を指しているだけなので、リストに点を足すと使えなくなる
+struct NoteCurve {
+    const std::tuple<double, double> *First = nullptr;
+    uint32_t Count = 0;
+
+    const std::tuple<double, double> *begin() const { return First; }
+    const std::tuple<double, double> *end() const { return First + Count; }
+    size_t size() const { return Count; }
+    bool empty() const { return !Count; }
+    const std::tuple<double, double> &operator[](const size_t index) const { return First[index]; }
+};
+
+// 全スライドの曲線を1本の配列に詰めたもの 区間の終端の中継点ごとに範囲を持つ
+class NoteCurvesList final {
+private:
+    std::vector<std::tuple<double, double>> points;
+    std::unordered_map<const SusDrawableNoteData*, std::tuple<uint32_t, uint32_t>> ranges;   // 先頭, 点数
+    uint32_t pendingFirst = 0;
+
+public:
+    void Clear();
+    void AddPoint(const double time, const double position) { points.emplace_back(time, position); }
+    // 前回の EndCurve 以降に足した点を note で終わる区間の曲線にする
+    void EndCurve(const SusDrawableNoteData *note);
+    // 無ければ空を返す
+    NoteCurve Find(const SusDrawableNoteData *note) const;
+    size_t GetCurveCount() const { return ranges.size(); }
+    size_t GetPointCount() const { return points.size(); }
+};
+
+// 字句解析を済ませた1行 SusAnalyzer::LoadFromLines に渡す
+struct SusTokenizedLine {
+    enum class Kind {
+        Command,
+        Data,
+        Invalid,    // # で始まるが解析できなかった行
+    };
+
+    Kind LineKind;
+    uint32_t Line;          // ファイル先頭からの行番号
+    std::string Name;       // コマンド名 データ行なら小節番号
+    std::string Lane;       // データ行のみ
+    std::string Value;      // データ行なら空白を除いたもの
+};
 
 // BMS派生フォーマットことSUS(SeaUrchinScore)の解析
 class SusAnalyzer final {
 private:
-    static boost::xpressive::sregex regexSusCommand;
-    static boost::xpressive::sregex regexSusData;
-
     const float defaultBeats = 4.0;
     const double defaultBpm = 120.0;
     const uint32_t defaultHispeedNumber = std::numeric_limits<uint32_t>::max();
@@ -232,6 +348,7 @@ private:
     const std::function<std::shared_ptr<SusHispeedTimeline>(uint32_t)> timelineResolver;
 
     uint32_t ticksPerBeat;          // 1拍あたりの分割数(分解能)
+    double curveTolerance;          // スライド曲線の許容誤差(X中央位置) 0以下なら SegmentsPerSecond で等分
     uint32_t measureCountOffset;    // SUSデータから読み込んだ小節数に加算するオフセット
     uint32_t longNoteChannelOffset; // SUSデータから読み込んだロングノーツ識別番号に加算するオフセット
     double longInjectionPerBeat;    // 1拍あたりのロングノーツのカウント(コンボ)数
@@ -239,24 +356,26 @@ private:
     std::vector<std::tuple<SusRelativeNoteTime, SusRawNoteData>> notes; // BPM指定、小節線、ノーツデータ全部入ってる
 
     std::unordered_map<uint32_t, double> bpmDefinitions;
-    std::unordered_map<uint32_t, float> beatsDefinitions;
+    std::map<uint32_t, float> beatsDefinitions;
     std::unordered_map<uint32_t, std::shared_ptr<SusHispeedTimeline>> hispeedDefinitions;
     std::unordered_map<uint32_t, std::shared_ptr<SusNoteExtraAttribute>> extraAttributes;
 
     std::vector<std::tuple<SusRelativeNoteTime, SusRawNoteData>> bpmChanges; // notesからBPM指定だけコピーしてきて使う
+    SusTempoMap tempoMap;   // bpmChangesとbeatsDefinitionsから作る、時刻変換はすべてこれを通す
 
     std::shared_ptr<SusHispeedTimeline> hispeedToApply, hispeedToMeasure;
     std::shared_ptr<SusNoteExtraAttribute> extraAttributeToApply;
 
-    void ProcessCommand(const boost::xpressive::smatch &result, bool onlyMeta, uint32_t line);
+    void FinishLoading();
+    void ProcessCommand(const std::string &command, const std::string &value, bool onlyMeta, uint32_t line);
     void ProcessRequest(const std::string &cmd, uint32_t line);
-    void ProcessData(const boost::xpressive::smatch &result, uint32_t line);
+    void ProcessData(const std::string &measure, const std::string &lane, const std::string &pattern, uint32_t line);
     void MakeMessage(const std::string &message) const;
     void MakeMessage(uint32_t line, const std::string &message) const;
     void MakeMessage(uint32_t meas, uint32_t tick, uint32_t lane, const std::string &message) const;
-    void CalculateCurves(const std::shared_ptr<SusDrawableNoteData>& note, NoteCurvesList &curveData) const;
     uint32_t GetMeasureCount(uint32_t relativeMeasureCount) const;
     uint32_t GetLongNoteChannel(uint32_t relativeLongNoteChannel) const;
+    uint32_t CalculateSettingsHash() const;
 
 public:
     SusMetaData SharedMetaData;
@@ -266,9 +385,22 @@ public:
     ~SusAnalyzer();
 
     void Reset();
+    // 登録したものは Reset しても残る
     void SetMessageCallBack(const std::function<void(std::string, std::string)>& func);
     void LoadFromFile(const std::wstring &fileName, bool analyzeOnlyMetaData = false);
+    // 別に字句解析した行を LoadFromFile と同じく処理する
+    void LoadFromLines(const std::vector<SusTokenizedLine> &lines);
     void RenderScoreData(DrawableNotesList &data, NoteCurvesList &curveData);
+    // Slide 1本分の曲線を curveData に足す RenderScoreData がすべての Slide に対して呼ぶ
+    void CalculateCurves(const std::shared_ptr<SusDrawableNoteData>& note, NoteCurvesList &curveData) const;
+    bool LoadCompiledChart(const std::wstring &fileName, uint32_t sourceHash, DrawableNotesList &data, NoteCurvesList &curveData);
+    void SaveCompiledChart(const std::wstring &fileName, uint32_t sourceHash, const DrawableNotesList &data, const NoteCurvesList &curveData) const;
+    // 曲線を折れ線にしたときの誤差がこれに収まるまで分割する (レーン全幅を1とした単位)
+    void SetCurveTolerance(double tolerance) { curveTolerance = tolerance; }
+    double GetCurveTolerance() const { return curveTolerance; }
+    const SusTempoMap &GetTempoMap() const { return tempoMap; }
+    // 読み込んだままのノーツ (BPM指定・小節線を含む) 時刻順
+    const std::vector<std::tuple<SusRelativeNoteTime, SusRawNoteData>> &GetRawNotes() const { return notes; }
     float GetBeatsAt(uint32_t measure) const;
     double GetBpmAt(uint32_t measure, uint32_t tick) const;
     double GetAbsoluteTime(uint32_t meas, uint32_t tick) const;
@@ -0,0 +1,87 @@
+﻿#include "SusNoteStore.h"
+#include "Misc.h"
+
+using namespace std;
+
+void SusNoteStore::Build(const DrawableNotesList &data)
+{
+    Clear();
+
+    auto total = data.size();
+    for (const auto &note : data) total += note->ExtraData.size();
+    for (auto array : { &Types, &Timelines, &FirstSteps, &StepCounts }) array->reserve(total);
+    for (auto array : { &StartTimes, &Durations, &StartTimesEx, &Positions }) array->reserve(total);
+    Sources.reserve(total);
+
+    unordered_map<shared_ptr<SusHispeedTimeline>, uint32_t> timelineIndices;
+    for (const auto &note : data) Push(note, timelineIndices);
+    rootCount = SU_TO_UINT32(data.size());
+    for (uint32_t i = 0; i < rootCount; ++i) {
+        FirstSteps[i] = SU_TO_UINT32(Sources.size());
+        StepCounts[i] = SU_TO_UINT32(data[i]->ExtraData.size());
+        for (const auto &step : data[i]->ExtraData) Push(step, timelineIndices);
+    }
+    timelineStates.resize(TimelineTable.size());
+    timelineCursors.assign(TimelineTable.size(), 0);
+}
+
+void SusNoteStore::Clear()
+{
+    Types.clear();
+    StartTimes.clear();
+    Durations.clear();
+    StartTimesEx.clear();
+    Timelines.clear();
+    FirstSteps.clear();
+    StepCounts.clear();
+    Positions.clear();
+    TimelineTable.clear();
+    Sources.clear();
+    timelineStates.clear();
+    timelineCursors.clear();
+    rootCount = 0;
+}
+
+void SusNoteStore::Push(const shared_ptr<SusDrawableNoteData> &note, unordered_map<shared_ptr<SusHispeedTimeline>, uint32_t> &timelineIndices)
+{
+    auto timeline = NoTimeline;
+    if (note->Timeline) {
+        const auto known = timelineIndices.find(note->Timeline);
+        if (known != timelineIndices.end()) {
+            timeline = known->second;
+        } else {
+            timeline = SU_TO_UINT32(TimelineTable.size());
+            timelineIndices[note->Timeline] = timeline;
+            TimelineTable.push_back(note->Timeline);
+        }
+    }
+
+    Types.push_back(SU_TO_UINT32(note->Type.to_ulong()));
+    StartTimes.push_back(note->StartTime);
+    Durations.push_back(note->Duration);
+    StartTimesEx.push_back(note->StartTimeEx);
+    Timelines.push_back(timeline);
+    FirstSteps.push_back(0);
+    StepCounts.push_back(0);
+    Positions.push_back(note->ModifiedPosition);
+    Sources.push_back(note);
+}
+
+void SusNoteStore::UpdateTimelines(const double time)
+{
+    for (size_t i = 0; i < TimelineTable.size(); ++i) timelineStates[i] = TimelineTable[i]->GetRawDrawStateAt(time, timelineCursors[i]);
+}
+
+void SusNoteStore::UpdatePositions(const uint32_t index)
+{
+    const auto last = FirstSteps[index] + StepCounts[index];
+    // タイムラインのないノーツは中継点と同じく位置なし (NaN) にする どの表示範囲の比較にも掛からない
+    Positions[index] = Timelines[index] == NoTimeline
+        ? numeric_limits<double>::quiet_NaN()
+        : StartTimesEx[index] - get<1>(timelineStates[Timelines[index]]);
+    for (auto i = FirstSteps[index]; i < last; ++i) {
+        Positions[i] = Timelines[i] == NoTimeline
+            ? numeric_limits<double>::quiet_NaN()
+            : StartTimesEx[i] - get<1>(timelineStates[Timelines[i]]);
+    }
+}
@@ -0,0 +1,43 @@
+﻿#pragma once
+
+#include "SusAnalyzer.h"
+
+// DrawableNotesList を種類ごとの連続配列に展開したもの
+// 親ノーツは元の並びのまま先頭に、中継点(ExtraData)はその後ろに親ごとにまとめて置く
+// 毎フレームの走査と描画位置はこちらで持ち、描画は番号で Positions を読む 判定の状態はノーツ側にあるので判定には Sources を渡す
+class SusNoteStore final {
+public:
+    static const uint32_t NoTimeline = std::numeric_limits<uint32_t>::max();
+
+    std::vector<uint32_t> Types;
+    std::vector<double> StartTimes;
+    std::vector<double> Durations;
+    std::vector<double> StartTimesEx;
+    std::vector<uint32_t> Timelines;        // TimelineTable上の位置 なければNoTimeline
+    std::vector<uint32_t> FirstSteps;       // 中継点の先頭位置 (中継点自身は0)
+    std::vector<uint32_t> StepCounts;
+    std::vector<double> Positions;          // UpdatePositionsで更新 ノーツ側の ModifiedPosition には書き戻さない
+
+    std::vector<std::shared_ptr<SusHispeedTimeline>> TimelineTable;
+    std::vector<std::shared_ptr<SusDrawableNoteData>> Sources;
+
+private:
+    uint32_t rootCount = 0;
+    std::vector<std::tuple<bool, double>> timelineStates;
+    std::vector<size_t> timelineCursors;    // TimelineTable ごとの GetRawDrawStateAt のカーソル
+
+    void Push(const std::shared_ptr<SusDrawableNoteData> &note, std::unordered_map<std::shared_ptr<SusHispeedTimeline>, uint32_t> &timelineIndices);
+
+public:
+    // 曲線は SlideMeshStore が持つのでここには展開しない
+    void Build(const DrawableNotesList &data);
+    void Clear();
+    uint32_t GetRootCount() const { return rootCount; }
+
+    // 時刻 time のハイスピ状態をタイムラインごとに1回だけ引いておく
+    void UpdateTimelines(double time);
+    // UpdateTimelines 後に使う 親ノーツと中継点の Positions を更新する
+    void UpdatePositions(uint32_t index);
+    // タイムラインのないノーツは見えないものとする
+    bool IsVisible(uint32_t index) const { return Timelines[index] != NoTimeline && std::get<0>(timelineStates[Timelines[index]]); }
+};
@@ -0,0 +1,92 @@
+﻿#include "TextureAtlas.h"
+#include "RenderDevice.h"
+
+using namespace std;
+
+TextureAtlasPage::TextureAtlasPage(const int size)
+{
+    softImage = MakeARGB8ColorSoftImage(size, size);
+    FillSoftImage(softImage, 0, 0, 0, 0);
+}
+
+TextureAtlasPage::~TextureAtlasPage()
+{
+    if (graph) RenderDevice::GetCurrent()->DeleteTexture(graph);
+    DeleteSoftImage(softImage);
+}
+
+bool TextureAtlasPage::Insert(const int sourceSoftImage, const int width, const int height, int *x, int *y)
+{
+    const auto padding = TextureAtlas::Padding;
+    const auto cellWidth = width + padding * 2;
+    const auto cellHeight = height + padding * 2;
+    int pageWidth, pageHeight;
+    GetSoftImageSize(softImage, &pageWidth, &pageHeight);
+
+    if (cursorX + cellWidth > pageWidth) {
+        cursorX = 0;
+        cursorY += shelfHeight;
+        shelfHeight = 0;
+    }
+    if (cellWidth > pageWidth || cursorY + cellHeight > pageHeight) return false;
+
+    const auto left = cursorX + padding;
+    const auto top = cursorY + padding;
+    BltSoftImage(0, 0, width, height, sourceSoftImage, left, top, softImage);
+    // 縁の1列を外側に複製する
+    for (auto i = 1; i <= padding; i++) {
+        BltSoftImage(0, 0, width, 1, sourceSoftImage, left, top - i, softImage);
+        BltSoftImage(0, height - 1, width, 1, sourceSoftImage, left, top + height - 1 + i, softImage);
+        BltSoftImage(0, 0, 1, height, sourceSoftImage, left - i, top, softImage);
+        BltSoftImage(width - 1, 0, 1, height, sourceSoftImage, left + width - 1 + i, top, softImage);
+    }
+    // 四隅はいちばん近い角の画素で埋める (空けておくと隣の画像が角に滲む)
+    for (auto i = 1; i <= padding; i++) {
+        for (auto j = 1; j <= padding; j++) {
+            BltSoftImage(0, 0, 1, 1, sourceSoftImage, left - i, top - j, softImage);
+            BltSoftImage(width - 1, 0, 1, 1, sourceSoftImage, left + width - 1 + i, top - j, softImage);
+            BltSoftImage(0, height - 1, 1, 1, sourceSoftImage, left - i, top + height - 1 + j, softImage);
+            BltSoftImage(width - 1, height - 1, 1, 1, sourceSoftImage, left + width - 1 + i, top + height - 1 + j, softImage);
+        }
+    }
+
+    cursorX += cellWidth;
+    shelfHeight = max(shelfHeight, cellHeight);
+    dirty = true;
+    *x = left;
+    *y = top;
+    return true;
+}
+
+int TextureAtlasPage::GetGraphHandle()
+{
+    if (!dirty) return graph;
+    // ハンドルを変えずに中身だけ送り直せば、配ったハンドルはそのまま使える
+    const auto device = RenderDevice::GetCurrent();
+    if (graph) {
+        device->UpdateTextureFromSoftImage(softImage, graph);
+    } else {
+        graph = device->CreateTextureFromSoftImage(softImage);
+    }
+    dirty = false;
+    return graph;
+}
+
+bool TextureAtlas::Insert(const int sourceSoftImage, shared_ptr<TextureAtlasPage> *page, int *x, int *y)
+{
+    int width, height;
+    if (GetSoftImageSize(sourceSoftImage, &width, &height) == -1) return false;
+    if (width <= 0 || height <= 0 || width > MaxImageSize || height > MaxImageSize) return false;
+
+    // 後ろのページほど空きがあるので、後ろから試す
+    for (auto it = pages.rbegin(); it != pages.rend(); ++it) {
+        if (!(*it)->Insert(sourceSoftImage, width, height, x, y)) continue;
+        *page = *it;
+        return true;
+    }
+    const auto newPage = make_shared<TextureAtlasPage>(PageSize);
+    if (!newPage->Insert(sourceSoftImage, width, height, x, y)) return false;
+    pages.push_back(newPage);
+    *page = newPage;
+    return true;
+}
@@ -0,0 +1,38 @@
+﻿#pragma once
+
+// スキンの小さな画像を大きなテクスチャ (ページ) に詰め込む
+// スプライトのバッチ描画はページと中の位置を使い、画像1枚ごとにテクスチャを切り替えずに済ませる
+// ScenePlayer のポリゴン描画などは部分画像を扱えないので、画像自身のハンドルも今までどおり持つ
+// (小さい画像に限るので、二重に持つ分のメモリは許容する)
+
+// 詰め込み先1枚 中身はソフトイメージに溜めておき、描画で使われる直前にテクスチャへ送る
+class TextureAtlasPage final {
+private:
+    int softImage;
+    int graph = 0;
+    bool dirty = false;
+    int cursorX = 0, cursorY = 0, shelfHeight = 0;     // 棚詰め (左から右、あふれたら下の段へ)
+
+public:
+    explicit TextureAtlasPage(int size);
+    ~TextureAtlasPage();
+
+    // 置ける場所があれば書き込んで位置を返す 余白を含めた位置ではなく、画像そのものの左上
+    bool Insert(int sourceSoftImage, int width, int height, int *x, int *y);
+    int GetGraphHandle();
+};
+
+class TextureAtlas final {
+public:
+    static const int PageSize = 2048;
+    static const int MaxImageSize = 256;    // これより大きい画像は詰めない
+    static const int Padding = 1;           // 縁を1ピクセル引き延ばして、拡大時のにじみを防ぐ
+
+private:
+    std::vector<std::shared_ptr<TextureAtlasPage>> pages;
+
+public:
+    // ARGB8 のソフトイメージを詰める 詰められなければ false
+    bool Insert(int sourceSoftImage, std::shared_ptr<TextureAtlasPage> *page, int *x, int *y);
+    size_t GetPageCount() const { return pages.size(); }
+};
@@ -0,0 +1,2142 @@
+﻿#include "VerificationRunner.h"
+#include "BenchmarkRunner.h"
+#include "ScenePlayer.h"
+#include "Replay.h"
+#include "SusAnalyzer.h"
+#include "MusicsManager.h"
+#include "OpeNITHMController.h"
+#include "KeysoundScheduler.h"
+#include "AudioBackend.h"
+#include "SpriteBatch.h"
+#include "SlideMesh.h"
+#include "Profiler.h"
+#include "Setting.h"
+#include "Config.h"
+#include "Misc.h"
+#include <boost/property_tree/json_parser.hpp>
+
+using namespace std;
+namespace ba = boost::algorithm;
+namespace xp = boost::xpressive;
+
+namespace
+{
+    // 字句解析を置き換える前の正規表現 (差分検証の基準)
+    const xp::sregex regexSusCommand = "#" >> (xp::s1 = +xp::alnum) >> !(+xp::space >> (xp::s2 = +(~xp::_n)));
+    const xp::sregex regexSusData = "#" >> (xp::s1 = xp::repeat<3, 3>(xp::alnum)) >> (xp::s2 = xp::repeat<2, 3>(xp::alnum)) >> ":" >> *xp::space >> (xp::s3 = +(~xp::_n));
+
+    // 空白・改行コード・大文字小文字・解析できない行の揺れを集めた譜面
+    const string TokenizerEdgeChart =
+        "\xEF\xBB\xBF#TITLE \"Edge \\\"case\\\"\"\r\n"
+        "#artist\tTab Separated\r\n"
+        "#SUBTITLE   \n"
+        "#DESIGNER\n"
+        "# TITLE spaced\n"
+        "#WAVEOFFSET -0.25\n"
+        "#REQUEST \"segments_per_second 40\"\n"
+        "#BPM01: 150\n"
+        "#bpm02:120.5\n"
+        "#00008: 01 \n"
+        "#00108:02\n"
+        "#00002: 3.5\n"
+        "#TIL00: \"0'0:1.0, 1'96:2.0\"\n"
+        "#HISPEED 00\n"
+        "#ATR01: \"pr:1, h:1.5\"\n"
+        "#ATTRIBUTE 01\n"
+        "#00010: 11 12  13 14\r\n"
+        "#0001a:\t1100\n"
+        "#00130a: 1200000022000000\r\n"
+        "#00131a: 0000320000000000\n"
+        "#00150: 10\n"
+        "#00151: 0012\n"
+        "#00220a: 12002200\n"
+        "#00240b: 1200000000002200\n"
+        "#001500:\n"
+        "#00310:     \n"
+        "#\n"
+        "#001\n"
+        "#0011: 11\n"
+        "#ABCDEFG: 11\n"
+        "#NOSPEED\n"
+        "not a command\n"
+        "\n"
+        "#00410: 11\r\n"
+        "#00510:11";
+
+    // 不可視中継点をまたいで曲がり、幅も変わる Slide
+    const string SlideInvisibleStepChart =
+        "#BPM01: 150\n"
+        "#00008: 01\n"
+        "#00030a: 14000000000000000000\n"
+        "#00034a: 00440000000000000000\n"
+        "#00038a: 00000054000000000000\n"
+        "#0003ba: 00000000004400000000\n"
+        "#00036a: 00000000000000340000\n"
+        "#00032a: 00000000000000000022\n";
+
+    // BPM120 で1小節2秒 1小節目 (2秒) から半拍ずつ、押す時刻のずれで判定が分かれる Tap と Air
+    const string InputEventChart =
+        "#BPM01: 120\n"
+        "#00008: 01\n"
+        "#00110: 14000000\n"
+        "#00114: 00140000\n"
+        "#00118: 00001400\n"
+        "#0011c: 00000014\n"
+        "#00214: 00140000\n"
+        "#00310: 14000000\n"
+        "#00350: 14000000\n";
+
+    string MakeLibraryChart(const string &songId, const string &title, const int level)
+    {
+        return fmt::format("#SONGID \"{0}\"\n#TITLE \"{1}\"\n#ARTIST \"Verification\"\n#DIFFICULTY 2\n#PLAYLEVEL {2}\n#00010: 11\n", songId, title, level);
+    }
+
+    // カテゴリ/曲ディレクトリ/譜面:曲名:レベル の一覧にして比べる
+    vector<string> DescribeLibrary(const MusicLibrary &library)
+    {
+        vector<string> result;
+        for (const auto &category : library) {
+            for (const auto &music : category->Musics) {
+                for (const auto &score : music->Scores) {
+                    result.push_back(fmt::format("{0}/{1}:{2}:{3}", category->GetName(), score->Path.generic_string(), music->Name, score->Level));
+                }
+            }
+        }
+        sort(result.begin(), result.end());
+        return result;
+    }
+}
+
+VerificationRunner::VerificationRunner(ExecutionManager *exm) : manager(exm)
+{}
+
+bool VerificationRunner::Expect(const bool condition, const string &subject, const string &message)
+{
+    ++checkCount;
+    if (condition) return true;
+    ++failureCount;
+    spdlog::get("main")->error(u8"検証失敗 ({0}): {1}", subject, message);
+    return false;
+}
+
+bool VerificationRunner::ExpectReference(const string &subject, const wstring &name, const string &actual)
+{
+    const auto reference = referenceDirectory / name;
+    const auto actualFile = WriteWorkFile(name, actual);
+    if (!boost::filesystem::exists(reference)) {
+        return Expect(false, subject, fmt::format(u8"記録済みの結果 {0} がありません", ConvertUnicodeToUTF8(reference.wstring())));
+    }
+    // チェックアウトで改行が CRLF になっていても比べられるように
+    auto expected = ReadWholeFile(reference);
+    expected.erase(remove(expected.begin(), expected.end(), '\r'), expected.end());
+    const auto differ = mismatch(expected.begin(), expected.end(), actual.begin(), actual.end());
+    const auto line = count(actual.begin(), differ.second, '\n') + 1;
+    return Expect(expected == actual, subject, fmt::format(u8"{0} が記録済みの結果と{1}行目から食い違います", ConvertUnicodeToUTF8(actualFile.wstring()), line));
+}
+
+boost::filesystem::path VerificationRunner::WriteWorkFile(const wstring &name, const string &content) const
+{
+    const auto file = workDirectory / name;
+    WriteWholeFile(file, content);
+    return file;
+}
+
+void VerificationRunner::WriteWholeFile(const boost::filesystem::path &file, const string &content)
+{
+    ofstream stream(file.wstring(), ios::out | ios::binary | ios::trunc);
+    stream << content;
+}
+
+string VerificationRunner::ReadWholeFile(const boost::filesystem::path &file)
+{
+    ifstream stream(file.wstring(), ios::in | ios::binary);
+    return string((istreambuf_iterator<char>(stream)), istreambuf_iterator<char>());
+}
+
+string VerificationRunner::CompileToBytes(SusAnalyzer &analyzer, const wstring &name) const
+{
+    DrawableNotesList data;
+    NoteCurvesList curveData;
+    analyzer.RenderScoreData(data, curveData);
+    const auto file = workDirectory / name;
+    analyzer.SaveCompiledChart(file.wstring(), 0, data, curveData);
+    return ReadWholeFile(file);
+}
+
+// 置き換える前と同じく、1行ずつ正規表現に掛けて解析する
+// 改行は手書きの字句解析と同じく CRLF・LF・CR のどれでもよいので、先に LF に揃えておく
+void VerificationRunner::LoadWithRegex(SusAnalyzer &analyzer, const wstring &fileName)
+{
+    auto buffer = ReadWholeFile(fileName);
+    if (ba::starts_with(buffer, "\xEF\xBB\xBF")) buffer.erase(0, 3);
+    ba::replace_all(buffer, "\r\n", "\n");
+    replace(buffer.begin(), buffer.end(), '\r', '\n');
+    istringstream stream(buffer);
+    string rawline;
+    xp::smatch match;
+    vector<SusTokenizedLine> lines;
+    uint32_t line = 0;
+    while (getline(stream, rawline)) {
+        ++line;
+        if (rawline.empty() || rawline[0] != '#') continue;
+
+        if (xp::regex_match(rawline, match, regexSusCommand)) {
+            lines.push_back({ SusTokenizedLine::Kind::Command, line, match[1].str(), "", match[2].str() });
+        } else if (xp::regex_match(rawline, match, regexSusData)) {
+            auto pattern = match[3].str();
+            ba::erase_all(pattern, " ");
+            lines.push_back({ SusTokenizedLine::Kind::Data, line, match[1].str(), match[2].str(), pattern });
+        } else {
+            lines.push_back({ SusTokenizedLine::Kind::Invalid, line, "", "", "" });
+        }
+    }
+    analyzer.LoadFromLines(lines);
+}
+
+// 手書きの字句解析と置き換え前の正規表現とで、警告と解析結果がすべて一致するか
+void VerificationRunner::VerifyTokenizer()
+{
+    vector<boost::filesystem::path> files;
+    for (const auto &profile : BenchmarkRunner::GetDefaultCorpus()) {
+        files.push_back(WriteWorkFile(ConvertUTF8ToUnicode(profile.Name) + L".sus", BenchmarkRunner::GenerateChart(profile)));
+    }
+    files.push_back(WriteWorkFile(L"tokenizer-edge.sus", TokenizerEdgeChart));
+
+    // 同じ譜面の改行だけを変えたもの 最終行は CR が値に残りやすいコマンドにする
+    const auto lfChart = ba::replace_all_copy(TokenizerEdgeChart, "\r\n", "\n") + "\n#DESIGNER \"Last Line\"";
+    const vector<pair<wstring, string>> newlineCharts = {
+        { L"tokenizer-lf.sus", lfChart },
+        { L"tokenizer-crlf.sus", ba::replace_all_copy(lfChart, "\n", "\r\n") + "\r\n" },
+        { L"tokenizer-cr.sus", ba::replace_all_copy(lfChart, "\n", "\r") },
+        { L"tokenizer-trailing-cr.sus", lfChart + "\r" },
+        { L"tokenizer-mixed.sus", TokenizerEdgeChart + "\r\n#DESIGNER \"Last Line\"\r" },
+    };
+    for (const auto &chart : newlineCharts) files.push_back(WriteWorkFile(chart.first, chart.second));
+
+    // 手元の楽曲フォルダにある譜面もすべて比べる
+    const auto musicDirectory = boost::filesystem::path(Setting::GetRootDirectory()) / SU_MUSIC_DIR;
+    boost::system::error_code ec;
+    for (boost::filesystem::recursive_directory_iterator it(musicDirectory, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->path().extension() == ".sus") files.push_back(it->path());
+    }
+
+    for (const auto &file : files) {
+        const auto subject = u8"tokenizer " + ConvertUnicodeToUTF8(file.filename().wstring());
+        SusAnalyzer current(192), reference(192);
+        vector<string> currentMessages, referenceMessages;
+        current.SetMessageCallBack([&currentMessages](const string &, const string &message) { currentMessages.push_back(message); });
+        reference.SetMessageCallBack([&referenceMessages](const string &, const string &message) { referenceMessages.push_back(message); });
+
+        current.LoadFromFile(file.wstring());
+        LoadWithRegex(reference, file.wstring());
+        const auto &currentNotes = current.GetRawNotes();
+        const auto &referenceNotes = reference.GetRawNotes();
+        Expect(currentNotes.size() == referenceNotes.size(), subject,
+            fmt::format(u8"ノーツ数が一致しません ({0}と{1})", currentNotes.size(), referenceNotes.size()));
+        for (size_t i = 0; i < min(currentNotes.size(), referenceNotes.size()); i++) {
+            const auto &a = currentNotes[i];
+            const auto &b = referenceNotes[i];
+            const auto same = get<0>(a) == get<0>(b)
+                && get<1>(a).Type == get<1>(b).Type
+                && get<1>(a).DefinitionNumber == get<1>(b).DefinitionNumber
+                && get<1>(a).Extra == get<1>(b).Extra;
+            if (!Expect(same, subject, fmt::format(u8"{0}番目のノーツが一致しません", i))) break;
+        }
+
+        const auto currentBytes = CompileToBytes(current, L"tokenizer-current.susc");
+        const auto referenceBytes = CompileToBytes(reference, L"tokenizer-reference.susc");
+        Expect(currentBytes == referenceBytes, subject, u8"解析結果が一致しません");
+        Expect(currentMessages == referenceMessages, subject,
+            fmt::format(u8"警告が一致しません ({0}件と{1}件)", currentMessages.size(), referenceMessages.size()));
+    }
+
+    // 2つの字句解析が揃って CR を取り違えても上では見つからないので、LF だけのものと直接比べる
+    const auto load = [&](const wstring &name) {
+        SusAnalyzer analyzer(192);
+        vector<string> messages;
+        analyzer.SetMessageCallBack([&messages](const string &, const string &message) { messages.push_back(message); });
+        analyzer.LoadFromFile((workDirectory / name).wstring());
+        const auto designer = analyzer.SharedMetaData.UDesigner;
+        return make_tuple(CompileToBytes(analyzer, L"tokenizer-newline.susc"), messages, designer);
+    };
+    const auto expected = load(newlineCharts[0].first);
+    Expect(get<2>(expected) == "Last Line", u8"tokenizer newline", fmt::format(u8"最終行の値が違います (\"{0}\")", get<2>(expected)));
+    for (size_t i = 1; i < newlineCharts.size(); i++) {
+        const auto subject = u8"tokenizer " + ConvertUnicodeToUTF8(newlineCharts[i].first);
+        const auto actual = load(newlineCharts[i].first);
+        Expect(get<0>(actual) == get<0>(expected), subject, u8"LF だけの譜面と解析結果が一致しません");
+        Expect(get<1>(actual) == get<1>(expected), subject,
+            fmt::format(u8"LF だけの譜面と警告が一致しません ({0}件と{1}件)", get<1>(actual).size(), get<1>(expected).size()));
+        Expect(get<2>(actual) == get<2>(expected), subject, fmt::format(u8"最終行の値が違います (\"{0}\")", get<2>(actual)));
+    }
+}
+
+// コンパイル済み譜面を読み込んで書き出し直したものが、元の書き出しとバイト単位で一致するか
+// 元譜面のハッシュや解析の設定が違うものは読み込まないか
+void VerificationRunner::VerifyCompiledChart()
+{
+    const uint32_t sourceHash = 0x5355u;
+    vector<pair<string, boost::filesystem::path>> charts;
+    for (const auto &profile : BenchmarkRunner::GetDefaultCorpus()) {
+        charts.emplace_back(profile.Name, WriteWorkFile(ConvertUTF8ToUnicode(profile.Name) + L".sus", BenchmarkRunner::GenerateChart(profile)));
+    }
+    charts.emplace_back("tokenizer-edge", WriteWorkFile(L"tokenizer-edge.sus", TokenizerEdgeChart));
+
+    for (const auto &chart : charts) {
+        const auto subject = u8"compiled-chart " + chart.first;
+        for (const auto tolerance : { 0.0, SU_SLIDE_CURVE_TOLERANCE }) {
+            const auto savedFile = workDirectory / L"compiled-saved.susc";
+            const auto resavedFile = workDirectory / L"compiled-resaved.susc";
+            DrawableNotesList data;
+            NoteCurvesList curveData;
+            SusAnalyzer source(192);
+            source.SetCurveTolerance(tolerance);
+            source.LoadFromFile(chart.second.wstring());
+            source.RenderScoreData(data, curveData);
+            source.SaveCompiledChart(savedFile.wstring(), sourceHash, data, curveData);
+
+            DrawableNotesList loadedData;
+            NoteCurvesList loadedCurveData;
+            SusAnalyzer loaded(192);
+            loaded.SetCurveTolerance(tolerance);
+            if (!Expect(loaded.LoadCompiledChart(savedFile.wstring(), sourceHash, loadedData, loadedCurveData), subject, u8"書き出したものを読み込めません")) continue;
+            Expect(loadedData.size() == data.size(), subject, fmt::format(u8"ノーツ数が一致しません ({0}と{1})", loadedData.size(), data.size()));
+            loaded.SaveCompiledChart(resavedFile.wstring(), sourceHash, loadedData, loadedCurveData);
+            Expect(ReadWholeFile(savedFile) == ReadWholeFile(resavedFile), subject, fmt::format(u8"書き出し直した内容が一致しません (許容誤差{0})", tolerance));
+
+            SusAnalyzer other(192);
+            other.SetCurveTolerance(tolerance);
+            Expect(!other.LoadCompiledChart(savedFile.wstring(), sourceHash + 1, loadedData, loadedCurveData), subject, u8"元譜面のハッシュが違うのに読み込みました");
+            other.SetCurveTolerance(tolerance + 0.25 / 1024);
+            Expect(!other.LoadCompiledChart(savedFile.wstring(), sourceHash, loadedData, loadedCurveData), subject, u8"許容誤差が違うのに読み込みました");
+        }
+    }
+
+    // 壊れたキャッシュは例外を出さずに読み込み失敗 (解析しなおし) になるか
+    // 小さな譜面で、途中で切れたものと、どこか4バイトを 0xffffffff にしたものをすべて試す
+    const auto subject = u8"compiled-chart broken";
+    const auto brokenSource = WriteWorkFile(L"compiled-broken.sus", "#BPM01: 120\n#00008: 01\n#00010: 1114\n#00110a: 12002200\n");
+    const auto savedFile = workDirectory / L"compiled-broken.susc";
+    DrawableNotesList data;
+    NoteCurvesList curveData;
+    SusAnalyzer source(192);
+    source.LoadFromFile(brokenSource.wstring());
+    source.RenderScoreData(data, curveData);
+    source.SaveCompiledChart(savedFile.wstring(), sourceHash, data, curveData);
+    Expect(!exists(workDirectory / L"compiled-broken.susc.tmp"), subject, u8"書き出し用の一時ファイルが残っています");
+    const auto saved = ReadWholeFile(savedFile);
+    const auto tryLoad = [&](const string &bytes, bool &loaded) {
+        const auto file = WriteWorkFile(L"compiled-broken-input.susc", bytes);
+        SusAnalyzer analyzer(192);
+        try {
+            loaded = analyzer.LoadCompiledChart(file.wstring(), sourceHash, data, curveData);
+            return true;
+        } catch (const exception &) {
+            return false;
+        }
+    };
+    for (size_t size = 16; size < saved.size(); size++) {
+        auto loaded = false;
+        const auto succeeded = tryLoad(saved.substr(0, size), loaded);
+        if (!Expect(succeeded && !loaded, subject, fmt::format(u8"{0}バイトで切れたものを{1}", size, succeeded ? u8"読み込みました" : u8"読もうとして例外が出ました"))) break;
+    }
+    for (size_t offset = 16; offset + 4 <= saved.size(); offset++) {
+        auto bytes = saved;
+        bytes.replace(offset, 4, "\xff\xff\xff\xff");
+        auto loaded = false;
+        if (!Expect(tryLoad(bytes, loaded), subject, fmt::format(u8"{0}バイト目からを壊したものを読もうとして例外が出ました", offset))) break;
+    }
+}
+
+// ランダムな拍数・BPM変化で作った SusTempoMap を、元の毎回先頭から数える実装と比べる
+void VerificationRunner::VerifyTempoMap()
+{
+    const auto subject = u8"tempo-map";
+    const uint32_t ticksPerBeat = 192;
+    const auto defaultBeats = 4.0f;
+    const auto defaultBpm = 120.0;
+    mt19937 random(0x54454d50);
+    const auto randomInt = [&](const int low, const int high) { return uniform_int_distribution<int>(low, high)(random); };
+    const auto randomReal = [&](const double low, const double high) { return uniform_real_distribution<double>(low, high)(random); };
+
+    for (auto trial = 0; trial < 300; trial++) {
+        // 拍子はtickが整数になるものに限る 同じ位置の変化点・小節頭や0'0の変化点を混ぜる
+        map<uint32_t, float> beatsDefinitions;
+        const auto beatsCount = randomInt(0, 6);
+        for (auto i = 0; i < beatsCount; i++) beatsDefinitions[randomInt(0, 30)] = float(randomInt(1, 28)) / 4;
+        const auto beatsLinear = [&](const uint32_t measure) {
+            auto result = defaultBeats;
+            auto last = 0u;
+            for (const auto &t : beatsDefinitions) {
+                if (t.first >= last && t.first <= measure) {
+                    result = t.second;
+                    last = t.first;
+                }
+            }
+            return result;
+        };
+        vector<tuple<SusRelativeNoteTime, double>> bpmChanges;
+        if (randomInt(0, 1)) bpmChanges.emplace_back(SusRelativeNoteTime { 0, 0 }, randomReal(60, 300));
+        const auto changeCount = randomInt(0, 16);
+        for (auto i = 0; i < changeCount; i++) {
+            const auto measure = SU_TO_UINT32(randomInt(0, 30));
+            const auto tick = randomInt(0, 2) ? SU_TO_UINT32(randomInt(0, SU_TO_INT32(beatsLinear(measure) * ticksPerBeat) - 1)) : 0u;
+            bpmChanges.emplace_back(SusRelativeNoteTime { measure, tick }, randomInt(0, 9) ? randomReal(30, 400) : randomReal(600, 1200));
+            if (!randomInt(0, 5)) bpmChanges.emplace_back(get<0>(bpmChanges.back()), randomReal(30, 400));
+        }
+        stable_sort(bpmChanges.begin(), bpmChanges.end(), [](const tuple<SusRelativeNoteTime, double> &a, const tuple<SusRelativeNoteTime, double> &b) {
+            return get<0>(a) < get<0>(b);
+        });
+
+        SusTempoMap tempoMap;
+        tempoMap.Compile(ticksPerBeat, beatsDefinitions, bpmChanges, defaultBeats, defaultBpm);
+
+        // 元の SusAnalyzer の NormalizeRelativeTime / GetBpmAt / GetAbsoluteTime / GetRelativeTime
+        const auto normalizeLinear = [&](const uint32_t meas, const uint32_t tick) {
+            auto nm = meas;
+            auto nt = tick;
+            while (nt >= beatsLinear(nm) * ticksPerBeat) nt -= SU_TO_UINT32(beatsLinear(nm++) * ticksPerBeat);
+            return make_tuple(nm, nt);
+        };
+        const auto bpmLinear = [&](const uint32_t measure, const uint32_t tick) {
+            uint32_t nm, nt;
+            tie(nm, nt) = normalizeLinear(measure, tick);
+            auto result = defaultBpm;
+            auto lastMeasure = 0u;
+            auto lastTick = 0u;
+            for (const auto &t : bpmChanges) {
+                const auto bcTime = get<0>(t);
+                if (bcTime.Measure > nm || bcTime.Measure < lastMeasure) continue;
+                if (bcTime.Measure == lastMeasure && lastTick > bcTime.Tick) continue;
+                result = get<1>(t);
+                lastMeasure = bcTime.Measure;
+                lastTick = bcTime.Tick;
+            }
+            return result;
+        };
+        const auto absoluteLinear = [&](const uint32_t meas, const uint32_t tick) {
+            auto time = 0.0;
+            auto lastBpm = defaultBpm;
+            uint32_t nm, nt;
+            tie(nm, nt) = normalizeLinear(meas, tick);
+            for (auto i = 0u; i < nm + 1; i++) {
+                const auto beats = beatsLinear(i);
+                auto lastChangeTick = 0u;
+                for (const auto &bc : bpmChanges) {
+                    if (get<0>(bc).Measure != i) continue;
+                    const auto timing = get<0>(bc);
+                    if (i == nm && timing.Tick >= nt) break;
+                    time += (60.0 / lastBpm) * (double(timing.Tick - lastChangeTick) / ticksPerBeat);
+                    lastChangeTick = timing.Tick;
+                    lastBpm = get<1>(bc);
+                }
+                if (i == nm) {
+                    time += (60.0 / lastBpm) * (double(nt - lastChangeTick) / ticksPerBeat);
+                } else {
+                    time += (60.0 / lastBpm) * (double(ticksPerBeat * beats - lastChangeTick) / ticksPerBeat);
+                }
+            }
+            return time;
+        };
+        const auto relativeLinear = [&](const double time) {
+            auto restTime = time;
+            uint32_t meas = 0;
+            auto secPerBeat = 60.0 / defaultBpm;
+            while (true) {
+                const auto beats = beatsLinear(meas);
+                auto lastChangeTick = 0u;
+                for (const auto &bc : bpmChanges) {
+                    const auto timing = get<0>(bc);
+                    if (timing.Measure != meas) continue;
+                    const auto dur = secPerBeat * (double(timing.Tick - lastChangeTick) / ticksPerBeat);
+                    if (dur >= restTime) return make_tuple(meas, lastChangeTick + static_cast<uint32_t>(restTime / secPerBeat * ticksPerBeat));
+                    restTime -= dur;
+                    lastChangeTick = timing.Tick;
+                    secPerBeat = 60.0 / get<1>(bc);
+                }
+                const double restTicks = ticksPerBeat * beats - lastChangeTick;
+                const auto restDuration = restTicks / ticksPerBeat * secPerBeat;
+                if (restDuration >= restTime) return make_tuple(meas, lastChangeTick + static_cast<uint32_t>(restTime / secPerBeat * ticksPerBeat));
+                restTime -= restDuration;
+                meas++;
+            }
+        };
+
+        // 変化点ちょうどとその前後・小節末尾・小節をまたいだtick・定義の範囲より後ろ
+        vector<SusRelativeNoteTime> positions;
+        for (const auto &bc : bpmChanges) {
+            const auto at = get<0>(bc);
+            positions.push_back(at);
+            if (at.Tick) positions.push_back({ at.Measure, at.Tick - 1 });
+            positions.push_back({ at.Measure, at.Tick + 1 });
+        }
+        for (auto measure = 0u; measure < 36; measure++) {
+            const auto ticks = SU_TO_UINT32(beatsLinear(measure) * ticksPerBeat);
+            positions.push_back({ measure, 0 });
+            positions.push_back({ measure, ticks - 1 });
+            positions.push_back({ measure, ticks });
+        }
+        for (auto i = 0; i < 200; i++) positions.push_back({ SU_TO_UINT32(randomInt(0, 40)), SU_TO_UINT32(randomInt(0, 3000)) });
+
+        auto mismatch = false;
+        string detail;
+        const auto fail = [&](const string &message) {
+            if (!mismatch) detail = message;
+            mismatch = true;
+        };
+        vector<double> times = { 0.0 };
+        for (const auto &position : positions) {
+            const auto expectedTime = absoluteLinear(position.Measure, position.Tick);
+            const auto time = tempoMap.GetAbsoluteTime(position.Measure, position.Tick);
+            // 定義の範囲より後ろは外挿で求めるので、足し算の順が違う分だけずれる
+            if (abs(time - expectedTime) > 1e-9 * max(1.0, expectedTime)) {
+                fail(fmt::format(u8"GetAbsoluteTime({0}, {1}) が {2} (元の実装は {3})", position.Measure, position.Tick, time, expectedTime));
+            }
+            if (tempoMap.GetBpmAt(position.Measure, position.Tick) != bpmLinear(position.Measure, position.Tick)) {
+                fail(fmt::format(u8"GetBpmAt({0}, {1}) が {2} (元の実装は {3})", position.Measure, position.Tick, tempoMap.GetBpmAt(position.Measure, position.Tick), bpmLinear(position.Measure, position.Tick)));
+            }
+            if (tempoMap.NormalizeRelativeTime(position.Measure, position.Tick) != normalizeLinear(position.Measure, position.Tick)) {
+                fail(fmt::format(u8"NormalizeRelativeTime({0}, {1}) が元の実装と違います", position.Measure, position.Tick));
+            }
+            times.push_back(expectedTime);
+            times.push_back(nextafter(expectedTime, -numeric_limits<double>::infinity()));
+            times.push_back(nextafter(expectedTime, numeric_limits<double>::infinity()));
+        }
+        for (auto i = 0; i < 200; i++) times.push_back(randomReal(0, absoluteLinear(40, 0)));
+
+        for (const auto time : times) {
+            if (time < 0) continue;
+            const auto expected = relativeLinear(time);
+            const auto actual = tempoMap.GetRelativeTime(time);
+            if (actual == expected) continue;
+            // 元の実装は小節の長さを引いていくので、小節の境目ちょうどでは丸めによって前の小節の末尾にも次の小節の頭にもなる
+            // 同じ時刻を指していればよいとし、どちらにするかは下で別に確かめる
+            const auto tolerance = 1e-9 * max(1.0, time);
+            if (abs(absoluteLinear(get<0>(actual), get<1>(actual)) - absoluteLinear(get<0>(expected), get<1>(expected))) <= tolerance) continue;
+            const auto later = max(actual, expected);
+            // tick ちょうどの時刻は切り捨てる前の誤差で、小節をまたいでもどちらの tick にもなりうる
+            const auto ticksLinear = [&](const tuple<uint32_t, uint32_t> &at) {
+                auto result = 0.0f;
+                for (auto i = 0u; i < get<0>(at); i++) result += beatsLinear(i) * ticksPerBeat;
+                return SU_TO_UINT32(result) + get<1>(at);
+            };
+            if (ticksLinear(later) - ticksLinear(min(actual, expected)) == 1 && abs(absoluteLinear(get<0>(later), get<1>(later)) - time) <= tolerance) continue;
+            fail(fmt::format(u8"GetRelativeTime({0}) が {1}'{2} (元の実装は {3}'{4})", time, get<0>(actual), get<1>(actual), get<0>(expected), get<1>(expected)));
+        }
+        // 小節末尾ちょうどの時刻は次の小節の頭ではなくその小節に含める (tick の切り捨ての誤差は上と同じく認める)
+        for (auto measure = 0u; measure < 36; measure++) {
+            const auto ticks = SU_TO_UINT32(beatsLinear(measure) * ticksPerBeat);
+            const auto actual = tempoMap.GetRelativeTime(tempoMap.GetAbsoluteTime(measure + 1, 0));
+            if (get<0>(actual) != measure || get<1>(actual) + 1 < ticks) fail(fmt::format(u8"{0}小節目の末尾が {1}'{2} になります", measure, get<0>(actual), get<1>(actual)));
+        }
+        if (!Expect(!mismatch, subject, u8"元の実装と一致しません: " + detail)) break;
+    }
+}
+
+// ランダムな定義文字列から作ったハイスピードを、区間を先頭から線形に探していた元の実装と比べる
+// 再生中のような昇順、シークのようなばらばら、まとめて引く場合をすべて見る
+void VerificationRunner::VerifyHispeedTimeline()
+{
+    const auto subject = u8"hispeed-timeline";
+    mt19937 random(0x48535054);
+    const auto randomInt = [&](const int low, const int high) { return uniform_int_distribution<int>(low, high)(random); };
+    const auto randomReal = [&](const double low, const double high) { return uniform_real_distribution<double>(low, high)(random); };
+    const auto relToAbs = [](const uint32_t measure, const uint32_t tick) { return measure * 2.0 + tick / 192.0 * 0.5; };
+
+    // 元の GetRawDrawStateAt / GetSpeedAt
+    const auto findLinear = [](const SusHispeedTimeline &timeline, const double time) {
+        const auto &segments = timeline.GetSegments();
+        auto lastData = segments[0];
+        for (size_t i = 1; i < segments.size(); i++) {
+            if (get<0>(segments[i]) >= time) break;
+            lastData = segments[i];
+        }
+        return lastData;
+    };
+    const auto stateLinear = [&](const SusHispeedTimeline &timeline, const double time) {
+        const auto lastData = findLinear(timeline, time);
+        return make_tuple(get<2>(lastData).VisibilityState == SusHispeedData::Visibility::Visible, get<1>(lastData) + (time - get<0>(lastData)) * get<2>(lastData).Speed);
+    };
+
+    for (auto trial = 0; trial < 500; trial++) {
+        // 重複・逆順・負や0の速度・表示切り替え・空の要素を混ぜる
+        vector<string> keys;
+        const auto keyCount = randomInt(0, 24);
+        for (auto i = 0; i < keyCount; i++) {
+            auto key = fmt::format("{0}'{1}", randomInt(0, 40), randomInt(0, 3) ? randomInt(0, 767) : 0);
+            switch (randomInt(0, 6)) {
+                case 0: key += ":v"; break;
+                case 1: key += fmt::format(":{0:.2f}:i", randomReal(-2, 4)); break;
+                case 2: key += ":0"; break;
+                case 3: key += fmt::format(" : {0:.3f}", randomReal(-1, 8)); break;
+                default: key += fmt::format(":{0:.2f}", randomReal(0.1, 4)); break;
+            }
+            keys.push_back(key);
+        }
+        if (randomInt(0, 9) == 0) keys.push_back("broken");
+        const auto definition = ba::join(keys, ", ");
+
+        SusHispeedTimeline timeline(relToAbs);
+        timeline.AddKeysByString(definition, [](uint32_t) { return nullptr; });
+        timeline.Finialize();
+
+        vector<double> times;
+        for (auto i = 0; i < 200; i++) times.push_back(randomReal(-10, 90));
+        for (const auto &point : timeline.GetSegments()) {
+            times.push_back(get<0>(point));
+            times.push_back(nextafter(get<0>(point), -numeric_limits<double>::infinity()));
+            times.push_back(nextafter(get<0>(point), numeric_limits<double>::infinity()));
+        }
+        shuffle(times.begin(), times.end(), random);
+        auto sortedTimes = times;
+        sort(sortedTimes.begin(), sortedTimes.end());
+
+        auto mismatch = false;
+        for (const auto &order : { times, sortedTimes }) {
+            size_t cursor = 0;
+            for (const auto time : order) {
+                if (timeline.GetRawDrawStateAt(time) != stateLinear(timeline, time)) mismatch = true;
+                if (timeline.GetRawDrawStateAt(time, cursor) != stateLinear(timeline, time)) mismatch = true;
+                if (timeline.GetSpeedAt(time) != get<2>(findLinear(timeline, time)).Speed) mismatch = true;
+            }
+        }
+        vector<tuple<bool, double>> states;
+        timeline.GetRawDrawStatesAt(sortedTimes, states);
+        for (size_t i = 0; i < sortedTimes.size(); i++) {
+            if (states[i] != stateLinear(timeline, sortedTimes[i])) mismatch = true;
+        }
+
+        // 表示範囲の境界: これより前は必ず手前、これより後は必ず奥
+        for (auto i = 0; i < 8; i++) {
+            const auto position = randomReal(-20, 120);
+            const auto earliest = timeline.GetEarliestTimeReaching(position);
+            const auto latest = timeline.GetLatestTimeWithin(position);
+            for (const auto time : sortedTimes) {
+                const auto drawn = get<1>(stateLinear(timeline, time));
+                if (time < earliest && drawn > position + 1e-9) mismatch = true;
+                if (time > latest && drawn < position - 1e-9) mismatch = true;
+            }
+        }
+        if (!Expect(!mismatch, subject, fmt::format(u8"元の実装と一致しません (\"{0}\")", definition))) break;
+    }
+}
+
+// NoteWindow の差分の出し入れが、毎回全ノーツの区間を見て絞った結果と一致するか
+// 再生と同じ細かい前進に、シーク・巻き戻し・幅の変更・区間の端ちょうどの時刻を混ぜる
+void VerificationRunner::VerifyNoteWindow()
+{
+    const auto subject = u8"note-window";
+    mt19937 random(0x4E57494E);
+    const auto randomInt = [&](const int low, const int high) { return uniform_int_distribution<int>(low, high)(random); };
+    const auto randomReal = [&](const double low, const double high) { return uniform_real_distribution<double>(low, high)(random); };
+    const auto infinity = numeric_limits<double>::infinity();
+
+    // Reset し直したときに前の状態が残らないか見るため、同じものを使い回す
+    NoteWindow window;
+    vector<uint32_t> actual, expected;
+    for (auto trial = 0; trial < 300; trial++) {
+        const auto count = randomInt(0, 200);
+        vector<uint32_t> order(count);
+        iota(order.begin(), order.end(), 0);
+        shuffle(order.begin(), order.end(), random);
+
+        // 同じ時刻の区間、長さ0の区間、Enter > Leave (常に対象外)、端のない区間を混ぜる
+        vector<tuple<double, double>> lifetimes;
+        vector<double> edges;
+        for (auto i = 0; i < count; i++) {
+            auto enter = randomInt(0, 3) ? randomReal(-5, 60) : double(randomInt(-5, 60));
+            auto leave = enter + (randomInt(0, 3) ? randomReal(0, 8) : double(randomInt(0, 4)));
+            switch (randomInt(0, 9)) {
+                case 0: leave = enter; break;
+                case 1: swap(enter, leave); enter += 1; break;
+                case 2: enter = -infinity; break;
+                case 3: leave = infinity; break;
+                default: break;
+            }
+            lifetimes.emplace_back(enter, leave);
+            if (isfinite(enter)) edges.push_back(enter);
+            if (isfinite(leave)) edges.push_back(leave);
+        }
+        window.Reset(order, lifetimes);
+
+        const auto scan = [&](const double time, const double margin, const function<bool(uint32_t)> &pred) {
+            expected.clear();
+            const auto enterTime = time + margin;
+            const auto leaveTime = time - margin;
+            for (size_t i = 0; i < order.size(); i++) {
+                const auto enter = get<0>(lifetimes[i]);
+                const auto leave = get<1>(lifetimes[i]);
+                if (enter > leave || enter > enterTime || leave < leaveTime) continue;
+                if (pred(order[i])) expected.push_back(order[i]);
+            }
+        };
+        const auto all = [](uint32_t) { return true; };
+        const auto some = [](const uint32_t note) { return note % 3 != 0; };
+
+        auto time = randomReal(-8, 0);
+        auto margin = 0.0;
+        string step;
+        auto mismatch = false;
+        for (auto i = 0; i < 400 && !mismatch; i++) {
+            switch (randomInt(0, 11)) {
+                case 0: time += randomReal(1, 20); step = u8"先送り"; break;
+                case 1: time -= randomReal(0, 20); step = u8"巻き戻し"; break;
+                case 2: time -= 1.0 / 60; step = u8"1フレーム巻き戻し"; break;
+                case 3: margin = randomInt(0, 2) ? randomReal(0, 0.5) : 0; step = u8"幅の変更"; break;
+                case 4:
+                    if (edges.empty()) continue;
+                    time = edges[randomInt(0, int(edges.size()) - 1)] + (randomInt(0, 1) ? margin : -margin);
+                    step = u8"区間の端";
+                    break;
+                default: time += randomReal(0, 1.0 / 30); step = u8"前進"; break;
+            }
+            window.Update(time, margin);
+
+            window.Collect(actual, all);
+            scan(time, margin, all);
+            mismatch = actual != expected || window.GetActiveCount() != expected.size();
+            window.Collect(actual, some);
+            scan(time, margin, some);
+            mismatch = mismatch || actual != expected;
+        }
+        if (!Expect(!mismatch, subject, fmt::format(u8"{0}回目 ({1}ノーツ): {2}の後の時刻{3} 幅{4}で全走査と一致しません", trial, count, step, time, margin))) break;
+    }
+
+    // Clear した後は何も取り出さない
+    window.Clear();
+    window.Update(0, 1);
+    window.Collect(actual, [](uint32_t) { return true; });
+    Expect(actual.empty() && window.GetActiveCount() == 0, subject, u8"Clear の後にノーツが残っています");
+}
+
+// 一時的な Music ディレクトリを書き換えながら、変わった譜面だけが解析し直されるか
+void VerificationRunner::VerifyMusicLibrary()
+{
+    const auto subject = u8"music-library";
+    const auto musicDirectory = workDirectory / L"Music";
+    const auto cacheFile = workDirectory / SU_CACHE_MUSIC_FILE;
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(musicDirectory, ec);
+    boost::filesystem::remove(cacheFile, ec);
+    boost::filesystem::create_directories(musicDirectory / L"Alpha" / L"first", ec);
+    boost::filesystem::create_directories(musicDirectory / L"Alpha" / L"second", ec);
+    boost::filesystem::create_directories(musicDirectory / L"Beta" / L"third", ec);
+
+    const auto write = &VerificationRunner::WriteWholeFile;
+    const auto firstBasic = musicDirectory / L"Alpha" / L"first" / L"basic.sus";
+    const auto firstExpert = musicDirectory / L"Alpha" / L"first" / L"expert.sus";
+    const auto second = musicDirectory / L"Alpha" / L"second" / L"second.sus";
+    const auto third = musicDirectory / L"Beta" / L"third" / L"third.sus";
+    const auto added = musicDirectory / L"Beta" / L"third" / L"added.sus";
+    write(firstBasic, MakeLibraryChart("first", "First", 3));
+    write(firstExpert, MakeLibraryChart("first", "First", 9));
+    write(second, MakeLibraryChart("second", "Second", 5));
+    write(third, MakeLibraryChart("third", "Third", 7));
+
+    // 走査して、解析し直した譜面と一覧が期待どおりか確かめる
+    const auto check = [&](MusicsManager &musics, const string &step, const vector<string> &expectedKeys, const vector<string> &expectedLibrary) {
+        musics.Reload(false);
+        const auto keys = musics.GetAnalyzedKeys();
+        Expect(keys == expectedKeys, subject, fmt::format(u8"{0}: 解析し直した譜面が違います ({1})", step, ba::join(keys, ", ")));
+        Expect(DescribeLibrary(*musics.GetCategories()) == expectedLibrary, subject, fmt::format(u8"{0}: 曲一覧が違います", step));
+    };
+    const auto setWriteTime = [&](const boost::filesystem::path &file, const time_t offset) {
+        boost::filesystem::last_write_time(file, boost::filesystem::last_write_time(file) + offset, ec);
+    };
+
+    MusicsManager musics(manager);
+    musics.SetLibraryLocation(musicDirectory, cacheFile);
+    vector<string> library = {
+        "Alpha/first/basic.sus:First:3", "Alpha/first/expert.sus:First:9",
+        "Alpha/second/second.sus:Second:5", "Beta/third/third.sus:Third:7",
+    };
+    check(musics, u8"初回", { "Alpha/first/basic.sus", "Alpha/first/expert.sus", "Alpha/second/second.sus", "Beta/third/third.sus" }, library);
+    check(musics, u8"変更なし", {}, library);
+
+    // 起動し直しても musics.mp から復元できる
+    MusicsManager restarted(manager);
+    restarted.SetLibraryLocation(musicDirectory, cacheFile);
+    check(restarted, u8"再起動", {}, library);
+
+    // サイズが変わる編集
+    write(firstExpert, MakeLibraryChart("first", "First", 12));
+    setWriteTime(firstExpert, 10);
+    library[1] = "Alpha/first/expert.sus:First:12";
+    check(restarted, u8"編集", { "Alpha/first/expert.sus" }, library);
+
+    // サイズが同じ編集は内容のハッシュで気付く
+    write(second, MakeLibraryChart("second", "Second", 6));
+    setWriteTime(second, 20);
+    library[2] = "Alpha/second/second.sus:Second:6";
+    check(restarted, u8"同サイズの編集", { "Alpha/second/second.sus" }, library);
+
+    // 更新日時だけ変わったものは解析しない
+    setWriteTime(third, 30);
+    check(restarted, u8"更新日時のみ", {}, library);
+
+    // 追加と削除
+    write(added, MakeLibraryChart("added", "Added", 1));
+    boost::filesystem::remove(firstBasic, ec);
+    library.erase(library.begin());
+    library.push_back("Beta/third/added.sus:Added:1");
+    sort(library.begin(), library.end());
+    check(restarted, u8"追加と削除", { "Beta/third/added.sus" }, library);
+
+    // 削除した譜面の情報が musics.mp に残っていない
+    MusicsManager last(manager);
+    last.SetLibraryLocation(musicDirectory, cacheFile);
+    check(last, u8"削除後の再起動", {}, library);
+    write(firstBasic, MakeLibraryChart("first", "First", 3));
+    library.insert(library.begin(), "Alpha/first/basic.sus:First:3");
+    check(last, u8"削除した譜面の復活", { "Alpha/first/basic.sus" }, library);
+
+    // 壊れた musics.mp は読み捨てて全部解析し直す
+    // 途中で切れたものと、残りのバイト数を超える件数を持つもの (確保する前に弾く)
+    const vector<pair<string, string>> brokenCaches = {
+        { u8"途中で切れたキャッシュ", ReadWholeFile(cacheFile).substr(0, 40) },
+        { u8"件数が大きすぎるキャッシュ", string("\x92\x02\xdf\xff\xff\xff\xff", 7) },
+        { u8"文字列長が大きすぎるキャッシュ", string("\x92\x02\x81\xdb\xff\xff\xff\xf0", 8) },
+    };
+    const vector<string> everything = { "Alpha/first/basic.sus", "Alpha/first/expert.sus", "Alpha/second/second.sus", "Beta/third/added.sus", "Beta/third/third.sus" };
+    for (const auto &brokenCache : brokenCaches) {
+        write(cacheFile, brokenCache.second);
+        MusicsManager broken(manager);
+        broken.SetLibraryLocation(musicDirectory, cacheFile);
+        check(broken, brokenCache.first, everything, library);
+    }
+}
+
+// 曲一覧を読むスレッドを回しながら非同期の再読み込みを繰り返し、読む側が壊れた一覧を見ないか
+void VerificationRunner::VerifyMusicLibraryReload()
+{
+    const auto subject = u8"music-library-reload";
+    const auto categoryCount = 4, musicCount = 8, reloadCount = 50, readerCount = 4;
+    const auto musicDirectory = workDirectory / L"MusicReload";
+    const auto cacheFile = workDirectory / L"musics-reload.mp";
+    boost::system::error_code ec;
+    boost::filesystem::remove_all(musicDirectory, ec);
+    boost::filesystem::remove(cacheFile, ec);
+
+    vector<boost::filesystem::path> files;
+    for (auto i = 0; i < categoryCount; i++) {
+        for (auto j = 0; j < musicCount; j++) {
+            const auto directory = musicDirectory / fmt::format("Category{0}", i) / fmt::format("Music{0}", j);
+            boost::filesystem::create_directories(directory, ec);
+            files.push_back(directory / L"chart.sus");
+            WriteWholeFile(files.back(), MakeLibraryChart(fmt::format("{0}-{1}", i, j), "Reload 0", 1));
+        }
+    }
+
+    MusicsManager musics(manager);
+    musics.SetLibraryLocation(musicDirectory, cacheFile);
+    musics.Reload(false);
+
+    // 曲名の世代は書き換えるたびに上がる 1つの一覧の中では譜面の数が揃っていて、世代も戻らない
+    std::atomic<bool> finished { false };
+    std::atomic<uint32_t> readCount { 0 }, brokenCount { 0 };
+    const auto read = [&] {
+        const auto cursor = musics.CreateMusicSelectionCursor();
+        while (!finished) {
+            const auto library = musics.GetCategories();
+            auto scores = 0;
+            for (const auto &category : *library) {
+                for (const auto &music : category->Musics) {
+                    if (music->Scores.empty() || !ba::starts_with(music->Name, "Reload ")) ++brokenCount;
+                    scores += SU_TO_INT32(music->Scores.size());
+                }
+            }
+            if (scores != categoryCount * musicCount) ++brokenCount;
+
+            // カーソル経由でも、再読み込み中は Unavailable を、それ以外は揃った一覧を見る
+            for (auto i = -musicCount; i <= musicCount; i++) {
+                const auto name = cursor->GetMusicName(i);
+                if (name != "Unavailable!" && !ba::starts_with(name, "Reload ")) ++brokenCount;
+                cursor->GetLevel(i);
+                cursor->GetCategoryName(i);
+            }
+            ++readCount;
+        }
+        cursor->Release();
+    };
+    vector<thread> readers;
+    for (auto i = 0; i < readerCount; i++) readers.emplace_back(read);
+
+    for (auto i = 1; i <= reloadCount; i++) {
+        WriteWholeFile(files[i % files.size()], MakeLibraryChart(fmt::format("{0}-{1}", (i % files.size()) / musicCount, i % musicCount), fmt::format("Reload {0}", i), 1));
+        boost::filesystem::last_write_time(files[i % files.size()], time(nullptr) + i, ec);
+        musics.Reload(true);
+        musics.Reload(true);    // 読み込み中の呼び出しは無視される
+        while (musics.IsReloading()) this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    finished = true;
+    for (auto &reader : readers) reader.join();
+
+    Expect(brokenCount == 0, subject, fmt::format(u8"読み出し{0}回中{1}回で壊れた一覧を見ました", readCount.load(), brokenCount.load()));
+    Expect(readCount > 0, subject, u8"一覧を読めていません");
+    const auto library = DescribeLibrary(*musics.GetCategories());
+    Expect(library.size() == files.size(), subject, fmt::format(u8"最後の一覧の譜面数が違います ({0})", library.size()));
+    const auto last = fmt::format("Category{0}/Music{1}/chart.sus:Reload {2}:1", (reloadCount % files.size()) / musicCount, reloadCount % musicCount, reloadCount);
+    Expect(find(library.begin(), library.end(), last) != library.end(), subject, u8"最後の書き換えが一覧に反映されていません");
+}
+
+// シリアルポートの代わりに名前付きパイプを開かせ、相手側からパケットを細切れに流し込む
+// 読み込みスレッド・エスケープ・再同期・チェックサム・LED 送信・切断時の解放までを通しで見る
+void VerificationRunner::VerifyOpeNITHMSerial()
+{
+    const auto subject = u8"openithm-serial";
+    const auto pipeName = fmt::format(L"\\\\.\\pipe\\SeaurchinVerification{0}", GetCurrentProcessId());
+    const auto pipe = CreateNamedPipeW(pipeName.c_str(), PIPE_ACCESS_DUPLEX, PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT, 1, 4096, 4096, 0, nullptr);
+    if (!Expect(pipe != INVALID_HANDLE_VALUE, subject, u8"名前付きパイプを作れません")) return;
+
+    // 相手側から見て届いたバイト列
+    const auto receive = [&](const size_t size, vector<uint8_t> &received) {
+        const auto deadline = chrono::steady_clock::now() + chrono::seconds(2);
+        while (received.size() < size && chrono::steady_clock::now() < deadline) {
+            DWORD available = 0;
+            if (!PeekNamedPipe(pipe, nullptr, 0, nullptr, &available, nullptr)) break;
+            if (!available) {
+                this_thread::sleep_for(chrono::milliseconds(1));
+                continue;
+            }
+            uint8_t buffer[256];
+            DWORD read = 0;
+            if (!ReadFile(pipe, buffer, min(DWORD(sizeof(buffer)), available), &read, nullptr)) break;
+            received.insert(received.end(), buffer, buffer + read);
+        }
+    };
+    const auto send = [&](const vector<uint8_t> &bytes) {
+        DWORD written = 0;
+        return WriteFile(pipe, bytes.data(), DWORD(bytes.size()), &written, nullptr) && written == bytes.size();
+    };
+    const auto packet = [](const uint8_t command, const vector<uint8_t> &data) {
+        return OpeNITHMController::EncodePacket(command, data.data(), data.size());
+    };
+    // センサーは右端のセルから上下2個ずつ
+    const auto sliderReport = [&](const vector<pair<int, uint8_t>> &cells) {
+        vector<uint8_t> pressures(32, 0);
+        for (const auto &cell : cells) pressures[(15 - cell.first) * 2 + 1] = cell.second;
+        return packet(OpeNITHMController::CommandSliderReport, pressures);
+    };
+
+    const auto state = make_shared<ControlState>();
+    state->Initialize();
+    OpeNITHMController controller(state);
+    controller.SetAirReportEnabled(true);
+    const auto startTime = ControlState::GetInputTimestamp();
+    if (!Expect(controller.Open(pipeName), subject, u8"パイプを開けません")) {
+        CloseHandle(pipe);
+        return;
+    }
+    ConnectNamedPipe(pipe, nullptr);
+
+    vector<uint8_t> received;
+    const auto enable = packet(OpeNITHMController::CommandEnableReport, {});
+    receive(enable.size(), received);
+    Expect(received == enable, subject, u8"開いたときに入力の送信開始を要求していません");
+    received.clear();
+    controller.SetLedColor(3, 10, 20, 30);
+
+    // 0xFF/0xFD を含む値、途中で切れたパケット、チェックサムの合わないパケットを混ぜる
+    vector<uint8_t> stream = { 0x00, 0x12, 0xFD };
+    const auto append = [&](const vector<uint8_t> &bytes) { stream.insert(stream.end(), bytes.begin(), bytes.end()); };
+    append(sliderReport({ { 0, 0xFF }, { 15, 0xFD } }));
+    append({ 0xFF, OpeNITHMController::CommandAirReport, 0x01 });
+    auto corrupted = packet(OpeNITHMController::CommandAirReport, { 0x3F });
+    corrupted.back() ^= 0x01;
+    append(corrupted);
+    append(packet(OpeNITHMController::CommandAirReport, { 0x03 }));
+    append(packet(OpeNITHMController::CommandAirReport, { 0x01 }));
+    append(sliderReport({ { 15, 0xFD }, { 7, 20 }, { 8, 19 } }));
+    append(packet(OpeNITHMController::CommandAirReport, { 0x00 }));
+    mt19937 random(0x4f4e4954);
+    for (size_t i = 0; i < stream.size();) {
+        const auto size = min(stream.size() - i, size_t(uniform_int_distribution<int>(1, 7)(random)));
+        send(vector<uint8_t>(stream.begin() + i, stream.begin() + i + size));
+        if (size % 2) this_thread::sleep_for(chrono::milliseconds(1));
+        i += size;
+    }
+
+    // LED は次に読めたところで送られる 並びは右端から BRG で、奇数番目は仕切り
+    vector<uint8_t> colors(1 + 32 * 3, 0);
+    colors[0] = 0xFF;
+    colors[1 + (15 - 3) * 2 * 3 + 0] = 30;
+    colors[1 + (15 - 3) * 2 * 3 + 1] = 10;
+    colors[1 + (15 - 3) * 2 * 3 + 2] = 20;
+    const auto leds = packet(OpeNITHMController::CommandLed, colors);
+    receive(leds.size(), received);
+    Expect(received == leds, subject, u8"LED の送信内容が違います");
+    received.clear();
+
+    const auto air = [](const AirControlSource source, const bool pressed) { return make_tuple(ControllerSource::IntegratedAir, int(source), pressed); };
+    const auto slider = [](const int cell, const bool pressed) { return make_tuple(ControllerSource::IntegratedSliders, cell, pressed); };
+    const vector<tuple<ControllerSource, int, bool>> expected = {
+        slider(0, true), slider(15, true),
+        air(AirControlSource::AirHold, true), air(AirControlSource::AirUp, true),
+        air(AirControlSource::AirDown, true),
+        slider(0, false), slider(7, true),
+        air(AirControlSource::AirHold, false),
+        slider(7, false), slider(15, false),    // 切断時に離す
+    };
+    vector<InputEvent> events;
+    const auto collect = [&](const size_t count) {
+        const auto deadline = chrono::steady_clock::now() + chrono::seconds(2);
+        while (events.size() < count && chrono::steady_clock::now() < deadline) {
+            state->Update();
+            events.insert(events.end(), state->GetFrameEvents().begin(), state->GetFrameEvents().end());
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+    };
+    collect(expected.size() - 2);
+
+    // 何も届かず ReadFile で待っている読み込みスレッドを、Close だけで止められるか
+    auto closing = async(launch::async, [&] { controller.Close(); });
+    if (!Expect(closing.wait_for(chrono::seconds(2)) == future_status::ready, subject, u8"読み込み待ちのまま閉じられません")) {
+        const vector<uint8_t> idle = { 0x00 };
+        while (closing.wait_for(chrono::milliseconds(1)) != future_status::ready) send(idle);
+    }
+    const auto disable = packet(OpeNITHMController::CommandDisableReport, {});
+    receive(disable.size(), received);
+    Expect(received == disable, subject, u8"閉じたときに入力の送信停止を要求していません");
+    CloseHandle(pipe);
+    collect(expected.size());
+    const auto endTime = ControlState::GetInputTimestamp();
+
+    vector<tuple<ControllerSource, int, bool>> actual;
+    for (const auto &event : events) actual.emplace_back(event.Source, event.Number, event.Pressed);
+    Expect(actual == expected, subject, fmt::format(u8"入力イベントが違います ({0}件、期待は{1}件)", actual.size(), expected.size()));
+    Expect(all_of(events.begin(), events.end(), [&](const InputEvent &event) { return event.Time >= startTime && event.Time <= endTime; })
+        && is_sorted(events.begin(), events.end(), [](const InputEvent &a, const InputEvent &b) { return a.Time < b.Time; }),
+        subject, u8"入力イベントの時刻が受信の前後に収まっていません");
+    Expect(controller.GetDroppedPacketCount() == 2, subject, fmt::format(u8"破棄したパケット数が違います ({0})", controller.GetDroppedPacketCount()));
+
+    // 抜かれたときのように Close を経ずに読めなくなっても、押したままのセルとエアーを離して切断扱いになるか
+    const auto unplugPipe = CreateNamedPipeW(pipeName.c_str(), PIPE_ACCESS_DUPLEX, PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT, 1, 4096, 4096, 0, nullptr);
+    if (Expect(unplugPipe != INVALID_HANDLE_VALUE, subject, u8"名前付きパイプを作れません")) {
+        const auto unplugState = make_shared<ControlState>();
+        unplugState->Initialize();
+        OpeNITHMController unplugged(unplugState);
+        unplugged.SetAirReportEnabled(true);
+        if (Expect(unplugged.Open(pipeName), subject, u8"パイプを開けません")) {
+            ConnectNamedPipe(unplugPipe, nullptr);
+            auto bytes = sliderReport({ { 4, 0xFF } });
+            const auto airBytes = packet(OpeNITHMController::CommandAirReport, { 0x01 });
+            bytes.insert(bytes.end(), airBytes.begin(), airBytes.end());
+            DWORD written = 0;
+            WriteFile(unplugPipe, bytes.data(), DWORD(bytes.size()), &written, nullptr);
+
+            vector<tuple<ControllerSource, int, bool>> unplugEvents;
+            const auto collectUnplugged = [&](const size_t count) {
+                const auto deadline = chrono::steady_clock::now() + chrono::seconds(2);
+                while (unplugEvents.size() < count && chrono::steady_clock::now() < deadline) {
+                    unplugState->Update();
+                    for (const auto &event : unplugState->GetFrameEvents()) unplugEvents.emplace_back(event.Source, event.Number, event.Pressed);
+                    this_thread::sleep_for(chrono::milliseconds(1));
+                }
+            };
+            collectUnplugged(3);
+            DisconnectNamedPipe(unplugPipe);
+            CloseHandle(unplugPipe);
+            const auto deadline = chrono::steady_clock::now() + chrono::seconds(2);
+            while (unplugged.IsOpen() && chrono::steady_clock::now() < deadline) this_thread::sleep_for(chrono::milliseconds(1));
+            Expect(!unplugged.IsOpen(), subject, u8"読めなくなっても接続中のままです");
+            collectUnplugged(5);
+            // 後から Close しても二重に離さない
+            unplugged.Close();
+            unplugState->Update();
+            for (const auto &event : unplugState->GetFrameEvents()) unplugEvents.emplace_back(event.Source, event.Number, event.Pressed);
+            const vector<tuple<ControllerSource, int, bool>> unplugExpected = {
+                slider(4, true), air(AirControlSource::AirHold, true), air(AirControlSource::AirUp, true),
+                slider(4, false), air(AirControlSource::AirHold, false),
+            };
+            Expect(unplugEvents == unplugExpected, subject, fmt::format(u8"切断時の入力イベントが違います ({0}件、期待は{1}件)", unplugEvents.size(), unplugExpected.size()));
+        } else {
+            CloseHandle(unplugPipe);
+        }
+    }
+
+    // エアーの報告は独自拡張なので、有効にしていなければ読み捨てる
+    const auto plainState = make_shared<ControlState>();
+    plainState->Initialize();
+    OpeNITHMController plain(plainState);
+    const auto airReport = packet(OpeNITHMController::CommandAirReport, { 0x01 });
+    plain.Feed(airReport.data(), airReport.size(), startTime);
+    plainState->Update();
+    Expect(plainState->GetFrameEvents().empty() && plain.GetDroppedPacketCount() == 0, subject, u8"無効にしたエアーの報告を解釈しています");
+}
+
+// 時刻付きの入力イベントを ControlState に流して PlayableProcessor で判定し、フレームレートによらず押した時刻で判定されるか
+void VerificationRunner::VerifyInputEvents()
+{
+    const auto subject = u8"input-events";
+    const auto chartFile = WriteWorkFile(L"input-events.sus", InputEventChart);
+    // 入力の時計で曲頭にあたる時刻
+    const auto origin = 1000.0;
+
+    // 曲中時刻・入力・押している秒 (0 なら押すだけ)
+    struct Press {
+        double Time;
+        ControllerSource Source;
+        int Number;
+        double Duration;
+    };
+    const vector<Press> presses = {
+        { 2.000, ControllerSource::IntegratedSliders, 1, 0.02 },
+        { 2.550, ControllerSource::IntegratedSliders, 5, 0.02 },
+        { 2.925, ControllerSource::IntegratedSliders, 9, 0.02 },
+        { 4.505, ControllerSource::IntegratedSliders, 6, 0.01 },    // 30fps と 60fps では同じフレームのうちに押して離す
+        { 6.000, ControllerSource::IntegratedSliders, 2, 0.02 },
+        { 6.040, ControllerSource::IntegratedAir, int(AirControlSource::AirUp), 0 },
+    };
+    vector<InputEvent> events;
+    for (const auto &press : presses) {
+        events.push_back({ origin + press.Time, press.Source, press.Number, true });
+        if (press.Duration > 0) events.push_back({ origin + press.Time + press.Duration, press.Source, press.Number, false });
+    }
+    stable_sort(events.begin(), events.end(), [](const InputEvent &a, const InputEvent &b) { return a.Time < b.Time; });
+
+    typedef tuple<AbilityNoteType, double, double, AbilityJudgeType> Judge;
+    auto expectedJudges = vector<Judge> {
+        Judge { AbilityNoteType::Tap, 0, 4, AbilityJudgeType::JusticeCritical },
+        Judge { AbilityNoteType::Tap, 4, 8, AbilityJudgeType::Justice },
+        Judge { AbilityNoteType::Tap, 8, 12, AbilityJudgeType::Attack },
+        Judge { AbilityNoteType::Tap, 12, 16, AbilityJudgeType::Miss },
+        Judge { AbilityNoteType::Tap, 4, 8, AbilityJudgeType::JusticeCritical },
+        Judge { AbilityNoteType::Tap, 0, 4, AbilityJudgeType::JusticeCritical },
+        Judge { AbilityNoteType::Air, 0, 4, AbilityJudgeType::Justice },
+    };
+    sort(expectedJudges.begin(), expectedJudges.end());
+    // ノーツの時刻順 (同時なら Tap が先) のずれ
+    const vector<double> expectedOffsets = { 0, 0.05, -0.075, 0.005, 0, 0.04 };
+
+    const auto autoPlay = manager->GetData<int>("AutoPlay", 1);
+    manager->SetData<int>("AutoPlay", 0);
+    const auto state = manager->GetControlStateSafe();
+    // 何フレームごとに処理落ちして、実時間が 3フレーム分先に進むか (0 なら処理落ちしない)
+    const vector<pair<double, int>> frameRates = { { 30.0, 0 }, { 60.0, 0 }, { 240.0, 0 }, { 60.0, 7 } };
+    for (const auto &frameRate : frameRates) {
+        const auto framesPerSecond = frameRate.first;
+        const auto player = manager->CreatePlayer();
+        vector<Judge> judges;
+        player->SetScoreFile(chartFile);
+        player->SetJudgeRecorder([&judges](double, const AbilityJudgeType judge, const JudgeInformation &info) {
+            judges.emplace_back(info.Note, info.Left, info.Right, judge);
+        });
+        player->Initialize();
+        player->LoadSynchronously();
+        // 設定ファイルの判定補正やリプレイ保存の設定によらないようにする
+        player->GetProcessor()->SetJudgeAdjusts(0, 1, 0, 1);
+        player->GetReady();
+        player->Play();
+        player->DiscardReplayRecording();
+
+        // ExecutionManager と同じく、Tick ごとに入力を締めてから Tick する
+        // 処理落ちしたフレームでは実時間までの入力が全部届いた状態で何回も Tick するので、
+        // 追いつくまでの Tick には遅れの分だけ戻した時刻を渡し、それより後の入力は後の Tick に回させる
+        const auto delta = 1.0 / framesPerSecond;
+        size_t next = 0;
+        auto realTime = player->GetPlayingTime();
+        auto frame = 0;
+        state->Update(origin + player->GetPlayingTime());
+        while (player->GetPlayingTime() < 7.0) {
+            realTime += delta;
+            if (frameRate.second && ++frame % frameRate.second == 0) realTime += 3 * delta;
+            for (; next < events.size() && events[next].Time <= origin + realTime; ++next) state->PushEvent(events[next]);
+            for (auto ticks = int(round((realTime - player->GetPlayingTime()) / delta)); ticks > 0; --ticks) {
+                const auto lag = (ticks - 1) * delta;
+                state->Update(origin + realTime - lag);
+                player->Tick(delta);
+            }
+        }
+        auto timings = player->GetJudgeTiming()->GetRecords();
+        player->SetJudgeRecorder(nullptr);
+        player->Release();
+
+        const auto step = frameRate.second ? fmt::format(u8"{0}fps ({1}フレームごとに処理落ち)", framesPerSecond, frameRate.second) : fmt::format(u8"{0}fps", framesPerSecond);
+        sort(judges.begin(), judges.end());
+        Expect(judges == expectedJudges, subject, fmt::format(u8"{0}: 判定が違います ({1}件)", step, judges.size()));
+        stable_sort(timings.begin(), timings.end(), [](const JudgeTimingRecord &a, const JudgeTimingRecord &b) {
+            return make_tuple(a.Time, a.Note) < make_tuple(b.Time, b.Note);
+        });
+        auto sameOffsets = timings.size() == expectedOffsets.size();
+        for (size_t i = 0; sameOffsets && i < timings.size(); i++) sameOffsets = abs(timings[i].Offset - expectedOffsets[i]) <= 1e-9;
+        Expect(sameOffsets, subject, fmt::format(u8"{0}: 判定のずれが押した時刻からのずれになっていません", step));
+    }
+    manager->SetData<int>("AutoPlay", autoPlay);
+}
+
+// 仮想時計で GameLoop を回し、Tick の回数・持ち越し・補間の割合が時計の経過時間と合うか
+void VerificationRunner::VerifyGameLoop()
+{
+    const auto subject = u8"game-loop";
+    // 240Hz の Tick を 100fps で回すので、1フレームあたり 2.4 Tick になる
+    // 20フレーム目の描画で 0.1秒止まると、次のフレームでは 24 Tick 溜まっていて上限の 8 Tick を超える
+    // 超えた分は捨てずに 21~24フレーム目で取り戻す 持ち越しは 16+10+4 で延べ 30 Tick
+    const auto stallFrame = 20;
+    const auto frames = 50;
+    auto ownedClock = make_unique<VirtualLoopClock>();
+    const auto clock = ownedClock.get();
+    GameLoop loop(move(ownedClock), 240, 100);
+    const auto interval = loop.GetTickInterval();
+
+    auto tickTime = 0.0;        // Tick に渡された刻みの合計
+    auto frameStart = 0.0;
+    auto frameTicks = 0;
+    auto maxFrameTicks = 0;
+    auto lastCatchUpFrame = -1;
+    auto lagMatches = true;
+    auto interpolationMatches = true;
+    for (auto frame = 0; frame < frames; frame++) {
+        frameStart = clock->Now();
+        frameTicks = 0;
+        loop.RunFrame([&](const double delta) {
+            // GetTickLag はこの Tick の終わりがフレームの開始よりどれだけ前か
+            const auto lag = max(0.0, frameStart - (tickTime + delta));
+            lagMatches = lagMatches && abs(delta - interval) <= 1e-12 && abs(loop.GetTickLag() - lag) <= 1e-9;
+            tickTime += delta;
+            ++frameTicks;
+        }, [&](const double interpolation) {
+            // 持ち越しのある間は0、追いついていれば最後の Tick から時計までの割合
+            const auto remaining = frameStart - tickTime;
+            if (remaining + 1e-9 >= interval) {
+                lastCatchUpFrame = frame;
+                interpolationMatches = interpolationMatches && interpolation == 0;
+            } else {
+                interpolationMatches = interpolationMatches && abs(interpolation - max(0.0, remaining) / interval) <= 1e-6;
+            }
+            if (frame == stallFrame) clock->WaitUntil(clock->Now() + 0.1);
+        });
+        maxFrameTicks = max(maxFrameTicks, frameTicks);
+    }
+
+    // 最後のフレームは 0.3 + 0.01 * 28 = 0.58秒に始まるので、ちょうど 139.2 Tick 分経っている
+    const auto expectedTicks = uint64_t(floor(frameStart / interval + 1e-9));
+    Expect(abs(frameStart - 0.58) <= 1e-9, subject, fmt::format(u8"最後のフレームの開始が {0}秒です (期待値 0.58秒)", frameStart));
+    Expect(loop.GetTickCount() == 139 && expectedTicks == 139 && abs(tickTime - 139 * interval) <= 1e-9, subject,
+        fmt::format(u8"Tick が {0}回 (刻みの合計 {1}秒) です (期待値 139回)", loop.GetTickCount(), tickTime));
+    Expect(loop.GetDeferredTickCount() == 30, subject, fmt::format(u8"持ち越した Tick が延べ {0}回です (期待値 30回)", loop.GetDeferredTickCount()));
+    Expect(maxFrameTicks == 8, subject, fmt::format(u8"1フレームで最大 {0}回 Tick しました (期待値 8回)", maxFrameTicks));
+    Expect(lastCatchUpFrame == stallFrame + 3, subject, fmt::format(u8"{0}フレーム目まで追いついていません (期待値 {1}フレーム目まで)", lastCatchUpFrame, stallFrame + 3));
+    Expect(lagMatches, subject, u8"追いつくための Tick の GetTickLag がフレームの開始からの遅れと合いません");
+    Expect(interpolationMatches, subject, u8"補間の割合が最後の Tick から時計までの時間と合いません");
+    Expect(abs(loop.GetInterpolation() - 0.2) <= 1e-6, subject, fmt::format(u8"最後のフレームの補間の割合が {0} です (期待値 0.2)", loop.GetInterpolation()));
+    Expect(loop.GetFrameCount() == uint64_t(frames), subject, fmt::format(u8"{0}フレームです (期待値 {1}フレーム)", loop.GetFrameCount(), frames));
+}
+
+// 決まった判定のずれを入れて、集計と JSON が手で計算した値と合うか
+void VerificationRunner::VerifyJudgeTiming()
+{
+    const auto subject = u8"judge-timing";
+    // ずれは 2.5ms 単位にしてあり、Slider 側の平均はちょうど0、AirString 側は 30ms になる
+    // ヒストグラムの bin は 5ms 幅なので範囲内のずれは bin の真ん中に来る 範囲外と範囲のちょうど両端はそれぞれ端の bin に入る
+    const vector<JudgeTimingRecord> records = {
+        { 2.0, AbilityNoteType::Tap, 2, 0.0125 },
+        { 2.5, AbilityNoteType::Tap, 2, -0.0175 },
+        { 3.0, AbilityNoteType::Tap, 2, 0.0375 },
+        { 3.5, AbilityNoteType::Flick, 5, 0.25 },
+        { 4.0, AbilityNoteType::Hold, 5, -0.1 },
+        { 4.5, AbilityNoteType::Slide, 5, 0.1 },
+        { 5.0, AbilityNoteType::ExTap, 15, -0.2825 },
+        { 5.5, AbilityNoteType::Air, -1, 0.0225 },
+        { 6.0, AbilityNoteType::AirAction, -1, 0.0375 },
+    };
+    JudgeTiming timing;
+    timing.Record(1.0, AbilityNoteType::Tap, 0, 0.05);
+    timing.Reset();
+    Expect(timing.GetRecordCount() == 0 && timing.GetNoteHistogram(AbilityNoteType::Tap, 30) == 0, subject, u8"Reset で記録が消えません");
+    timing.SetJudgeAdjusts(0.012, -0.010);
+    for (const auto &record : records) timing.Record(record.Time, record.Note, record.Lane, record.Offset);
+
+    const auto expectStatistics = [&](const string &name, const TimingStatistics &actual, const uint32_t count, const double mean, const double deviation, const double earliest, const double latest) {
+        Expect(actual.Count == count && abs(actual.Mean - mean) <= 1e-12 && abs(actual.StandardDeviation - deviation) <= 1e-12
+            && actual.Earliest == earliest && actual.Latest == latest,
+            subject, fmt::format(u8"{0}: {1}件 平均{2} 標準偏差{3} 範囲{4}~{5} (期待値 {6}件 平均{7} 標準偏差{8} 範囲{9}~{10})", name,
+                actual.Count, actual.Mean, actual.StandardDeviation, actual.Earliest, actual.Latest, count, mean, deviation, earliest, latest));
+    };
+    TimingStatistics statistics;
+    timing.GetSliderStatistics(&statistics);
+    expectStatistics(u8"Slider", statistics, 7, 0, sqrt(26268.0 / 7) * 0.0025, -0.2825, 0.25);
+    timing.GetAirStringStatistics(&statistics);
+    expectStatistics(u8"AirString", statistics, 2, 0.03, 0.0075, 0.0225, 0.0375);
+    timing.GetNoteStatistics(AbilityNoteType::Tap, &statistics);
+    expectStatistics(u8"Tap", statistics, 3, 13.0 / 3 * 0.0025, sqrt(2184.0 / 27) * 0.0025, -0.0175, 0.0375);
+    timing.GetNoteStatistics(AbilityNoteType::HellTap, &statistics);
+    expectStatistics(u8"HellTap", statistics, 0, 0, 0, 0, 0);
+    timing.GetLaneStatistics(5, &statistics);
+    expectStatistics(u8"レーン5", statistics, 3, 0.25 / 3, sqrt(222.0 / 27) * 0.05, -0.1, 0.25);
+    timing.GetLaneStatistics(15, &statistics);
+    expectStatistics(u8"レーン15", statistics, 1, -0.2825, 0, -0.2825, -0.2825);
+    timing.GetLaneStatistics(-1, &statistics);
+    expectStatistics(u8"レーン-1", statistics, 0, 0, 0, 0, 0);
+
+    // 種別ごと・レーンごとのヒストグラムで、値の入っている bin
+    const auto expectHistogram = [&](const string &name, const function<uint32_t(int)> &histogram, const map<int, uint32_t> &expected) {
+        map<int, uint32_t> actual;
+        for (auto i = 0; i < JudgeTiming::HistogramBins; i++) {
+            if (histogram(i)) actual[i] = histogram(i);
+        }
+        Expect(actual == expected && histogram(-1) == 0 && histogram(JudgeTiming::HistogramBins) == 0, subject, fmt::format(u8"{0} のヒストグラムが違います", name));
+    };
+    expectHistogram(u8"Tap", [&](const int bin) { return timing.GetNoteHistogram(AbilityNoteType::Tap, bin); }, { { 16, 1 }, { 22, 1 }, { 27, 1 } });
+    expectHistogram(u8"Flick", [&](const int bin) { return timing.GetNoteHistogram(AbilityNoteType::Flick, bin); }, { { 39, 1 } });
+    expectHistogram(u8"Hold", [&](const int bin) { return timing.GetNoteHistogram(AbilityNoteType::Hold, bin); }, { { 0, 1 } });
+    expectHistogram(u8"Slide", [&](const int bin) { return timing.GetNoteHistogram(AbilityNoteType::Slide, bin); }, { { 39, 1 } });
+    expectHistogram(u8"ExTap", [&](const int bin) { return timing.GetNoteHistogram(AbilityNoteType::ExTap, bin); }, { { 0, 1 } });
+    expectHistogram(u8"Air", [&](const int bin) { return timing.GetNoteHistogram(AbilityNoteType::Air, bin); }, { { 24, 1 } });
+    expectHistogram(u8"AirAction", [&](const int bin) { return timing.GetNoteHistogram(AbilityNoteType::AirAction, bin); }, { { 27, 1 } });
+    expectHistogram(u8"レーン5", [&](const int bin) { return timing.GetLaneHistogram(5, bin); }, { { 0, 1 }, { 39, 2 } });
+    expectHistogram(u8"レーン16", [&](const int bin) { return timing.GetLaneHistogram(16, bin); }, {});
+
+    // 平均のずれが Slider 0ms、AirString 30ms 遅れなので、今の補正 12ms/-10ms から 12ms/20ms を勧める
+    Expect(timing.GetSuggestedAdjustSlider() == 12, subject, fmt::format(u8"Slider の推奨補正が {0}ms です (期待値 12ms)", timing.GetSuggestedAdjustSlider()));
+    Expect(timing.GetSuggestedAdjustAirString() == 20, subject, fmt::format(u8"AirString の推奨補正が {0}ms です (期待値 20ms)", timing.GetSuggestedAdjustAirString()));
+
+    ostringstream json;
+    timing.WriteJson(json);
+    WriteWorkFile(L"judge-timing.json", json.str());
+    boost::property_tree::ptree tree;
+    try {
+        istringstream stream(json.str());
+        boost::property_tree::read_json(stream, tree);
+    } catch (const boost::property_tree::ptree_error &error) {
+        Expect(false, subject, fmt::format(u8"書き出した結果が JSON として読めません: {0}", error.what()));
+        return;
+    }
+    try {
+        const auto histogramOf = [](const boost::property_tree::ptree &accumulator) {
+            map<int, uint32_t> bins;
+            auto index = 0;
+            for (const auto &bin : accumulator.get_child("histogram")) {
+                if (const auto count = bin.second.get_value<uint32_t>()) bins[index] = count;
+                ++index;
+            }
+            return make_tuple(index, bins);
+        };
+        Expect(abs(tree.get<double>("histogram.range") - JudgeTiming::HistogramRange) <= 1e-6 && tree.get<int>("histogram.bins") == JudgeTiming::HistogramBins,
+            subject, u8"JSON のヒストグラムの範囲が違います");
+        Expect(tree.get<int>("judgeAdjust.slider") == 12 && tree.get<int>("judgeAdjust.airString") == -10, subject, u8"JSON の今の補正が違います");
+        Expect(tree.get<int>("suggestedAdjust.slider") == 12 && tree.get<int>("suggestedAdjust.airString") == 20, subject, u8"JSON の推奨補正が違います");
+        Expect(tree.get<uint32_t>("slider.count") == 7 && abs(tree.get<double>("slider.mean")) <= 1e-6
+            && abs(tree.get<double>("slider.stddev") - sqrt(26268.0 / 7) * 0.0025) <= 1e-6, subject, u8"JSON の Slider の集計が違います");
+        Expect(tree.get<uint32_t>("airString.count") == 2 && abs(tree.get<double>("airString.mean") - 0.03) <= 1e-6, subject, u8"JSON の AirString の集計が違います");
+        const auto &tap = tree.get_child("notes.Tap");
+        Expect(tap.get<uint32_t>("count") == 3 && abs(tap.get<double>("earliest") + 0.0175) <= 1e-6 && abs(tap.get<double>("latest") - 0.0375) <= 1e-6
+            && histogramOf(tap) == make_tuple(int(JudgeTiming::HistogramBins), map<int, uint32_t> { { 16, 1 }, { 22, 1 }, { 27, 1 } }),
+            subject, u8"JSON の Tap の集計が違います");
+        Expect(tree.get_child("notes").size() == size_t(AbilityNoteType::AirAction) && tree.get<uint32_t>("notes.HellTap.count") == 0, subject, u8"JSON のノーツ種別が揃っていません");
+
+        const auto &lanes = tree.get_child("lanes");
+        vector<boost::property_tree::ptree> laneList;
+        for (const auto &lane : lanes) laneList.push_back(lane.second);
+        Expect(laneList.size() == JudgeTiming::Lanes, subject, fmt::format(u8"JSON のレーンが {0} 個です", laneList.size()));
+        if (laneList.size() == JudgeTiming::Lanes) {
+            Expect(laneList[5].get<uint32_t>("count") == 3 && histogramOf(laneList[5]) == make_tuple(int(JudgeTiming::HistogramBins), map<int, uint32_t> { { 0, 1 }, { 39, 2 } }),
+                subject, u8"JSON のレーン5の集計が違います");
+            Expect(laneList[0].get<uint32_t>("count") == 0, subject, u8"JSON のレーン0に記録が入っています");
+        }
+
+        vector<JudgeTimingRecord> written;
+        for (const auto &item : tree.get_child("records")) {
+            const auto &record = item.second;
+            const auto name = record.get<string>("note");
+            auto type = AbilityNoteType::Tap;
+            for (auto i = int(AbilityNoteType::Tap); i <= int(AbilityNoteType::AirAction); i++) {
+                if (name == GetAbilityNoteTypeName(AbilityNoteType(i))) type = AbilityNoteType(i);
+            }
+            written.push_back({ record.get<double>("time"), type, record.get<int32_t>("lane"), record.get<double>("offset") });
+        }
+        auto sameRecords = written.size() == records.size();
+        for (size_t i = 0; sameRecords && i < written.size(); i++) {
+            sameRecords = abs(written[i].Time - records[i].Time) <= 1e-6 && written[i].Note == records[i].Note
+                && written[i].Lane == records[i].Lane && abs(written[i].Offset - records[i].Offset) <= 1e-6;
+        }
+        Expect(sameRecords, subject, fmt::format(u8"JSON の記録が入れた順・値になっていません ({0}件)", written.size()));
+    } catch (const boost::property_tree::ptree_error &error) {
+        Expect(false, subject, fmt::format(u8"JSON の項目が足りません: {0}", error.what()));
+    }
+}
+
+// 回帰確認用のリプレイ (Data/Verification/Replays/regression.srp) の判定を、譜面と入力から手で求めた結果と照らし合わせる
+// 記録された判定、ReplayProcessor での再生、同じ入力を ControlState に流した PlayableProcessor の3つがどれも手で求めた結果と一致し、
+// 再生と PlayableProcessor は時刻や Slide の位置まで一致すること
+void VerificationRunner::VerifyReplay()
+{
+    const auto subject = u8"replay";
+    const auto replayFile = referenceDirectory / L"Replays" / L"regression.srp";
+    const auto replay = make_shared<Replay>();
+    if (!Expect(replay->Load(replayFile.wstring()), subject, fmt::format(u8"{0} を読み込めません", ConvertUnicodeToUTF8(replayFile.wstring())))) return;
+    const auto &settings = replay->Settings;
+    const auto chartFile = replayFile.parent_path() / ConvertUTF8ToUnicode(settings.ChartFile);
+    if (!Expect(CalculateFileCrc32(chartFile.wstring()) == settings.ChartHash, subject, u8"譜面が記録時と異なります")) return;
+    Expect(settings.JudgeAdjustSlider == 0.01 && settings.JudgeMultiplierSlider == 1 && settings.JudgeAdjustAirString == 0.05 && settings.JudgeMultiplierAirString == 4 && !settings.AutoAir,
+        subject, u8"記録の判定補正が手で求めたときの前提と違います");
+
+    // 記録の先頭だけを書き出して読み直せるか 書き出し用の一時ファイルが残らないか
+    Replay small;
+    small.Settings = settings;
+    small.Ticks.assign(replay->Ticks.begin(), replay->Ticks.begin() + min<size_t>(replay->Ticks.size(), 4));
+    for (const auto &input : replay->Inputs) {
+        if (small.Inputs.size() < 4 && (small.Inputs.empty() || !input.State.Events.empty())) small.Inputs.push_back(input);
+    }
+    small.Judges.assign(replay->Judges.begin(), replay->Judges.begin() + min<size_t>(replay->Judges.size(), 4));
+    const auto smallFile = workDirectory / L"replay-small.srp";
+    Expect(small.Save(smallFile.wstring()) && !exists(workDirectory / L"replay-small.srp.tmp"), subject, u8"書き出せないか、一時ファイルが残っています");
+    Replay reloaded;
+    Expect(reloaded.Load(smallFile.wstring()) && reloaded.Ticks.size() == small.Ticks.size() && reloaded.Inputs.size() == small.Inputs.size() && reloaded.Judges.size() == small.Judges.size(),
+        subject, u8"書き出したものを読み直せません");
+
+    // 壊れたファイルは例外を出さずに読み込み失敗になるか 途中で切れたものと、どこか4バイトを 0xffffffff にしたものをすべて試す
+    const auto saved = ReadWholeFile(smallFile);
+    const auto tryLoad = [&](const string &bytes, bool &loaded) {
+        const auto file = WriteWorkFile(L"replay-broken.srp", bytes);
+        Replay broken;
+        try {
+            loaded = broken.Load(file.wstring());
+            return true;
+        } catch (const exception &) {
+            return false;
+        }
+    };
+    for (size_t size = 0; size < saved.size(); size++) {
+        auto loaded = false;
+        const auto succeeded = tryLoad(saved.substr(0, size), loaded);
+        if (!Expect(succeeded && !loaded, subject, fmt::format(u8"{0}バイトで切れたものを{1}", size, succeeded ? u8"読み込みました" : u8"読もうとして例外が出ました"))) break;
+    }
+    for (size_t offset = 0; offset + 4 <= saved.size(); offset++) {
+        auto bytes = saved;
+        bytes.replace(offset, 4, "\xff\xff\xff\xff");
+        auto loaded = false;
+        if (!Expect(tryLoad(bytes, loaded), subject, fmt::format(u8"{0}バイト目からを壊したものを読もうとして例外が出ました", offset))) break;
+    }
+
+    // 記録したときの入力 曲中時刻・入力・押している秒 (0 なら押すだけ)
+    struct Press {
+        double Time;
+        ControllerSource Source;
+        int Number;
+        double Duration;
+    };
+    const auto slider = ControllerSource::IntegratedSliders;
+    vector<Press> presses = {
+        { 2.014, slider, 1, 0.05 }, { 2.489, slider, 9, 0.05 }, { 2.557, slider, 1, 0.05 }, { 2.938, slider, 1, 0.05 },
+        { 3.010, slider, 13, 0.05 }, { 3.539, slider, 1, 0.05 },
+        { 4.502, slider, 9, 1.018 }, { 4.589, slider, 13, 0.05 }, { 4.672, ControllerSource::IntegratedAir, int(AirControlSource::AirUp), 0 },
+        { 4.965, slider, 5, 0.05 },
+        { 6.025, slider, 1, 0.05 }, { 6.264, slider, 13, 0.05 }, { 6.489, slider, 1, 0.05 }, { 6.807, slider, 13, 0.05 },
+        { 6.938, slider, 1, 0.05 }, { 7.260, slider, 13, 0.05 }, { 7.539, slider, 1, 0.05 },
+        { 8.571, slider, 3, 0.05 }, { 9.002, slider, 11, 0.05 }, { 9.965, slider, 13, 0.05 },
+        { 10.208, ControllerSource::IntegratedAir, int(AirControlSource::AirDown), 0 },
+    };
+    for (auto cell = 1; cell <= 6; cell++) presses.push_back({ 12.025, slider, cell, 1.495 });
+
+    // BPM120 (1小節2秒) の譜面に対して、押した時刻から補正 (Slider は +10ms、AirString は +50ms で幅4倍) を引いたずれで判定する
+    // JC は 33ms、J は 66ms、A は 84ms 以内 ExTap は A 以内ならすべて JC
+    // 押さなかったノーツは A の幅を過ぎた Tick で Miss、Hold/Slide の中継点と 0.25秒ごとの判定はその時刻に押していれば JC
+    // Slide の途中の判定は曲線上の位置で左端が決まるので比べない (-1)
+    typedef tuple<AbilityNoteType, int, AbilityJudgeType> Judge;
+    const auto jc = AbilityJudgeType::JusticeCritical, j = AbilityJudgeType::Justice, a = AbilityJudgeType::Attack, miss = AbilityJudgeType::Miss;
+    const vector<Judge> expected = {
+        Judge { AbilityNoteType::Tap, 0, jc },          // 2.0 +4ms
+        Judge { AbilityNoteType::ExTap, 8, jc },        // 2.5 -21ms
+        Judge { AbilityNoteType::Tap, 0, j },           // 2.5 +47ms
+        Judge { AbilityNoteType::Tap, 0, a },           // 3.0 -72ms
+        Judge { AbilityNoteType::Tap, 12, jc },         // 3.0 0ms
+        Judge { AbilityNoteType::Tap, 0, jc },          // 3.5 +29ms
+        Judge { AbilityNoteType::Flick, 4, miss },      // 4.0 押さない
+        Judge { AbilityNoteType::Hold, 8, jc },         // 4.5 -8ms
+        Judge { AbilityNoteType::Tap, 12, a },          // 4.5 +79ms
+        Judge { AbilityNoteType::Air, 12, jc },         // 4.5 +122ms (幅4倍で +30.5ms)
+        Judge { AbilityNoteType::Hold, 8, jc },         // 4.75
+        Judge { AbilityNoteType::Flick, 4, j },         // 5.0 -45ms
+        Judge { AbilityNoteType::Hold, 8, jc },         // 5.0
+        Judge { AbilityNoteType::Hold, 8, jc },         // 5.25
+        Judge { AbilityNoteType::Hold, 8, jc },         // 5.5 終点 (5.52 に離す)
+        Judge { AbilityNoteType::Tap, 0, jc },          // 6.0 +15ms
+        Judge { AbilityNoteType::Tap, 12, jc },         // 6.25 +4ms
+        Judge { AbilityNoteType::Tap, 0, jc },          // 6.5 -21ms
+        Judge { AbilityNoteType::Tap, 12, j },          // 6.75 +47ms
+        Judge { AbilityNoteType::Tap, 0, a },           // 7.0 -72ms
+        Judge { AbilityNoteType::Tap, 12, jc },         // 7.25 0ms
+        Judge { AbilityNoteType::Tap, 0, jc },          // 7.5 +29ms
+        Judge { AbilityNoteType::Tap, 12, miss },       // 7.75 押さない
+        Judge { AbilityNoteType::ExTap, 2, jc },        // 8.5 +61ms
+        Judge { AbilityNoteType::Flick, 10, jc },       // 9.0 -8ms
+        Judge { AbilityNoteType::Tap, 12, j },          // 10.0 -45ms
+        Judge { AbilityNoteType::Air, 12, j },          // 10.0 +158ms (幅4倍で +39.5ms)
+        Judge { AbilityNoteType::Slide, 2, jc },        // 12.0 +15ms (1~6 を押したまま)
+        Judge { AbilityNoteType::Slide, -1, miss },     // 12.25 曲線が 7 より右
+        Judge { AbilityNoteType::Slide, -1, miss },     // 12.5 曲線が 8 より右
+        Judge { AbilityNoteType::Slide, 6, jc },        // 12.75 中継点 6~10
+        Judge { AbilityNoteType::Slide, -1, jc },       // 13.0 曲線が 3~7
+        Judge { AbilityNoteType::Slide, -1, jc },       // 13.25 曲線が 5~9
+        Judge { AbilityNoteType::Slide, 9, miss },      // 13.5 終点 9~13
+    };
+    const auto check = [&](const string &step, const vector<ReplayJudge> &judges) {
+        auto matches = judges.size() == expected.size();
+        for (size_t i = 0; matches && i < judges.size(); i++) {
+            const auto left = get<1>(expected[i]);
+            matches = judges[i].Information.Note == get<0>(expected[i])
+                && judges[i].Judge == get<2>(expected[i])
+                && (left < 0 || judges[i].Information.Left == left);
+        }
+        Expect(matches, subject, fmt::format(u8"{0}: 判定が手で求めた結果と違います ({1}件、期待は{2}件)", step, judges.size(), expected.size()));
+    };
+    check(u8"記録", replay->Judges);
+
+    // 記録した Tick で回す (ReplayProcessor は Reset で記録の判定補正に合わせる)
+    const auto autoPlay = manager->GetData<int>("AutoPlay", 1);
+    const auto play = [&](const int mode, const function<void(ScenePlayer *player, double delta)> &tick) {
+        manager->SetData<int>("AutoPlay", mode);
+        const auto player = manager->CreatePlayer();
+        vector<ReplayJudge> judges;
+        player->SetScoreFile(chartFile);
+        player->SetReplaySource(replay);
+        player->SetJudgeRecorder([&judges](const double time, const AbilityJudgeType judge, const JudgeInformation &info) {
+            judges.push_back(ReplayJudge { time, judge, info });
+        });
+        player->Initialize();
+        player->LoadSynchronously();
+        player->GetProcessor()->SetJudgeAdjusts(settings.JudgeAdjustSlider, settings.JudgeMultiplierSlider, settings.JudgeAdjustAirString, settings.JudgeMultiplierAirString);
+        player->GetReady();
+        player->Play();
+        player->DiscardReplayRecording();
+        for (const auto &recorded : replay->Ticks) tick(player, recorded.Delta);
+        player->SetJudgeRecorder(nullptr);
+        player->Release();
+        return judges;
+    };
+    const auto replayed = play(3, [](ScenePlayer *player, const double delta) { player->Tick(delta); });
+    check(u8"ReplayProcessor", replayed);
+
+    // ExecutionManager と同じく、Tick ごとに入力を締めてから Tick する
+    // 6.025 と 12.025 は Tick の境目ちょうどなので、記録と同じく次の Tick で届ける
+    vector<InputEvent> events;
+    const auto origin = 1000.0;
+    for (const auto &press : presses) {
+        events.push_back({ origin + press.Time, press.Source, press.Number, true });
+        if (press.Duration > 0) events.push_back({ origin + press.Time + press.Duration, press.Source, press.Number, false });
+    }
+    stable_sort(events.begin(), events.end(), [](const InputEvent &x, const InputEvent &y) { return x.Time < y.Time; });
+    const auto state = manager->GetControlStateSafe();
+    size_t next = 0;
+    auto started = false;
+    const auto live = play(0, [&](ScenePlayer *player, const double delta) {
+        if (!started) state->Update(origin + player->GetPlayingTime());
+        started = true;
+        const auto time = origin + player->GetPlayingTime() + delta;
+        for (; next < events.size() && events[next].Time < time - 1e-9; ++next) state->PushEvent(events[next]);
+        state->Update(time);
+        player->Tick(delta);
+    });
+    check(u8"PlayableProcessor", live);
+    manager->SetData<int>("AutoPlay", autoPlay);
+
+    auto same = replayed.size() == live.size();
+    for (size_t i = 0; same && i < live.size(); i++) {
+        same = abs(replayed[i].Time - live[i].Time) <= 1e-9
+            && replayed[i].Judge == live[i].Judge
+            && replayed[i].Information.Note == live[i].Information.Note
+            && abs(replayed[i].Information.Left - live[i].Information.Left) <= 1e-6
+            && abs(replayed[i].Information.Right - live[i].Information.Right) <= 1e-6;
+    }
+    Expect(same, subject, u8"ReplayProcessor と同じ入力の PlayableProcessor とで判定の時刻か位置が違います");
+}
+
+void VerificationRunner::VerifyKeysoundOnset()
+{
+    const auto subject = u8"keysound-onset";
+    const auto frequency = 48000;
+    const auto leadTime = 0.03;
+    // デバイスの代わりに、再生位置より bufferFrames 先まで updateFrames ずつ合成する
+    const int64_t bufferFrames = 1440;
+    const int64_t updateFrames = 480;
+    mt19937 random(0x4b534f4e);
+    vector<double> noteTimes;
+    for (auto i = 0; i < 400; i++) noteTimes.push_back(uniform_real_distribution<double>(0.5, 20)(random));
+    sort(noteTimes.begin(), noteTimes.end());
+    // 曲の前のメトロノーム (ScenePlayer と同じ予約のしかた) も同じ流れで鳴らす
+    vector<double> beatTimes;
+    for (auto beat = 0; beat < 8; beat++) beatTimes.push_back(0.1 + beat * 60 / 145.0);
+    auto soundTimes = noteTimes;
+    soundTimes.insert(soundTimes.end(), beatTimes.begin(), beatTimes.end());
+    sort(soundTimes.begin(), soundTimes.end());
+    vector<int64_t> expected;
+    for (const auto time : soundTimes) expected.push_back(llround((time - leadTime) * frequency));
+
+    // ahead 秒先読みして予約したときに、実際に鳴り始めたフレーム
+    const auto render = [&](const double ahead) {
+        KeysoundScheduler scheduler(frequency, 2, leadTime);
+        const auto impulse = scheduler.AddWaveform({ 1.0f, 1.0f });
+        scheduler.Synchronize(0, 0);
+        vector<float> output, block;
+        mt19937 tickRandom(0x5449434b);
+        auto next = noteTimes.begin();
+        size_t nextBeat = 0;
+        for (auto time = 0.0; time < 21; time += uniform_real_distribution<double>(1.0 / 240, 1.0 / 30)(tickRandom)) {
+            // 前のフレームからここまでの間にデバイスが合成した分
+            const auto target = llround(time * frequency) + bufferFrames;
+            while (scheduler.GetRenderedFrames() < target) {
+                const auto frames = size_t(min<int64_t>(updateFrames, target - scheduler.GetRenderedFrames()));
+                block.resize(frames * 2);
+                scheduler.Render(block.data(), frames);
+                output.insert(output.end(), block.begin(), block.end());
+            }
+            for (; next != noteTimes.end() && *next <= time + leadTime + ahead; ++next) scheduler.Schedule(impulse, *next);
+            KeysoundScheduler::ScheduleUntil(beatTimes, &nextBeat, time + leadTime + ahead, [&](const double beat) { scheduler.Schedule(impulse, beat); });
+        }
+        vector<int64_t> onsets;
+        for (size_t i = 0; i < output.size() / 2; i++) {
+            for (auto count = lround(output[i * 2]); count > 0; count--) onsets.push_back(int64_t(i));
+        }
+        return onsets;
+    };
+
+    const auto lookahead = double(bufferFrames) / frequency + KeysoundScheduler::FrameMargin;
+    const auto reserved = render(lookahead);
+    auto exact = reserved.size() == expected.size();
+    for (size_t i = 0; exact && i < expected.size(); i++) exact = reserved[i] == expected[i];
+    Expect(exact, subject, fmt::format(u8"先読みして予約した判定音とメトロノームの発音位置がずれています ({0}件、期待は{1}件)", reserved.size(), expected.size()));
+
+    // 判定の時点で予約すると合成済みのバッファに間に合わない 上の検証がずれを見逃していないことの確認
+    const auto late = render(0);
+    auto shifted = 0;
+    for (size_t i = 0; i < min(late.size(), expected.size()); i++) shifted += late[i] != expected[i];
+    Expect(late.size() == expected.size() && shifted > 0, subject, u8"先読みなしの予約でも発音位置がずれませんでした");
+}
+
+void VerificationRunner::VerifyOfflineAudio()
+{
+    const auto subject = u8"offline-audio";
+    const auto channels = WaveFileAudioBackend::Channels;
+    const auto leadTime = 0.03;
+    const auto outputFile = workDirectory / L"offline-audio.wav";
+    WaveFileAudioBackend audio(outputFile.wstring());
+    if (!Expect(audio.Open(), subject, u8"音声ファイルを開けませんでした")) return;
+    const auto frequency = audio.GetFrequency();
+
+    // 2のべき乗の分母で表せる値だけを使い、どの環境でも合成結果がビット単位で揃うようにする
+    vector<float> click(96 * channels), tone(320 * channels);
+    for (auto i = 0; i < 96; i++) {
+        click[i * channels] = (96 - i) / 128.0f;
+        click[i * channels + 1] = -(96 - i) / 256.0f;
+    }
+    for (auto i = 0; i < 320; i++) {
+        tone[i * channels] = tone[i * channels + 1] = (i / 8 % 2 ? -1 : 1) / 16.0f;
+    }
+
+    // ScenePlayer と同じく、判定音のミキサーと途中から始まる BGM を載せる
+    KeysoundScheduler keysounds(frequency, channels, leadTime);
+    const auto clickId = keysounds.AddWaveform(click);
+    const auto keysoundFrame = audio.GetRenderedFrames();
+    audio.AddSource([&](float *buffer, const size_t frames) { keysounds.Render(buffer, frames); });
+    auto bgmSource = -1;
+    const auto bgmTime = 0.2;
+
+    // 先読みで予約するものと、判定の時点で過去の時刻に予約するものを混ぜる
+    const vector<pair<double, bool>> notes = {
+        { 0.0, true }, { 0.125, true }, { 0.13, false }, { 0.25, true }, { 0.3, false },
+        { 0.375, true }, { 0.4, true }, { 0.41, false }, { 0.5, true }, { 0.625, false },
+    };
+    vector<bool> scheduled(notes.size());
+    const double deltas[] = { 1.0 / 60, 1.0 / 75, 1.0 / 30, 1.0 / 144, 1.0 / 50 };
+    auto chartTime = -0.25;
+    for (auto tick = 0; chartTime < 0.9; tick++) {
+        // 時計を曲中時刻と同じだけ進めてから対応を取る
+        const auto delta = deltas[tick % 5];
+        chartTime += delta;
+        audio.Advance(delta);
+        keysounds.Synchronize(chartTime, audio.GetClockFrame() - keysoundFrame);
+        for (size_t i = 0; i < notes.size(); i++) {
+            const auto ahead = notes[i].second ? KeysoundScheduler::FrameMargin : 0.0;
+            if (scheduled[i] || chartTime + leadTime + ahead < notes[i].first) continue;
+            keysounds.Schedule(clickId, notes[i].first);
+            scheduled[i] = true;
+        }
+        if (bgmSource < 0 && chartTime >= bgmTime) {
+            const auto startFrame = audio.GetClockFrame() - llround((chartTime - bgmTime) * frequency);
+            auto position = audio.GetRenderedFrames();
+            bgmSource = audio.AddSource([&tone, channels, startFrame, position](float *buffer, const size_t frames) mutable {
+                for (size_t i = 0; i < frames; i++) {
+                    const auto offset = position + int64_t(i) - startFrame;
+                    if (offset < 0 || offset >= int64_t(tone.size() / channels)) continue;
+                    for (auto c = 0; c < channels; c++) buffer[i * channels + c] = tone[offset * channels + c];
+                }
+                position += frames;
+            });
+        }
+        if (bgmSource >= 0 && chartTime >= 0.8) {
+            audio.RemoveSource(bgmSource);
+            bgmSource = -1;
+        }
+    }
+    audio.Close();
+
+    const auto wave = ReadWholeFile(outputFile);
+    const auto readValue = [&](const size_t offset) {
+        uint32_t value = 0;
+        memcpy(&value, wave.data() + offset, sizeof(uint32_t));
+        return value;
+    };
+    const auto headerSize = size_t(44);
+    if (!Expect(wave.size() >= headerSize && wave.compare(0, 4, "RIFF") == 0 && wave.compare(8, 8, "WAVEfmt ") == 0, subject, u8"WAV のヘッダーが壊れています")) return;
+    Expect(readValue(20) == (3 | channels << 16) && readValue(24) == uint32_t(frequency), subject, u8"WAV の形式が違います");
+    Expect(readValue(40) == wave.size() - headerSize && readValue(4) == wave.size() - 8, subject, u8"WAV のデータ長が実際の長さと合いません");
+
+    // 無音でないフレームだけを書き出して記録と比べる
+    const auto frames = (wave.size() - headerSize) / (sizeof(float) * channels);
+    vector<float> samples(frames * channels);
+    memcpy(samples.data(), wave.data() + headerSize, samples.size() * sizeof(float));
+    auto actual = fmt::format("frames {0}\n", frames);
+    for (size_t i = 0; i < frames; i++) {
+        if (samples[i * channels] == 0 && samples[i * channels + 1] == 0) continue;
+        actual += fmt::format("{0} {1} {2}\n", i, samples[i * channels], samples[i * channels + 1]);
+    }
+    ExpectReference(subject, L"offline-audio.txt", actual);
+}
+
+// 記録用のバックエンドで、矩形の並びごとにバッチがいくつに分かれるかを数える
+// 重なりや Z、Immediate、さかのぼる上限、1バッチの上限のそれぞれで切れるべきところだけ切れているか
+void VerificationRunner::VerifySpriteBatch()
+{
+    const auto subject = u8"sprite-batch";
+    SpriteBatch batch(SpriteBatchBackend::CreateRecording());
+    const auto recording = static_cast<RecordingSpriteBatchBackend*>(batch.GetBackend());
+
+    // (x, y) から 8x8 の矩形を texture で積む
+    const auto add = [&](const int texture, const float x, const float y) {
+        VERTEX2D vertices[4] = {};
+        for (auto i = 0; i < 4; i++) {
+            vertices[i].pos = VGet(x + (i & 1) * 8.0f, y + (i >> 1) * 8.0f, 0.0f);
+            vertices[i].rhw = 1.0f;
+        }
+        batch.AddQuad({ texture, RenderBlendMode::Alpha, 255, true }, vertices);
+    };
+    // 1フレーム分積んで、送られた (テクスチャ, 矩形数) の並びを比べる
+    const auto check = [&](const string &name, const function<void()> &draw, const vector<pair<int, uint32_t>> &expected, const uint32_t immediateDraws) {
+        recording->Clear();
+        batch.BeginFrame();
+        batch.Begin();
+        draw();
+        batch.End();
+        batch.EndFrame();
+        vector<pair<int, uint32_t>> actual;
+        for (const auto &submitted : recording->GetBatches()) actual.emplace_back(submitted.Key.Texture, submitted.Quads);
+        const auto &statistics = batch.GetLastFrameStatistics();
+        Expect(actual == expected, subject, fmt::format(u8"{0}: バッチの分かれ方が違います ({1}回、期待は{2}回)", name, actual.size(), expected.size()));
+        Expect(statistics.Batches == actual.size(), subject, fmt::format(u8"{0}: 送った回数の集計が違います ({1})", name, statistics.Batches));
+        Expect(statistics.ImmediateDraws == immediateDraws, subject, fmt::format(u8"{0}: Immediate の回数が違います ({1})", name, statistics.ImmediateDraws));
+    };
+
+    check(u8"重ならない2種の交互", [&] {
+        for (auto i = 0; i < 64; i++) add(1 + i % 2, i * 10.0f, 0);
+    }, { { 1, 32 }, { 2, 32 } }, 0);
+    check(u8"間の矩形と重なる", [&] {
+        add(1, 0, 0);
+        add(2, 4, 4);
+        add(1, 0, 0);
+        add(1, 100, 0);
+    }, { { 1, 1 }, { 2, 1 }, { 1, 2 } }, 0);
+    check(u8"Z の違い", [&] {
+        add(1, 0, 0);
+        batch.SetLayer(1);
+        add(1, 10, 0);
+        batch.SetLayer(0);
+        add(1, 20, 0);
+    }, { { 1, 1 }, { 1, 1 }, { 1, 1 } }, 0);
+    check(u8"Immediate で切る", [&] {
+        add(1, 0, 0);
+        { SpriteBatch::Immediate immediate; }
+        add(1, 10, 0);
+    }, { { 1, 1 }, { 1, 1 } }, 1);
+
+    // さかのぼれるのは直近 LookBehind 個まで
+    for (const auto others : { SpriteBatch::LookBehind - 1, SpriteBatch::LookBehind }) {
+        vector<pair<int, uint32_t>> expected = { { 0, 2 } };
+        for (auto i = 1; i <= others; i++) expected.emplace_back(i, 1);
+        if (others == SpriteBatch::LookBehind) {
+            expected[0].second = 1;
+            expected.emplace_back(0, 1);
+        }
+        check(fmt::format(u8"間に{0}種", others), [&] {
+            add(0, 0, 0);
+            for (auto i = 1; i <= others; i++) add(i, i * 10.0f, 0);
+            add(0, 0, 10);
+        }, expected, 0);
+    }
+
+    check(u8"1バッチの上限", [&] {
+        for (uint32_t i = 0; i <= SpriteBatch::MaxQuadsPerBatch; i++) add(1, 0, 0);
+    }, { { 1, SpriteBatch::MaxQuadsPerBatch }, { 1, 1 } }, 0);
+}
+
+// 記録用の描画デバイスにソフトウェアで描かせた結果を、記録済みの画像 (render-golden.png) と比べる
+// 2D と 3D の塗り、合成方法、明るさ、フィルタ、描画先の切り替えをひととおり通す
+// 浮動小数点の揺れで縁の画素が変わることはあるので、各色2段階までの差と全体の0.1%までの画素は許す
+void VerificationRunner::VerifyRenderGolden()
+{
+    const auto subject = u8"render-golden";
+    const auto previous = RenderDevice::GetCurrent();
+    RecordingRenderDevice device(160, 120, true);
+    RenderDevice::SetCurrent(&device);
+
+    // 透明度のあるグラデーション
+    const auto softImage = MakeARGB8ColorSoftImage(16, 16);
+    for (auto y = 0; y < 16; y++) {
+        for (auto x = 0; x < 16; x++) DrawPixelSoftImage(softImage, x, y, x * 16, y * 16, 255 - x * 8, 64 + x * 6 + y * 6);
+    }
+    const auto texture = device.CreateTextureFromSoftImage(softImage);
+    DeleteSoftImage(softImage);
+
+    device.Clear();
+    device.SetBlendMode(RenderBlendMode::None, 255);
+    device.DrawQuadrangle(4, 4, 60, 8, 56, 40, 8, 36, MakeRenderColor(40, 80, 120), true);
+    device.DrawTriangle(70, 4, 100, 36, 64, 30, MakeRenderColor(200, 60, 30), true);
+    device.DrawTriangle(104, 4, 150, 10, 120, 40, MakeRenderColor(250, 250, 90), false);
+    device.DrawLine(4, 50, 150, 60, MakeRenderColor(90, 255, 140), 3);
+    for (auto i = 0; i < 20; i++) device.DrawPixel(4 + i * 7, 44, MakeRenderColor(255, 255, 255));
+
+    device.SetBlendMode(RenderBlendMode::Alpha, 200);
+    device.SetFilterMode(RenderFilterMode::Nearest);
+    device.DrawImage(30, 80, 0, 0, 16, 16, 8, 8, 2.0, 2.0, 0.3, texture, true);
+    device.SetFilterMode(RenderFilterMode::Bilinear);
+    device.SetBright(255, 160, 160);
+    device.DrawImage(70, 80, 0, 0, 16, 16, 8, 8, 2.5, 1.5, -0.5, texture, true);
+    device.SetBright(255, 255, 255);
+    device.SetBlendMode(RenderBlendMode::Add, 160);
+    device.DrawImageQuad(96, 66, 130, 70, 126, 100, 92, 96, 4, 4, 8, 8, texture, true);
+
+    // 頂点ごとの色
+    VERTEX2D vertices[4] = {};
+    for (auto i = 0; i < 4; i++) {
+        vertices[i].pos = VGet(100.0f + (i & 1) * 30.0f, 104.0f + (i >> 1) * 14.0f, 0.0f);
+        vertices[i].rhw = 1.0f;
+        vertices[i].dif = GetColorU8(i * 80, 255 - i * 60, 128, 255);
+        vertices[i].u = float(i & 1);
+        vertices[i].v = float(i >> 1);
+    }
+    const uint16_t indices[] = { 0, 1, 2, 2, 1, 3 };
+    device.SetBlendMode(RenderBlendMode::Alpha, 255);
+    device.DrawPolygon2D(vertices, 4, indices, 2, texture, true);
+
+    // 別の描画先に描いたものを貼る
+    const auto target = device.CreateRenderTarget(24, 24);
+    device.SetRenderTarget(target);
+    device.Clear();
+    device.SetBlendMode(RenderBlendMode::None, 255);
+    device.DrawTriangle(0, 0, 24, 0, 0, 24, MakeRenderColor(255, 0, 255), true);
+    device.SetRenderTarget(RenderDevice::BackBuffer);
+    device.SetFilterMode(RenderFilterMode::Nearest);
+    device.DrawImage(140, 100, 0, 0, 24, 24, 12, 12, 1.0, 1.0, 0, target, false);
+
+    // 奥行きを見て、交差する2枚の手前側だけが残るか
+    device.SetDepthTest(true);
+    device.DrawTriangle3D(VGet(10, 10, 40), VGet(60, 10, 40), VGet(35, 50, 40), MakeRenderColor(0, 160, 255), true);
+    device.DrawTriangle3D(VGet(20, 5, 0), VGet(70, 5, 80), VGet(45, 45, 0), MakeRenderColor(255, 120, 0), true);
+    device.SetDepthTest(false);
+
+    const auto actualFile = workDirectory / L"render-golden.png";
+    Expect(device.SavePng(RenderDevice::BackBuffer, actualFile.wstring()), subject, u8"描画結果を書き出せません");
+    const auto referenceFile = referenceDirectory / L"render-golden.png";
+    const auto reference = device.LoadTexture(referenceFile.wstring(), false);
+    int width, height, referenceWidth, referenceHeight;
+    vector<uint32_t> pixels, referencePixels;
+    device.GetPixels(RenderDevice::BackBuffer, &width, &height, &pixels);
+    const auto loaded = reference != -1 && device.GetPixels(reference, &referenceWidth, &referenceHeight, &referencePixels);
+    if (Expect(loaded, subject, fmt::format(u8"基準画像 {0} を読めません", ConvertUnicodeToUTF8(referenceFile.wstring())))
+        && Expect(width == referenceWidth && height == referenceHeight, subject, fmt::format(u8"基準画像と大きさが違います ({0}x{1})", referenceWidth, referenceHeight))) {
+        size_t differences = 0, first = 0;
+        for (size_t i = 0; i < pixels.size(); i++) {
+            auto close = true;
+            for (auto shift = 0; shift < 32; shift += 8) {
+                close = close && abs(int(pixels[i] >> shift & 0xFF) - int(referencePixels[i] >> shift & 0xFF)) <= 2;
+            }
+            if (!close && !differences++) first = i;
+        }
+        Expect(differences <= pixels.size() / 1000, subject, fmt::format(u8"{0}画素が基準画像と違います (最初は ({1}, {2}) で {3:08x}、基準は {4:08x}) 描画結果は {5}",
+            differences, first % width, first / width, pixels[first], referencePixels[first], ConvertUnicodeToUTF8(actualFile.wstring())));
+    }
+
+    if (reference != -1) device.DeleteTexture(reference);
+    device.DeleteTexture(target);
+    device.DeleteTexture(texture);
+    RenderDevice::SetCurrent(previous);
+}
+
+// Slide の中心位置と幅を、曲線を先頭から線形に探していた元の判定の実装と比べる
+// 再生中のような昇順、シークのようなばらばら、カーソルを使わない引き方をすべて見る
+void VerificationRunner::VerifySlideCurve()
+{
+    mt19937 random(0x534c4445);
+    vector<pair<string, boost::filesystem::path>> charts;
+    for (const auto &profile : BenchmarkRunner::GetDefaultCorpus()) {
+        if (!profile.Slides) continue;
+        charts.emplace_back(profile.Name, WriteWorkFile(ConvertUTF8ToUnicode(profile.Name) + L".sus", BenchmarkRunner::GenerateChart(profile)));
+    }
+    charts.emplace_back("invisible-step", WriteWorkFile(L"slide-invisible-step.sus", SlideInvisibleStepChart));
+
+    // 元の CheckSlideJudgement 区間は From->StartTime < time <= To->StartTime
+    const auto evaluateLinear = [](const NoteCurvesList &curveData, const shared_ptr<SusDrawableNoteData> &note, const double time, double *x, double *width) {
+        auto lastStep = note;
+        auto refNote = note;
+        for (const auto &extra : note->ExtraData) {
+            if (extra->Type[size_t(SusNoteType::Control)]) continue;
+            if (extra->Type[size_t(SusNoteType::Injection)]) continue;
+            if (time <= extra->StartTime) {
+                refNote = extra;
+                break;
+            }
+            lastStep = refNote = extra;
+        }
+        const auto refcurve = curveData.Find(refNote.get());
+        if (lastStep == refNote || refcurve.empty()) return false;
+        const auto timeInBlock = time - lastStep->StartTime;
+        auto start = refcurve[0];
+        auto next = refcurve[0];
+        for (const auto &segment : refcurve) {
+            if (get<0>(segment) >= timeInBlock) {
+                next = segment;
+                break;
+            }
+            start = next = segment;
+        }
+        // 元は曲線の端で 0 除算になっていたので、そこは端の点とする
+        const auto span = get<0>(next) - get<0>(start);
+        *x = glm::mix(get<1>(start), get<1>(next), span > 0 ? (timeInBlock - get<0>(start)) / span : 0.0);
+        *width = glm::mix(double(lastStep->Length), double(refNote->Length), timeInBlock / (refNote->StartTime - lastStep->StartTime));
+        return true;
+    };
+
+    for (const auto &chart : charts) {
+        // 判定が使う位置と Injection のレーンは、許容誤差によらず同じでなければならない
+        vector<double> judgeReference;
+        for (const auto tolerance : { 0.0, SU_SLIDE_CURVE_TOLERANCE }) {
+            const auto subject = fmt::format(u8"slide-curve {0} (許容誤差{1})", chart.first, tolerance);
+            DrawableNotesList data;
+            NoteCurvesList curveData;
+            SusAnalyzer analyzer(192);
+            analyzer.SetCurveTolerance(tolerance);
+            analyzer.LoadFromFile(chart.second.wstring());
+            analyzer.RenderScoreData(data, curveData);
+            SusNoteStore store;
+            store.Build(data);
+            SlideMeshStore meshes;
+            meshes.Build(store, curveData);
+
+            uint64_t queries = 0;
+            auto slides = 0;
+            for (const auto &note : data) {
+                if (!note->Type[size_t(SusNoteType::Slide)]) continue;
+                const auto mesh = meshes.Find(note.get());
+                if (!Expect(mesh != nullptr, subject, fmt::format(u8"{0:.3f}秒の Slide の形がありません", note->StartTime))) continue;
+                ++slides;
+
+                // 区間の境目と分割点の前後、その間のばらばらの時刻
+                vector<double> times;
+                for (auto i = 0; i < 64; i++) times.push_back(uniform_real_distribution<double>(note->StartTime, note->StartTime + note->Duration)(random));
+                auto lastStep = note.get();
+                for (const auto &extra : note->ExtraData) {
+                    if (extra->Type[size_t(SusNoteType::Control)]) continue;
+                    if (extra->Type[size_t(SusNoteType::Injection)]) continue;
+                    vector<double> edges = { extra->StartTime };
+                    for (const auto &segment : curveData.Find(extra.get())) edges.push_back(lastStep->StartTime + get<0>(segment));
+                    for (const auto edge : edges) {
+                        times.push_back(edge);
+                        times.push_back(nextafter(edge, -numeric_limits<double>::infinity()));
+                        times.push_back(nextafter(edge, numeric_limits<double>::infinity()));
+                    }
+                    lastStep = extra.get();
+                }
+                shuffle(times.begin(), times.end(), random);
+                auto sortedTimes = times;
+                sort(sortedTimes.begin(), sortedTimes.end());
+
+                auto mismatch = false;
+                string detail;
+                const auto check = [&](const double time, const bool useCursor) {
+                    double expectedX, expectedWidth, x, width;
+                    if (time <= note->StartTime || !evaluateLinear(curveData, note, time, &expectedX, &expectedWidth)) return;
+                    ++queries;
+                    const auto found = useCursor ? meshes.Evaluate(note.get(), time, &x, &width) : meshes.Evaluate(*mesh, time, &x, &width);
+                    double curveX, curveWidth;
+                    const auto onCurve = tolerance <= 0 || (meshes.EvaluateCurve(note.get(), time, &curveX, &curveWidth) && abs(curveX - x) <= tolerance + 1e-9);
+                    if (found && onCurve && abs(x - expectedX) <= 1e-9 && abs(width - expectedWidth) <= 1e-9) return;
+                    if (!mismatch && !onCurve) {
+                        detail = fmt::format(u8"{0:.3f}秒の Slide の {1:.9f}秒で 折れ線の位置{2} が曲線の位置{3} から許容誤差より離れています", note->StartTime, time, x, curveX);
+                    } else if (!mismatch) {
+                        detail = fmt::format(u8"{0:.3f}秒の Slide の {1:.9f}秒で 位置{2} 幅{3} (元の実装は 位置{4} 幅{5}) {6}", note->StartTime, time,
+                            found ? x : NAN, found ? width : NAN, expectedX, expectedWidth, useCursor ? u8"カーソルあり" : u8"カーソルなし");
+                    }
+                    mismatch = true;
+                };
+                for (const auto &order : { sortedTimes, times }) {
+                    for (const auto time : order) check(time, true);
+                }
+                for (const auto time : times) check(time, false);
+                if (!Expect(!mismatch, subject, u8"元の実装と一致しません: " + detail)) break;
+            }
+            Expect(slides && queries, subject, u8"比べられる Slide がありません");
+
+            vector<double> judge;
+            for (const auto &note : data) {
+                if (!note->Type[size_t(SusNoteType::Slide)]) continue;
+                double x, width;
+                for (auto i = 0; i <= 16; i++) {
+                    if (meshes.EvaluateCurve(note.get(), note->StartTime + note->Duration * i / 16, &x, &width)) judge.insert(judge.end(), { x, width });
+                }
+                for (const auto &extra : note->ExtraData) {
+                    if (extra->Type[size_t(SusNoteType::Injection)]) judge.insert(judge.end(), { double(extra->StartLane), double(extra->Length) });
+                }
+            }
+            if (tolerance <= 0) {
+                judgeReference = judge;
+            } else {
+                Expect(judge == judgeReference, subject, u8"判定に使う位置か Injection のレーンが許容誤差で変わります");
+            }
+        }
+    }
+}
+
+#ifdef SU_ENABLE_PROFILER
+// Profile.json と同じ書き出しを JSON として読み戻し、記録した区間とカウンタが揃っているか確かめる
+void VerificationRunner::VerifyProfilerTrace()
+{
+    const auto subject = u8"profiler-trace";
+    auto &profiler = Profiler::GetInstance();
+    const auto wasRecording = profiler.IsRecording();
+    profiler.Stop();
+    profiler.Clear();
+    profiler.Start();
+
+    // 書き出しで escape が要る名前を混ぜ、2スレッドで入れ子の区間を作る
+    const char * const innerNames[] = { "Inner \"quoted\"", "Back\\slash", "Line\nBreak\t\x01", u8"日本語" };
+    const auto record = [&](const int count) {
+        for (auto i = 0; i < count; i++) {
+            const ProfileZone outer("Outer");
+            const ProfileZone inner(innerNames[i % 4]);
+            SU_PROFILE_COUNT(DrawCalls, 1);
+        }
+    };
+    thread worker(record, 100);
+    worker.join();
+    for (auto i = 0; i < 25; i++) {
+        record(4);
+        SU_PROFILE_FRAME();
+    }
+    profiler.Stop();
+
+    const auto traceFile = workDirectory / L"Profile.json";
+    const auto saved = profiler.SaveChromeTrace(traceFile.wstring());
+    profiler.Clear();
+    if (wasRecording) profiler.Start();
+    if (!Expect(saved, subject, u8"計測結果を書き出せませんでした")) return;
+
+    boost::property_tree::ptree trace;
+    try {
+        ifstream stream(traceFile.wstring(), ios::in);
+        boost::property_tree::read_json(stream, trace);
+    } catch (const boost::property_tree::ptree_error &error) {
+        Expect(false, subject, fmt::format(u8"計測結果が JSON として読めません: {0}", error.what()));
+        return;
+    }
+
+    struct TraceZone {
+        string Name;
+        int Thread;
+        double Begin, End;
+    };
+    vector<TraceZone> zones;
+    map<string, int> names;
+    auto frames = 0, drawCalls = 0;
+    auto malformed = false;
+    try {
+        for (const auto &item : trace.get_child("traceEvents")) {
+            const auto &event = item.second;
+            const auto phase = event.get<string>("ph");
+            if (phase == "X") {
+                const auto begin = event.get<double>("ts");
+                const auto duration = event.get<double>("dur");
+                if (begin < 0 || duration < 0) malformed = true;
+                zones.push_back({ event.get<string>("name"), event.get<int>("tid"), begin, begin + duration });
+                ++names[zones.back().Name];
+            } else if (phase == "C") {
+                event.get<double>("ts");
+                drawCalls += event.get<int>("args.DrawCalls");
+                ++frames;
+            } else if (phase != "M") {
+                malformed = true;
+            }
+        }
+    } catch (const boost::property_tree::ptree_error &error) {
+        Expect(false, subject, fmt::format(u8"trace event の項目が足りません: {0}", error.what()));
+        return;
+    }
+    Expect(!malformed, subject, u8"不正な trace event があります");
+
+    map<string, int> expectedNames = { { "Outer", 200 } };
+    for (const auto name : innerNames) expectedNames[name] = 50;
+    Expect(names == expectedNames, subject, fmt::format(u8"区間の名前か数が記録と違います ({0}区間)", zones.size()));
+    Expect(frames == 25 && drawCalls == 200, subject, fmt::format(u8"フレームのカウンタが記録と違います ({0}フレーム DrawCalls {1})", frames, drawCalls));
+
+    // 内側の区間は同じスレッドの外側の区間に収まっているはず (ts/dur は小数3桁で丸められる)
+    const auto epsilon = 0.002;
+    auto nested = true;
+    for (const auto &zone : zones) {
+        if (zone.Name == "Outer") continue;
+        nested = nested && any_of(zones.begin(), zones.end(), [&](const TraceZone &outer) {
+            return outer.Name == "Outer" && outer.Thread == zone.Thread
+                && outer.Begin <= zone.Begin + epsilon && zone.End <= outer.End + epsilon;
+        });
+    }
+    Expect(nested, subject, u8"内側の区間が外側の区間からはみ出しています");
+    unordered_set<int> threads;
+    for (const auto &zone : zones) threads.insert(zone.Thread);
+    Expect(threads.size() == 2, subject, fmt::format(u8"スレッドの数が違います ({0})", threads.size()));
+}
+#endif
+
+int VerificationRunner::Run(const string &target)
+{
+    auto log = spdlog::get("main");
+    const vector<pair<string, void (VerificationRunner::*)()>> items = {
+        { "tokenizer", &VerificationRunner::VerifyTokenizer },
+        { "compiled-chart", &VerificationRunner::VerifyCompiledChart },
+        { "tempo-map", &VerificationRunner::VerifyTempoMap },
+        { "hispeed-timeline", &VerificationRunner::VerifyHispeedTimeline },
+        { "note-window", &VerificationRunner::VerifyNoteWindow },
+        { "music-library", &VerificationRunner::VerifyMusicLibrary },
+        { "music-library-reload", &VerificationRunner::VerifyMusicLibraryReload },
+        { "openithm-serial", &VerificationRunner::VerifyOpeNITHMSerial },
+        { "input-events", &VerificationRunner::VerifyInputEvents },
+        { "game-loop", &VerificationRunner::VerifyGameLoop },
+        { "judge-timing", &VerificationRunner::VerifyJudgeTiming },
+        { "replay", &VerificationRunner::VerifyReplay },
+        { "keysound-onset", &VerificationRunner::VerifyKeysoundOnset },
+        { "offline-audio", &VerificationRunner::VerifyOfflineAudio },
+        { "sprite-batch", &VerificationRunner::VerifySpriteBatch },
+        { "render-golden", &VerificationRunner::VerifyRenderGolden },
+        { "slide-curve", &VerificationRunner::VerifySlideCurve },
+#ifdef SU_ENABLE_PROFILER
+        { "profiler-trace", &VerificationRunner::VerifyProfilerTrace },
+#endif
+    };
+    const auto all = target == "all";
+    if (!all && none_of(items.begin(), items.end(), [&](const auto &item) { return item.first == target; })) {
+        log->error(u8"検証項目 {0} はありません", target);
+        return 1;
+    }
+
+    workDirectory = boost::filesystem::path(Setting::GetRootDirectory()) / SU_DATA_DIR / SU_CACHE_DIR / L"Verification";
+    referenceDirectory = boost::filesystem::path(Setting::GetRootDirectory()) / SU_DATA_DIR / L"Verification";
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(workDirectory, ec);
+    checkCount = failureCount = 0;
+
+    for (const auto &item : items) {
+        if (!all && item.first != target) continue;
+        const auto failures = failureCount;
+        log->info(u8"検証: {0}", item.first);
+        (this->*item.second)();
+        if (failureCount == failures) log->info(u8"検証: {0} OK", item.first);
+    }
+    log->info(u8"検証終了: {0}件中 {1}件の食い違い", checkCount, failureCount);
+    return failureCount ? 4 : 0;
+}
@@ -0,0 +1,55 @@
+﻿#pragma once
+
+#include "ExecutionManager.h"
+
+class SusAnalyzer;
+
+// 置き換えた処理が、元の処理や記録と同じ結果になるかの検証 (ヘッドレス実行用)
+// 作業用の譜面やファイルは Cache/Verification に作る 食い違いはすべてログに出して最後に失敗を返す
+// 記録済みの結果は Data/Verification に置く
+class VerificationRunner final {
+private:
+    ExecutionManager *manager;
+    boost::filesystem::path workDirectory;
+    boost::filesystem::path referenceDirectory;
+    uint32_t checkCount = 0;
+    uint32_t failureCount = 0;
+
+    // condition が偽なら失敗として数える
+    bool Expect(bool condition, const std::string &subject, const std::string &message);
+    // 記録済みの name と同じ内容か 今回の結果は作業用ディレクトリに同じ名前で書き出す
+    bool ExpectReference(const std::string &subject, const std::wstring &name, const std::string &actual);
+    boost::filesystem::path WriteWorkFile(const std::wstring &name, const std::string &content) const;
+    static void WriteWholeFile(const boost::filesystem::path &file, const std::string &content);
+    static std::string ReadWholeFile(const boost::filesystem::path &file);
+    // 解析結果をコンパイル済み譜面として書き出したバイト列 (全ノーツ・曲線・タイムラインを含む)
+    std::string CompileToBytes(SusAnalyzer &analyzer, const std::wstring &name) const;
+    static void LoadWithRegex(SusAnalyzer &analyzer, const std::wstring &fileName);
+
+    void VerifyTokenizer();
+    void VerifyCompiledChart();
+    void VerifyTempoMap();
+    void VerifyHispeedTimeline();
+    void VerifyNoteWindow();
+    void VerifyMusicLibrary();
+    void VerifyMusicLibraryReload();
+    void VerifyOpeNITHMSerial();
+    void VerifyInputEvents();
+    void VerifyGameLoop();
+    void VerifyJudgeTiming();
+    void VerifyReplay();
+    void VerifyKeysoundOnset();
+    void VerifyOfflineAudio();
+    void VerifySpriteBatch();
+    void VerifyRenderGolden();
+    void VerifySlideCurve();
+#ifdef SU_ENABLE_PROFILER
+    void VerifyProfilerTrace();
+#endif
+
+public:
+    explicit VerificationRunner(ExecutionManager *exm);
+
+    // target は項目名か all すべて一致すれば0、食い違いがあれば4を返す
+    int Run(const std::string &target);
+};